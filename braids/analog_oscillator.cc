@@ -85,6 +85,15 @@ void AnalogOscillator::Render(
     pitch_ = 0;
   }
   
+#ifdef TEST
+  FastRenderFn fast_fn = fast_fn_table_[shape_];
+  if (fast_path_ && fast_fn && size % kChunkSize == 0 &&
+      !HasSync(sync_in, size)) {
+    (this->*fast_fn)(buffer, sync_out, size);
+    return;
+  }
+#endif  // TEST
+  
   (this->*fn)(sync_in, buffer, sync_out, size);
 }
 
@@ -586,6 +595,211 @@ void AnalogOscillator::RenderBuzz(
   }
 }
 
+#ifdef TEST
+
+void AnalogOscillator::RenderSquareNoSync(
+    int16_t* buffer,
+    uint8_t* sync_out,
+    size_t size) {
+  BEGIN_INTERPOLATE_PHASE_INCREMENT
+  if (parameter_ > 32000) {
+    parameter_ = 32000;
+  }
+  uint32_t pw = static_cast<uint32_t>(32768 - parameter_) << 16;
+  
+  ChunkPhases chunk;
+  const uint32_t* phase = chunk.phase;
+  const uint32_t* increment = chunk.increment;
+  InitChunkPhases(phase_increment, phase_increment_increment, &chunk);
+  int32_t carry = next_sample_ - (phase_ < pw ? 0 : 32767);
+  for (; size; size -= kChunkSize) {
+    ComputeChunkPhases(&phase_increment, phase_increment_increment, &chunk);
+    
+    // Naive square, delayed by one sample.
+    uint32_t above = 0;
+    for (size_t i = 0; i < kChunkSize; ++i) {
+      uint32_t previous_phase = phase[i] - increment[i];
+      buffer[i] = ((previous_phase < pw ? 0 : 32767) - 16384) << 1;
+      above |= phase[i] >= pw;
+    }
+    AddCarry(buffer, &carry);
+    
+    bool wrapped = HasWrapped(phase, increment);
+    if (high_ ? wrapped : above) {
+      for (size_t i = 0; i < kChunkSize; ++i) {
+        bool self_reset = phase[i] < increment[i];
+        while (true) {
+          if (!high_) {
+            if (phase[i] < pw) {
+              break;
+            }
+            uint32_t t = (phase[i] - pw) / (increment[i] >> 16);
+            AddBlep(i, ThisBlepSample(t), NextBlepSample(t), buffer, &carry);
+            high_ = true;
+          }
+          if (!self_reset) {
+            break;
+          }
+          self_reset = false;
+          uint32_t t = phase[i] / (increment[i] >> 16);
+          AddBlep(i, -ThisBlepSample(t), -NextBlepSample(t), buffer, &carry);
+          high_ = false;
+        }
+      }
+    }
+    
+    if (sync_out) {
+      WriteSyncOut(phase, increment, wrapped, sync_out);
+      sync_out += kChunkSize;
+    }
+    buffer += kChunkSize;
+  }
+  next_sample_ = (phase_ < pw ? 0 : 32767) + carry;
+  END_INTERPOLATE_PHASE_INCREMENT
+}
+
+void AnalogOscillator::RenderSawNoSync(
+    int16_t* buffer,
+    uint8_t* sync_out,
+    size_t size) {
+  BEGIN_INTERPOLATE_PHASE_INCREMENT
+  ChunkPhases chunk;
+  const uint32_t* phase = chunk.phase;
+  const uint32_t* increment = chunk.increment;
+  InitChunkPhases(phase_increment, phase_increment_increment, &chunk);
+  int32_t carry = next_sample_ - static_cast<int32_t>(phase_ >> 17);
+  for (; size; size -= kChunkSize) {
+    ComputeChunkPhases(&phase_increment, phase_increment_increment, &chunk);
+    
+    // Naive saw, delayed by one sample.
+    for (size_t i = 0; i < kChunkSize; ++i) {
+      uint32_t previous_phase = phase[i] - increment[i];
+      buffer[i] = (static_cast<int32_t>(previous_phase >> 17) - 16384) << 1;
+    }
+    AddCarry(buffer, &carry);
+    
+    bool wrapped = HasWrapped(phase, increment);
+    if (wrapped) {
+      for (size_t i = 0; i < kChunkSize; ++i) {
+        if (phase[i] < increment[i]) {
+          uint32_t t = phase[i] / (increment[i] >> 16);
+          AddBlep(i, -ThisBlepSample(t), -NextBlepSample(t), buffer, &carry);
+        }
+      }
+    }
+    
+    if (sync_out) {
+      WriteSyncOut(phase, increment, wrapped, sync_out);
+      sync_out += kChunkSize;
+    }
+    buffer += kChunkSize;
+  }
+  next_sample_ = static_cast<int32_t>(phase_ >> 17) + carry;
+  END_INTERPOLATE_PHASE_INCREMENT
+}
+
+void AnalogOscillator::RenderVariableSawNoSync(
+    int16_t* buffer,
+    uint8_t* sync_out,
+    size_t size) {
+  BEGIN_INTERPOLATE_PHASE_INCREMENT
+  if (parameter_ < 1024) {
+    parameter_ = 1024;
+  }
+  uint32_t pw = static_cast<uint32_t>(parameter_) << 16;
+  
+  ChunkPhases chunk;
+  const uint32_t* phase = chunk.phase;
+  const uint32_t* increment = chunk.increment;
+  InitChunkPhases(phase_increment, phase_increment_increment, &chunk);
+  int32_t carry = next_sample_ - \
+      static_cast<int32_t>((phase_ >> 18) + ((phase_ - pw) >> 18));
+  for (; size; size -= kChunkSize) {
+    ComputeChunkPhases(&phase_increment, phase_increment_increment, &chunk);
+    
+    // Naive waveform (sum of two saws), delayed by one sample.
+    uint32_t above = 0;
+    for (size_t i = 0; i < kChunkSize; ++i) {
+      uint32_t previous_phase = phase[i] - increment[i];
+      int32_t naive = (previous_phase >> 18) + ((previous_phase - pw) >> 18);
+      buffer[i] = (naive - 16384) << 1;
+      above |= phase[i] >= pw;
+    }
+    AddCarry(buffer, &carry);
+    
+    bool wrapped = HasWrapped(phase, increment);
+    if (high_ ? wrapped : above) {
+      for (size_t i = 0; i < kChunkSize; ++i) {
+        bool self_reset = phase[i] < increment[i];
+        while (true) {
+          if (!high_) {
+            if (phase[i] < pw) {
+              break;
+            }
+            uint32_t t = (phase[i] - pw) / (increment[i] >> 16);
+            AddBlep(
+                i,
+                -(ThisBlepSample(t) >> 1),
+                -(NextBlepSample(t) >> 1),
+                buffer,
+                &carry);
+            high_ = true;
+          }
+          if (!self_reset) {
+            break;
+          }
+          self_reset = false;
+          uint32_t t = phase[i] / (increment[i] >> 16);
+          AddBlep(
+              i,
+              -(ThisBlepSample(t) >> 1),
+              -(NextBlepSample(t) >> 1),
+              buffer,
+              &carry);
+          high_ = false;
+        }
+      }
+    }
+    
+    if (sync_out) {
+      WriteSyncOut(phase, increment, wrapped, sync_out);
+      sync_out += kChunkSize;
+    }
+    buffer += kChunkSize;
+  }
+  next_sample_ = static_cast<int32_t>((phase_ >> 18) + ((phase_ - pw) >> 18));
+  next_sample_ += carry;
+  END_INTERPOLATE_PHASE_INCREMENT
+}
+
+void AnalogOscillator::RenderTriangleNoSync(
+    int16_t* buffer,
+    uint8_t* sync_out,
+    size_t size) {
+  BEGIN_INTERPOLATE_PHASE_INCREMENT
+  uint32_t phase = phase_;
+  uint32_t phase_a[kChunkSize];
+  uint32_t phase_b[kChunkSize];
+  for (; size; size -= kChunkSize) {
+    for (size_t i = 0; i < kChunkSize; ++i) {
+      INTERPOLATE_PHASE_INCREMENT
+      phase += phase_increment >> 1;
+      phase_a[i] = phase;
+      phase += phase_increment >> 1;
+      phase_b[i] = phase;
+    }
+    for (size_t i = 0; i < kChunkSize; ++i) {
+      buffer[i] = (TriangleSample(phase_a[i]) >> 1) + \
+          (TriangleSample(phase_b[i]) >> 1);
+    }
+    buffer += kChunkSize;
+  }
+  phase_ = phase;
+  END_INTERPOLATE_PHASE_INCREMENT
+}
+
+#endif  // TEST
+
 /* static */
 AnalogOscillator::RenderFn AnalogOscillator::fn_table_[] = {
   &AnalogOscillator::RenderSaw,
@@ -599,4 +813,24 @@ AnalogOscillator::RenderFn AnalogOscillator::fn_table_[] = {
   &AnalogOscillator::RenderBuzz,
 };
 
+#ifdef TEST
+
+/* static */
+AnalogOscillator::FastRenderFn AnalogOscillator::fast_fn_table_[] = {
+  &AnalogOscillator::RenderSawNoSync,
+  &AnalogOscillator::RenderVariableSawNoSync,
+  NULL,
+  &AnalogOscillator::RenderSquareNoSync,
+  &AnalogOscillator::RenderTriangleNoSync,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+};
+
+/* static */
+bool AnalogOscillator::fast_path_ = true;
+
+#endif  // TEST
+
 }  // namespace braids
@@ -63,6 +63,9 @@ class AnalogOscillator {
       int16_t*,
       uint8_t*,
       size_t);
+#ifdef TEST
+  typedef void (AnalogOscillator::*FastRenderFn)(int16_t*, uint8_t*, size_t);
+#endif  // TEST
 
   AnalogOscillator() { }
   ~AnalogOscillator() { }
@@ -107,6 +110,13 @@ class AnalogOscillator {
       int16_t* buffer,
       uint8_t* sync_out,
       size_t size);
+
+#ifdef TEST
+  // Used to compare the fast paths with the reference implementation.
+  static inline void set_fast_path(bool enabled) {
+    fast_path_ = enabled;
+  }
+#endif  // TEST
   
  private:
   void RenderSquare(const uint8_t*, int16_t*, uint8_t*, size_t);
@@ -118,6 +128,127 @@ class AnalogOscillator {
   void RenderTriangleFold(const uint8_t*, int16_t*, uint8_t*, size_t);
   void RenderSineFold(const uint8_t*, int16_t*, uint8_t*, size_t);
   void RenderBuzz(const uint8_t*, int16_t*, uint8_t*, size_t);
+
+#ifdef TEST
+  // Host-only fast paths, for blocks without sync input. Blocks are split
+  // into chunks of kChunkSize samples. The phases and the naive waveform of
+  // a chunk are computed by loops without branches, which the compiler turns
+  // into int32x4/int16x8 operations. The BLEP residuals are added only to the
+  // chunks in which a discontinuity occurs. The output is the same as with
+  // the functions above.
+  void RenderSquareNoSync(int16_t*, uint8_t*, size_t);
+  void RenderSawNoSync(int16_t*, uint8_t*, size_t);
+  void RenderVariableSawNoSync(int16_t*, uint8_t*, size_t);
+  void RenderTriangleNoSync(int16_t*, uint8_t*, size_t);
+  
+  static const size_t kChunkSize = 8;
+
+  // Phase and phase increment at each sample of a chunk, as reached by the
+  // Render* functions. They are computed in closed form from the phase and
+  // phase increment at the start of the chunk, plus per-lane offsets which
+  // are updated by additions only.
+  struct ChunkPhases {
+    uint32_t phase[kChunkSize];
+    uint32_t increment[kChunkSize];
+    uint32_t phase_offset[kChunkSize];
+    uint32_t increment_offset[kChunkSize];
+  };
+  
+  static inline void InitChunkPhases(
+      uint32_t phase_increment,
+      uint32_t phase_increment_increment,
+      ChunkPhases* c) {
+    for (size_t i = 0; i < kChunkSize; ++i) {
+      uint32_t n = i + 1;
+      c->increment_offset[i] = n * phase_increment_increment;
+      c->phase_offset[i] = n * phase_increment + \
+          (n * (n + 1) >> 1) * phase_increment_increment;
+    }
+  }
+  
+  inline void ComputeChunkPhases(
+      uint32_t* phase_increment,
+      uint32_t phase_increment_increment,
+      ChunkPhases* c) {
+    uint32_t pi = *phase_increment;
+    for (size_t i = 0; i < kChunkSize; ++i) {
+      c->increment[i] = pi + c->increment_offset[i];
+      c->phase[i] = phase_ + c->phase_offset[i];
+      c->phase_offset[i] += c->increment_offset[i] * kChunkSize;
+    }
+    // State at the end of the chunk, computed without reading the arrays.
+    const uint32_t n = kChunkSize;
+    phase_ += n * pi + (n * (n + 1) >> 1) * phase_increment_increment;
+    *phase_increment = pi + n * phase_increment_increment;
+  }
+  
+  static inline bool HasSync(const uint8_t* sync_in, size_t size) {
+    uint64_t sync = 0;
+    for (; size; size -= kChunkSize) {
+      uint64_t word;
+      memcpy(&word, sync_in, kChunkSize);
+      sync |= word;
+      sync_in += kChunkSize;
+    }
+    return sync != 0;
+  }
+  
+  static inline bool HasWrapped(
+      const uint32_t* phase,
+      const uint32_t* increment) {
+    uint32_t wrapped = 0;
+    for (size_t i = 0; i < kChunkSize; ++i) {
+      wrapped |= phase[i] < increment[i];
+    }
+    return wrapped != 0;
+  }
+  
+  static inline void WriteSyncOut(
+      const uint32_t* phase,
+      const uint32_t* increment,
+      bool wrapped,
+      uint8_t* sync_out) {
+    memset(sync_out, 0, kChunkSize);
+    if (wrapped) {
+      for (size_t i = 0; i < kChunkSize; ++i) {
+        if (phase[i] < increment[i]) {
+          sync_out[i] = phase[i] / (increment[i] >> 7) + 1;
+        }
+      }
+    }
+  }
+  
+  // Adds the BLEP residuals of a discontinuity occurring at sample i of a
+  // chunk. The residual for the next sample is carried over to the next
+  // chunk when i is the last sample.
+  static inline void AddBlep(
+      size_t i,
+      int32_t this_sample,
+      int32_t next_sample,
+      int16_t* buffer,
+      int32_t* carry) {
+    buffer[i] += this_sample * 2;
+    if (i + 1 < kChunkSize) {
+      buffer[i + 1] += next_sample * 2;
+    } else {
+      *carry += next_sample;
+    }
+  }
+  
+  static inline void AddCarry(int16_t* buffer, int32_t* carry) {
+    if (*carry) {
+      buffer[0] += *carry * 2;
+      *carry = 0;
+    }
+  }
+  
+  static inline int16_t TriangleSample(uint32_t phase) {
+    uint16_t phase_16 = phase >> 16;
+    int16_t triangle = (phase_16 << 1) ^ (phase_16 & 0x8000 ? 0xffff : 0x0000);
+    triangle += 32768;
+    return triangle;
+  }
+#endif  // TEST
   
   uint32_t ComputePhaseIncrement(int16_t midi_pitch);
   
@@ -153,6 +284,10 @@ class AnalogOscillator {
   AnalogOscillatorShape previous_shape_;
   
   static RenderFn fn_table_[];
+#ifdef TEST
+  static FastRenderFn fast_fn_table_[];
+  static bool fast_path_;
+#endif  // TEST
   
   DISALLOW_COPY_AND_ASSIGN(AnalogOscillator);
 };
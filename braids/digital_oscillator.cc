@@ -29,6 +29,8 @@
 #include "braids/digital_oscillator.h"
 
 #include <algorithm>
+#include <cassert>
+#include <cmath>
 #include <cstdio>
 
 #include "stmlib/utils/dsp.h"
@@ -123,9 +125,38 @@ void DigitalOscillator::Render(
     pitch_ = 0;
   }
 
+#ifdef TEST
+  // Shapes using delay lines need a buffer, see Init().
+  assert(delay_lines_ || !delay_lines_size(shape_));
+#endif  // TEST
+  if (!delay_lines_ && delay_lines_size(shape_)) {
+    std::fill(&buffer[0], &buffer[size], 0);
+    return;
+  }
+  
   (this->*fn)(sync, buffer, size);
 }
 
+/* static */
+size_t DigitalOscillator::delay_lines_size(DigitalOscillatorShape shape) {
+  // fn_table_ is not in the order of DigitalOscillatorShape for the physical
+  // models, so the render function is looked at instead of the shape.
+  RenderFn fn = fn_table_[shape];
+  DigitalOscillatorDelayLines* d = NULL;
+  if (fn == &DigitalOscillator::RenderComb) {
+    return sizeof(d->comb);
+  } else if (fn == &DigitalOscillator::RenderPlucked) {
+    return sizeof(d->ks);
+  } else if (fn == &DigitalOscillator::RenderBowed) {
+    return sizeof(d->bowed);
+  } else if (fn == &DigitalOscillator::RenderBlown) {
+    return sizeof(d->bore);
+  } else if (fn == &DigitalOscillator::RenderFluted) {
+    return sizeof(d->fluted);
+  }
+  return 0;
+}
+
 void DigitalOscillator::RenderTripleRingMod(
     const uint8_t* sync,
     int16_t* buffer,
@@ -251,7 +282,7 @@ void DigitalOscillator::RenderComb(
   filtered_pitch = (15 * filtered_pitch + pitch) >> 4;
   state_.ffm.previous_sample = filtered_pitch;
   
-  int16_t* dl = delay_lines_.comb;
+  int16_t* dl = delay_lines_->comb;
   uint32_t delay = ComputeDelay(filtered_pitch);
   if (delay > (kCombDelayLength << 16)) {
     delay = kCombDelayLength << 16;
@@ -1142,7 +1173,7 @@ void DigitalOscillator::RenderPlucked(
     int32_t sample = 0;
     for (size_t i = 0; i < kNumPluckVoices; ++i) {
       PluckState* p = &state_.plk[i];
-      int16_t* dl = delay_lines_.ks + i * 1025;
+      int16_t* dl = delay_lines_->ks + i * 1025;
       // Initialization: Just use a white noise sample and fill the delay
       // line.
       if (p->initialization_ptr) {
@@ -1198,12 +1229,12 @@ void DigitalOscillator::RenderBowed(
     const uint8_t* sync,
     int16_t* buffer,
     size_t size) {
-  int8_t* dl_b = delay_lines_.bowed.bridge;
-  int8_t* dl_n = delay_lines_.bowed.neck;
+  int8_t* dl_b = delay_lines_->bowed.bridge;
+  int8_t* dl_n = delay_lines_->bowed.neck;
   
   if (strike_) {
-    memset(dl_b, 0, sizeof(delay_lines_.bowed.bridge));
-    memset(dl_n, 0, sizeof(delay_lines_.bowed.neck));
+    memset(dl_b, 0, sizeof(delay_lines_->bowed.bridge));
+    memset(dl_n, 0, sizeof(delay_lines_->bowed.neck));
     memset(&state_, 0, sizeof(state_));
     strike_ = false;
   }
@@ -1308,9 +1339,9 @@ void DigitalOscillator::RenderBlown(
   uint16_t delay_ptr = state_.phy.delay_ptr;
   int32_t lp_state = state_.phy.lp_state;
   
-  int16_t* dl = delay_lines_.bore;
+  int16_t* dl = delay_lines_->bore;
   if (strike_) {
-    memset(dl, 0, sizeof(delay_lines_.bore));
+    memset(dl, 0, sizeof(delay_lines_->bore));
     strike_ = false;
   }
 
@@ -1376,13 +1407,13 @@ void DigitalOscillator::RenderFluted(
   int32_t dc_blocking_x0 = state_.phy.filter_state[0];
   int32_t dc_blocking_y0 = state_.phy.filter_state[1];
 
-  int8_t* dl_b = delay_lines_.fluted.bore;
-  int8_t* dl_j = delay_lines_.fluted.jet;
+  int8_t* dl_b = delay_lines_->fluted.bore;
+  int8_t* dl_j = delay_lines_->fluted.jet;
   
   if (strike_) {
     excitation_ptr = 0;
-    memset(dl_b, 0, sizeof(delay_lines_.fluted.bore));
-    memset(dl_j, 0, sizeof(delay_lines_.fluted.jet));
+    memset(dl_b, 0, sizeof(delay_lines_->fluted.bore));
+    memset(dl_j, 0, sizeof(delay_lines_->fluted.jet));
     lp_state = 0;
     strike_ = false;
   }
@@ -1547,6 +1578,19 @@ void DigitalOscillator::RenderWavetables(
     wave[i] = wt_waves + wave_index * 129;
   }
 
+#ifdef TEST
+  if (band_limited_) {
+    int32_t weights[2] = {
+      65536 - static_cast<int32_t>(wave_pointer & 0xffff),
+      static_cast<int32_t>(wave_pointer & 0xffff)
+    };
+    const int16_t* mixed = MixBandLimitedWaves(
+        wave, weights, 2, phase_increment_, &band_limited_wave_[0]);
+    RenderBandLimitedWave(sync, mixed, buffer, size);
+    return;
+  }
+#endif  // TEST
+
   uint32_t phase_increment = phase_increment_ >> 1;
   while (size--) {
     int16_t sample;
@@ -1590,6 +1634,23 @@ void DigitalOscillator::RenderWaveMap(
     }
   }
 
+#ifdef TEST
+  if (band_limited_) {
+    uint32_t x = wave_xfade[0];
+    uint32_t y = wave_xfade[1];
+    int32_t weights[4] = {
+      static_cast<int32_t>((65536 - y) * (65535 - x) >> 16),
+      static_cast<int32_t>(y * (65535 - x) >> 16),
+      static_cast<int32_t>((65536 - y) * x >> 16),
+      static_cast<int32_t>(y * x >> 16)
+    };
+    const int16_t* mixed = MixBandLimitedWaves(
+        &wave[0][0], weights, 4, phase_increment_, &band_limited_wave_[0]);
+    RenderBandLimitedWave(sync, mixed, buffer, size);
+    return;
+  }
+#endif  // TEST
+
   uint32_t phase_increment = phase_increment_ >> 1;
   while (size--) {
     int16_t sample;
@@ -1626,17 +1687,15 @@ static const uint8_t mini_wave_line[] = {
   135, 174
 };
 
+template<typename T>
 void DigitalOscillator::RenderWaveLine(
+    const T* wave_0,
+    const T* wave_1,
+    const T* wave_2,
     const uint8_t* sync,
     int16_t* buffer,
     size_t size) {
-  smoothed_parameter_ = (3 * smoothed_parameter_ + (parameter_[0] << 1)) >> 2;
-
   uint16_t scan = smoothed_parameter_;
-  const uint8_t* wave_0 = wt_waves + wave_line[previous_parameter_[0] >> 9] * 129;
-  const uint8_t* wave_1 = wt_waves + wave_line[scan >> 10] * 129;
-  const uint8_t* wave_2 = wt_waves + wave_line[(scan >> 10) + 1] * 129;
-
   uint16_t smooth_xfade = scan << 6;
   uint16_t rough_xfade = 0;
   uint16_t rough_xfade_increment = 32768 / size;
@@ -1728,6 +1787,44 @@ void DigitalOscillator::RenderWaveLine(
     }
   }
   phase_ = phase;
+}
+
+void DigitalOscillator::RenderWaveLine(
+    const uint8_t* sync,
+    int16_t* buffer,
+    size_t size) {
+  smoothed_parameter_ = (3 * smoothed_parameter_ + (parameter_[0] << 1)) >> 2;
+
+  uint16_t scan = smoothed_parameter_;
+  const uint8_t* wave_0 = wt_waves + wave_line[previous_parameter_[0] >> 9] * 129;
+  const uint8_t* wave_1 = wt_waves + wave_line[scan >> 10] * 129;
+  const uint8_t* wave_2 = wt_waves + wave_line[(scan >> 10) + 1] * 129;
+
+#ifdef TEST
+  if (band_limited_) {
+    // The crossfades between waves change within the block, so only the
+    // levels are mixed.
+    // wave_0 is only read when parameter_[1] < 16384, wave_2 when
+    // parameter_[1] >= 8192.
+    const int32_t weight = 65536;
+    const int16_t* mixed[3] = { NULL, NULL, NULL };
+    if (parameter_[1] < 16384) {
+      mixed[0] = MixBandLimitedWaves(
+          &wave_0, &weight, 1, phase_increment_, &band_limited_wave_[0]);
+    }
+    mixed[1] = MixBandLimitedWaves(
+        &wave_1, &weight, 1, phase_increment_, &band_limited_wave_[1]);
+    if (parameter_[1] >= 8192) {
+      mixed[2] = MixBandLimitedWaves(
+          &wave_2, &weight, 1, phase_increment_, &band_limited_wave_[2]);
+    }
+    RenderWaveLine(mixed[0], mixed[1], mixed[2], sync, buffer, size);
+  } else {
+    RenderWaveLine(wave_0, wave_1, wave_2, sync, buffer, size);
+  }
+#else
+  RenderWaveLine(wave_0, wave_1, wave_2, sync, buffer, size);
+#endif  // TEST
   previous_parameter_[0] = smoothed_parameter_ >> 1;
 }
 
@@ -1796,6 +1893,20 @@ void DigitalOscillator::RenderWaveParaphonic(
   const uint8_t* wave_2 = wt_waves + mini_wave_line[(parameter_[0] >> 10) + 1] * 129;
   uint16_t wave_xfade = parameter_[0] << 6;
   
+#ifdef TEST
+  if (band_limited_) {
+    uint32_t increments[4] = {
+      phase_increment_0,
+      phase_increment[0],
+      phase_increment[1],
+      phase_increment[2]
+    };
+    RenderBandLimitedWaveParaphonic(
+        wave_1, wave_2, wave_xfade, increments, buffer, size);
+    return;
+  }
+#endif  // TEST
+  
   while (size) {
     int32_t sample = 0;
     
@@ -1831,6 +1942,195 @@ void DigitalOscillator::RenderWaveParaphonic(
 
 }
 
+#ifdef TEST
+
+static int16_t* ComputeBandLimitedWaves(size_t num_levels, size_t stride) {
+  const size_t wave_size = 129;
+  const size_t num_waves = WT_WAVES_SIZE / wave_size;
+  const size_t n = wave_size - 1;
+  int16_t* waves = new int16_t[num_waves * num_levels * stride];
+  std::fill(&waves[0], &waves[num_waves * num_levels * stride], 0);
+
+  double c[128];
+  double s[128];
+  for (size_t i = 0; i < n; ++i) {
+    c[i] = cos(2.0 * M_PI * i / n);
+    s[i] = sin(2.0 * M_PI * i / n);
+  }
+
+  double x[129];
+  double re[65];
+  double im[65];
+  double level[8][129];
+  for (size_t w = 0; w < num_waves; ++w) {
+    const uint8_t* wave = wt_waves + w * wave_size;
+    for (size_t i = 0; i < wave_size; ++i) {
+      x[i] = (static_cast<int32_t>(wave[i]) << 8) - 32768.0;
+    }
+    for (size_t k = 0; k <= n / 2; ++k) {
+      re[k] = im[k] = 0.0;
+      for (size_t i = 0; i < n; ++i) {
+        re[k] += x[i] * c[(k * i) % n];
+        im[k] += x[i] * s[(k * i) % n];
+      }
+    }
+
+    // Level 0 is the original wave. The levels are scaled together if the
+    // Gibbs overshoot of one of them is out of range.
+    double peak = 32767.0;
+    for (size_t l = 0; l < num_levels; ++l) {
+      size_t num_harmonics = (n / 2) >> l;
+      for (size_t i = 0; i < n; ++i) {
+        double y = x[i];
+        if (l) {
+          y = re[0] / n;
+          for (size_t k = 1; k <= num_harmonics; ++k) {
+            y += 2.0 / n * (
+                re[k] * c[(k * i) % n] + im[k] * s[(k * i) % n]);
+          }
+        }
+        level[l][i] = y;
+        peak = std::max(peak, fabs(y));
+      }
+      level[l][n] = l ? level[l][0] : x[n];
+    }
+    double gain = 32767.0 / peak;
+    for (size_t l = 0; l < num_levels; ++l) {
+      int16_t* out = &waves[(w * num_levels + l) * stride];
+      for (size_t i = 0; i < wave_size; ++i) {
+        out[i] = static_cast<int16_t>(floor(level[l][i] * gain + 0.5));
+      }
+    }
+  }
+  return waves;
+}
+
+/* static */
+const int16_t* DigitalOscillator::band_limited_waves() {
+  static const int16_t* waves = ComputeBandLimitedWaves(
+      kNumWaveLevels, kWaveSize);
+  return waves;
+}
+
+/* static */
+const int16_t* DigitalOscillator::MixBandLimitedWaves(
+    const uint8_t* const* waves,
+    const int32_t* weights,
+    size_t num_waves,
+    uint32_t phase_increment,
+    BandLimitedWave* mixed) {
+  const int16_t* band_limited = band_limited_waves();
+
+  // Level k keeps 2^(6 - k) harmonics. When the phase increment is between
+  // 2^(24 + k) and 2^(25 + k), they are all below the Nyquist frequency,
+  // and the levels k and k + 1 are crossfaded.
+  size_t level = 0;
+  int32_t level_xfade = 0;
+  if (phase_increment >= (1UL << 24)) {
+    size_t msb = 31 - __builtin_clz(phase_increment);
+    level = msb - 24;
+    level_xfade = ((phase_increment << (31 - msb)) >> 15) & 0xffff;
+    if (level >= kNumWaveLevels - 1) {
+      level = kNumWaveLevels - 1;
+      level_xfade = 0;
+    }
+  }
+  
+  bool hit = mixed->num_waves == num_waves && \
+      mixed->level == level && mixed->level_xfade == level_xfade;
+  for (size_t w = 0; w < num_waves && hit; ++w) {
+    hit = mixed->waves[w] == waves[w] && mixed->weights[w] == weights[w];
+  }
+  if (hit) {
+    return mixed->samples;
+  }
+  mixed->num_waves = num_waves;
+  mixed->level = level;
+  mixed->level_xfade = level_xfade;
+  std::copy(&waves[0], &waves[num_waves], &mixed->waves[0]);
+  std::copy(&weights[0], &weights[num_waves], &mixed->weights[0]);
+  
+  // The weights of all tables add up to 1.0 in Q15, so the sum of the
+  // products fits in 32 bits.
+  int32_t sum[kWaveSize];
+  std::fill(&sum[0], &sum[kWaveSize], 0);
+  for (size_t w = 0; w < num_waves; ++w) {
+    size_t index = (waves[w] - wt_waves) / 129;
+    const int16_t* t = &band_limited[index * kNumWaveLevels * kWaveSize];
+    for (size_t l = 0; l < 2; ++l) {
+      int32_t weight = static_cast<int64_t>(weights[w]) * \
+          (l ? level_xfade : 65536 - level_xfade) >> 17;
+      if (!weight) {
+        continue;
+      }
+      const int16_t* level_table = &t[(level + l) * kWaveSize];
+      for (size_t i = 0; i < kWaveSize; ++i) {
+        sum[i] += level_table[i] * weight;
+      }
+    }
+  }
+  for (size_t i = 0; i < kWaveSize; ++i) {
+    mixed->samples[i] = sum[i] >> 15;
+  }
+  return mixed->samples;
+}
+
+void DigitalOscillator::RenderBandLimitedWave(
+    const uint8_t* sync,
+    const int16_t* wave,
+    int16_t* buffer,
+    size_t size) {
+  // 2x oversampling, as in the original models: the linear interpolation
+  // of the table alone would alias more than them at mid-range pitches.
+  uint32_t phase = phase_;
+  uint32_t phase_increment = phase_increment_ >> 1;
+  while (size--) {
+    int16_t sample;
+    phase += phase_increment;
+    if (*sync++) {
+      phase = 0;
+    }
+    sample = Interpolate824(wave, phase >> 1) >> 1;
+    phase += phase_increment;
+    sample += Interpolate824(wave, phase >> 1) >> 1;
+    *buffer++ = sample;
+  }
+  phase_ = phase;
+}
+
+void DigitalOscillator::RenderBandLimitedWaveParaphonic(
+    const uint8_t* wave_1,
+    const uint8_t* wave_2,
+    uint16_t wave_xfade,
+    const uint32_t* phase_increment,
+    int16_t* buffer,
+    size_t size) {
+  const uint8_t* waves[2] = { wave_1, wave_2 };
+  int32_t weights[2] = { 65536 - wave_xfade, wave_xfade };
+  const int16_t* mixed[4];
+  uint32_t phase[4];
+  for (size_t i = 0; i < 4; ++i) {
+    mixed[i] = MixBandLimitedWaves(
+        waves, weights, 2, phase_increment[i], &band_limited_wave_[i]);
+    phase[i] = state_.saw.phase[i];
+  }
+  
+  while (size--) {
+    int32_t sample = 0;
+    for (size_t i = 0; i < 4; ++i) {
+      phase[i] += phase_increment[i];
+      sample += Interpolate824(mixed[i], phase[i] >> 1);
+    }
+    *buffer++ = sample >> 2;
+  }
+  
+  for (size_t i = 0; i < 4; ++i) {
+    state_.saw.phase[i] = phase[i];
+  }
+}
+
+#endif  // TEST
+
 void DigitalOscillator::RenderFilteredNoise(
     const uint8_t* sync,
     int16_t* buffer,
@@ -2565,4 +2865,8 @@ DigitalOscillator::RenderFn DigitalOscillator::fn_table_[] = {
   &DigitalOscillator::RenderQuestionMark
 };
 
+#ifdef TEST
+bool DigitalOscillator::band_limited_ = false;
+#endif  // TEST
+
 }  // namespace braids
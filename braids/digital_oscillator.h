@@ -236,13 +236,33 @@ union DigitalOscillatorState {
   uint32_t modulator_phase;
 };
 
+// Delay lines of the comb filter and physical models. They are by far the
+// largest part of the state of the oscillator, and are only used by a few
+// shapes, so they are allocated by the owner of the oscillator.
+union DigitalOscillatorDelayLines {
+  int16_t comb[kCombDelayLength];
+  int16_t ks[1025 * 4];
+  struct {
+    int8_t bridge[kWGBridgeLength];
+    int8_t neck[kWGNeckLength];
+  } bowed;
+  int16_t bore[kWGBoreLength];
+  struct {
+    int8_t jet[kWGJetLength];
+    int8_t bore[kWGFBoreLength];
+  } fluted;
+};
+
 class DigitalOscillator {
  public:
   typedef void (DigitalOscillator::*RenderFn)(const uint8_t*, int16_t*, size_t);
 
-  DigitalOscillator() { }
+  DigitalOscillator() : delay_lines_(NULL) { }
   ~DigitalOscillator() { }
   
+  // The physical models and the comb filter need delay lines, which are not
+  // part of the object: set_delay_lines() must be called before rendering
+  // these shapes. Without a buffer, they render silence.
   inline void Init() {
     memset(&state_, 0, sizeof(state_));
     pulse_[0].Init();
@@ -255,6 +275,11 @@ class DigitalOscillator {
     phase_ = 0;
     strike_ = true;
     init_ = true;
+#ifdef TEST
+    for (size_t i = 0; i < 4; ++i) {
+      band_limited_wave_[i].num_waves = 0;
+    }
+#endif  // TEST
   }
   
   inline void set_shape(DigitalOscillatorShape shape) {
@@ -284,9 +309,24 @@ class DigitalOscillator {
   inline void Strike() {
     strike_ = true;
   }
+  
+  // The buffer only needs to be delay_lines_size(shape) bytes long for the
+  // shape being rendered.
+  inline void set_delay_lines(DigitalOscillatorDelayLines* delay_lines) {
+    delay_lines_ = delay_lines;
+  }
+  
+  static size_t delay_lines_size(DigitalOscillatorShape shape);
 
   void Render(const uint8_t* sync, int16_t* buffer, size_t size);
   
+#ifdef TEST
+  // Used to compare the band-limited wavetables with the original ones.
+  static inline void set_band_limited_wavetables(bool enabled) {
+    band_limited_ = enabled;
+  }
+#endif  // TEST
+  
  private:
   void RenderTripleRingMod(const uint8_t*, int16_t*, size_t);
   void RenderSawSwarm(const uint8_t*, int16_t*, size_t);
@@ -330,6 +370,55 @@ class DigitalOscillator {
   
   // void RenderYourAlgo(const uint8_t*, int16_t*, size_t);
   
+  template<typename T>
+  void RenderWaveLine(
+      const T* wave_0,
+      const T* wave_1,
+      const T* wave_2,
+      const uint8_t* sync,
+      int16_t* buffer,
+      size_t size);
+
+#ifdef TEST
+  // Host-only band-limited versions of the wavetable models. Each wave of
+  // wt_waves is stored at kNumWaveLevels levels, level k keeping 64 >> k
+  // harmonics. The tables are computed the first time they are used. For
+  // each block, the waves being crossfaded and the two levels surrounding
+  // the pitch are mixed into a single table, which is then read with the
+  // same 2x oversampling as the original tables. Disabled by default.
+  static const size_t kNumWaveLevels = 7;
+  // 129 samples, padded to a multiple of 8 so that the mixing loops are
+  // vectorized without epilogue.
+  static const size_t kWaveSize = 136;
+  
+  // A mixed table is kept until its waves, their weights or the levels
+  // change, so that steady notes do not pay for the mix at every block.
+  struct BandLimitedWave {
+    const uint8_t* waves[4];
+    int32_t weights[4];
+    size_t num_waves;
+    size_t level;
+    int32_t level_xfade;
+    int16_t samples[kWaveSize];
+  };
+  
+  static const int16_t* band_limited_waves();
+  static const int16_t* MixBandLimitedWaves(
+      const uint8_t* const* waves,
+      const int32_t* weights,
+      size_t num_waves,
+      uint32_t phase_increment,
+      BandLimitedWave* mixed);
+  void RenderBandLimitedWave(const uint8_t*, const int16_t*, int16_t*, size_t);
+  void RenderBandLimitedWaveParaphonic(
+      const uint8_t* wave_1,
+      const uint8_t* wave_2,
+      uint16_t wave_xfade,
+      const uint32_t* phase_increment,
+      int16_t* buffer,
+      size_t size);
+#endif  // TEST
+  
   uint32_t ComputePhaseIncrement(int16_t midi_pitch);
   uint32_t ComputeDelay(int16_t midi_pitch);
   int16_t InterpolateFormantParameter(
@@ -359,21 +448,13 @@ class DigitalOscillator {
   Excitation pulse_[4];
   Svf svf_[3];
   
-  union {
-    int16_t comb[kCombDelayLength];
-    int16_t ks[1025 * 4];
-    struct {
-      int8_t bridge[kWGBridgeLength];
-      int8_t neck[kWGNeckLength];
-    } bowed;
-    int16_t bore[kWGBoreLength];
-    struct {
-      int8_t jet[kWGJetLength];
-      int8_t bore[kWGFBoreLength];
-    } fluted;
-  } delay_lines_;
+  DigitalOscillatorDelayLines* delay_lines_;
   
   static RenderFn fn_table_[];
+#ifdef TEST
+  static bool band_limited_;
+  BandLimitedWave band_limited_wave_[4];
+#endif  // TEST
   
   DISALLOW_COPY_AND_ASSIGN(DigitalOscillator);
 };
@@ -47,6 +47,19 @@ void MacroOscillator::Render(
   (this->*fn)(sync, buffer, size);
 }
 
+/* static */
+size_t MacroOscillator::delay_lines_size(MacroOscillatorShape shape) {
+  RenderFn fn = fn_table_[shape];
+  if (fn == &MacroOscillator::RenderSawComb) {
+    return DigitalOscillator::delay_lines_size(OSC_SHAPE_COMB_FILTER);
+  } else if (fn == &MacroOscillator::RenderDigital) {
+    return DigitalOscillator::delay_lines_size(
+        static_cast<DigitalOscillatorShape>(
+            shape - MACRO_OSC_SHAPE_TRIPLE_RING_MOD));
+  }
+  return 0;
+}
+
 void MacroOscillator::RenderCSaw(
     const uint8_t* sync,
     int16_t* buffer,
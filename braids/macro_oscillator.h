@@ -81,6 +81,13 @@ class MacroOscillator {
     digital_oscillator_.Strike();
   }
   
+  inline void set_delay_lines(DigitalOscillatorDelayLines* delay_lines) {
+    digital_oscillator_.set_delay_lines(delay_lines);
+  }
+  
+  // Size of the delay lines needed by a shape, 0 if it does not use any.
+  static size_t delay_lines_size(MacroOscillatorShape shape);
+  
   void Render(const uint8_t* sync_buffer, int16_t* buffer, size_t size);
   
  private:
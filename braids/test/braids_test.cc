@@ -13,17 +13,27 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <algorithm>
+#include <cassert>
 #include <cmath>
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
+#include <ctime>
+#include <vector>
 
+#include "braids/analog_oscillator.h"
+#include "braids/digital_oscillator.h"
 #include "braids/macro_oscillator.h"
 #include "braids/quantizer.h"
+#include "braids/quantizer_scales.h"
+#include "braids/test/digital_oscillator_front_end.h"
+#include "braids/test/polyphonic_engine.h"
 #include "stmlib/test/wav_writer.h"
 #include "stmlib/utils/dsp.h"
 
 using namespace braids;
+using namespace std;
 using namespace stmlib;
 
 const uint32_t kSampleRate = 96000;
@@ -57,6 +67,445 @@ void TestAudioRendering() {
   }
 }
 
+// Renders the analog oscillator with or without its fast paths. With sweep
+// enabled, the pitch covers the whole range, and some blocks receive a sync
+// pulse - so that the transitions between the two paths are covered too.
+// Otherwise, a steady note is rendered, without sync, as in most patches.
+double RenderAnalogOscillator(
+    AnalogOscillatorShape shape,
+    bool fast_path,
+    bool sweep,
+    int16_t* buffer,
+    uint8_t* sync_out,
+    size_t num_blocks) {
+  AnalogOscillator osc;
+  AnalogOscillator::set_fast_path(fast_path);
+  // Some members are not reset by Init(), and are expected to be zeroed
+  // like all globals on the module.
+  memset(static_cast<void*>(&osc), 0, sizeof(osc));
+  osc.Init();
+  osc.set_shape(shape);
+  
+  clock_t start = clock();
+  for (size_t i = 0; i < num_blocks; ++i) {
+    uint8_t sync_in[kAudioBlockSize];
+    memset(sync_in, 0, sizeof(sync_in));
+    uint16_t tri = i * 7;
+    tri = tri > 32767 ? 65535 - tri : tri;
+    if (sweep) {
+      if ((i % 97) == 0) {
+        sync_in[i % kAudioBlockSize] = 1 + (i % 255);
+      }
+      osc.set_pitch((24 << 7) + (i * 5) % (96 << 7));
+    } else {
+      osc.set_pitch(48 << 7);
+    }
+    osc.set_parameter(tri);
+    osc.set_aux_parameter(32767 - tri);
+    osc.Render(
+        sync_in,
+        &buffer[i * kAudioBlockSize],
+        sync_out ? &sync_out[i * kAudioBlockSize] : NULL,
+        kAudioBlockSize);
+  }
+  AnalogOscillator::set_fast_path(true);
+  return static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+}
+
+void TestAnalogOscillatorFastPath() {
+  const char* names[] = {
+    "SAW", "VARIABLE_SAW", "CSAW", "SQUARE", "TRIANGLE", "SINE",
+    "TRIANGLE_FOLD", "SINE_FOLD", "BUZZ"
+  };
+  const size_t num_blocks = kSampleRate * 20 / kAudioBlockSize;
+  const size_t num_samples = num_blocks * kAudioBlockSize;
+  int16_t* reference = new int16_t[num_samples];
+  int16_t* fast = new int16_t[num_samples];
+  uint8_t* reference_sync = new uint8_t[num_samples];
+  uint8_t* fast_sync = new uint8_t[num_samples];
+  
+  printf("Shape          ns/sample (reference, fast, speedup)\n");
+  printf("               steady note            sweep and sync\n");
+  for (int shape = 0; shape <= OSC_SHAPE_BUZZ; ++shape) {
+    AnalogOscillatorShape s = static_cast<AnalogOscillatorShape>(shape);
+    double reference_time[2] = { 1e9, 1e9 };
+    double fast_time[2] = { 1e9, 1e9 };
+    size_t num_errors = 0;
+    for (int sweep = 0; sweep < 2; ++sweep) {
+      // Best of 3 runs.
+      for (int run = 0; run < 3; ++run) {
+        reference_time[sweep] = min(
+            reference_time[sweep],
+            RenderAnalogOscillator(
+                s, false, sweep, reference, reference_sync, num_blocks));
+        fast_time[sweep] = min(
+            fast_time[sweep],
+            RenderAnalogOscillator(
+                s, true, sweep, fast, fast_sync, num_blocks));
+      }
+      for (size_t i = 0; i < num_samples; ++i) {
+        if (reference[i] != fast[i] || reference_sync[i] != fast_sync[i]) {
+          if (!num_errors) {
+            printf("%s: first mismatch at %zu (%d vs %d)\n",
+                   names[shape], i, reference[i], fast[i]);
+          }
+          ++num_errors;
+        }
+      }
+    }
+    printf("%-14s", names[shape]);
+    for (int sweep = 0; sweep < 2; ++sweep) {
+      printf(" %5.2f %5.2f %4.2fx  ",
+             reference_time[sweep] * 1e9 / num_samples,
+             fast_time[sweep] * 1e9 / num_samples,
+             reference_time[sweep] / fast_time[sweep]);
+    }
+    printf("%s\n", num_errors ? "FAILED" : "ok");
+  }
+  
+  delete[] reference;
+  delete[] fast;
+  delete[] reference_sync;
+  delete[] fast_sync;
+}
+
+size_t CountRisingZeroCrossings(const float* x, size_t size) {
+  size_t count = 0;
+  for (size_t i = 1; i < size; ++i) {
+    count += x[i - 1] < 0.0f && x[i] >= 0.0f;
+  }
+  return count;
+}
+
+void TestDigitalOscillatorFrontEnd() {
+  const uint32_t rates[] = { 44100, 48000, 96000, 192000 };
+  const DigitalOscillatorShape shapes[] = {
+    OSC_SHAPE_FM,
+    OSC_SHAPE_WAVETABLES,
+    OSC_SHAPE_VOWEL,
+    OSC_SHAPE_COMB_FILTER,
+    OSC_SHAPE_FILTERED_NOISE
+  };
+  const char* names[] = { "FM", "WAVETABLES", "VOWEL", "COMB", "NOISE" };
+  const size_t kHostBlockSize = 64;
+  const size_t kDuration = 10;
+
+  // A 440Hz sine, through the direct and the resampled path.
+  for (size_t r = 0; r < 4; ++r) {
+    for (int resample = 0; resample < 2; ++resample) {
+      DigitalOscillatorFrontEnd front_end;
+      front_end.Init(rates[r]);
+      front_end.set_always_resample(resample);
+      front_end.set_shape(OSC_SHAPE_FM);
+      front_end.set_parameters(0, 0);
+      front_end.set_pitch(69 << 7);
+      vector<float> out(rates[r] * 2);
+      for (size_t i = 0; i < out.size(); i += kHostBlockSize) {
+        front_end.Render(&out[i], min(kHostBlockSize, out.size() - i));
+      }
+      // Skip the first 100ms.
+      size_t skip = rates[r] / 10;
+      double frequency = CountRisingZeroCrossings(
+          &out[skip], out.size() - skip) / 1.9;
+      printf("%6d Hz, %s: 440Hz sine measured at %.1fHz %s\n",
+             rates[r],
+             front_end.resampling() ? "resampled" : "direct   ",
+             frequency,
+             fabs(frequency - 440.0) < 2.0 ? "ok" : "FAILED");
+    }
+  }
+
+  printf("Rate     ");
+  for (size_t s = 0; s < 5; ++s) {
+    printf("%-15s", names[s]);
+  }
+  printf("(ns/sample, %% of real time)\n");
+  for (size_t r = 0; r < 4; ++r) {
+    vector<float> out(kHostBlockSize);
+    printf("%6d  ", rates[r]);
+    for (size_t s = 0; s < 5; ++s) {
+      double best = 1e9;
+      size_t num_samples = rates[r] * kDuration;
+      for (int run = 0; run < 3; ++run) {
+        DigitalOscillatorFrontEnd front_end;
+        front_end.Init(rates[r]);
+        front_end.set_shape(shapes[s]);
+        front_end.set_parameters(16384, 8192);
+        front_end.set_pitch(48 << 7);
+        clock_t start = clock();
+        for (size_t i = 0; i < num_samples; i += kHostBlockSize) {
+          front_end.set_pitch((48 << 7) + (i / kHostBlockSize) % 1024);
+          front_end.Render(&out[0], kHostBlockSize);
+        }
+        best = min(
+            best,
+            static_cast<double>(clock() - start) / CLOCKS_PER_SEC);
+      }
+      printf("%c%5.1f %5.2f%%  ",
+             DigitalOscillatorFrontEnd::rate_bound(shapes[s]) &&
+                 rates[r] != kNativeSampleRate ? '*' : ' ',
+             best * 1e9 / num_samples,
+             best * 100.0 / kDuration);
+    }
+    printf("\n");
+  }
+  printf("* resampled from 96kHz\n");
+}
+
+// In-place radix-2 FFT, size must be a power of 2.
+void Fft(vector<double>* re, vector<double>* im) {
+  size_t n = re->size();
+  for (size_t i = 1, j = 0; i < n; ++i) {
+    size_t bit = n >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j ^= bit;
+    if (i < j) {
+      swap((*re)[i], (*re)[j]);
+      swap((*im)[i], (*im)[j]);
+    }
+  }
+  for (size_t length = 2; length <= n; length <<= 1) {
+    double angle = -2.0 * M_PI / length;
+    for (size_t i = 0; i < n; i += length) {
+      for (size_t j = 0; j < length / 2; ++j) {
+        double wr = cos(angle * j);
+        double wi = sin(angle * j);
+        double* ur = &(*re)[i + j];
+        double* ui = &(*im)[i + j];
+        double* vr = &(*re)[i + j + length / 2];
+        double* vi = &(*im)[i + j + length / 2];
+        double tr = *vr * wr - *vi * wi;
+        double ti = *vr * wi + *vi * wr;
+        *vr = *ur - tr;
+        *vi = *ui - ti;
+        *ur += tr;
+        *ui += ti;
+      }
+    }
+  }
+}
+
+// Ratio between the power outside of the harmonics of f0, and the power of
+// the harmonics, in dB.
+double AliasingRatio(const int16_t* x, size_t n, double f0) {
+  vector<double> re(n);
+  vector<double> im(n, 0.0);
+  for (size_t i = 0; i < n; ++i) {
+    double window = 0.5 - 0.5 * cos(2.0 * M_PI * i / n);
+    re[i] = x[i] * window;
+  }
+  Fft(&re, &im);
+  vector<bool> harmonic(n / 2, false);
+  for (double f = f0; f < kSampleRate / 2; f += f0) {
+    int bin = static_cast<int>(f * n / kSampleRate + 0.5);
+    for (int i = max(0, bin - 4); i <= bin + 4 && i < int(n / 2); ++i) {
+      harmonic[i] = true;
+    }
+  }
+  double signal = 0.0;
+  double aliasing = 0.0;
+  for (size_t i = 5; i < n / 2; ++i) {
+    double power = re[i] * re[i] + im[i] * im[i];
+    if (harmonic[i]) {
+      signal += power;
+    } else {
+      aliasing += power;
+    }
+  }
+  return 10.0 * log10(aliasing / signal);
+}
+
+void TestBandLimitedWavetables() {
+  const DigitalOscillatorShape shapes[] = {
+    OSC_SHAPE_WAVETABLES,
+    OSC_SHAPE_WAVE_MAP,
+    OSC_SHAPE_WAVE_LINE,
+    OSC_SHAPE_WAVE_PARAPHONIC
+  };
+  const char* names[] = { "WAVETABLES", "WAVE_MAP", "WAVE_LINE", "PARAPHONIC" };
+  const int notes[] = { 48, 72, 96, 108 };
+  const size_t kFftSize = 65536;
+  const size_t num_blocks = kFftSize / kAudioBlockSize + 1;
+  vector<int16_t> out(num_blocks * kAudioBlockSize);
+  uint8_t sync[kAudioBlockSize] = { 0 };
+
+  printf("Shape       Note  aliasing dB (original, band-limited)  "
+         "ns/sample (original, band-limited)\n");
+  for (size_t s = 0; s < 4; ++s) {
+    for (size_t n = 0; n < 4; ++n) {
+      double ratio[2];
+      double time[2] = { 1e9, 1e9 };
+      for (int band_limited = 0; band_limited < 2; ++band_limited) {
+        DigitalOscillator::set_band_limited_wavetables(band_limited);
+        for (int run = 0; run < 3; ++run) {
+          DigitalOscillator osc;
+          memset(static_cast<void*>(&osc), 0, sizeof(osc));
+          osc.Init();
+          osc.set_shape(shapes[s]);
+          osc.set_parameters(20000, 9000);
+          osc.set_pitch(notes[n] << 7);
+          // Compute the tables and let the parameters settle.
+          osc.Render(sync, &out[0], kAudioBlockSize);
+          osc.Render(sync, &out[0], kAudioBlockSize);
+          clock_t start = clock();
+          for (size_t i = 0; i < num_blocks; ++i) {
+            osc.set_pitch(notes[n] << 7);
+            osc.Render(sync, &out[i * kAudioBlockSize], kAudioBlockSize);
+          }
+          time[band_limited] = min(
+              time[band_limited],
+              static_cast<double>(clock() - start) / CLOCKS_PER_SEC);
+          double f0 = osc.phase_increment() * \
+              static_cast<double>(kSampleRate) / 4294967296.0;
+          // The paraphonic model plays a chord: only the root is checked.
+          ratio[band_limited] = AliasingRatio(&out[0], kFftSize, f0);
+        }
+      }
+      printf("%-11s %4d  ", names[s], notes[n]);
+      if (shapes[s] == OSC_SHAPE_WAVE_PARAPHONIC) {
+        // Plays a chord, so most of the spectrum is not a harmonic of f0.
+        printf("%20s", "");
+      } else {
+        printf("%8.1f %8.1f       ", ratio[0], ratio[1]);
+        // Never more aliasing than the original tables (up to rounding).
+        assert(ratio[1] < ratio[0] + 0.1);
+        assert(ratio[1] < -40.0);
+      }
+      printf("%19.2f %6.2f\n",
+             time[0] * 1e9 / (num_blocks * kAudioBlockSize),
+             time[1] * 1e9 / (num_blocks * kAudioBlockSize));
+    }
+  }
+  DigitalOscillator::set_band_limited_wavetables(false);
+}
+
+void TestPolyphonicEngine() {
+  const MacroOscillatorShape shapes[] = {
+    MACRO_OSC_SHAPE_CSAW,
+    MACRO_OSC_SHAPE_SAW_SWARM,
+    MACRO_OSC_SHAPE_SAW_COMB,
+    MACRO_OSC_SHAPE_VOWEL_FOF,
+    MACRO_OSC_SHAPE_FM,
+    MACRO_OSC_SHAPE_PLUCKED,
+    MACRO_OSC_SHAPE_BOWED,
+    MACRO_OSC_SHAPE_STRUCK_BELL,
+    MACRO_OSC_SHAPE_WAVETABLES,
+    MACRO_OSC_SHAPE_FLUTED,
+    MACRO_OSC_SHAPE_TRIPLE_SAW,
+    MACRO_OSC_SHAPE_FILTERED_NOISE,
+  };
+  const size_t num_shapes = sizeof(shapes) / sizeof(shapes[0]);
+  const size_t num_samples = kSampleRate * 2;
+  float* out = new float[num_samples];
+
+  // A voice rendered by the engine, with its delay lines taken from a pool,
+  // is identical to the oscillator of the module, with static delay lines.
+  // Only shapes which do not draw random numbers are compared, since the
+  // engine draws them for the VCO drift.
+  const MacroOscillatorShape reference_shapes[] = {
+    MACRO_OSC_SHAPE_SAW_COMB, MACRO_OSC_SHAPE_BOWED
+  };
+  for (size_t i = 0; i < 2; ++i) {
+    PolyphonicPatch patch;
+    memset(&patch, 0, sizeof(patch));
+    patch.shape = reference_shapes[i];
+    patch.timbre = 12000;
+    patch.color = 20000;
+    PolyphonicEngine engine;
+    engine.Init(1);
+    engine.set_patch(0, patch);
+    engine.NoteOn(0, 48 << 7);
+
+    MacroOscillator osc;
+    static DigitalOscillatorDelayLines delay_lines;
+    memset(static_cast<void*>(&osc), 0, sizeof(osc));
+    memset(&delay_lines, 0, sizeof(delay_lines));
+    osc.Init();
+    osc.set_delay_lines(&delay_lines);
+    osc.set_shape(patch.shape);
+    osc.Strike();
+    uint8_t sync[kAudioBlockSize] = { 0 };
+    int16_t block[kAudioBlockSize];
+    uint16_t gain_lp = 0;
+    size_t num_errors = 0;
+    for (size_t n = 0; n < num_samples; n += kAudioBlockSize) {
+      engine.Render(&out[n], kAudioBlockSize);
+      osc.set_parameters(patch.timbre, patch.color);
+      osc.set_pitch(48 << 7);
+      osc.Render(sync, block, kAudioBlockSize);
+      for (size_t j = 0; j < kAudioBlockSize; ++j) {
+        int16_t sample = block[j] * gain_lp >> 16;
+        gain_lp += (65535 - gain_lp) >> 4;
+        num_errors += out[n + j] != static_cast<float>(sample) / 32768.0f;
+      }
+    }
+    printf("Engine vs. module, shape %d: %s\n",
+           patch.shape, num_errors ? "FAILED" : "ok");
+  }
+
+  printf("Voices  bytes/voice (full, pooled)  delay lines  voices/core\n");
+  for (size_t num_voices = 16; num_voices <= 64; num_voices *= 2) {
+    PolyphonicEngine engine;
+    engine.Init(num_voices);
+    size_t expected_delay_lines = 0;
+    for (size_t i = 0; i < num_voices; ++i) {
+      PolyphonicPatch patch;
+      memset(&patch, 0, sizeof(patch));
+      patch.shape = shapes[i % num_shapes];
+      patch.timbre = (i * 2777) % 32768;
+      patch.color = (i * 7919) % 32768;
+      patch.ad_attack = 1;
+      patch.ad_decay = 8;
+      patch.ad_timbre = 4;
+      patch.ad_vca = true;
+      patch.vco_drift = 4;
+      patch.scale = i % 4 == 0 ? &scales[2] : NULL;
+      engine.set_patch(i, patch);
+      engine.NoteOn(i, (36 + (i * 7) % 36) << 7);
+      expected_delay_lines += MacroOscillator::delay_lines_size(
+          patch.shape) != 0;
+    }
+    engine.Render(out, num_samples);
+
+    // Best of 3 runs.
+    double voices_per_core = 0.0;
+    for (int run = 0; run < 3; ++run) {
+      engine.ResetTimers();
+      for (size_t i = 0; i < num_voices; ++i) {
+        engine.NoteOn(i, (36 + (i * 7 + run) % 36) << 7);
+      }
+      engine.Render(out, num_samples);
+      voices_per_core = max(
+          voices_per_core, engine.statistics().voices_per_core());
+    }
+
+    PolyphonicStatistics s = engine.statistics();
+    printf("%6zu  %11zu %8.0f  %16zu  %11.1f  %s\n",
+           num_voices,
+           PolyphonicStatistics::full_voice_bytes(),
+           s.bytes_per_voice(),
+           s.num_delay_lines,
+           voices_per_core,
+           s.num_delay_lines == expected_delay_lines ? "ok" : "FAILED");
+
+    // Switching all voices to shapes without delay lines returns them to
+    // the pools.
+    for (size_t i = 0; i < num_voices; ++i) {
+      PolyphonicPatch patch;
+      memset(&patch, 0, sizeof(patch));
+      patch.shape = MACRO_OSC_SHAPE_CSAW;
+      engine.set_patch(i, patch);
+    }
+    s = engine.statistics();
+    if (s.num_delay_lines || s.num_quantizers) {
+      printf("Slabs not released: FAILED\n");
+    }
+  }
+  delete[] out;
+}
+
 void TestQuantizer() {
   Quantizer q;
   q.Init();
@@ -68,5 +517,9 @@ void TestQuantizer() {
 
 int main(void) {
   // TestQuantizer();
+  TestAnalogOscillatorFastPath();
+  TestPolyphonicEngine();
+  TestDigitalOscillatorFrontEnd();
+  TestBandLimitedWavetables();
   TestAudioRendering();
 }
@@ -0,0 +1,239 @@
+// Copyright 2012 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Runs the digital oscillator at an arbitrary sample rate, with float output.
+
+#include "braids/test/digital_oscillator_front_end.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace braids {
+
+using namespace std;
+
+static const float kInt16ToFloat = 1.0f / 32768.0f;
+
+// Kaiser window parameter, and position of the cutoff of the anti-aliasing
+// filter relative to the lowest of the two Nyquist frequencies.
+static const double kKaiserBeta = 7.0;
+static const double kCutoff = 0.85;
+
+static double BesselI0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  for (int k = 1; k < 32; ++k) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+static uint32_t GreatestCommonDivisor(uint32_t a, uint32_t b) {
+  while (b) {
+    uint32_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+void PolyphaseResampler::Init(uint32_t input_rate, uint32_t output_rate) {
+  uint32_t gcd = GreatestCommonDivisor(input_rate, output_rate);
+  up_factor_ = output_rate / gcd;
+  down_factor_ = input_rate / gcd;
+
+  // Prototype filter at input_rate * up_factor_, with a gain of up_factor_
+  // to compensate for the zeros inserted between the input samples.
+  size_t length = up_factor_ * kNumTaps;
+  double cutoff = 0.5 * kCutoff * min(1.0,
+      static_cast<double>(up_factor_) / down_factor_) / up_factor_;
+  double center = 0.5 * (length - 1);
+  double norm = 1.0 / BesselI0(kKaiserBeta);
+
+  // Phase p, tap j multiplies the input sample j samples before the most
+  // recent one. The taps are stored in reverse order, so that the inner loop
+  // of Read() runs forward through the input.
+  coefficients_.resize(length);
+  for (size_t p = 0; p < up_factor_; ++p) {
+    for (size_t j = 0; j < kNumTaps; ++j) {
+      double k = p + j * up_factor_;
+      double x = k - center;
+      double sinc = x == 0.0
+          ? 2.0 * cutoff
+          : sin(2.0 * M_PI * cutoff * x) / (M_PI * x);
+      double r = x / (0.5 * length);
+      double window = BesselI0(kKaiserBeta * sqrt(max(0.0, 1.0 - r * r)));
+      coefficients_[p * kNumTaps + kNumTaps - 1 - j] = static_cast<float>(
+          sinc * window * norm * up_factor_);
+    }
+  }
+  Reset();
+}
+
+void PolyphaseResampler::Reset() {
+  fill(&input_[0], &input_[kNumTaps - 1], 0.0f);
+  input_size_ = kNumTaps - 1;
+  position_ = kNumTaps - 1;
+  phase_ = 0;
+}
+
+void PolyphaseResampler::Write(const int16_t* in, size_t size) {
+  // Drop the samples which will not be read again.
+  size_t keep_from = position_ + 1 - kNumTaps;
+  if (keep_from) {
+    size_t keep = input_size_ > keep_from ? input_size_ - keep_from : 0;
+    copy(&input_[keep_from], &input_[keep_from + keep], &input_[0]);
+    input_size_ = keep;
+    position_ -= keep_from;
+  }
+  float* x = &input_[input_size_];
+  for (size_t i = 0; i < size; ++i) {
+    x[i] = static_cast<float>(in[i]) * kInt16ToFloat;
+  }
+  input_size_ += size;
+}
+
+size_t PolyphaseResampler::Read(float* out, size_t size) {
+  size_t n = 0;
+  while (n < size && position_ < input_size_) {
+    const float* c = &coefficients_[phase_ * kNumTaps];
+    const float* x = &input_[position_ + 1 - kNumTaps];
+    // Four partial sums, so that the compiler can vectorize the loop without
+    // reordering additions.
+    float s[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (size_t j = 0; j < kNumTaps; j += 4) {
+      s[0] += c[j] * x[j];
+      s[1] += c[j + 1] * x[j + 1];
+      s[2] += c[j + 2] * x[j + 2];
+      s[3] += c[j + 3] * x[j + 3];
+    }
+    out[n++] = (s[0] + s[1]) + (s[2] + s[3]);
+
+    phase_ += down_factor_;
+    while (phase_ >= up_factor_) {
+      phase_ -= up_factor_;
+      ++position_;
+    }
+  }
+  return n;
+}
+
+void DigitalOscillatorFrontEnd::Init(uint32_t sample_rate) {
+  // Some members of the oscillator are not reset by Init().
+  memset(static_cast<void*>(&osc_), 0, sizeof(osc_));
+  osc_.Init();
+  osc_.set_delay_lines(delay_lines_);
+
+  sample_rate_ = sample_rate;
+  pitch_offset_ = static_cast<int16_t>(floor(
+      12.0 * 128.0 * log2(
+          static_cast<double>(kNativeSampleRate) / sample_rate) + 0.5));
+  pitch_ = 60 << 7;
+  always_resample_ = false;
+  resampler_.Init(kNativeSampleRate, sample_rate);
+  resampling_ = false;
+  block_position_ = kFrontEndBlockSize;
+  set_shape(OSC_SHAPE_TRIPLE_RING_MOD);
+}
+
+/* static */
+bool DigitalOscillatorFrontEnd::rate_bound(DigitalOscillatorShape shape) {
+  switch (shape) {
+    case OSC_SHAPE_TRIPLE_RING_MOD:
+    case OSC_SHAPE_DIGITAL_FILTER_LP:
+    case OSC_SHAPE_DIGITAL_FILTER_PK:
+    case OSC_SHAPE_DIGITAL_FILTER_BP:
+    case OSC_SHAPE_DIGITAL_FILTER_HP:
+    case OSC_SHAPE_HARMONICS:
+    case OSC_SHAPE_FM:
+    case OSC_SHAPE_FEEDBACK_FM:
+    case OSC_SHAPE_CHAOTIC_FEEDBACK_FM:
+    case OSC_SHAPE_WAVETABLES:
+    case OSC_SHAPE_WAVE_MAP:
+    case OSC_SHAPE_WAVE_LINE:
+    case OSC_SHAPE_WAVE_PARAPHONIC:
+      return false;
+    default:
+      return true;
+  }
+}
+
+void DigitalOscillatorFrontEnd::set_shape(DigitalOscillatorShape shape) {
+  if (DigitalOscillator::delay_lines_size(shape) && !delay_lines_) {
+    delay_lines_ = new DigitalOscillatorDelayLines;
+    memset(delay_lines_, 0, sizeof(*delay_lines_));
+    osc_.set_delay_lines(delay_lines_);
+  }
+
+  bool resampling = sample_rate_ != kNativeSampleRate &&
+      (always_resample_ || rate_bound(shape));
+  if (resampling != resampling_) {
+    resampler_.Reset();
+    block_position_ = kFrontEndBlockSize;
+    resampling_ = resampling;
+  }
+  shape_ = shape;
+  osc_.set_shape(shape);
+}
+
+void DigitalOscillatorFrontEnd::Render(float* out, size_t size) {
+  static const uint8_t no_sync[kFrontEndBlockSize] = { 0 };
+
+  int32_t pitch = pitch_ + (resampling_ ? 0 : pitch_offset_);
+  CONSTRAIN(pitch, 0, 16383);
+  osc_.set_pitch(pitch);
+
+  if (resampling_) {
+    while (size) {
+      size_t n = resampler_.Read(out, size);
+      out += n;
+      size -= n;
+      if (size) {
+        osc_.Render(no_sync, block_, kFrontEndBlockSize);
+        resampler_.Write(block_, kFrontEndBlockSize);
+      }
+    }
+  } else {
+    while (size) {
+      if (block_position_ == kFrontEndBlockSize) {
+        osc_.Render(no_sync, block_, kFrontEndBlockSize);
+        block_position_ = 0;
+      }
+      size_t n = min(size, kFrontEndBlockSize - block_position_);
+      const int16_t* in = &block_[block_position_];
+      for (size_t i = 0; i < n; ++i) {
+        out[i] = static_cast<float>(in[i]) * kInt16ToFloat;
+      }
+      block_position_ += n;
+      out += n;
+      size -= n;
+    }
+  }
+}
+
+}  // namespace braids
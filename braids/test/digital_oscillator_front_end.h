@@ -0,0 +1,147 @@
+// Copyright 2012 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Runs the digital oscillator at an arbitrary sample rate, with float output.
+//
+// In the models whose frequencies are all derived from the pitch (FM,
+// wavetables, digital filter...), running at another sample rate is the same
+// as transposing: the pitch is offset by 12 * log2(96000 / sample_rate)
+// semitones, computed once in Init(), and the oscillator renders directly at
+// the host rate. The other models (physical models, drums, formants, noise)
+// have time constants and filter coefficients in tables computed for 96kHz,
+// so they run at 96kHz and are converted by a polyphase resampler.
+//
+// In both cases, the int16 output of the oscillator is converted to float in
+// the same pass as the resampling, or the copy to the output buffer.
+
+#ifndef BRAIDS_TEST_DIGITAL_OSCILLATOR_FRONT_END_H_
+#define BRAIDS_TEST_DIGITAL_OSCILLATOR_FRONT_END_H_
+
+#include "stmlib/stmlib.h"
+
+#include <vector>
+
+#include "braids/digital_oscillator.h"
+
+namespace braids {
+
+const uint32_t kNativeSampleRate = 96000;
+const size_t kFrontEndBlockSize = 24;
+
+// Rational resampler converting from kNativeSampleRate to an arbitrary
+// integer sample rate. The windowed-sinc prototype is split into
+// up_factor_ phases of kNumTaps taps each.
+class PolyphaseResampler {
+ public:
+  PolyphaseResampler() { }
+  ~PolyphaseResampler() { }
+
+  static const size_t kNumTaps = 32;
+
+  void Init(uint32_t input_rate, uint32_t output_rate);
+  void Reset();
+
+  // Appends size samples to the input. Never more than kMaxInput at once.
+  void Write(const int16_t* in, size_t size);
+
+  // Reads up to size output samples, and returns the number of samples read.
+  size_t Read(float* out, size_t size);
+
+  static const size_t kMaxInput = 64;
+
+ private:
+  size_t up_factor_;
+  size_t down_factor_;
+  std::vector<float> coefficients_;
+
+  // The last kNumTaps - 1 samples of the previous write are kept at the
+  // beginning of the buffer.
+  float input_[kNumTaps - 1 + kMaxInput];
+  size_t input_size_;
+  size_t position_;  // Most recent input sample used by the next output.
+  size_t phase_;
+
+  DISALLOW_COPY_AND_ASSIGN(PolyphaseResampler);
+};
+
+class DigitalOscillatorFrontEnd {
+ public:
+  DigitalOscillatorFrontEnd() : delay_lines_(NULL) { }
+  ~DigitalOscillatorFrontEnd() { delete delay_lines_; }
+
+  void Init(uint32_t sample_rate);
+
+  void set_shape(DigitalOscillatorShape shape);
+
+  // Same units as DigitalOscillator::set_pitch, but relative to the host
+  // sample rate.
+  inline void set_pitch(int16_t pitch) {
+    pitch_ = pitch;
+  }
+
+  inline void set_parameters(int16_t parameter_1, int16_t parameter_2) {
+    osc_.set_parameters(parameter_1, parameter_2);
+  }
+
+  inline void Strike() {
+    osc_.Strike();
+  }
+
+  // Writes size samples. Full scale is 1.0.
+  void Render(float* out, size_t size);
+
+  // Models with time constants or filters which do not follow the pitch.
+  static bool rate_bound(DigitalOscillatorShape shape);
+
+  inline bool resampling() const { return resampling_; }
+
+  // For testing: also resample the models which could run at the host rate.
+  inline void set_always_resample(bool always_resample) {
+    always_resample_ = always_resample;
+    set_shape(shape_);
+  }
+
+ private:
+  DigitalOscillator osc_;
+  DigitalOscillatorDelayLines* delay_lines_;
+  PolyphaseResampler resampler_;
+
+  DigitalOscillatorShape shape_;
+  uint32_t sample_rate_;
+  int16_t pitch_;
+  int16_t pitch_offset_;
+  bool resampling_;
+  bool always_resample_;
+
+  int16_t block_[kFrontEndBlockSize];
+  size_t block_position_;
+
+  DISALLOW_COPY_AND_ASSIGN(DigitalOscillatorFrontEnd);
+};
+
+}  // namespace braids
+
+#endif  // BRAIDS_TEST_DIGITAL_OSCILLATOR_FRONT_END_H_
@@ -0,0 +1,306 @@
+// Copyright 2012 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Host engine running many copies of the module's voice.
+
+#include "braids/test/polyphonic_engine.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <new>
+
+namespace braids {
+
+using namespace std;
+
+const size_t kSlabsPerChunk = 4;
+
+static inline size_t RoundToCacheLine(size_t size) {
+  return (size + kCacheLineSize - 1) & ~(kCacheLineSize - 1);
+}
+
+static void* AllocateAligned(size_t size) {
+  void* p = NULL;
+  if (posix_memalign(&p, kCacheLineSize, size)) {
+    return NULL;
+  }
+  return p;
+}
+
+static double ThreadTime() {
+  timespec t;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+void SlabPool::Init(size_t slab_size, size_t slabs_per_chunk) {
+  slab_size_ = RoundToCacheLine(max(slab_size, sizeof(void*)));
+  slabs_per_chunk_ = slabs_per_chunk;
+  num_allocated_ = 0;
+  free_list_ = NULL;
+}
+
+void SlabPool::Clear() {
+  for (size_t i = 0; i < chunks_.size(); ++i) {
+    free(chunks_[i]);
+  }
+  chunks_.clear();
+  num_allocated_ = 0;
+  free_list_ = NULL;
+}
+
+void* SlabPool::Allocate() {
+  if (!free_list_) {
+    uint8_t* chunk = static_cast<uint8_t*>(
+        AllocateAligned(slabs_per_chunk_ * slab_size_));
+    if (!chunk) {
+      return NULL;
+    }
+    chunks_.push_back(chunk);
+    for (size_t i = 0; i < slabs_per_chunk_; ++i) {
+      void* slab = chunk + i * slab_size_;
+      *static_cast<void**>(slab) = free_list_;
+      free_list_ = slab;
+    }
+  }
+  void* slab = free_list_;
+  free_list_ = *static_cast<void**>(slab);
+  ++num_allocated_;
+  return slab;
+}
+
+void SlabPool::Free(void* slab) {
+  *static_cast<void**>(slab) = free_list_;
+  free_list_ = slab;
+  --num_allocated_;
+}
+
+// Hot state first: it is touched at every block, by every voice.
+struct PolyphonicEngine::Voice {
+  MacroOscillator osc;
+  Envelope envelope;
+  VcoJitterSource jitter_source;
+  Quantizer* quantizer;
+  DigitalOscillatorDelayLines* delay_lines;
+  size_t delay_lines_size;
+
+  PolyphonicPatch patch;
+  int16_t pitch;
+  uint16_t gain_lp;
+  bool trigger;
+} __attribute__((aligned(kCacheLineSize)));
+
+/* static */
+size_t PolyphonicStatistics::full_voice_bytes() {
+  return RoundToCacheLine(
+      sizeof(MacroOscillator) +
+      sizeof(DigitalOscillatorDelayLines) +
+      sizeof(Envelope) +
+      sizeof(VcoJitterSource) +
+      sizeof(Quantizer));
+}
+
+void PolyphonicEngine::Init(size_t num_voices) {
+  Clear();
+  num_voices_ = num_voices;
+  voices_ = static_cast<Voice*>(AllocateAligned(num_voices * sizeof(Voice)));
+  // Not all members of the oscillators and envelope are reset by Init().
+  memset(static_cast<void*>(voices_), 0, num_voices * sizeof(Voice));
+  for (size_t i = 0; i < num_voices; ++i) {
+    Voice* v = new(&voices_[i]) Voice;
+    v->osc.Init();
+    v->envelope.Init();
+    v->jitter_source.Init();
+    v->quantizer = NULL;
+    v->delay_lines = NULL;
+    v->delay_lines_size = 0;
+    v->patch.shape = MACRO_OSC_SHAPE_CSAW;
+    v->patch.scale = NULL;
+    v->pitch = 60 << 7;
+    v->gain_lp = 0;
+    v->trigger = false;
+  }
+  quantizer_pool_.Init(sizeof(Quantizer), kSlabsPerChunk);
+  ResetTimers();
+}
+
+void PolyphonicEngine::Clear() {
+  if (!voices_) {
+    return;
+  }
+  for (size_t i = 0; i < num_voices_; ++i) {
+    voices_[i].~Voice();
+  }
+  free(voices_);
+  voices_ = NULL;
+  num_voices_ = 0;
+
+  for (size_t i = 0; i < delay_line_pools_.size(); ++i) {
+    delete delay_line_pools_[i];
+  }
+  delay_line_pools_.clear();
+  quantizer_pool_.Clear();
+}
+
+SlabPool* PolyphonicEngine::delay_line_pool(size_t size) {
+  size = RoundToCacheLine(size);
+  for (size_t i = 0; i < delay_line_pools_.size(); ++i) {
+    if (delay_line_pools_[i]->slab_size() == size) {
+      return delay_line_pools_[i];
+    }
+  }
+  SlabPool* pool = new SlabPool;
+  pool->Init(size, kSlabsPerChunk);
+  delay_line_pools_.push_back(pool);
+  return pool;
+}
+
+void PolyphonicEngine::set_patch(size_t voice, const PolyphonicPatch& patch) {
+  Voice* v = &voices_[voice];
+
+  // Delay lines from a pool of a different size class are not reused: for
+  // example, switching from the comb filter to the bowed string gives back
+  // 16kb and takes 5kb.
+  size_t size = MacroOscillator::delay_lines_size(patch.shape);
+  if (RoundToCacheLine(size) != RoundToCacheLine(v->delay_lines_size)) {
+    if (v->delay_lines) {
+      delay_line_pool(v->delay_lines_size)->Free(v->delay_lines);
+      v->delay_lines = NULL;
+    }
+    if (size) {
+      // Do not leak the sound of the previous owner of the slab.
+      void* slab = delay_line_pool(size)->Allocate();
+      if (slab) {
+        memset(slab, 0, size);
+        v->delay_lines = static_cast<DigitalOscillatorDelayLines*>(slab);
+      }
+    }
+    v->delay_lines_size = v->delay_lines ? size : 0;
+    v->osc.set_delay_lines(v->delay_lines);
+  }
+
+  if (patch.scale && !v->quantizer) {
+    void* slab = quantizer_pool_.Allocate();
+    if (slab) {
+      v->quantizer = new(slab) Quantizer;
+      v->quantizer->Init();
+      v->quantizer->Configure(*patch.scale);
+    }
+  } else if (!patch.scale && v->quantizer) {
+    v->quantizer->~Quantizer();
+    quantizer_pool_.Free(v->quantizer);
+    v->quantizer = NULL;
+  } else if (patch.scale && patch.scale != v->patch.scale) {
+    v->quantizer->Configure(*patch.scale);
+  }
+
+  v->patch = patch;
+  v->osc.set_shape(patch.shape);
+}
+
+void PolyphonicEngine::NoteOn(size_t voice, int16_t pitch) {
+  voices_[voice].pitch = pitch;
+  voices_[voice].trigger = true;
+}
+
+void PolyphonicEngine::RenderVoice(Voice* v, int16_t* out) {
+  static const uint8_t no_sync[kPolyphonicEngineBlockSize] = { 0 };
+  const PolyphonicPatch& patch = v->patch;
+
+  v->envelope.Update(patch.ad_attack * 8, patch.ad_decay * 8);
+  uint32_t ad_value = v->envelope.Render();
+
+  int32_t timbre = patch.timbre + (ad_value * patch.ad_timbre >> 5);
+  int32_t color = patch.color + (ad_value * patch.ad_color >> 5);
+  CONSTRAIN(timbre, 0, 32767);
+  CONSTRAIN(color, 0, 32767);
+  v->osc.set_parameters(timbre, color);
+
+  int32_t pitch = v->pitch;
+  if (v->quantizer) {
+    pitch = v->quantizer->Process(pitch, (60 + patch.quantizer_root) << 7);
+  }
+  pitch += v->jitter_source.Render(patch.vco_drift);
+  pitch += ad_value * patch.ad_fm >> 7;
+  CONSTRAIN(pitch, 0, 16383);
+  v->osc.set_pitch(pitch);
+
+  if (v->trigger) {
+    v->osc.Strike();
+    v->envelope.Trigger(ENV_SEGMENT_ATTACK);
+    v->trigger = false;
+  }
+
+  v->osc.Render(no_sync, out, kPolyphonicEngineBlockSize);
+
+  int32_t gain = patch.ad_vca ? ad_value : 65535;
+  uint16_t gain_lp = v->gain_lp;
+  for (size_t i = 0; i < kPolyphonicEngineBlockSize; ++i) {
+    out[i] = out[i] * gain_lp >> 16;
+    gain_lp += (gain - gain_lp) >> 4;
+  }
+  v->gain_lp = gain_lp;
+}
+
+void PolyphonicEngine::Render(float* out, size_t size) {
+  double start = ThreadTime();
+  int16_t voice_buffer[kPolyphonicEngineBlockSize];
+  int32_t mix[kPolyphonicEngineBlockSize];
+  for (size_t n = 0; n < size; n += kPolyphonicEngineBlockSize) {
+    fill(&mix[0], &mix[kPolyphonicEngineBlockSize], 0);
+    for (size_t i = 0; i < num_voices_; ++i) {
+      RenderVoice(&voices_[i], voice_buffer);
+      for (size_t j = 0; j < kPolyphonicEngineBlockSize; ++j) {
+        mix[j] += voice_buffer[j];
+      }
+    }
+    for (size_t j = 0; j < kPolyphonicEngineBlockSize; ++j) {
+      out[n + j] = static_cast<float>(mix[j]) / 32768.0f;
+    }
+  }
+  busy_seconds_ += ThreadTime() - start;
+  rendered_seconds_ += static_cast<double>(size) / kPolyphonicEngineSampleRate;
+}
+
+PolyphonicStatistics PolyphonicEngine::statistics() const {
+  PolyphonicStatistics s;
+  s.num_voices = num_voices_;
+  s.voice_bytes = num_voices_ * sizeof(Voice);
+  s.delay_line_bytes = 0;
+  s.num_delay_lines = 0;
+  for (size_t i = 0; i < delay_line_pools_.size(); ++i) {
+    s.delay_line_bytes += delay_line_pools_[i]->reserved_bytes();
+    s.num_delay_lines += delay_line_pools_[i]->num_allocated();
+  }
+  s.quantizer_bytes = quantizer_pool_.reserved_bytes();
+  s.num_quantizers = quantizer_pool_.num_allocated();
+  s.rendered_seconds = rendered_seconds_;
+  s.busy_seconds = busy_seconds_;
+  return s;
+}
+
+}  // namespace braids
@@ -0,0 +1,175 @@
+// Copyright 2012 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Host engine running many copies of the module's voice (macro-oscillator,
+// AD envelope, quantizer and VCO drift), as in RenderBlock() in braids.cc.
+//
+// The state of all voices is stored in a single array of cache-line aligned
+// records, and the voices are rendered one after the other, one block at a
+// time. The delay lines of the physical models and comb filter, and the
+// quantizer, are much larger than the rest of the state of a voice, so they
+// are allocated from slab pools, only for the voices whose patch uses them.
+
+#ifndef BRAIDS_TEST_POLYPHONIC_ENGINE_H_
+#define BRAIDS_TEST_POLYPHONIC_ENGINE_H_
+
+#include "stmlib/stmlib.h"
+
+#include <vector>
+
+#include "braids/envelope.h"
+#include "braids/macro_oscillator.h"
+#include "braids/quantizer.h"
+#include "braids/settings.h"
+#include "braids/vco_jitter_source.h"
+
+namespace braids {
+
+const size_t kPolyphonicEngineBlockSize = 24;
+const float kPolyphonicEngineSampleRate = 96000.0f;
+const size_t kCacheLineSize = 64;
+
+// Allocator for blocks of a fixed size. Blocks are carved out of chunks of
+// slabs_per_chunk blocks, and are linked in a free list when not in use.
+// Chunks are only allocated when the free list is empty, and are released
+// when the pool is destroyed.
+class SlabPool {
+ public:
+  SlabPool() : free_list_(NULL) { }
+  ~SlabPool() { Clear(); }
+
+  void Init(size_t slab_size, size_t slabs_per_chunk);
+  void Clear();
+
+  void* Allocate();
+  void Free(void* slab);
+
+  inline size_t slab_size() const { return slab_size_; }
+  inline size_t num_allocated() const { return num_allocated_; }
+  inline size_t reserved_bytes() const {
+    return chunks_.size() * slabs_per_chunk_ * slab_size_;
+  }
+
+ private:
+  size_t slab_size_;
+  size_t slabs_per_chunk_;
+  size_t num_allocated_;
+  void* free_list_;
+  std::vector<void*> chunks_;
+
+  DISALLOW_COPY_AND_ASSIGN(SlabPool);
+};
+
+// The settings of the module used by RenderBlock(). Envelope times and
+// modulation amounts use the same ranges as the corresponding settings.
+struct PolyphonicPatch {
+  MacroOscillatorShape shape;
+  int16_t timbre;
+  int16_t color;
+  uint8_t ad_attack;
+  uint8_t ad_decay;
+  uint8_t ad_timbre;
+  uint8_t ad_color;
+  uint8_t ad_fm;
+  bool ad_vca;
+  uint8_t vco_drift;
+  const Scale* scale;  // NULL to disable the quantizer.
+  int32_t quantizer_root;
+};
+
+struct PolyphonicStatistics {
+  size_t num_voices;
+  size_t voice_bytes;  // Bytes allocated for the voice records.
+  size_t delay_line_bytes;  // Bytes reserved by the delay line pools.
+  size_t quantizer_bytes;  // Bytes reserved by the quantizer pool.
+  size_t num_delay_lines;  // Delay lines in use.
+  size_t num_quantizers;  // Quantizers in use.
+
+  double rendered_seconds;
+  double busy_seconds;
+
+  inline size_t total_bytes() const {
+    return voice_bytes + delay_line_bytes + quantizer_bytes;
+  }
+
+  inline double bytes_per_voice() const {
+    return static_cast<double>(total_bytes()) / num_voices;
+  }
+
+  // A voice using all the state of the module, whatever the patch.
+  static size_t full_voice_bytes();
+
+  inline double voices_per_core() const {
+    return num_voices * rendered_seconds / busy_seconds;
+  }
+};
+
+class PolyphonicEngine {
+ public:
+  PolyphonicEngine() : voices_(NULL), num_voices_(0) { }
+  ~PolyphonicEngine() { Clear(); }
+
+  void Init(size_t num_voices);
+  void Clear();
+
+  // Allocates or releases the delay lines and quantizer of the voice when
+  // the new patch needs them and the previous one did not, or the opposite.
+  void set_patch(size_t voice, const PolyphonicPatch& patch);
+
+  void NoteOn(size_t voice, int16_t pitch);
+
+  // Mixes all voices into out. size must be a multiple of
+  // kPolyphonicEngineBlockSize.
+  void Render(float* out, size_t size);
+
+  PolyphonicStatistics statistics() const;
+
+  inline void ResetTimers() {
+    rendered_seconds_ = 0.0;
+    busy_seconds_ = 0.0;
+  }
+
+ private:
+  struct Voice;
+
+  SlabPool* delay_line_pool(size_t size);
+  void RenderVoice(Voice* voice, int16_t* out);
+
+  Voice* voices_;
+  size_t num_voices_;
+
+  std::vector<SlabPool*> delay_line_pools_;
+  SlabPool quantizer_pool_;
+
+  double rendered_seconds_;
+  double busy_seconds_;
+
+  DISALLOW_COPY_AND_ASSIGN(PolyphonicEngine);
+};
+
+}  // namespace braids
+
+#endif  // BRAIDS_TEST_POLYPHONIC_ENGINE_H_
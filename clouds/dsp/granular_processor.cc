@@ -52,8 +52,15 @@ void GranularProcessor::Init(
   
   num_channels_ = 2;
   low_fidelity_ = false;
+  requested_num_channels_ = 2;
+  requested_low_fidelity_ = false;
+  grain_budget_shift_ = 0;
   bypass_ = false;
   
+  time_source_ = NULL;
+  ticks_per_sample_ = 0.0f;
+  quality_governor_.Init();
+  
   src_down_.Init();
   src_up_.Init();
   
@@ -64,6 +71,33 @@ void GranularProcessor::Init(
   dry_wet_ = 0.0f;
 }
 
+void GranularProcessor::ApplyQuality() {
+  int32_t num_channels = requested_num_channels_;
+  bool low_fidelity = requested_low_fidelity_;
+  QualityLevel level = quality_level();
+  
+  if (level >= QUALITY_LEVEL_LOW_FIDELITY) {
+    low_fidelity = true;
+  }
+  if (level >= QUALITY_LEVEL_MONO) {
+    num_channels = 1;
+  }
+  grain_budget_shift_ = level >= QUALITY_LEVEL_QUARTER_GRAINS
+      ? 2 : (level >= QUALITY_LEVEL_HALF_GRAINS ? 1 : 0);
+  if (!reset_buffers_) {
+    // Otherwise, the budget is applied when the player is reinitialized.
+    player_.set_grain_budget(player_.max_num_grains() >> grain_budget_shift_);
+  }
+  SetLayout(num_channels, low_fidelity);
+}
+
+void GranularProcessor::SetLayout(int32_t num_channels, bool low_fidelity) {
+  reset_buffers_ = reset_buffers_ || num_channels_ != num_channels;
+  reset_buffers_ = reset_buffers_ || low_fidelity_ != low_fidelity;
+  num_channels_ = num_channels;
+  low_fidelity_ = low_fidelity;
+}
+
 void GranularProcessor::ResetFilters() {
   for (int32_t i = 0; i < 2; ++i) {
     fb_filter_[i].Init();
@@ -160,6 +194,25 @@ void GranularProcessor::Process(
     ShortFrame* input,
     ShortFrame* output,
     size_t size) {
+  if (!time_source_) {
+    Render(input, output, size);
+    return;
+  }
+  
+  uint32_t start = (*time_source_)();
+  Render(input, output, size);
+  uint32_t elapsed = (*time_source_)() - start;
+  
+  float load = static_cast<float>(elapsed) / (ticks_per_sample_ * size);
+  if (quality_governor_.Process(load)) {
+    ApplyQuality();
+  }
+}
+
+void GranularProcessor::Render(
+    ShortFrame* input,
+    ShortFrame* output,
+    size_t size) {
   // TIC
   if (bypass_) {
     copy(&input[0], &input[size], &output[0]);
@@ -291,7 +344,9 @@ void GranularProcessor::PreparePersistentData() {
       buffer_8_[0].head() : buffer_16_[0].head();
   persistent_state_.write_head[1] = low_fidelity_ ?
       buffer_8_[1].head() : buffer_16_[1].head();
-  persistent_state_.quality = quality();
+  // The layout of the saved data depends on the quality actually in use.
+  persistent_state_.quality = (num_channels_ == 1 ? 1 : 0) | \
+      (low_fidelity_ ? 2 : 0);
   persistent_state_.spectral = playback_mode() == PLAYBACK_MODE_SPECTRAL;
 }
 
@@ -344,7 +399,16 @@ bool GranularProcessor::LoadPersistentData(const uint32_t* data) {
             ? PLAYBACK_MODE_SPECTRAL
             : PLAYBACK_MODE_GRANULAR);
       }
-      set_quality(persistent_state_.quality);
+      if (time_source_) {
+        // The buffers must be laid out as when they were saved, whatever the
+        // quality currently requested or allowed by the governor. The next
+        // change of quality, requested or automatic, reallocates them.
+        SetLayout(
+            persistent_state_.quality & 1 ? 1 : 2,
+            persistent_state_.quality & 2 ? true : false);
+      } else {
+        set_quality(persistent_state_.quality);
+      }
 
       // We can force a switch to this mode, and once everything has been
       // initialized for this mode, we continue with the loop to copy the
@@ -443,6 +507,7 @@ void GranularProcessor::Prepare() {
       int32_t num_grains = (num_channels_ == 1 ? 40 : 32) * \
           (low_fidelity_ ? 23 : 16) >> 4;
       player_.Init(num_channels_, num_grains);
+      player_.set_grain_budget(num_grains >> grain_budget_shift_);
       ws_player_.Init(&correlator_, num_channels_);
       looper_.Init(num_channels_);
     }
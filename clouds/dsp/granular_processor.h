@@ -41,11 +41,13 @@
 #include "clouds/dsp/granular_sample_player.h"
 #include "clouds/dsp/looping_sample_player.h"
 #include "clouds/dsp/pvoc/phase_vocoder.h"
+#include "clouds/dsp/quality_governor.h"
 #include "clouds/dsp/sample_rate_converter.h"
 #include "clouds/dsp/wsola_sample_player.h"
 
 namespace clouds {
 
+const float kInputSampleRate = 32000.0f;
 const int32_t kDownsamplingFactor = 2;
 
 enum PlaybackMode {
@@ -75,6 +77,9 @@ class GranularProcessor {
   GranularProcessor() { }
   ~GranularProcessor() { }
   
+  // Free-running counter used to measure the rendering time of each block.
+  typedef uint32_t (*TimeSource)();
+  
   void Init(
       void* large_buffer,
       size_t large_buffer_size,
@@ -128,22 +133,44 @@ class GranularProcessor {
   }
   
   inline void set_num_channels(int32_t num_channels) {
-    reset_buffers_ = reset_buffers_ || num_channels_ != num_channels;
-    num_channels_ = num_channels;
+    requested_num_channels_ = num_channels;
+    ApplyQuality();
   }
   
   inline void set_low_fidelity(bool low_fidelity) {
-    reset_buffers_ = reset_buffers_ || low_fidelity != low_fidelity_;
-    low_fidelity_ = low_fidelity;
+    requested_low_fidelity_ = low_fidelity;
+    ApplyQuality();
   }
   
+  // Quality setting, as requested by the user.
   inline int32_t quality() const {
     int32_t quality = 0;
-    if (num_channels_ == 1) quality |= 1;
-    if (low_fidelity_) quality |= 2;
+    if (requested_num_channels_ == 1) quality |= 1;
+    if (requested_low_fidelity_) quality |= 2;
     return quality;
   }
   
+  // Enables automatic quality scaling (or disables it when now is NULL).
+  // ticks_per_second is the rate of the counter returned by now. When the
+  // rendering time of a block gets close to its duration, the number of
+  // grains is reduced first, then the processor switches to 8-bit buffers
+  // and half-rate processing, then to mono. The last two steps reallocate,
+  // and thus clear, the recording buffer.
+  inline void set_adaptive_quality(TimeSource now, float ticks_per_second) {
+    time_source_ = now;
+    ticks_per_sample_ = ticks_per_second / kInputSampleRate;
+    quality_governor_.Init();
+    ApplyQuality();
+  }
+  
+  inline QualityLevel quality_level() const {
+    return time_source_ ? quality_governor_.level() : QUALITY_LEVEL_FULL;
+  }
+  
+  inline const QualityGovernor& quality_governor() const {
+    return quality_governor_;
+  }
+  
   void GetPersistentData(PersistentBlock* block, size_t *num_blocks);
   bool LoadPersistentData(const uint32_t* data);
   void PreparePersistentData();
@@ -154,17 +181,27 @@ class GranularProcessor {
   }
 
   inline float sample_rate() const {
-    return 32000.0f / \
+    return kInputSampleRate / \
         (low_fidelity_ ? kDownsamplingFactor : 1);
   }
      
+  void ApplyQuality();
+  void SetLayout(int32_t num_channels, bool low_fidelity);
   void ResetFilters();
+  void Render(ShortFrame* input, ShortFrame* output, size_t size);
   void ProcessGranular(FloatFrame* input, FloatFrame* output, size_t size);
 
   PlaybackMode playback_mode_;
   PlaybackMode previous_playback_mode_;
   int32_t num_channels_;
   bool low_fidelity_;
+  int32_t requested_num_channels_;
+  bool requested_low_fidelity_;
+  int32_t grain_budget_shift_;
+  
+  TimeSource time_source_;
+  float ticks_per_sample_;
+  QualityGovernor quality_governor_;
   
   bool silence_;
   bool bypass_;
@@ -35,12 +35,12 @@
 
 #include "stmlib/dsp/atan.h"
 #include "stmlib/dsp/units.h"
-#include "stmlib/utils/random.h"
 
 #include "clouds/dsp/audio_buffer.h"
 #include "clouds/dsp/frame.h"
 #include "clouds/dsp/grain.h"
 #include "clouds/dsp/parameters.h"
+#include "clouds/dsp/random.h"
 
 #include "clouds/resources.h"
 
@@ -57,6 +57,7 @@ class GranularSamplePlayer {
   
   void Init(int32_t num_channels, int32_t max_num_grains) {
     max_num_grains_ = max_num_grains;
+    grain_budget_ = max_num_grains;
     num_midfi_grains_ = 3 * max_num_grains / 4;
     gain_normalization_ = 1.0f;
     for (int32_t i = 0; i < kMaxNumGrains; ++i) {
@@ -67,6 +68,16 @@ class GranularSamplePlayer {
     grain_size_hint_ = 1024.0f;
   }
   
+  // Limits the number of simultaneously active grains. Grains already playing
+  // are not interrupted.
+  inline void set_grain_budget(int32_t grain_budget) {
+    grain_budget_ = std::min(grain_budget, max_num_grains_);
+  }
+  
+  inline int32_t max_num_grains() const {
+    return max_num_grains_;
+  }
+  
   template<Resolution resolution>
   void Play(
       const AudioBuffer<resolution>* buffer,
@@ -74,7 +85,7 @@ class GranularSamplePlayer {
       float* out, size_t size) {
     float overlap = parameters.granular.overlap;
     overlap = overlap * overlap * overlap;
-    float target_num_grains = max_num_grains_ * overlap;
+    float target_num_grains = grain_budget_ * overlap;
     float p = target_num_grains / static_cast<float>(grain_size_hint_);
     float space_between_grains = grain_size_hint_ / target_num_grains;
     if (parameters.granular.use_deterministic_seed) {
@@ -85,6 +96,9 @@ class GranularSamplePlayer {
     
     // Build a list of available grains.
     int32_t num_available_grains = FillAvailableGrainsList();
+    int32_t num_schedulable_grains = std::min(
+        num_available_grains,
+        grain_budget_ - (max_num_grains_ - num_available_grains));
     
     // Try to schedule new grains.
     bool seed_trigger = parameters.trigger;
@@ -94,7 +108,8 @@ class GranularSamplePlayer {
           && target_num_grains > num_grains_;
       bool seed_deterministic = grain_rate_phasor_ >= space_between_grains;
       bool seed = seed_probabilistic || seed_deterministic || seed_trigger;
-      if (num_available_grains && seed) {
+      if (num_schedulable_grains > 0 && seed) {
+        --num_schedulable_grains;
         --num_available_grains;
         int32_t index = available_grains_[num_available_grains];
         GrainQuality quality;
@@ -236,6 +251,7 @@ class GranularSamplePlayer {
   }
   
   int32_t max_num_grains_;
+  int32_t grain_budget_;
   int32_t num_midfi_grains_;
   int32_t num_channels_;
 
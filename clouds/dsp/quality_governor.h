@@ -0,0 +1,145 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Decides when to trade quality for CPU, from the measured load of each block.
+//
+// The quality is degraded one level at a time when a deadline is missed, or
+// when the smoothed load stays too high. It is restored one level at a time
+// once the smoothed load has been low for a while. The two thresholds are far
+// apart, a level change is followed by a hold period during which the load
+// is allowed to settle, and the recovery delay doubles each time a recovery
+// is quickly followed by a new degradation - so that the quality does not
+// oscillate between two levels.
+
+#ifndef CLOUDS_DSP_QUALITY_GOVERNOR_H_
+#define CLOUDS_DSP_QUALITY_GOVERNOR_H_
+
+#include "stmlib/stmlib.h"
+#include "stmlib/dsp/dsp.h"
+
+namespace clouds {
+
+enum QualityLevel {
+  QUALITY_LEVEL_FULL,
+  QUALITY_LEVEL_HALF_GRAINS,
+  QUALITY_LEVEL_QUARTER_GRAINS,
+  QUALITY_LEVEL_LOW_FIDELITY,  // 8-bit buffers, processing at half rate.
+  QUALITY_LEVEL_MONO,
+  QUALITY_LEVEL_LAST
+};
+
+const float kQualityDegradeLoad = 0.85f;
+const float kQualityRecoverLoad = 0.5f;
+const int32_t kQualityHoldBlocks = 250;
+const int32_t kQualityMinRecoveryBlocks = 1000;
+const int32_t kQualityMaxRecoveryBlocks = 32000;
+
+class QualityGovernor {
+ public:
+  QualityGovernor() { }
+  ~QualityGovernor() { }
+  
+  void Init() {
+    level_ = QUALITY_LEVEL_FULL;
+    load_ = 0.0f;
+    hold_ = 0;
+    low_load_blocks_ = 0;
+    since_recovery_ = kQualityMaxRecoveryBlocks;
+    recovery_blocks_ = kQualityMinRecoveryBlocks;
+    deadline_misses_ = 0;
+    num_degradations_ = 0;
+    num_recoveries_ = 0;
+  }
+  
+  // load is the time taken to render the block, divided by its duration.
+  // Returns true when the level has changed.
+  bool Process(float load) {
+    SLOPE(load_, load, 0.5f, 0.005f);
+    if (load >= 1.0f) {
+      ++deadline_misses_;
+    }
+    if (since_recovery_ < kQualityMaxRecoveryBlocks) {
+      ++since_recovery_;
+    }
+    if (hold_) {
+      --hold_;
+      return false;
+    }
+    
+    if ((load >= 1.0f || load_ >= kQualityDegradeLoad) && \
+        level_ < QUALITY_LEVEL_LAST - 1) {
+      // Back off when the previous recovery was premature.
+      if (since_recovery_ < 2 * recovery_blocks_) {
+        recovery_blocks_ = recovery_blocks_ * 2 > kQualityMaxRecoveryBlocks
+            ? kQualityMaxRecoveryBlocks
+            : recovery_blocks_ * 2;
+      }
+      level_ = static_cast<QualityLevel>(level_ + 1);
+      ++num_degradations_;
+      hold_ = kQualityHoldBlocks;
+      low_load_blocks_ = 0;
+      return true;
+    }
+    
+    if (load_ < kQualityRecoverLoad && level_ > QUALITY_LEVEL_FULL) {
+      if (++low_load_blocks_ >= recovery_blocks_) {
+        level_ = static_cast<QualityLevel>(level_ - 1);
+        ++num_recoveries_;
+        hold_ = kQualityHoldBlocks;
+        low_load_blocks_ = 0;
+        since_recovery_ = 0;
+        return true;
+      }
+    } else {
+      low_load_blocks_ = 0;
+    }
+    return false;
+  }
+  
+  inline QualityLevel level() const { return level_; }
+  inline float load() const { return load_; }
+  inline uint32_t deadline_misses() const { return deadline_misses_; }
+  inline uint32_t num_degradations() const { return num_degradations_; }
+  inline uint32_t num_recoveries() const { return num_recoveries_; }
+  
+ private:
+  QualityLevel level_;
+  float load_;
+  int32_t hold_;
+  int32_t low_load_blocks_;
+  int32_t since_recovery_;
+  int32_t recovery_blocks_;
+  
+  uint32_t deadline_misses_;
+  uint32_t num_degradations_;
+  uint32_t num_recoveries_;
+  
+  DISALLOW_COPY_AND_ASSIGN(QualityGovernor);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_DSP_QUALITY_GOVERNOR_H_
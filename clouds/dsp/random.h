@@ -0,0 +1,92 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Random number source of the processing chain.
+//
+// On the module, this is the global stmlib generator. In host builds, each
+// thread has its own generator state, so that several processors can run
+// concurrently, each of them reproducibly seeded with Seed().
+
+#ifndef CLOUDS_DSP_RANDOM_H_
+#define CLOUDS_DSP_RANDOM_H_
+
+#include "stmlib/stmlib.h"
+#include "stmlib/utils/random.h"
+
+namespace clouds {
+
+class Random {
+ public:
+#ifdef TEST
+  static inline uint32_t state() {
+    return mutable_state();
+  }
+
+  static inline void Seed(uint32_t seed) {
+    mutable_state() = seed;
+  }
+
+  static inline uint32_t GetWord() {
+    uint32_t& state = mutable_state();
+    state = state * 1664525L + 1013904223L;
+    return state;
+  }
+#else
+  static inline uint32_t state() {
+    return stmlib::Random::state();
+  }
+
+  static inline void Seed(uint32_t seed) {
+    stmlib::Random::Seed(seed);
+  }
+
+  static inline uint32_t GetWord() {
+    return stmlib::Random::GetWord();
+  }
+#endif  // TEST
+
+  static inline int16_t GetSample() {
+    return static_cast<int16_t>(GetWord() >> 16);
+  }
+
+  static inline float GetFloat() {
+    return static_cast<float>(GetWord()) / 4294967296.0f;
+  }
+
+ private:
+#ifdef TEST
+  static inline uint32_t& mutable_state() {
+    static thread_local uint32_t state = 0x21;
+    return state;
+  }
+#endif  // TEST
+
+  DISALLOW_COPY_AND_ASSIGN(Random);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_DSP_RANDOM_H_
@@ -0,0 +1,176 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Offline rendering of many GranularProcessor instances on a pool of threads.
+
+#include "clouds/test/batch_renderer.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "clouds/dsp/random.h"
+
+namespace clouds {
+
+using namespace std;
+
+const size_t kCacheLineSize = 64;
+const size_t kLargeBufferSize = 118784;
+const size_t kSmallBufferSize = 65536 - 128;
+
+static void* AllocateAligned(size_t size) {
+  void* p = NULL;
+  if (posix_memalign(&p, kCacheLineSize, size)) {
+    return NULL;
+  }
+  return p;
+}
+
+static double Now() {
+  return chrono::duration<double>(
+      chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// CPU time of the calling thread - does not count the time during which a
+// worker waits for a core.
+static double ThreadTime() {
+  timespec t;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+void BatchRenderer::Init(
+    size_t num_threads,
+    size_t block_size,
+    float sample_rate) {
+  num_threads_ = num_threads ? num_threads : 1;
+  block_size_ = min(block_size, static_cast<size_t>(kMaxBlockSize));
+  sample_rate_ = sample_rate;
+  jobs_ = NULL;
+  num_jobs_ = 0;
+  next_job_ = 0;
+  memset(&statistics_, 0, sizeof(statistics_));
+}
+
+void BatchRenderer::RenderJob(
+    GranularProcessor* processor,
+    uint8_t* large_buffer,
+    uint8_t* small_buffer,
+    const BatchJob& job) {
+  // Start from exactly the same state, whatever the previous job was.
+  memset(large_buffer, 0, kLargeBufferSize);
+  memset(small_buffer, 0, kSmallBufferSize);
+  memset(static_cast<void*>(processor), 0, sizeof(GranularProcessor));
+  Random::Seed(job.seed);
+  
+  processor->Init(
+      large_buffer, kLargeBufferSize,
+      small_buffer, kSmallBufferSize);
+  processor->set_quality(job.quality);
+  processor->set_playback_mode(job.playback_mode);
+  
+  size_t remaining = job.num_frames;
+  const ShortFrame* input = job.input;
+  ShortFrame* output = job.output;
+  ShortFrame in[kMaxBlockSize];
+  while (remaining) {
+    size_t size = min(remaining, block_size_);
+    // Process() takes a mutable input buffer.
+    copy(&input[0], &input[size], &in[0]);
+    *processor->mutable_parameters() = job.parameters;
+    processor->Prepare();
+    processor->Process(in, output, size);
+    input += size;
+    output += size;
+    remaining -= size;
+  }
+}
+
+void BatchRenderer::Worker(double* busy_seconds) {
+  // Allocated by the worker thread, so that first-touch placement puts the
+  // memory on the node of the core running it.
+  void* processor_memory = AllocateAligned(sizeof(GranularProcessor));
+  uint8_t* large_buffer = static_cast<uint8_t*>(
+      AllocateAligned(kLargeBufferSize));
+  uint8_t* small_buffer = static_cast<uint8_t*>(
+      AllocateAligned(kSmallBufferSize));
+  GranularProcessor* processor = new(processor_memory) GranularProcessor;
+  
+  double busy = 0.0;
+  while (true) {
+    size_t index = next_job_++;
+    if (index >= num_jobs_) {
+      break;
+    }
+    double start = ThreadTime();
+    RenderJob(processor, large_buffer, small_buffer, jobs_[index]);
+    busy += ThreadTime() - start;
+  }
+  *busy_seconds = busy;
+  
+  processor->~GranularProcessor();
+  free(processor_memory);
+  free(large_buffer);
+  free(small_buffer);
+}
+
+void BatchRenderer::Render(BatchJob* jobs, size_t num_jobs) {
+  jobs_ = jobs;
+  num_jobs_ = num_jobs;
+  next_job_ = 0;
+  
+  vector<double> busy_seconds(num_threads_, 0.0);
+  double start = Now();
+  if (num_threads_ == 1) {
+    Worker(&busy_seconds[0]);
+  } else {
+    vector<thread> workers;
+    for (size_t i = 0; i < num_threads_; ++i) {
+      workers.push_back(thread(&BatchRenderer::Worker, this, &busy_seconds[i]));
+    }
+    for (size_t i = 0; i < num_threads_; ++i) {
+      workers[i].join();
+    }
+  }
+  
+  statistics_.num_threads = num_threads_;
+  statistics_.wall_seconds = Now() - start;
+  statistics_.busy_seconds = 0.0;
+  statistics_.audio_seconds = 0.0;
+  for (size_t i = 0; i < num_threads_; ++i) {
+    statistics_.busy_seconds += busy_seconds[i];
+  }
+  for (size_t i = 0; i < num_jobs; ++i) {
+    statistics_.audio_seconds += jobs[i].num_frames / sample_rate_;
+  }
+}
+
+}  // namespace clouds
@@ -0,0 +1,109 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Offline rendering of many GranularProcessor instances on a pool of threads.
+//
+// Each job is rendered from start to end by a single worker, by a processor
+// re-initialized from cleared memory and seeded with the seed of the job -
+// so the output of a job does not depend on the number of threads, or on
+// which worker picked it. Each worker allocates, and first touches, its own
+// cache-line aligned processor and sample memory, which are thus placed on
+// the memory node of the core running it, and reused from one job to the
+// next.
+
+#ifndef CLOUDS_TEST_BATCH_RENDERER_H_
+#define CLOUDS_TEST_BATCH_RENDERER_H_
+
+#include <atomic>
+
+#include "stmlib/stmlib.h"
+
+#include "clouds/dsp/frame.h"
+#include "clouds/dsp/granular_processor.h"
+#include "clouds/dsp/parameters.h"
+
+namespace clouds {
+
+struct BatchJob {
+  uint32_t seed;
+  PlaybackMode playback_mode;
+  int32_t quality;
+  Parameters parameters;
+  
+  const ShortFrame* input;
+  ShortFrame* output;
+  size_t num_frames;
+};
+
+struct BatchStatistics {
+  size_t num_threads;
+  double audio_seconds;
+  double wall_seconds;
+  double busy_seconds;  // Sum of the CPU time of all workers.
+  
+  inline double realtime_ratio() const {
+    return audio_seconds / wall_seconds;
+  }
+  
+  inline double realtime_ratio_per_core() const {
+    return audio_seconds / busy_seconds;
+  }
+};
+
+class BatchRenderer {
+ public:
+  BatchRenderer() { }
+  ~BatchRenderer() { }
+  
+  void Init(size_t num_threads, size_t block_size, float sample_rate);
+  void Render(BatchJob* jobs, size_t num_jobs);
+  
+  inline const BatchStatistics& statistics() const { return statistics_; }
+  
+ private:
+  void Worker(double* busy_seconds);
+  void RenderJob(
+      GranularProcessor* processor,
+      uint8_t* large_buffer,
+      uint8_t* small_buffer,
+      const BatchJob& job);
+  
+  size_t num_threads_;
+  size_t block_size_;
+  float sample_rate_;
+  
+  BatchJob* jobs_;
+  size_t num_jobs_;
+  std::atomic<size_t> next_job_;
+  
+  BatchStatistics statistics_;
+  
+  DISALLOW_COPY_AND_ASSIGN(BatchRenderer);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_TEST_BATCH_RENDERER_H_
@@ -34,6 +34,7 @@
 
 #include "clouds/dsp/granular_processor.h"
 #include "clouds/resources.h"
+#include "clouds/test/batch_renderer.h"
 
 using namespace clouds;
 using namespace std;
@@ -109,7 +110,7 @@ void TestDSP() {
     p->gate = false;
     p->trigger = false;
     p->freeze = true && (block_counter & 2047) > 1024;
-    pot_noise += 0.05f * ((Random::GetSample() / 32768.0f) * 0.00f - pot_noise);
+    pot_noise += 0.05f * ((stmlib::Random::GetSample() / 32768.0f) * 0.00f - pot_noise);
     p->position = triangle * 0.0f + 0.00f;
     p->size = 0.5f;
     p->pitch = -7.0f + (triangle > 0.5f ? 1.0f : 0.0f) * 0.0f;
@@ -223,8 +224,288 @@ void TestGrainSize() {
   }
 }
 
+void TestBatchRenderer() {
+  const size_t kNumJobs = 32;
+  const size_t kNumFrames = kSampleRate * 2;
+  
+  vector<ShortFrame> input(kNumJobs * kNumFrames);
+  vector<ShortFrame> reference(kNumJobs * kNumFrames);
+  vector<ShortFrame> output(kNumJobs * kNumFrames);
+  BatchJob jobs[kNumJobs];
+  
+  for (size_t i = 0; i < kNumJobs; ++i) {
+    float frequency = (110.0f + 20.0f * i) / kSampleRate;
+    for (size_t j = 0; j < kNumFrames; ++j) {
+      ShortFrame* f = &input[i * kNumFrames + j];
+      f->l = f->r = 16384.0f * sinf(2.0f * M_PI * frequency * j);
+    }
+    BatchJob* job = &jobs[i];
+    job->seed = i * 0x9e3779b9;
+    job->playback_mode = PlaybackMode(i % PLAYBACK_MODE_LAST);
+    job->quality = (i / PLAYBACK_MODE_LAST) % 4;
+    memset(&job->parameters, 0, sizeof(Parameters));
+    job->parameters.position = 0.3f;
+    job->parameters.size = 0.5f;
+    job->parameters.pitch = 0.0f;
+    job->parameters.density = 0.7f;
+    job->parameters.texture = 0.5f;
+    job->parameters.dry_wet = 1.0f;
+    job->parameters.stereo_spread = 0.5f;
+    job->parameters.feedback = 0.2f;
+    job->parameters.reverb = 0.2f;
+    job->input = &input[i * kNumFrames];
+    job->num_frames = kNumFrames;
+  }
+  
+  size_t num_threads[] = { 1, 2, 4, 8 };
+  for (size_t i = 0; i < sizeof(num_threads) / sizeof(size_t); ++i) {
+    vector<ShortFrame>& destination = i == 0 ? reference : output;
+    for (size_t j = 0; j < kNumJobs; ++j) {
+      jobs[j].output = &destination[j * kNumFrames];
+    }
+    
+    BatchRenderer renderer;
+    renderer.Init(num_threads[i], kBlockSize, kSampleRate);
+    renderer.Render(jobs, kNumJobs);
+    
+    const BatchStatistics& s = renderer.statistics();
+    bool identical = i == 0 || !memcmp(
+        &reference[0], &output[0], reference.size() * sizeof(ShortFrame));
+    printf(
+        "%zu threads: %.1fx realtime, %.1fx realtime per core, %s\n",
+        s.num_threads,
+        s.realtime_ratio(),
+        s.realtime_ratio_per_core(),
+        identical ? "identical" : "MISMATCH");
+    assert(identical);
+  }
+}
+
+uint32_t fake_time = 0;
+uint32_t fake_block_cost = 0;
+bool fake_time_rendering = false;
+
+uint32_t FakeTimeSource() {
+  // Process() reads the time before and after rendering the block.
+  if (fake_time_rendering) {
+    fake_time += fake_block_cost;
+  }
+  fake_time_rendering = !fake_time_rendering;
+  return fake_time;
+}
+
+// Layout of the buffers in use, as it would be saved.
+int32_t SavedQuality(GranularProcessor* processor, size_t* num_blocks) {
+  PersistentBlock blocks[4];
+  processor->PreparePersistentData();
+  processor->GetPersistentData(blocks, num_blocks);
+  return static_cast<const PersistentState*>(blocks[0].data)->quality;
+}
+
+// Runs one block with a simulated rendering time of load * block duration.
+void ProcessWithLoad(GranularProcessor* processor, float load) {
+  ShortFrame input[kBlockSize];
+  ShortFrame output[kBlockSize];
+  for (size_t j = 0; j < kBlockSize; ++j) {
+    input[j].l = input[j].r = (j * 1024) & 0x7fff;
+  }
+  fake_block_cost = static_cast<uint32_t>(load * kBlockSize);
+  processor->Prepare();
+  processor->Process(input, output, kBlockSize);
+}
+
+void TestAdaptiveQuality() {
+  static uint8_t large_buffer[118784];
+  static uint8_t small_buffer[65536 - 128];
+  
+  GranularProcessor processor;
+  processor.Init(
+      &large_buffer[0], sizeof(large_buffer),
+      &small_buffer[0], sizeof(small_buffer));
+  processor.set_quality(0);
+  processor.set_playback_mode(PLAYBACK_MODE_GRANULAR);
+  // 1 tick per sample: a block costs its duration at a load of 1.
+  processor.set_adaptive_quality(&FakeTimeSource, kSampleRate);
+  
+  Parameters* p = processor.mutable_parameters();
+  memset(p, 0, sizeof(Parameters));
+  p->density = 0.9f;
+  p->size = 0.5f;
+  p->texture = 0.5f;
+  p->dry_wet = 1.0f;
+  
+  // Simulated CPU load at each quality level. Heavy: only mono is sustainable.
+  // Medium: only full quality is too expensive, which makes the governor
+  // oscillate between the first two levels, each time recovering later.
+  const float heavy_load[] = { 1.2f, 1.05f, 0.95f, 0.9f, 0.6f };
+  const float idle_load[] = { 0.2f, 0.2f, 0.2f, 0.2f, 0.2f };
+  const float medium_load[] = { 0.9f, 0.4f, 0.4f, 0.4f, 0.4f };
+  const float* loads[] = { heavy_load, idle_load, medium_load };
+  const size_t kBlocksPerSecond = kSampleRate / kBlockSize;
+  const size_t phase_end[] = {
+      10 * kBlocksPerSecond, 30 * kBlocksPerSecond, 60 * kBlocksPerSecond };
+  
+  const QualityGovernor& governor = processor.quality_governor();
+  QualityLevel previous_level = processor.quality_level();
+  assert(previous_level == QUALITY_LEVEL_FULL);
+  
+  size_t phase = 0;
+  size_t degradation_block = 0;
+  vector<size_t> recovery_delays;
+  bool seen_low_fidelity = false;
+  bool seen_mono = false;
+  for (size_t i = 0; i < phase_end[2]; ++i) {
+    if (i == phase_end[phase]) {
+      ++phase;
+    }
+    ProcessWithLoad(&processor, loads[phase][processor.quality_level()]);
+    
+    QualityLevel level = processor.quality_level();
+    if (level == previous_level) {
+      continue;
+    }
+    printf("%6.2fs: quality level %d\n", i / float(kBlocksPerSecond), level);
+    
+    // One level at a time, down while busy, up while idle.
+    if (phase == 1) {
+      assert(level == previous_level - 1);
+    } else if (phase == 0) {
+      assert(level == previous_level + 1);
+    } else {
+      assert(level <= QUALITY_LEVEL_HALF_GRAINS);
+      if (level > previous_level) {
+        degradation_block = i;
+      } else {
+        recovery_delays.push_back(i - degradation_block);
+      }
+    }
+    previous_level = level;
+    
+    // The layout of the buffers follows the quality level, while the quality
+    // requested by the user is left untouched.
+    size_t num_blocks;
+    int32_t saved_quality = SavedQuality(&processor, &num_blocks);
+    if (level == QUALITY_LEVEL_LOW_FIDELITY) {
+      assert(saved_quality == 2 && num_blocks == 3);
+      seen_low_fidelity = true;
+    } else if (level == QUALITY_LEVEL_MONO) {
+      assert(saved_quality == 3 && num_blocks == 2);
+      seen_mono = true;
+    } else {
+      assert(saved_quality == 0 && num_blocks == 3);
+    }
+    assert(processor.quality() == 0);
+  }
+  
+  printf(
+      "%u deadline misses, %u degradations, %u recoveries\n",
+      governor.deadline_misses(),
+      governor.num_degradations(),
+      governor.num_recoveries());
+  assert(seen_low_fidelity && seen_mono);
+  assert(governor.deadline_misses() > 0);
+  
+  // Busy, then idle: 4 degradations and 4 recoveries. Then, the recovery
+  // delay doubles each time the medium load forces a new degradation.
+  size_t n = recovery_delays.size();
+  assert(governor.num_degradations() == 4 + n + (previous_level ? 1 : 0));
+  assert(governor.num_recoveries() == 4 + n);
+  assert(n >= 3);
+  for (size_t i = 0; i < n; ++i) {
+    printf("Recovery after %zu blocks\n", recovery_delays[i]);
+    if (i == 0) {
+      continue;
+    }
+    assert(recovery_delays[i] <= 2 * recovery_delays[i - 1]);
+    assert(recovery_delays[i] + 2 * kQualityHoldBlocks >= \
+        2 * recovery_delays[i - 1]);
+  }
+}
+
+void TestLoadPersistentData(bool adaptive) {
+  static uint8_t large_buffer[2][118784];
+  static uint8_t small_buffer[2][65536 - 128];
+  
+  GranularProcessor source;
+  GranularProcessor destination;
+  source.Init(
+      &large_buffer[0][0], sizeof(large_buffer[0]),
+      &small_buffer[0][0], sizeof(small_buffer[0]));
+  destination.Init(
+      &large_buffer[1][0], sizeof(large_buffer[1]),
+      &small_buffer[1][0], sizeof(small_buffer[1]));
+  
+  // Record a few seconds in stereo, at full quality.
+  source.set_quality(0);
+  source.set_playback_mode(PLAYBACK_MODE_GRANULAR);
+  memset(source.mutable_parameters(), 0, sizeof(Parameters));
+  for (size_t i = 0; i < 2 * kSampleRate / kBlockSize; ++i) {
+    ShortFrame input[kBlockSize];
+    ShortFrame output[kBlockSize];
+    for (size_t j = 0; j < kBlockSize; ++j) {
+      input[j].l = (i * kBlockSize + j) * 37;
+      input[j].r = (i * kBlockSize + j) * 91;
+    }
+    source.Prepare();
+    source.Process(input, output, kBlockSize);
+  }
+  
+  // Serialize it as the firmware does.
+  PersistentBlock blocks[4];
+  size_t num_blocks;
+  source.PreparePersistentData();
+  source.GetPersistentData(blocks, &num_blocks);
+  assert(num_blocks == 3);
+  vector<uint32_t> data;
+  for (size_t i = 0; i < num_blocks; ++i) {
+    data.push_back(blocks[i].tag);
+    data.push_back(blocks[i].size);
+    const uint32_t* words = static_cast<const uint32_t*>(blocks[i].data);
+    data.insert(data.end(), words, words + blocks[i].size / sizeof(uint32_t));
+  }
+  
+  destination.set_playback_mode(PLAYBACK_MODE_GRANULAR);
+  memset(destination.mutable_parameters(), 0, sizeof(Parameters));
+  if (adaptive) {
+    // Load it while the governor has switched to mono, 8-bit buffers.
+    destination.set_quality(0);
+    destination.set_adaptive_quality(&FakeTimeSource, kSampleRate);
+    while (destination.quality_level() != QUALITY_LEVEL_MONO) {
+      ProcessWithLoad(&destination, 1.5f);
+    }
+  } else {
+    // Load it while mono, 8-bit buffers are requested: as before the
+    // governor, the quality setting follows the loaded data.
+    destination.set_quality(3);
+  }
+  assert(destination.LoadPersistentData(&data[0]));
+  
+  // The buffers are back in the saved layout, with the saved contents.
+  assert(destination.quality() == 0);
+  assert(destination.quality_level() == (adaptive
+      ? QUALITY_LEVEL_MONO
+      : QUALITY_LEVEL_FULL));
+  assert(SavedQuality(&destination, &num_blocks) == 0);
+  assert(num_blocks == 3);
+  destination.GetPersistentData(blocks, &num_blocks);
+  const uint32_t* saved = &data[0];
+  for (size_t i = 0; i < num_blocks; ++i) {
+    assert(blocks[i].tag == saved[0] && blocks[i].size == saved[1]);
+    if (i > 0) {
+      assert(!memcmp(blocks[i].data, &saved[2], blocks[i].size));
+    }
+    saved += 2 + blocks[i].size / sizeof(uint32_t);
+  }
+  printf("Persistent data loaded in the saved layout (%s)\n",
+         adaptive ? "adaptive quality" : "fixed quality");
+}
+
 int main(void) {
   _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
   TestDSP();
+  TestBatchRenderer();
+  TestAdaptiveQuality();
+  TestLoadPersistentData(false);
+  TestLoadPersistentData(true);
   // TestGrainSize();
 }
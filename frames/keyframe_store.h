@@ -0,0 +1,299 @@
+// Copyright 2013 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Keyframe store for long automation lanes, evaluated on a host. Same model
+// and same interpolation as the Keyframer - each keyframe stores a value for
+// all channels - but with any number of keyframes and channels, and 32-bit
+// timestamps.
+//
+// Keyframes are kept sorted, and found by binary search. Readers playing the
+// lanes back keep a KeyframeCursor, which caches the interval they are in:
+// for monotonic playback, finding the keyframes around the next timestamp
+// costs one or two comparisons. Values are stored keyframe after keyframe, so
+// interpolating all channels reads two contiguous rows, in a loop without
+// branches.
+//
+// The store is large for many keyframes and channels - allocate it on the
+// heap.
+
+#ifndef FRAMES_KEYFRAME_STORE_H_
+#define FRAMES_KEYFRAME_STORE_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+
+#include "frames/keyframer.h"
+
+namespace frames {
+
+const size_t kNumEasingCurves = EASING_CURVE_BOUNCE + 1;
+
+struct KeyframeCursor {
+  KeyframeCursor() : position(0) { }
+  
+  // Index of the first keyframe at or after the last timestamp, as
+  // returned by KeyframeStore::Find().
+  size_t position;
+};
+
+template<size_t max_num_keyframes, size_t num_channels>
+class KeyframeStore {
+ public:
+  KeyframeStore() { }
+  ~KeyframeStore() { }
+  
+  void Init() {
+    num_keyframes_ = 0;
+    id_counter_ = 0;
+    std::fill(&easing_curve_[0], &easing_curve_[num_channels],
+              EASING_CURVE_LINEAR);
+    std::fill(&response_[0], &response_[num_channels], 0);
+  }
+  
+  // Index of the first keyframe with a timestamp greater or equal to
+  // timestamp.
+  inline size_t Find(uint32_t timestamp) const {
+    return std::lower_bound(
+        &timestamp_[0],
+        &timestamp_[num_keyframes_],
+        timestamp) - &timestamp_[0];
+  }
+  
+  // Same as Find(), starting from the position of the cursor.
+  inline size_t Seek(uint32_t timestamp, KeyframeCursor* cursor) const {
+    size_t p = cursor->position;
+    if (p <= num_keyframes_ && IsPosition(timestamp, p)) {
+      return p;
+    } else if (p < num_keyframes_ && IsPosition(timestamp, p + 1)) {
+      cursor->position = p + 1;
+      return p + 1;
+    }
+    cursor->position = Find(timestamp);
+    return cursor->position;
+  }
+  
+  bool AddKeyframe(uint32_t timestamp, const uint16_t* values) {
+    size_t p = Find(timestamp);
+    if (p >= num_keyframes_ || timestamp_[p] != timestamp) {
+      if (num_keyframes_ == max_num_keyframes) {
+        return false;
+      }
+      std::copy_backward(
+          &timestamp_[p],
+          &timestamp_[num_keyframes_],
+          &timestamp_[num_keyframes_ + 1]);
+      std::copy_backward(
+          &id_[p],
+          &id_[num_keyframes_],
+          &id_[num_keyframes_ + 1]);
+      std::copy_backward(
+          row(p),
+          row(num_keyframes_),
+          row(num_keyframes_ + 1));
+      timestamp_[p] = timestamp;
+      id_[p] = id_counter_++;
+      ++num_keyframes_;
+    }
+    std::copy(&values[0], &values[num_channels], row(p));
+    return true;
+  }
+  
+  bool RemoveKeyframe(uint32_t timestamp) {
+    size_t p = Find(timestamp);
+    if (p >= num_keyframes_ || timestamp_[p] != timestamp) {
+      return false;
+    }
+    std::copy(
+        &timestamp_[p + 1],
+        &timestamp_[num_keyframes_],
+        &timestamp_[p]);
+    std::copy(&id_[p + 1], &id_[num_keyframes_], &id_[p]);
+    std::copy(row(p + 1), row(num_keyframes_), row(p));
+    --num_keyframes_;
+    return true;
+  }
+  
+  // Same as Keyframer::FindNearestKeyframe.
+  int32_t FindNearestKeyframe(uint32_t timestamp, uint32_t tolerance) const {
+    size_t p = Find(timestamp);
+    size_t start = p ? p - 1 : 0;
+    size_t end = std::min(p + 2, num_keyframes_);
+    for (size_t i = start; i < end; ++i) {
+      uint32_t distance = timestamp_[i] > timestamp
+          ? timestamp_[i] - timestamp
+          : timestamp - timestamp_[i];
+      if (distance < tolerance) {
+        return i;
+      }
+    }
+    return -1;
+  }
+  
+  // Computes the level of all channels, with the same interpolation as
+  // Keyframer::Evaluate. Returns false if the store is empty.
+  inline bool Evaluate(
+      uint32_t timestamp,
+      KeyframeCursor* cursor,
+      uint16_t* levels) const {
+    if (!num_keyframes_) {
+      return false;
+    }
+    size_t p = Seek(timestamp, cursor);
+    if (p == 0 || p == num_keyframes_) {
+      const uint16_t* source = row(p == 0 ? 0 : num_keyframes_ - 1);
+      std::copy(&source[0], &source[num_channels], &levels[0]);
+      return true;
+    }
+    
+    uint32_t t_a = timestamp_[p - 1];
+    uint32_t t_b = timestamp_[p];
+    uint32_t scale = static_cast<uint32_t>(
+        (static_cast<uint64_t>(timestamp - t_a) << 16) / (t_b - t_a));
+    
+    // The easing curve is applied once per curve rather than once per
+    // channel.
+    int32_t shaped_scale[kNumEasingCurves];
+    for (size_t i = 0; i < kNumEasingCurves; ++i) {
+      shaped_scale[i] = Keyframer::ShapeScale(scale, EasingCurve(i)) >> 1;
+    }
+    int32_t channel_scale[num_channels];
+    for (size_t i = 0; i < num_channels; ++i) {
+      channel_scale[i] = shaped_scale[easing_curve_[i]];
+    }
+    Interpolate(row(p - 1), row(p), channel_scale, levels);
+    return true;
+  }
+  
+  // Converts levels to DAC codes, as Keyframer::Evaluate does.
+  inline void ConvertToDacCodes(const uint16_t* levels, uint16_t* codes) {
+    for (size_t i = 0; i < num_channels; ++i) {
+      codes[i] = Keyframer::ConvertToDacCode(levels[i], response_[i]);
+    }
+  }
+  
+  // Copies the keyframes and settings of a Keyframer - for instance, loaded
+  // from the storage of a module - into the first kNumChannels channels.
+  void Import(const Keyframer& keyframer) {
+    Init();
+    uint16_t values[num_channels];
+    std::fill(&values[0], &values[num_channels], 0);
+    for (size_t i = 0; i < keyframer.num_keyframes(); ++i) {
+      const Keyframe& k = keyframer.keyframe(i);
+      std::copy(&k.values[0], &k.values[kNumKeyframerChannels], &values[0]);
+      AddKeyframe(k.timestamp, values);
+      id_[i] = k.id;
+      id_counter_ = std::max(id_counter_, static_cast<uint16_t>(k.id + 1));
+    }
+    for (size_t i = 0; i < kNumKeyframerChannels; ++i) {
+      const ChannelSettings& s = keyframer.mutable_settings(i);
+      easing_curve_[i] = s.easing_curve;
+      response_[i] = s.response;
+    }
+  }
+  
+  // Writes the first kNumChannels channels to a Keyframer, which can then
+  // save them with its usual storage layout. Fails when there are more
+  // keyframes than the Keyframer can hold, or timestamps above 65535.
+  bool Export(Keyframer* keyframer) const {
+    if (num_keyframes_ > kMaxNumKeyframe ||
+        (num_keyframes_ && timestamp_[num_keyframes_ - 1] > 65535)) {
+      return false;
+    }
+    keyframer->Clear();
+    uint16_t values[kNumChannels];
+    std::fill(&values[0], &values[kNumChannels], 0);
+    for (size_t i = 0; i < num_keyframes_; ++i) {
+      const uint16_t* source = row(i);
+      std::copy(&source[0], &source[kNumKeyframerChannels], &values[0]);
+      keyframer->AddKeyframe(timestamp_[i], values);
+      keyframer->mutable_keyframe(i)->id = id_[i];
+    }
+    for (size_t i = 0; i < kNumKeyframerChannels; ++i) {
+      keyframer->mutable_settings(i)->easing_curve = easing_curve_[i];
+      keyframer->mutable_settings(i)->response = response_[i];
+    }
+    return true;
+  }
+  
+  inline void set_easing_curve(size_t channel, EasingCurve curve) {
+    easing_curve_[channel] = curve;
+  }
+  
+  inline void set_response(size_t channel, uint8_t response) {
+    response_[channel] = response;
+  }
+  
+  inline size_t num_keyframes() const { return num_keyframes_; }
+  inline uint32_t timestamp(size_t i) const { return timestamp_[i]; }
+  inline uint16_t id(size_t i) const { return id_[i]; }
+  inline const uint16_t* values(size_t i) const { return row(i); }
+  
+ private:
+  // Number of channels shared with a Keyframer.
+  static const size_t kNumKeyframerChannels = \
+      num_channels < kNumChannels ? num_channels : kNumChannels;
+  
+  inline uint16_t* row(size_t i) { return &values_[0] + i * num_channels; }
+  inline const uint16_t* row(size_t i) const {
+    return &values_[0] + i * num_channels;
+  }
+  
+  inline bool IsPosition(uint32_t timestamp, size_t p) const {
+    return (p == 0 || timestamp_[p - 1] < timestamp) &&
+        (p == num_keyframes_ || timestamp_[p] >= timestamp);
+  }
+  
+  // Multi-channel interpolation kernel. No branch and no table lookup: the
+  // compiler can vectorize it.
+  static inline void Interpolate(
+      const uint16_t* a,
+      const uint16_t* b,
+      const int32_t* scale,
+      uint16_t* levels) {
+    for (size_t i = 0; i < num_channels; ++i) {
+      int32_t from = a[i];
+      int32_t to = b[i];
+      levels[i] = from + ((to - from) * scale[i] >> 15);
+    }
+  }
+  
+  size_t num_keyframes_;
+  uint16_t id_counter_;
+  
+  uint32_t timestamp_[max_num_keyframes];
+  uint16_t id_[max_num_keyframes];
+  uint16_t values_[max_num_keyframes * num_channels];
+  
+  EasingCurve easing_curve_[num_channels];
+  uint8_t response_[num_channels];
+  
+  DISALLOW_COPY_AND_ASSIGN(KeyframeStore);
+};
+
+}  // namespace frames
+
+#endif  // FRAMES_KEYFRAME_STORE_H_
@@ -57,6 +57,7 @@ stmlib::Storage<0x8020000, 4> storage;
 #endif  // TEST
 
 void Keyframer::Init() {
+  position_ = -1;
 #ifndef TEST
   if (!storage.ParsimoniousLoad(keyframes_, SETTINGS_SIZE, &version_token_)) {
     for (uint8_t i = 0; i < kNumChannels; ++i) {
@@ -107,6 +108,19 @@ uint16_t Keyframer::FindKeyframe(uint16_t timestamp) {
       KeyframeLess()) - keyframes_;
 }
 
+uint16_t Keyframer::FindKeyframe(uint16_t timestamp, int16_t hint) {
+  // When the keyframes are played back, the timestamp is most likely in the
+  // same interval as during the previous call, or in the next one.
+  int16_t last = min(hint + 1, static_cast<int>(num_keyframes_));
+  for (int16_t i = max(hint, static_cast<int16_t>(0)); i <= last; ++i) {
+    if ((i == 0 || keyframes_[i - 1].timestamp < timestamp) &&
+        (i == num_keyframes_ || keyframes_[i].timestamp >= timestamp)) {
+      return i;
+    }
+  }
+  return FindKeyframe(timestamp);
+}
+
 /* static */
 uint16_t Keyframer::ConvertToDacCode(uint16_t gain, uint8_t response) {
   // Exponential response is easy, straight to the 2164.
@@ -122,11 +136,8 @@ uint16_t Keyframer::ConvertToDacCode(uint16_t gain, uint8_t response) {
   return (linear + ((exponential - linear) * balance >> 15)) >> 4;
 }
 
-inline uint16_t Keyframer::Easing(
-    int32_t from,
-    int32_t to,
-    uint32_t scale,
-    EasingCurve curve) {
+/* static */
+int32_t Keyframer::ShapeScale(uint32_t scale, EasingCurve curve) {
   int32_t shaped_scale = scale;
   if (curve == EASING_CURVE_STEP) {
     shaped_scale = scale < 32768 ? 0 : 65535;
@@ -138,6 +149,15 @@ inline uint16_t Keyframer::Easing(
     shaped_scale = scale_a + (((scale_b - scale_a) >> 1) * \
       ((scale << 10) & 0xffff) >> 15);
   }
+  return shaped_scale;
+}
+
+inline uint16_t Keyframer::Easing(
+    int32_t from,
+    int32_t to,
+    uint32_t scale,
+    EasingCurve curve) {
+  int32_t shaped_scale = ShapeScale(scale, curve);
   return from + ((to - from) * (shaped_scale >> 1) >> 15);
 }
 
@@ -218,7 +238,7 @@ void Keyframer::Evaluate(uint16_t timestamp) {
     position_ = -1;
     nearest_keyframe_ = -1;
   } else {
-    uint16_t position = FindKeyframe(timestamp);
+    uint16_t position = FindKeyframe(timestamp, position_);
     position_ = position;
 
     // Check for the areas before the first keyframe, and after the last
@@ -119,6 +119,9 @@ class Keyframer {
   
   uint16_t Easing(int32_t from, int32_t to, uint32_t scale, EasingCurve curve);
   
+  // Shapes an interpolation coefficient (0 to 65535) with an easing curve.
+  static int32_t ShapeScale(uint32_t scale, EasingCurve curve);
+  
   // This creates a sample animation (between 0 to 65535 and back to 0) used
   // for animating the LED when editing the easing curve or response.
   uint16_t SampleAnimation(uint8_t channel, uint16_t tick, bool easing);
@@ -139,6 +142,7 @@ class Keyframer {
   
  private:
   uint16_t FindKeyframe(uint16_t timestamp);
+  uint16_t FindKeyframe(uint16_t timestamp, int16_t hint);
    
   Keyframe keyframes_[kMaxNumKeyframe];
   ChannelSettings settings_[kNumChannels];
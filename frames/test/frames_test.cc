@@ -0,0 +1,205 @@
+// Copyright 2013 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+#include "frames/keyframe_store.h"
+#include "frames/keyframer.h"
+
+using namespace frames;
+
+typedef KeyframeStore<kMaxNumKeyframe, kNumChannels> SmallKeyframeStore;
+
+// Fills a Keyframer and a KeyframeStore with the same random keyframes and
+// settings.
+void RandomizeKeyframes(Keyframer* keyframer, SmallKeyframeStore* store) {
+  keyframer->Init();
+  keyframer->Clear();
+  store->Init();
+  for (size_t i = 0; i < kNumChannels; ++i) {
+    EasingCurve curve = EasingCurve(rand() % kNumEasingCurves);
+    uint8_t response = rand() % 8;
+    keyframer->mutable_settings(i)->easing_curve = curve;
+    keyframer->mutable_settings(i)->response = response;
+    store->set_easing_curve(i, curve);
+    store->set_response(i, response);
+  }
+
+  size_t num_keyframes = rand() % (kMaxNumKeyframe + 8);
+  for (size_t i = 0; i < num_keyframes; ++i) {
+    uint16_t values[kNumChannels];
+    for (size_t j = 0; j < kNumChannels; ++j) {
+      values[j] = rand();
+    }
+    // Sometimes overwrite an existing keyframe.
+    uint16_t timestamp = keyframer->num_keyframes() && !(rand() % 8)
+        ? keyframer->keyframe(rand() % keyframer->num_keyframes()).timestamp
+        : rand();
+    bool added = keyframer->AddKeyframe(timestamp, values);
+    assert(store->AddKeyframe(timestamp, values) == added);
+  }
+
+  if (keyframer->num_keyframes() > 3) {
+    uint16_t timestamp = keyframer->keyframe(2).timestamp;
+    assert(keyframer->RemoveKeyframe(timestamp));
+    assert(store->RemoveKeyframe(timestamp));
+  }
+  assert(!store->RemoveKeyframe(65536));
+}
+
+void TestKeyframeStore() {
+  SmallKeyframeStore* store = new SmallKeyframeStore();
+  SmallKeyframeStore* imported = new SmallKeyframeStore();
+  Keyframer keyframer;
+  Keyframer exported;
+
+  for (int trial = 0; trial < 500; ++trial) {
+    RandomizeKeyframes(&keyframer, store);
+    assert(keyframer.num_keyframes() == store->num_keyframes());
+    for (size_t i = 0; i < store->num_keyframes(); ++i) {
+      const Keyframe& k = keyframer.keyframe(i);
+      assert(k.timestamp == store->timestamp(i));
+      assert(k.id == store->id(i));
+      for (size_t j = 0; j < kNumChannels; ++j) {
+        assert(k.values[j] == store->values(i)[j]);
+      }
+    }
+
+    // Monotonic playback (the cursor follows), random seeks (the cursor
+    // jumps), and the timestamps of the keyframes themselves.
+    KeyframeCursor cursor;
+    for (int i = 0; i < 4000; ++i) {
+      uint16_t timestamp;
+      if (i % 4 == 3) {
+        timestamp = rand();
+      } else if (i % 4 == 2 && store->num_keyframes()) {
+        timestamp = store->timestamp(rand() % store->num_keyframes());
+      } else {
+        timestamp = i * 17;
+      }
+
+      keyframer.Evaluate(timestamp);
+      uint16_t levels[kNumChannels];
+      uint16_t codes[kNumChannels];
+      if (!store->Evaluate(timestamp, &cursor, levels)) {
+        assert(keyframer.num_keyframes() == 0);
+        continue;
+      }
+      store->ConvertToDacCodes(levels, codes);
+      for (size_t j = 0; j < kNumChannels; ++j) {
+        assert(levels[j] == keyframer.level(j));
+        assert(codes[j] == keyframer.dac_code(j));
+      }
+      assert(keyframer.position() == static_cast<int16_t>(
+          store->Find(timestamp)));
+      assert(keyframer.FindNearestKeyframe(timestamp, 500) == \
+          store->FindNearestKeyframe(timestamp, 500));
+    }
+
+    // Round trip through the Keyframer.
+    exported.Init();
+    assert(store->Export(&exported));
+    imported->Import(exported);
+    assert(imported->num_keyframes() == store->num_keyframes());
+    for (size_t i = 0; i < store->num_keyframes(); ++i) {
+      assert(imported->timestamp(i) == store->timestamp(i));
+      assert(imported->id(i) == store->id(i));
+      for (size_t j = 0; j < kNumChannels; ++j) {
+        assert(imported->values(i)[j] == store->values(i)[j]);
+      }
+    }
+  }
+  delete imported;
+  delete store;
+}
+
+void BenchmarkKeyframeStore() {
+  const int kNumFrames = 1000000;
+
+  // Same data in a Keyframer and a KeyframeStore.
+  SmallKeyframeStore* small = new SmallKeyframeStore();
+  Keyframer keyframer;
+  do {
+    RandomizeKeyframes(&keyframer, small);
+  } while (keyframer.num_keyframes() < kMaxNumKeyframe / 2);
+
+  uint32_t sum = 0;
+  clock_t start = clock();
+  for (int i = 0; i < kNumFrames; ++i) {
+    keyframer.Evaluate(i);
+    sum += keyframer.level(i & 3);
+  }
+  float keyframer_time = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+
+  uint16_t levels[256];
+  KeyframeCursor cursor;
+  start = clock();
+  for (int i = 0; i < kNumFrames; ++i) {
+    small->Evaluate(i & 0xffff, &cursor, levels);
+    sum += levels[i & 3];
+  }
+  float store_time = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+  printf("%d keyframes x %d channels: Keyframer %.1f Mframes/s, "
+         "KeyframeStore %.1f Mframes/s\n",
+         keyframer.num_keyframes(), kNumChannels,
+         kNumFrames / keyframer_time * 1e-6,
+         kNumFrames / store_time * 1e-6);
+  delete small;
+
+  // Long automation lanes.
+  typedef KeyframeStore<4096, 256> LargeKeyframeStore;
+  LargeKeyframeStore* large = new LargeKeyframeStore();
+  large->Init();
+  for (size_t i = 0; i < 256; ++i) {
+    large->set_easing_curve(i, EasingCurve(i % kNumEasingCurves));
+  }
+  uint16_t values[256];
+  for (uint32_t i = 0; i < 4096; ++i) {
+    for (size_t j = 0; j < 256; ++j) {
+      values[j] = rand();
+    }
+    large->AddKeyframe(i * 1000 + rand() % 500, values);
+  }
+
+  cursor.position = 0;
+  start = clock();
+  for (int i = 0; i < kNumFrames; ++i) {
+    large->Evaluate(i * 4, &cursor, levels);
+    sum += levels[i & 255];
+  }
+  float cursor_time = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+
+  start = clock();
+  for (int i = 0; i < kNumFrames; ++i) {
+    KeyframeCursor no_cursor;
+    large->Evaluate(i * 4, &no_cursor, levels);
+    sum += levels[i & 255];
+  }
+  float search_time = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+  printf("4096 keyframes x 256 channels: %.2f Mframes/s with a cursor, "
+         "%.2f Mframes/s with a binary search (%u)\n",
+         kNumFrames / cursor_time * 1e-6,
+         kNumFrames / search_time * 1e-6,
+         sum);
+  delete large;
+}
+
+int main(void) {
+  TestKeyframeStore();
+  BenchmarkKeyframeStore();
+}
@@ -227,17 +227,18 @@ class PatternGenerator {
     return result;
   }
   
- private:
-  static void LoadSettings();
-  static void Evaluate();
-  static void EvaluateEuclidean();
-  static void EvaluateDrums();
-  
+  // Level of an instrument on a step, interpolated from the drum map.
   static uint8_t ReadDrumMap(
       uint8_t step,
       uint8_t instrument,
       uint8_t x,
       uint8_t y);
+  
+ private:
+  static void LoadSettings();
+  static void Evaluate();
+  static void EvaluateEuclidean();
+  static void EvaluateDrums();
 
   static Options options_;
   
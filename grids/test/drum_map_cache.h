@@ -0,0 +1,92 @@
+// Copyright 2011 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -----------------------------------------------------------------------------
+//
+// Levels of all parts over all the steps of the pattern, for one position on
+// the drum map. Each step is interpolated from the map the first time it is
+// read, and the whole table is invalidated when the position changes - so
+// that with static X/Y settings, the map is read only once.
+//
+// Used by the host tools. The module itself reads the map on each step: the
+// interpolation only takes a few hundred cycles per step, and the table would
+// use 5% of the RAM.
+
+#ifndef GRIDS_TEST_DRUM_MAP_CACHE_H_
+#define GRIDS_TEST_DRUM_MAP_CACHE_H_
+
+#include <string.h>
+
+#include "avrlib/base.h"
+
+#include "grids/pattern_generator.h"
+
+namespace grids {
+
+class DrumMapCache {
+ public:
+  DrumMapCache() { }
+  ~DrumMapCache() { }
+
+  inline void Init() {
+    x_ = 0;
+    y_ = 0;
+    memset(valid_, 0, sizeof(valid_));
+  }
+
+  inline void set_position(uint8_t x, uint8_t y) {
+    if (x != x_ || y != y_) {
+      x_ = x;
+      y_ = y;
+      memset(valid_, 0, sizeof(valid_));
+    }
+  }
+
+  // Returns the kNumParts levels of a step.
+  inline const uint8_t* levels(uint8_t step) {
+    uint8_t mask = 1 << (step & 7);
+    if (!(valid_[step >> 3] & mask)) {
+      Fill(step);
+      valid_[step >> 3] |= mask;
+    }
+    return levels_[step];
+  }
+
+  // Fills the whole table at once.
+  void FillAll() {
+    for (uint8_t step = 0; step < kStepsPerPattern; ++step) {
+      Fill(step);
+    }
+    memset(valid_, 0xff, sizeof(valid_));
+  }
+
+ private:
+  void Fill(uint8_t step) {
+    for (uint8_t i = 0; i < kNumParts; ++i) {
+      levels_[step][i] = PatternGenerator::ReadDrumMap(step, i, x_, y_);
+    }
+  }
+
+  uint8_t x_;
+  uint8_t y_;
+  uint8_t valid_[kStepsPerPattern / 8];
+  uint8_t levels_[kStepsPerPattern][kNumParts];
+
+  DISALLOW_COPY_AND_ASSIGN(DrumMapCache);
+};
+
+}  // namespace grids
+
+#endif // GRIDS_TEST_DRUM_MAP_CACHE_H_
@@ -0,0 +1,240 @@
+// Copyright 2011 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include "grids/pattern_generator.h"
+#include "grids/test/drum_map_cache.h"
+#include "grids/test/pattern_engine.h"
+#include "grids/test/pattern_browser.h"
+
+using namespace grids;
+using namespace std;
+
+void TestDrumMapCache() {
+  DrumMapCache cache;
+  cache.Init();
+  
+  // Walk the map in small and large jumps, reading the steps in a shuffled
+  // order so that some of them are still cached from a previous position.
+  srand(0);
+  uint32_t mismatches = 0;
+  for (int32_t n = 0; n < 20000; ++n) {
+    uint8_t x = rand() & 0xff;
+    uint8_t y = rand() & 0xff;
+    if (n & 1) {
+      x = rand() & 1 ? 0 : 255;
+    }
+    cache.set_position(x, y);
+    for (uint8_t i = 0; i < kStepsPerPattern; ++i) {
+      uint8_t step = (i * 13 + n) % kStepsPerPattern;
+      const uint8_t* levels = cache.levels(step);
+      for (uint8_t part = 0; part < kNumParts; ++part) {
+        if (levels[part] != PatternGenerator::ReadDrumMap(step, part, x, y)) {
+          ++mismatches;
+        }
+      }
+    }
+  }
+  printf("Drum map cache: %d mismatches\n", mismatches);
+  assert(mismatches == 0);
+}
+
+void TestPatternBrowser() {
+  const uint32_t kNumQueries = 32 * 32 * 16;
+  vector<PatternQuery> queries(kNumQueries);
+  vector<PatternBits> bits(kNumQueries);
+  
+  // Sorted by position, as recommended.
+  uint32_t n = 0;
+  for (uint32_t x = 0; x < 256; x += 8) {
+    for (uint32_t y = 0; y < 256; y += 8) {
+      for (uint32_t d = 0; d < 16; ++d) {
+        queries[n].x = x;
+        queries[n].y = y;
+        for (uint8_t part = 0; part < kNumParts; ++part) {
+          queries[n].density[part] = (d * 17 + part * 85) & 0xff;
+        }
+        ++n;
+      }
+    }
+  }
+  
+  PatternBrowser browser;
+  browser.Init();
+  clock_t start = clock();
+  browser.Evaluate(&queries[0], &bits[0], kNumQueries);
+  clock_t end = clock();
+  printf(
+      "Pattern browser: %.0f patterns/s\n",
+      kNumQueries / (static_cast<double>(end - start) / CLOCKS_PER_SEC));
+  
+  uint32_t mismatches = 0;
+  for (n = 0; n < kNumQueries; ++n) {
+    const PatternQuery& q = queries[n];
+    for (uint8_t part = 0; part < kNumParts; ++part) {
+      uint32_t trigger = 0;
+      uint32_t accent = 0;
+      uint8_t threshold = ~q.density[part];
+      for (uint8_t step = 0; step < kStepsPerPattern; ++step) {
+        uint8_t level = PatternGenerator::ReadDrumMap(step, part, q.x, q.y);
+        if (level > threshold) {
+          trigger |= 1UL << step;
+          if (level > 192) {
+            accent |= 1UL << step;
+          }
+        }
+      }
+      if (bits[n].trigger[part] != trigger || bits[n].accent[part] != accent) {
+        ++mismatches;
+      }
+    }
+  }
+  printf("Pattern browser: %d mismatches\n", mismatches);
+  assert(mismatches == 0);
+}
+
+void TestPatternEngine() {
+  // 120 BPM at 8kHz: 500 samples per step.
+  const uint32_t kStepDuration = 500;
+  const uint32_t kPatternDuration = kStepDuration * kStepsPerPattern;
+  
+  PatternEngine<kNumParts> engine;
+  engine.Init(8000.0f, 1);
+  engine.set_tempo(120.0f);
+  
+  PatternGenerator::Init();
+  PatternGenerator::set_output_clock(0);
+  PatternGeneratorSettings* settings = PatternGenerator::mutable_settings();
+  
+  srand(0);
+  uint32_t mismatches = 0;
+  uint32_t num_triggers = 0;
+  PatternEvent events[4 * kNumParts * kStepsPerPattern];
+  for (int32_t pattern = 0; pattern < 2000; ++pattern) {
+    OutputMode mode = pattern & 1 ? OUTPUT_MODE_EUCLIDEAN : OUTPUT_MODE_DRUMS;
+    PatternGenerator::set_output_mode(mode);
+    engine.set_output_mode(mode);
+    
+    // The module's settings are shared by all parts: a single X/Y position
+    // in drums mode, the euclidean lengths (stored in the same union) in
+    // euclidean mode.
+    uint8_t x = rand() & 0xff;
+    uint8_t y = rand() & 0xff;
+    for (uint8_t i = 0; i < kNumParts; ++i) {
+      uint8_t density = rand() & 0xff;
+      uint8_t length = rand() & 0xff;
+      settings->density[i] = density;
+      if (mode == OUTPUT_MODE_DRUMS) {
+        settings->options.drums.x = x;
+        settings->options.drums.y = y;
+        settings->options.drums.randomness = 0;
+      } else {
+        settings->options.euclidean_length[i] = length;
+      }
+      PartSettings* part = engine.mutable_part_settings(i);
+      part->x = x;
+      part->y = y;
+      part->instrument = i;
+      part->density = density;
+      part->randomness = 0;
+      part->euclidean_length = length;
+    }
+    
+    uint8_t expected[kStepsPerPattern];
+    for (uint8_t step = 0; step < kStepsPerPattern; ++step) {
+      PatternGenerator::TickClock(kPulsesPerStep);
+      expected[step] = PatternGenerator::state();
+      if (mode == OUTPUT_MODE_EUCLIDEAN) {
+        // Bits 3-5 are the reset outputs, which the engine does not render.
+        expected[step] &= 0x07;
+      }
+    }
+    
+    uint8_t rendered[kStepsPerPattern];
+    memset(rendered, 0, sizeof(rendered));
+    size_t num_events = engine.Render(
+        events, sizeof(events) / sizeof(events[0]), kPatternDuration);
+    for (size_t i = 0; i < num_events; ++i) {
+      const PatternEvent& e = events[i];
+      if (e.type == PATTERN_EVENT_GATE_ON) {
+        assert(e.offset % kStepDuration == 0);
+        uint8_t step = e.offset / kStepDuration;
+        rendered[step] |= 1 << e.part;
+        if (e.accent) {
+          rendered[step] |= 8 << e.part;
+        }
+        ++num_triggers;
+      }
+    }
+    for (uint8_t step = 0; step < kStepsPerPattern; ++step) {
+      // Triggers in bits 0-2, accents in bits 3-5. The clock and random bits
+      // are not rendered by the engine.
+      if ((expected[step] & 0x3f) != rendered[step]) {
+        ++mismatches;
+      }
+    }
+  }
+  printf("Pattern engine: %d triggers, %d mismatches\n",
+         num_triggers, mismatches);
+  assert(engine.dropped_events() == 0);
+  assert(num_triggers > 0);
+  assert(mismatches == 0);
+}
+
+void TestPatternEngineSwing() {
+  const uint32_t kStepDuration = 500;
+  const uint32_t kPatternDuration = kStepDuration * kStepsPerPattern;
+  
+  PatternEngine<kNumParts> engine;
+  engine.Init(8000.0f, 1);
+  engine.set_tempo(120.0f);
+  engine.set_swing(0.2f);
+  for (uint8_t i = 0; i < kNumParts; ++i) {
+    engine.mutable_part_settings(i)->density = 255;
+  }
+  
+  // As on the module, the euclidean patterns are not swung.
+  PatternEvent events[4 * kNumParts * kStepsPerPattern];
+  uint32_t swung[2] = { 0, 0 };
+  for (int mode = 0; mode < 2; ++mode) {
+    engine.set_output_mode(mode ? OUTPUT_MODE_DRUMS : OUTPUT_MODE_EUCLIDEAN);
+    engine.Reset();
+    size_t num_events = engine.Render(
+        events, sizeof(events) / sizeof(events[0]), kPatternDuration);
+    for (size_t i = 0; i < num_events; ++i) {
+      if (events[i].type == PATTERN_EVENT_GATE_ON && \
+          events[i].offset % kStepDuration) {
+        ++swung[mode];
+      }
+    }
+  }
+  printf("Pattern engine swing: %d euclidean, %d drums triggers off the grid\n",
+         swung[0], swung[1]);
+  assert(swung[0] == 0);
+  assert(swung[1] > 0);
+}
+
+int main(void) {
+  TestDrumMapCache();
+  TestPatternBrowser();
+  TestPatternEngine();
+  TestPatternEngineSwing();
+}
@@ -0,0 +1,46 @@
+// Copyright 2011 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -----------------------------------------------------------------------------
+//
+// Host replacement for <avr/eeprom.h>, backed by a blank (0xff) array.
+
+#ifndef GRIDS_TEST_HOST_AVR_EEPROM_H_
+#define GRIDS_TEST_HOST_AVR_EEPROM_H_
+
+#include <inttypes.h>
+#include <string.h>
+
+const uint16_t kHostEepromSize = 1024;
+
+inline uint8_t* host_eeprom() {
+  static uint8_t data[kHostEepromSize];
+  static bool erased = false;
+  if (!erased) {
+    memset(data, 0xff, kHostEepromSize);
+    erased = true;
+  }
+  return data;
+}
+
+inline uint8_t eeprom_read_byte(const uint8_t* address) {
+  return host_eeprom()[reinterpret_cast<uintptr_t>(address)];
+}
+
+inline void eeprom_write_byte(uint8_t* address, uint8_t value) {
+  host_eeprom()[reinterpret_cast<uintptr_t>(address)] = value;
+}
+
+#endif  // GRIDS_TEST_HOST_AVR_EEPROM_H_
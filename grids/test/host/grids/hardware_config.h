@@ -0,0 +1,44 @@
+// Copyright 2011 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -----------------------------------------------------------------------------
+//
+// Host replacement for grids/hardware_config.h: only the pin assignments
+// used by the pattern generator, without the AVR peripherals.
+
+#ifndef GRIDS_HARDWARE_CONFIG_H_
+#define GRIDS_HARDWARE_CONFIG_H_
+
+#include "avrlib/base.h"
+
+namespace grids {
+
+enum LedBits {
+  LED_CLOCK = 1,
+  LED_BD = 8,
+  LED_SD = 4,
+  LED_HH = 2,
+  LED_ALL = LED_CLOCK | LED_BD | LED_SD | LED_HH
+};
+
+enum InputBits {
+  INPUT_CLOCK = 2,
+  INPUT_RESET = 4,
+  INPUT_SW_RESET = 8
+};
+
+}  // namespace grids
+
+#endif  // GRIDS_HARDWARE_CONFIG_H_
@@ -0,0 +1,58 @@
+// Copyright 2011 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -----------------------------------------------------------------------------
+//
+// Batch evaluation of drum patterns, for pattern browsing tools.
+
+#include "grids/test/pattern_browser.h"
+
+namespace grids {
+
+void PatternBrowser::Evaluate(const PatternQuery& query, PatternBits* bits) {
+  cache_.set_position(query.x, query.y);
+  
+  uint8_t threshold[kNumParts];
+  for (uint8_t i = 0; i < kNumParts; ++i) {
+    threshold[i] = ~query.density[i];
+    bits->trigger[i] = 0;
+    bits->accent[i] = 0;
+  }
+  
+  uint32_t step_mask = 1;
+  for (uint8_t step = 0; step < kStepsPerPattern; ++step) {
+    const uint8_t* levels = cache_.levels(step);
+    for (uint8_t i = 0; i < kNumParts; ++i) {
+      if (levels[i] > threshold[i]) {
+        bits->trigger[i] |= step_mask;
+        if (levels[i] > 192) {
+          bits->accent[i] |= step_mask;
+        }
+      }
+    }
+    step_mask <<= 1;
+  }
+}
+
+void PatternBrowser::Evaluate(
+    const PatternQuery* queries,
+    PatternBits* bits,
+    uint32_t size) {
+  while (size--) {
+    Evaluate(*queries++, bits++);
+  }
+}
+
+}  // namespace grids
@@ -0,0 +1,68 @@
+// Copyright 2011 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -----------------------------------------------------------------------------
+//
+// Batch evaluation of drum patterns, for pattern browsing tools.
+//
+// Each query is a position on the drum map and a density for each part. The
+// result is the 32-step trigger and accent masks that the module would play
+// with the randomness knob at zero. Queries at the same position share the
+// same interpolated level table, so sorting the queries by position makes
+// the interpolation cost negligible.
+
+#ifndef GRIDS_TEST_PATTERN_BROWSER_H_
+#define GRIDS_TEST_PATTERN_BROWSER_H_
+
+#include "avrlib/base.h"
+
+#include "grids/pattern_generator.h"
+#include "grids/test/drum_map_cache.h"
+
+namespace grids {
+
+struct PatternQuery {
+  uint8_t x;
+  uint8_t y;
+  uint8_t density[kNumParts];
+};
+
+struct PatternBits {
+  // Bit n is set when the part is triggered (resp. accented) on step n.
+  uint32_t trigger[kNumParts];
+  uint32_t accent[kNumParts];
+};
+
+class PatternBrowser {
+ public:
+  PatternBrowser() { }
+  ~PatternBrowser() { }
+  
+  void Init() {
+    cache_.Init();
+  }
+  
+  void Evaluate(const PatternQuery& query, PatternBits* bits);
+  void Evaluate(const PatternQuery* queries, PatternBits* bits, uint32_t size);
+
+ private:
+  DrumMapCache cache_;
+  
+  DISALLOW_COPY_AND_ASSIGN(PatternBrowser);
+};
+
+}  // namespace grids
+
+#endif // GRIDS_TEST_PATTERN_BROWSER_H_
@@ -0,0 +1,296 @@
+// Copyright 2011 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -----------------------------------------------------------------------------
+//
+// Reentrant pattern generator, for offline rendering on the host.
+//
+// Same drum map and euclidean behaviour as PatternGenerator, but all the
+// state is held by the instance, the number of parts is a template parameter,
+// and the clock is a sample counter at an arbitrary tempo and sample rate.
+// Render() outputs a sample-accurate stream of gate on/off events, which
+// translates directly into MIDI note on/off messages.
+//
+// In drums mode, each part reads one instrument of the map (BD, SD or HH) at
+// its own X/Y position. The pattern length is fixed by the map data (32
+// steps of a 32nd note); euclidean lengths are limited to 32 by the table.
+
+#ifndef GRIDS_TEST_PATTERN_ENGINE_H_
+#define GRIDS_TEST_PATTERN_ENGINE_H_
+
+#include "avrlib/base.h"
+#include "avrlib/op.h"
+
+#include "grids/pattern_generator.h"
+#include "grids/resources.h"
+#include "grids/test/drum_map_cache.h"
+
+namespace grids {
+
+struct PartSettings {
+  uint8_t x;
+  uint8_t y;
+  uint8_t instrument;  // Map instrument read in drums mode: 0, 1 or 2.
+  uint8_t density;
+  uint8_t randomness;
+  uint8_t euclidean_length;  // Same scale as the panel knob.
+};
+
+enum PatternEventType {
+  PATTERN_EVENT_GATE_OFF,
+  PATTERN_EVENT_GATE_ON
+};
+
+struct PatternEvent {
+  uint32_t offset;  // In samples, from the beginning of the rendered block.
+  uint8_t part;
+  uint8_t type;
+  bool accent;
+};
+
+template<uint8_t num_parts>
+class PatternEngine {
+ public:
+  PatternEngine() { }
+  ~PatternEngine() { }
+  
+  void Init(float sample_rate, uint32_t seed) {
+    sample_rate_ = sample_rate;
+    output_mode_ = OUTPUT_MODE_DRUMS;
+    swing_ = 0.0f;
+    gate_length_ = 0.001f * sample_rate;  // 1ms, as on the module.
+    rng_state_ = seed ? seed : 1;
+    position_ = 0;
+    dropped_events_ = 0;
+    set_tempo(120.0f);
+    for (uint8_t i = 0; i < num_parts; ++i) {
+      PartSettings* s = &settings_[i];
+      s->x = s->y = 128;
+      s->instrument = i % kNumParts;
+      s->density = 128;
+      s->randomness = 0;
+      s->euclidean_length = 255;
+      cache_[i].Init();
+    }
+    Reset();
+  }
+  
+  // Restarts the pattern on the next rendered sample.
+  void Reset() {
+    step_ = 0;
+    next_onset_ = static_cast<double>(position_);
+    gate_pending_ = false;
+    for (uint8_t i = 0; i < num_parts; ++i) {
+      euclidean_step_[i] = 0;
+      perturbation_[i] = 0;
+      gate_[i] = false;
+    }
+  }
+  
+  inline void set_tempo(float bpm) {
+    // 8 steps per quarter note.
+    step_duration_ = sample_rate_ * 60.0 / (bpm * 8.0);
+  }
+  
+  // In [0, 0.33]: relative lengthening of the first sixteenth of each pair.
+  // Ignored in euclidean mode.
+  inline void set_swing(float swing) { swing_ = swing; }
+  inline void set_gate_length(float seconds) {
+    gate_length_ = seconds * sample_rate_;
+  }
+  inline void set_output_mode(OutputMode output_mode) {
+    output_mode_ = output_mode;
+  }
+  inline PartSettings* mutable_part_settings(uint8_t part) {
+    return &settings_[part];
+  }
+  
+  inline uint8_t step() const { return step_; }
+  inline uint64_t position() const { return position_; }
+  inline uint32_t dropped_events() const { return dropped_events_; }
+  
+  // Renders the events of the next size samples, in chronological order.
+  // Returns the number of events written. With a gate length shorter than a
+  // step, at most 2 * num_parts events are generated per step.
+  size_t Render(PatternEvent* events, size_t max_events, size_t size) {
+    size_t num_events = 0;
+    const uint64_t end = position_ + size;
+    
+    while (true) {
+      const uint64_t onset = static_cast<uint64_t>(next_onset_);
+      const uint64_t limit = onset < end ? onset : end;
+      
+      if (gate_pending_ && gate_off_ < limit) {
+        for (uint8_t i = 0; i < num_parts; ++i) {
+          if (gate_[i]) {
+            Emit(events, max_events, &num_events,
+                 gate_off_, i, PATTERN_EVENT_GATE_OFF, false);
+            gate_[i] = false;
+          }
+        }
+        gate_pending_ = false;
+      }
+      if (onset >= end) {
+        break;
+      }
+      
+      if (output_mode_ == OUTPUT_MODE_EUCLIDEAN) {
+        EvaluateEuclidean(events, max_events, &num_events, onset);
+      } else {
+        EvaluateDrums(events, max_events, &num_events, onset);
+      }
+      
+      // Same swing as the module, which only swings in drums mode: the first
+      // two steps of each sixteenth pair are longer, the next two shorter.
+      const double swing = output_mode_ == OUTPUT_MODE_DRUMS
+          ? swing_ * step_duration_
+          : 0.0;
+      const double duration = step_duration_ + ((step_ & 2) ? -swing : swing);
+      if (gate_pending_) {
+        double length = gate_length_ < duration - 1.0
+            ? gate_length_
+            : duration - 1.0;
+        gate_off_ = onset + static_cast<uint64_t>(length > 1.0 ? length : 1.0);
+      }
+      next_onset_ += duration;
+      if (!(step_ & 1)) {
+        for (uint8_t i = 0; i < num_parts; ++i) {
+          ++euclidean_step_[i];
+        }
+      }
+      ++step_;
+      if (step_ >= kStepsPerPattern) {
+        step_ = 0;
+      }
+    }
+    position_ = end;
+    return num_events;
+  }
+  
+ private:
+  inline void Emit(
+      PatternEvent* events,
+      size_t max_events,
+      size_t* num_events,
+      uint64_t time,
+      uint8_t part,
+      uint8_t type,
+      bool accent) {
+    if (*num_events >= max_events) {
+      ++dropped_events_;
+      return;
+    }
+    PatternEvent* e = &events[(*num_events)++];
+    e->offset = static_cast<uint32_t>(time - position_);
+    e->part = part;
+    e->type = type;
+    e->accent = accent;
+  }
+  
+  inline uint8_t RandomByte() {
+    rng_state_ = rng_state_ * 1664525L + 1013904223L;
+    return rng_state_ >> 24;
+  }
+  
+  void EvaluateDrums(
+      PatternEvent* events,
+      size_t max_events,
+      size_t* num_events,
+      uint64_t onset) {
+    using namespace avrlib;
+    
+    for (uint8_t i = 0; i < num_parts; ++i) {
+      const PartSettings& s = settings_[i];
+      if (step_ == 0) {
+        perturbation_[i] = U8U8MulShift8(RandomByte(), s.randomness >> 2);
+      }
+      cache_[i].set_position(s.x, s.y);
+      uint8_t level = cache_[i].levels(step_)[s.instrument];
+      if (level < 255 - perturbation_[i]) {
+        level += perturbation_[i];
+      } else {
+        level = 255;
+      }
+      uint8_t threshold = ~s.density;
+      if (level > threshold) {
+        Trigger(events, max_events, num_events, onset, i, level > 192);
+      }
+    }
+  }
+  
+  void EvaluateEuclidean(
+      PatternEvent* events,
+      size_t max_events,
+      size_t* num_events,
+      uint64_t onset) {
+    if (step_ & 1) {
+      return;
+    }
+    for (uint8_t i = 0; i < num_parts; ++i) {
+      const PartSettings& s = settings_[i];
+      uint8_t length = (s.euclidean_length >> 3) + 1;
+      uint8_t density = s.density >> 3;
+      uint16_t address = (length - 1) * 32 + density;
+      while (euclidean_step_[i] >= length) {
+        euclidean_step_[i] -= length;
+      }
+      uint32_t step_mask = 1L << static_cast<uint32_t>(euclidean_step_[i]);
+      uint32_t pattern_bits = pgm_read_dword(lut_res_euclidean + address);
+      if (pattern_bits & step_mask) {
+        Trigger(events, max_events, num_events, onset, i, false);
+      }
+    }
+  }
+  
+  inline void Trigger(
+      PatternEvent* events,
+      size_t max_events,
+      size_t* num_events,
+      uint64_t onset,
+      uint8_t part,
+      bool accent) {
+    Emit(events, max_events, num_events,
+         onset, part, PATTERN_EVENT_GATE_ON, accent);
+    gate_[part] = true;
+    gate_pending_ = true;
+  }
+  
+  float sample_rate_;
+  double step_duration_;
+  float swing_;
+  float gate_length_;
+  OutputMode output_mode_;
+  
+  uint32_t rng_state_;
+  uint64_t position_;
+  double next_onset_;
+  uint64_t gate_off_;
+  bool gate_pending_;
+  uint32_t dropped_events_;
+  
+  uint8_t step_;
+  uint8_t euclidean_step_[num_parts];
+  uint8_t perturbation_[num_parts];
+  bool gate_[num_parts];
+  
+  PartSettings settings_[num_parts];
+  DrumMapCache cache_[num_parts];
+  
+  DISALLOW_COPY_AND_ASSIGN(PatternEngine);
+};
+
+}  // namespace grids
+
+#endif // GRIDS_TEST_PATTERN_ENGINE_H_
@@ -0,0 +1,130 @@
+// Copyright 2015 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Interface for additional period predictors, which can be registered with a
+// RampExtractor to compete with its built-in ones.
+
+#ifndef MARBLES_RAMP_PERIOD_PREDICTOR_H_
+#define MARBLES_RAMP_PERIOD_PREDICTOR_H_
+
+#include "stmlib/stmlib.h"
+
+namespace marbles {
+
+// Errors above 4 standard deviations are outliers.
+const float kKalmanOutlierThreshold = 16.0f;
+const float kKalmanMinMeasurementNoise = 1e-6f;
+const int kKalmanMaxNumOutliers = 2;
+
+class PeriodPredictor {
+ public:
+  PeriodPredictor() { }
+  virtual ~PeriodPredictor() { }
+  
+  // Called when the clock has been stopped and restarted.
+  virtual void Reset() = 0;
+  
+  // Called for each new clock pulse, with the duration (in samples) of the
+  // period that has just ended. Returns the expected duration of the next one.
+  virtual float Predict(float last_period) = 0;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(PeriodPredictor);
+};
+
+// Scalar Kalman filter tracking a constant period observed with noise. The
+// gain adapts to the measured jitter: it converges faster than a moving
+// average with a fixed coefficient on a steady clock, and averages out more
+// jitter on a noisy one. A run of large errors is taken as a tempo change,
+// and the filter restarts from the last observation.
+class KalmanPeriodPredictor : public PeriodPredictor {
+ public:
+  KalmanPeriodPredictor() { }
+  virtual ~KalmanPeriodPredictor() { }
+  
+  // Noise figures are relative to the period: 0.01 is 1% of the period.
+  void Init(float process_noise, float measurement_noise) {
+    process_noise_ = process_noise * process_noise;
+    initial_measurement_noise_ = measurement_noise * measurement_noise;
+    Reset();
+  }
+  
+  virtual void Reset() {
+    period_ = 0.0f;
+    variance_ = 1.0f;
+    measurement_noise_ = initial_measurement_noise_;
+    num_outliers_ = 0;
+  }
+  
+  virtual float Predict(float last_period) {
+    if (period_ == 0.0f) {
+      period_ = last_period;
+      return period_;
+    }
+    
+    // Everything is computed relative to the current estimate.
+    float error = (last_period - period_) / period_;
+    float error_squared = error * error;
+    
+    variance_ += process_noise_;
+    float tolerance = kKalmanOutlierThreshold * \
+        (variance_ + measurement_noise_);
+    if (error_squared > tolerance) {
+      if (++num_outliers_ >= kKalmanMaxNumOutliers) {
+        period_ = last_period;
+        variance_ = 1.0f;
+        num_outliers_ = 0;
+      }
+      return period_;
+    }
+    num_outliers_ = 0;
+    
+    float gain = variance_ / (variance_ + measurement_noise_);
+    period_ += gain * error * period_;
+    variance_ *= 1.0f - gain;
+    
+    // Slowly track the jitter of the clock.
+    measurement_noise_ += 0.05f * (error_squared - measurement_noise_);
+    if (measurement_noise_ < kKalmanMinMeasurementNoise) {
+      measurement_noise_ = kKalmanMinMeasurementNoise;
+    }
+    return period_;
+  }
+
+ private:
+  float period_;
+  float variance_;
+  float process_noise_;
+  float measurement_noise_;
+  float initial_measurement_noise_;
+  int num_outliers_;
+  
+  DISALLOW_COPY_AND_ASSIGN(KalmanPeriodPredictor);
+};
+
+}  // namespace marbles
+
+#endif  // MARBLES_RAMP_PERIOD_PREDICTOR_H_
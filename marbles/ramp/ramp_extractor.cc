@@ -31,6 +31,7 @@
 // - Periodic rhythmic pattern.
 // - Assume that the pulse width is constant, deduct the period from the on time
 //   and the pulse width.
+// - Any additional predictor registered with AddPredictor().
 
 #include "marbles/ramp/ramp_extractor.h"
 
@@ -56,9 +57,20 @@ void RampExtractor::Init(float max_frequency) {
   max_frequency_ = max_frequency;
   audio_rate_period_ = 1.0f / (100.0f / 32000.0f);
   audio_rate_period_hysteresis_ = audio_rate_period_;
+  num_external_predictors_ = 0;
+  enabled_predictors_ = 0xffffffff;
   Reset();
 }
 
+int RampExtractor::AddPredictor(PeriodPredictor* predictor) {
+  if (num_external_predictors_ >= kMaxNumExternalPredictors) {
+    return -1;
+  }
+  predictor->Reset();
+  external_predictor_[num_external_predictors_] = predictor;
+  return PREDICTOR_LAST + num_external_predictors_++;
+}
+
 void RampExtractor::Reset() {
   audio_rate_ = false;
   train_phase_ = 0.0f;
@@ -81,12 +93,35 @@ void RampExtractor::Reset() {
   next_bucket_ = 48.0f;
   
   average_pulse_width_ = 0.0f;
-  fill(&predicted_period_[0], &predicted_period_[PREDICTOR_LAST], 4000.0f);
-  fill(&prediction_accuracy_[0], &prediction_accuracy_[PREDICTOR_LAST], 0.0f);
+  fill(&predicted_period_[0], &predicted_period_[kMaxNumPredictors], 4000.0f);
+  fill(
+      &prediction_accuracy_[0],
+      &prediction_accuracy_[kMaxNumPredictors],
+      0.0f);
   fill(
       &prediction_hash_table_[0],
       &prediction_hash_table_[kHashTableSize],
       0.0f);
+  
+  for (size_t i = 0; i < num_external_predictors_; ++i) {
+    external_predictor_[i]->Reset();
+  }
+  best_predictor_ = PREDICTOR_FAST_MOVING_AVERAGE;
+  output_period_ = 4000.0f;
+  
+  PredictionStatistics s;
+  s.accuracy = 0.0f;
+  s.error = 0.0f;
+  s.mean_squared_error = 0.0f;
+  s.num_predictions = 0;
+  s.num_selected = 0;
+  fill(&statistics_[0], &statistics_[kMaxNumPredictors + 1], s);
+}
+
+void RampExtractor::UpdateStatistics(PredictionStatistics* s, float error) {
+  s->error = error;
+  ONE_POLE(s->mean_squared_error, error * error, 0.1f);
+  ++s->num_predictions;
 }
 
 float RampExtractor::ComputeAveragePulseWidth(float tolerance) const {
@@ -105,14 +140,21 @@ float RampExtractor::ComputeAveragePulseWidth(float tolerance) const {
 RampExtractor::Prediction RampExtractor::PredictNextPeriod() {
   float last_period = static_cast<float>(history_[current_pulse_].total_duration);
   
-  Predictor best_predictor = PREDICTOR_FAST_MOVING_AVERAGE;
+  UpdateStatistics(
+      &statistics_[kMaxNumPredictors],
+      (output_period_ - last_period) / (last_period + 0.01f));
+  
+  int best_predictor = -1;
+  const int num_predictors = PREDICTOR_LAST + num_external_predictors_;
 
-  for (int i = PREDICTOR_FAST_MOVING_AVERAGE; i < PREDICTOR_LAST; ++i) {
+  for (int i = PREDICTOR_FAST_MOVING_AVERAGE; i < num_predictors; ++i) {
     float error = (predicted_period_[i] - last_period) / (last_period + 0.01f);
     // Scoring function: 10% error is half as good as 0% error.
     float accuracy = 1.0f / (1.0f + 100.0f * error * error);
     // Slowly trust good predictors, quickly demote predictors who make errors.
     SLOPE(prediction_accuracy_[i], accuracy, 0.1f, 0.5f);
+    UpdateStatistics(&statistics_[i], error);
+    statistics_[i].accuracy = prediction_accuracy_[i];
 
     // (Ugly code but I don't want virtuals for these.)
     switch (i) {
@@ -145,7 +187,10 @@ RampExtractor::Prediction RampExtractor::PredictNextPeriod() {
         break;
         
       default:
-        {
+        if (i >= PREDICTOR_LAST) {
+          predicted_period_[i] = external_predictor_[i - PREDICTOR_LAST]->\
+              Predict(last_period);
+        } else {
           // Periodicity detector.
           size_t candidate_period = i - PREDICTOR_PERIOD_1 + 1;
           size_t t = current_pulse_ + 1 + kHistorySize - candidate_period;
@@ -154,15 +199,25 @@ RampExtractor::Prediction RampExtractor::PredictNextPeriod() {
         break;
     }
     
-    if (prediction_accuracy_[i] >= prediction_accuracy_[best_predictor]) {
-      best_predictor = Predictor(i);
+    if ((enabled_predictors_ & (1 << i)) && (best_predictor == -1 ||
+        prediction_accuracy_[i] >= prediction_accuracy_[best_predictor])) {
+      best_predictor = i;
     }
   }
   
+  if (best_predictor == -1) {
+    best_predictor = PREDICTOR_FAST_MOVING_AVERAGE;
+  }
+  
   Prediction p;
   p.period = predicted_period_[best_predictor];
   p.accuracy = prediction_accuracy_[best_predictor];
   
+  best_predictor_ = best_predictor;
+  output_period_ = p.period;
+  ++statistics_[best_predictor].num_selected;
+  statistics_[kMaxNumPredictors].accuracy = p.accuracy;
+  
   return p;
 }
 
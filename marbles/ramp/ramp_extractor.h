@@ -34,6 +34,7 @@
 // 
 // All prediction strategies are concurrently tested, and the output from the
 // best performing one is selected (à la early Scheirer/Goto beat trackers).
+// Additional strategies can be registered with AddPredictor().
 
 #ifndef MARBLES_RAMP_RAMP_EXTRACTOR_H_
 #define MARBLES_RAMP_RAMP_EXTRACTOR_H_
@@ -41,12 +42,43 @@
 #include "stmlib/stmlib.h"
 #include "stmlib/utils/gate_flags.h"
 
+#include "marbles/ramp/period_predictor.h"
 #include "marbles/ramp/ramp_divider.h"
 
 namespace marbles {
 
+const size_t kMaxNumExternalPredictors = 4;
+
+struct PredictionStatistics {
+  float accuracy;  // Score used to select the best predictor, from 0 to 1.
+  float error;  // Relative error of the last prediction.
+  float mean_squared_error;  // Relative, averaged over the last ~10 periods.
+  uint32_t num_predictions;
+  uint32_t num_selected;
+};
+
 class RampExtractor {
  public:
+  enum Predictor {
+    PREDICTOR_SLOW_MOVING_AVERAGE,
+    PREDICTOR_FAST_MOVING_AVERAGE,
+    PREDICTOR_HASH,
+    PREDICTOR_PERIOD_1,
+    PREDICTOR_PERIOD_2,
+    PREDICTOR_PERIOD_3,
+    PREDICTOR_PERIOD_4,
+    PREDICTOR_PERIOD_5,
+    PREDICTOR_PERIOD_6,
+    PREDICTOR_PERIOD_7,
+    PREDICTOR_PERIOD_8,
+    PREDICTOR_PERIOD_9,
+    PREDICTOR_PERIOD_10,
+    PREDICTOR_LAST
+  };
+  
+  static const size_t kMaxNumPredictors = \
+      PREDICTOR_LAST + kMaxNumExternalPredictors;
+  
   RampExtractor() { }
   ~RampExtractor() { }
   
@@ -59,6 +91,32 @@ class RampExtractor {
       size_t size);
   void Reset();
   
+  // Registers an additional predictor. Returns its index, to be used with
+  // predictor_statistics() and set_enabled_predictors(), or -1 when all
+  // slots are taken. The predictor must outlive the extractor.
+  int AddPredictor(PeriodPredictor* predictor);
+  
+  // Bitmask of the predictors which can be selected - all by default. The
+  // others are still evaluated.
+  inline void set_enabled_predictors(uint32_t mask) {
+    enabled_predictors_ = mask;
+  }
+  
+  inline size_t num_predictors() const {
+    return PREDICTOR_LAST + num_external_predictors_;
+  }
+  
+  inline const PredictionStatistics& predictor_statistics(size_t i) const {
+    return statistics_[i];
+  }
+  
+  // Statistics of the predictions actually used to generate the ramp.
+  inline const PredictionStatistics& statistics() const {
+    return statistics_[kMaxNumPredictors];
+  }
+  
+  inline int best_predictor() const { return best_predictor_; }
+  
  private:
   struct Pulse {
     uint32_t on_duration;
@@ -72,39 +130,32 @@ class RampExtractor {
     float accuracy;
   };
   
-  enum Predictor {
-    PREDICTOR_SLOW_MOVING_AVERAGE,
-    PREDICTOR_FAST_MOVING_AVERAGE,
-    PREDICTOR_HASH,
-    PREDICTOR_PERIOD_1,
-    PREDICTOR_PERIOD_2,
-    PREDICTOR_PERIOD_3,
-    PREDICTOR_PERIOD_4,
-    PREDICTOR_PERIOD_5,
-    PREDICTOR_PERIOD_6,
-    PREDICTOR_PERIOD_7,
-    PREDICTOR_PERIOD_8,
-    PREDICTOR_PERIOD_9,
-    PREDICTOR_PERIOD_10,
-    PREDICTOR_LAST
-  };
-  
   static const size_t kHistorySize = 16;
   static const size_t kHashTableSize = 256;
   
   float ComputeAveragePulseWidth(float tolerance) const;
   
   Prediction PredictNextPeriod();
+  void UpdateStatistics(PredictionStatistics* s, float error);
 
   size_t current_pulse_;
   Pulse history_[kHistorySize];
   float next_bucket_;
   
   float prediction_hash_table_[kHashTableSize];
-  float predicted_period_[PREDICTOR_LAST];
-  float prediction_accuracy_[PREDICTOR_LAST];
+  float predicted_period_[kMaxNumPredictors];
+  float prediction_accuracy_[kMaxNumPredictors];
   float average_pulse_width_;
   
+  PeriodPredictor* external_predictor_[kMaxNumExternalPredictors];
+  size_t num_external_predictors_;
+  uint32_t enabled_predictors_;
+  int best_predictor_;
+  float output_period_;
+  
+  // One entry per predictor, and one for the output.
+  PredictionStatistics statistics_[kMaxNumPredictors + 1];
+  
   float train_phase_;
   float frequency_;
   float max_output_phase_;
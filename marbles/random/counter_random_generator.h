@@ -0,0 +1,190 @@
+// Copyright 2015 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Counter-based pseudo-random generator (Philox 4x32, 10 rounds).
+//
+// Word n of the sequence is a function of the key and of n only, so the
+// sequence can be produced by blocks of any size, or started anywhere with
+// Seek(). Split() derives the key of an independent child sequence - for
+// example, one per voice or one per rendering job.
+
+#ifndef MARBLES_RANDOM_COUNTER_RANDOM_GENERATOR_H_
+#define MARBLES_RANDOM_COUNTER_RANDOM_GENERATOR_H_
+
+#include "stmlib/stmlib.h"
+
+namespace marbles {
+
+const size_t kCounterRandomBlockSize = 4;
+
+class CounterRandomGenerator {
+ public:
+  CounterRandomGenerator() { }
+  ~CounterRandomGenerator() { }
+
+  inline void Init(uint32_t seed) {
+    key_[0] = seed;
+    key_[1] = 0;
+    position_ = 0;
+  }
+
+  inline void Split(uint32_t stream, CounterRandomGenerator* child) const {
+    // Blocks with the last word of the counter set to all ones are never
+    // used for the sequence itself.
+    uint32_t counter[4] = { stream, 0, 0, 0xffffffff };
+    uint32_t key[4];
+    Block(key_, counter, key);
+    child->key_[0] = key[0];
+    child->key_[1] = key[1];
+    child->position_ = 0;
+  }
+
+  inline void Seek(uint64_t position) {
+    position_ = position;
+    if (position_ % kCounterRandomBlockSize) {
+      RenderBlock(position_ / kCounterRandomBlockSize, block_);
+    }
+  }
+
+  inline uint64_t position() const { return position_; }
+
+  inline uint32_t GetWord() {
+    size_t index = position_ % kCounterRandomBlockSize;
+    if (index == 0) {
+      RenderBlock(position_ / kCounterRandomBlockSize, block_);
+    }
+    ++position_;
+    return block_[index];
+  }
+
+  inline float GetFloat() {
+    return static_cast<float>(GetWord()) / 4294967296.0f;
+  }
+
+  // Same as calling GetWord() size times.
+  inline void Fill(uint32_t* words, size_t size) {
+    while (size && (position_ % kCounterRandomBlockSize)) {
+      *words++ = GetWord();
+      --size;
+    }
+
+    // Whole blocks, kNumInterleavedBlocks at a time: the rounds of
+    // independent blocks are interleaved so that they can be vectorized.
+    uint64_t block = position_ / kCounterRandomBlockSize;
+    while (size >= kNumInterleavedBlocks * kCounterRandomBlockSize) {
+      RenderBlocks(block, words);
+      block += kNumInterleavedBlocks;
+      words += kNumInterleavedBlocks * kCounterRandomBlockSize;
+      size -= kNumInterleavedBlocks * kCounterRandomBlockSize;
+      position_ += kNumInterleavedBlocks * kCounterRandomBlockSize;
+    }
+    while (size) {
+      *words++ = GetWord();
+      --size;
+    }
+  }
+
+ private:
+  static const size_t kNumInterleavedBlocks = 4;
+  static const size_t kNumRounds = 10;
+
+  static inline void Block(
+      const uint32_t* key,
+      const uint32_t* counter,
+      uint32_t* out) {
+    uint32_t k0 = key[0];
+    uint32_t k1 = key[1];
+    uint32_t c0 = counter[0];
+    uint32_t c1 = counter[1];
+    uint32_t c2 = counter[2];
+    uint32_t c3 = counter[3];
+    for (size_t i = 0; i < kNumRounds; ++i) {
+      uint64_t p0 = static_cast<uint64_t>(0xd2511f53) * c0;
+      uint64_t p1 = static_cast<uint64_t>(0xcd9e8d57) * c2;
+      c0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+      c1 = static_cast<uint32_t>(p1);
+      c2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+      c3 = static_cast<uint32_t>(p0);
+      k0 += 0x9e3779b9;
+      k1 += 0xbb67ae85;
+    }
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+  }
+
+  inline void RenderBlock(uint64_t block, uint32_t* out) const {
+    uint32_t counter[4] = {
+      static_cast<uint32_t>(block),
+      static_cast<uint32_t>(block >> 32),
+      0,
+      0
+    };
+    Block(key_, counter, out);
+  }
+
+  inline void RenderBlocks(uint64_t block, uint32_t* out) const {
+    const size_t n = kNumInterleavedBlocks;
+    uint32_t c0[n], c1[n], c2[n], c3[n];
+    for (size_t j = 0; j < n; ++j) {
+      c0[j] = static_cast<uint32_t>(block + j);
+      c1[j] = static_cast<uint32_t>((block + j) >> 32);
+      c2[j] = 0;
+      c3[j] = 0;
+    }
+    uint32_t k0 = key_[0];
+    uint32_t k1 = key_[1];
+    for (size_t i = 0; i < kNumRounds; ++i) {
+      for (size_t j = 0; j < n; ++j) {
+        uint64_t p0 = static_cast<uint64_t>(0xd2511f53) * c0[j];
+        uint64_t p1 = static_cast<uint64_t>(0xcd9e8d57) * c2[j];
+        c0[j] = static_cast<uint32_t>(p1 >> 32) ^ c1[j] ^ k0;
+        c1[j] = static_cast<uint32_t>(p1);
+        c2[j] = static_cast<uint32_t>(p0 >> 32) ^ c3[j] ^ k1;
+        c3[j] = static_cast<uint32_t>(p0);
+      }
+      k0 += 0x9e3779b9;
+      k1 += 0xbb67ae85;
+    }
+    for (size_t j = 0; j < n; ++j) {
+      out[j * 4 + 0] = c0[j];
+      out[j * 4 + 1] = c1[j];
+      out[j * 4 + 2] = c2[j];
+      out[j * 4 + 3] = c3[j];
+    }
+  }
+
+  uint32_t key_[2];
+  uint64_t position_;
+  uint32_t block_[kCounterRandomBlockSize];
+
+  DISALLOW_COPY_AND_ASSIGN(CounterRandomGenerator);
+};
+
+}  // namespace marbles
+
+#endif  // MARBLES_RANDOM_COUNTER_RANDOM_GENERATOR_H_
@@ -104,6 +104,83 @@ inline float FastBetaDistributionSample(float uniform) {
   return stmlib::Interpolate(dist_icdf_4_3, uniform, kIcdfTableSize);
 }
 
+// Same as BetaDistributionSample, for many samples drawn with the same
+// spread and bias. The four tables surrounding (spread, bias) are blended
+// once in Init(), so each sample costs a single table interpolation, and
+// the loop in Sample() has no data-dependent branch.
+//
+// Meant for batches: Init() is the cost of about 100 calls to
+// BetaDistributionSample.
+class BetaDistributionSampler {
+ public:
+  BetaDistributionSampler() { }
+  ~BetaDistributionSampler() { }
+
+  void Init(float spread, float bias) {
+    bool flip_result = bias > 0.5f;
+    if (flip_result) {
+      bias = 1.0f - bias;
+    }
+    // 1 - x when the result is flipped, x otherwise.
+    offset_ = flip_result ? 1.0f : 0.0f;
+    scale_ = flip_result ? -1.0f : 1.0f;
+
+    bias *= (static_cast<float>(kNumBiasValues) - 1.0f) * 2.0f;
+    spread *= (static_cast<float>(kNumRangeValues) - 1.0f);
+
+    MAKE_INTEGRAL_FRACTIONAL(bias);
+    MAKE_INTEGRAL_FRACTIONAL(spread);
+
+    size_t cell = bias_integral * (kNumRangeValues + 1) + spread_integral;
+    const float* x1y1 = distributions_table[cell];
+    const float* x2y1 = distributions_table[cell + 1];
+    const float* x1y2 = distributions_table[cell + kNumRangeValues + 1];
+    const float* x2y2 = distributions_table[cell + kNumRangeValues + 2];
+
+    for (size_t i = 0; i < kTableSize; ++i) {
+      float y1 = x1y1[i] + (x2y1[i] - x1y1[i]) * spread_fractional;
+      float y2 = x1y2[i] + (x2y2[i] - x1y2[i]) * spread_fractional;
+      table_[i] = y1 + (y2 - y1) * bias_fractional;
+    }
+    // Guard point, read when the uniform sample is exactly 1.0.
+    table_[kTableSize] = table_[kTableSize - 1];
+  }
+
+  inline float Sample(float uniform) const {
+    uniform = offset_ + scale_ * uniform;
+
+    // Lower 5% and 95% percentiles use a different table with higher
+    // resolution.
+    const bool low = uniform <= 0.05f;
+    const bool high = uniform >= 0.95f;
+    const float tail = (high ? uniform - 0.95f : uniform) * 20.0f;
+    const float x = (low || high ? tail : uniform) * kIcdfTableSize;
+    const size_t offset = low ? kSegmentSize : (high ? 2 * kSegmentSize : 0);
+
+    MAKE_INTEGRAL_FRACTIONAL(x);
+    const float* t = &table_[offset + x_integral];
+    const float y = t[0] + (t[1] - t[0]) * x_fractional;
+    return offset_ + scale_ * y;
+  }
+
+  inline void Sample(const float* uniform, float* out, size_t size) const {
+    for (size_t i = 0; i < size; ++i) {
+      out[i] = Sample(uniform[i]);
+    }
+  }
+
+ private:
+  // Main table, followed by the tables for the lower and upper tails.
+  static const size_t kSegmentSize = 129;  // kIcdfTableSize + 1
+  static const size_t kTableSize = 3 * kSegmentSize;
+
+  float offset_;
+  float scale_;
+  float table_[kTableSize + 1];
+
+  DISALLOW_COPY_AND_ASSIGN(BetaDistributionSampler);
+};
+
 // Draws samples from a discrete distribution. Used for the quantizer.
 // Example:
 // * 1 with probability 0.2
@@ -160,7 +237,12 @@ class DiscreteDistribution {
   inline Result Sample(float u) const {
     Result r;
     u *= sum_;
-    int n = std::upper_bound(&cdf_[1], &cdf_[num_tokens_ + 1], u) - &cdf_[0];
+    // Same as std::upper_bound on the (sorted) cdf, but the number of
+    // iterations does not depend on u, and the loop has no branch.
+    int n = 1;
+    for (int i = 1; i < num_tokens_; ++i) {
+      n += cdf_[i] <= u;
+    }
     float norm = 1.0f / sum_;
     r.token_id = token_ids_[n];
     r.width = (cdf_[n] - cdf_[n - 1]) * norm;
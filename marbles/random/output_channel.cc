@@ -91,6 +91,36 @@ float OutputChannel::GenerateNewVoltage(RandomSequence* random_sequence) {
   }
 }
 
+void OutputChannel::GenerateVoltages(
+    const float* uniform,
+    float* voltage,
+    float* quantized_voltage,
+    size_t size) {
+  float degenerate_amount = 1.25f - spread_ * 25.0f;
+  float bernoulli_amount = spread_ * 25.0f - 23.75f;
+
+  CONSTRAIN(degenerate_amount, 0.0f, 1.0f);
+  CONSTRAIN(bernoulli_amount, 0.0f, 1.0f);
+  
+  BetaDistributionSampler sampler;
+  sampler.Init(spread_, bias_);
+  sampler.Sample(uniform, voltage, size);
+  
+  const float bernoulli_threshold = 1.0f - bias_;
+  for (size_t i = 0; i < size; ++i) {
+    float value = voltage[i];
+    float bernoulli_value = uniform[i] >= bernoulli_threshold
+        ? 0.999999f
+        : 0.0f;
+    value += degenerate_amount * (bias_ - value);
+    value += bernoulli_amount * (bernoulli_value - value);
+    voltage[i] = scale_offset_(value);
+  }
+  
+  quantizer_[scale_index_].Process(
+      voltage, quantized_voltage, size, 2.0f * steps_ - 1.0f);
+}
+
 void OutputChannel::Process(
     RandomSequence* random_sequence,
     const float* phase,
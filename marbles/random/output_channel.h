@@ -105,6 +105,15 @@ class OutputChannel {
     return quantizer_[scale_index_].Process(voltage, amount, false);
   }
   
+  // Converts a block of uniformly distributed values into voltages with the
+  // current spread and bias, then quantizes them - as a new step outside of
+  // register mode would. For rendering many values at once.
+  void GenerateVoltages(
+      const float* uniform,
+      float* voltage,
+      float* quantized_voltage,
+      size_t size);
+  
  private:
   float GenerateNewVoltage(RandomSequence* random_sequence);
   
@@ -32,11 +32,15 @@
 
 #include <cmath>
 #include <algorithm>
+#include <limits>
 
 namespace marbles {
 
 using namespace std;
 
+// Smallest power of 2 above the number of midpoints (kMaxDegrees + 1).
+const int kQuantizerLookupSize = 32;
+
 void Quantizer::Init(const Scale& scale) {
   int n = scale.num_degrees;
 
@@ -135,4 +139,62 @@ float Quantizer::Process(float value, float amount, bool hysteresis) {
   return quantized_voltage;
 }
 
+void Quantizer::Process(
+    const float* value,
+    float* quantized_voltage,
+    size_t size,
+    float amount) {
+  if (!size) {
+    return;
+  }
+  int level = level_quantizer_.Process(amount, kNumThresholds + 1);
+  if (level == 0) {
+    copy(&value[0], &value[size], &quantized_voltage[0]);
+    return;
+  }
+  level -= 1;
+  
+  // The candidate voltages within one interval are the last active degree of
+  // the previous interval, the active degrees, and the first active degree
+  // of the next interval. A value goes to the k-th candidate when it is
+  // above the k first midpoints between candidates - which gives the same
+  // result as the search in Process(). The midpoints are sorted, so k is
+  // found by a binary search with a fixed number of steps, and without any
+  // branch. Unused midpoints are never reached.
+  const Level& l = level_[level];
+  float candidate[kMaxDegrees + 2];
+  float threshold[kQuantizerLookupSize];
+  int num_candidates = 0;
+  candidate[num_candidates++] = voltage_[l.last] - base_interval_;
+  for (int i = 0; i < num_degrees_; ++i) {
+    if (l.bitmask & (1 << i)) {
+      candidate[num_candidates++] = voltage_[i];
+    }
+  }
+  candidate[num_candidates++] = voltage_[l.first] + base_interval_;
+  for (int i = 0; i < kQuantizerLookupSize; ++i) {
+    threshold[i] = i < num_candidates - 1
+        ? (candidate[i] + candidate[i + 1]) * 0.5f
+        : numeric_limits<float>::max();
+  }
+  
+  for (size_t i = 0; i < size; ++i) {
+    const float note = value[i] * base_interval_reciprocal_;
+    MAKE_INTEGRAL_FRACTIONAL(note);
+    if (value[i] < 0.0f) {
+      note_integral -= 1;
+      note_fractional += 1.0f;
+    }
+    note_fractional *= base_interval_;
+    
+    int k = 0;
+    for (int step = kQuantizerLookupSize / 2; step; step >>= 1) {
+      k += note_fractional >= threshold[k + step - 1] ? step : 0;
+    }
+    quantized_voltage[i] = candidate[k] + \
+        static_cast<float>(note_integral) * base_interval_;
+  }
+  feedback_[level] = (quantized_voltage[size - 1] - value[size - 1]) * 0.25f;
+}
+
 }  // namespace marbles
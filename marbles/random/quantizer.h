@@ -98,6 +98,14 @@ class Quantizer {
 
   float Process(float value, float amount, bool hysteresis);
   
+  // Quantizes a block of values with the same amount, without hysteresis.
+  // Same as calling Process(value[i], amount, false) for each value.
+  void Process(
+      const float* value,
+      float* quantized_voltage,
+      size_t size,
+      float amount);
+  
  private:
   struct Level {
     uint16_t bitmask;  // bitmask of active degrees.
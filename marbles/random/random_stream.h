@@ -57,6 +57,17 @@ class RandomStream {
     fallback_generator_->Mix(value);
   }
   
+  // Room left in the buffer.
+  inline size_t writable() const {
+    return buffer_.writable();
+  }
+  
+  inline void Write(const uint32_t* values, size_t size) {
+    while (size--) {
+      Write(*values++);
+    }
+  }
+  
   inline uint32_t GetWord() {
     if (buffer_.readable()) {
       return buffer_.ImmediateRead();
@@ -0,0 +1,215 @@
+// Copyright 2015 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Offline rendering of T and X/Y sequences for many seeds.
+
+#include "marbles/test/batch_engine.h"
+
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <thread>
+#include <vector>
+
+#include "marbles/io_buffer.h"
+#include "marbles/random/counter_random_generator.h"
+#include "marbles/random/random_generator.h"
+#include "marbles/random/random_stream.h"
+
+namespace marbles {
+
+using namespace std;
+using namespace stmlib;
+
+const uint64_t kFnvOffsetBasis = 0xcbf29ce484222325ULL;
+const uint64_t kFnvPrime = 0x100000001b3ULL;
+
+// Everything needed to render one job. Owned by a worker, and re-initialized
+// for each job.
+struct BatchEngine::Voice {
+  CounterRandomGenerator counter_random_generator;
+  RandomGenerator fallback_generator;
+  RandomStream random_stream;
+  TGenerator t_generator;
+  XYGenerator xy_generator;
+
+  uint32_t words[128];
+  uint64_t num_random_words;
+
+  // Replaces what the hardware RNG would have written since the last block.
+  void TopUp() {
+    size_t size = random_stream.writable();
+    counter_random_generator.Fill(words, size);
+    random_stream.Write(words, size);
+    num_random_words += size;
+  }
+};
+
+static double Now() {
+  return chrono::duration<double>(
+      chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double ThreadTime() {
+  timespec t;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static inline uint64_t Hash(uint64_t h, const void* data, size_t size) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  while (size--) {
+    h = (h ^ *bytes++) * kFnvPrime;
+  }
+  return h;
+}
+
+void BatchEngine::Init(size_t num_threads, float sample_rate) {
+  num_threads_ = num_threads ? num_threads : 1;
+  sample_rate_ = sample_rate;
+  jobs_ = NULL;
+  num_jobs_ = 0;
+  next_job_ = 0;
+  memset(&statistics_, 0, sizeof(statistics_));
+}
+
+void BatchEngine::RenderJob(Voice* voice, BatchJob* job) {
+  voice->num_random_words = 0;
+  voice->counter_random_generator.Init(job->seed);
+  voice->fallback_generator.Init(job->seed);
+  voice->random_stream.Init(&voice->fallback_generator);
+
+  // Both generators read random words during their initialization.
+  voice->TopUp();
+  voice->t_generator.Init(&voice->random_stream, sample_rate_);
+  voice->TopUp();
+  voice->xy_generator.Init(&voice->random_stream, sample_rate_);
+
+  TGenerator* t = &voice->t_generator;
+  t->set_model(job->t_model);
+  t->set_range(job->t_range);
+  t->set_rate(job->t_rate);
+  t->set_bias(job->t_bias);
+  t->set_jitter(job->t_jitter);
+  t->set_deja_vu(job->t_deja_vu);
+  t->set_length(job->t_length);
+  t->set_pulse_width_mean(job->t_pulse_width_mean);
+  t->set_pulse_width_std(job->t_pulse_width_std);
+
+  GateFlags no_clock[kBlockSize];
+  fill(&no_clock[0], &no_clock[kBlockSize], GATE_FLAG_LOW);
+
+  float ramp_buffer[kBlockSize * 4];
+  Ramps ramps;
+  ramps.master = &ramp_buffer[0];
+  ramps.external = &ramp_buffer[kBlockSize];
+  ramps.slave[0] = &ramp_buffer[kBlockSize * 2];
+  ramps.slave[1] = &ramp_buffer[kBlockSize * 3];
+
+  float voltages[kBlockSize * 4];
+  bool gates[kBlockSize * 2];
+
+  uint64_t hash = kFnvOffsetBasis;
+  size_t frame = 0;
+  while (frame < job->num_frames) {
+    // Only the last block of a job can be shorter.
+    size_t size = min(kBlockSize, job->num_frames - frame);
+    voice->TopUp();
+    t->Process(false, no_clock, ramps, gates, size);
+    voice->xy_generator.Process(
+        CLOCK_SOURCE_INTERNAL_T1_T2_T3,
+        job->x,
+        job->y,
+        no_clock,
+        ramps,
+        voltages,
+        size);
+    hash = Hash(hash, voltages, sizeof(float) * 4 * size);
+    hash = Hash(hash, gates, sizeof(bool) * 2 * size);
+    if (job->voltages) {
+      copy(&voltages[0], &voltages[4 * size], &job->voltages[4 * frame]);
+    }
+    if (job->gates) {
+      copy(&gates[0], &gates[2 * size], &job->gates[2 * frame]);
+    }
+    frame += size;
+  }
+  job->hash = hash;
+  job->num_random_words = voice->num_random_words;
+}
+
+void BatchEngine::Worker(double* busy_seconds) {
+  // Allocated by the worker, so that it is placed close to the core running
+  // it, and reused from one job to the next.
+  Voice* voice = new Voice;
+
+  double busy = 0.0;
+  while (true) {
+    size_t index = next_job_++;
+    if (index >= num_jobs_) {
+      break;
+    }
+    double start = ThreadTime();
+    RenderJob(voice, &jobs_[index]);
+    busy += ThreadTime() - start;
+  }
+  *busy_seconds = busy;
+  delete voice;
+}
+
+void BatchEngine::Render(BatchJob* jobs, size_t num_jobs) {
+  jobs_ = jobs;
+  num_jobs_ = num_jobs;
+  next_job_ = 0;
+
+  vector<double> busy_seconds(num_threads_, 0.0);
+  double start = Now();
+  if (num_threads_ == 1) {
+    Worker(&busy_seconds[0]);
+  } else {
+    vector<thread> workers;
+    for (size_t i = 0; i < num_threads_; ++i) {
+      workers.push_back(thread(&BatchEngine::Worker, this, &busy_seconds[i]));
+    }
+    for (size_t i = 0; i < num_threads_; ++i) {
+      workers[i].join();
+    }
+  }
+
+  statistics_.num_threads = num_threads_;
+  statistics_.num_sequences = num_jobs;
+  statistics_.wall_seconds = Now() - start;
+  statistics_.busy_seconds = 0.0;
+  statistics_.sequence_seconds = 0.0;
+  for (size_t i = 0; i < num_threads_; ++i) {
+    statistics_.busy_seconds += busy_seconds[i];
+  }
+  for (size_t i = 0; i < num_jobs; ++i) {
+    statistics_.sequence_seconds += jobs[i].num_frames / sample_rate_;
+  }
+}
+
+}  // namespace marbles
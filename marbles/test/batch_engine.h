@@ -0,0 +1,130 @@
+// Copyright 2015 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Offline rendering of T and X/Y sequences for many seeds, on a pool of
+// threads.
+//
+// The generators draw their random words from a RandomStream, as on the
+// module. Instead of the hardware RNG, the stream is topped up before each
+// block with a vector of words from a CounterRandomGenerator keyed by the
+// seed of the job. The stream is read in order and never runs dry, so the
+// words consumed by the generators are the same whatever the number of
+// threads, or the number of words generated at once.
+//
+// The generators always run with the block size of the module: their
+// parameters are updated once per block, so their output depends on it.
+
+#ifndef MARBLES_TEST_BATCH_ENGINE_H_
+#define MARBLES_TEST_BATCH_ENGINE_H_
+
+#include <atomic>
+
+#include "stmlib/stmlib.h"
+
+#include "marbles/random/t_generator.h"
+#include "marbles/random/x_y_generator.h"
+
+namespace marbles {
+
+struct BatchJob {
+  uint32_t seed;
+
+  TGeneratorModel t_model;
+  TGeneratorRange t_range;
+  float t_rate;
+  float t_bias;
+  float t_jitter;
+  float t_deja_vu;
+  int t_length;
+  float t_pulse_width_mean;
+  float t_pulse_width_std;
+
+  GroupSettings x;
+  GroupSettings y;
+
+  size_t num_frames;
+
+  // Optional outputs: 4 voltages (X1, X2, X3, Y) and 2 gates (T1, T3) per
+  // frame. Can be NULL when only the hash is needed.
+  float* voltages;
+  bool* gates;
+
+  // Filled by the engine.
+  uint64_t hash;
+  uint64_t num_random_words;
+};
+
+struct BatchStatistics {
+  size_t num_threads;
+  size_t num_sequences;
+  double sequence_seconds;
+  double wall_seconds;
+  double busy_seconds;  // Sum of the CPU time of all workers.
+
+  inline double sequences_per_second() const {
+    return num_sequences / wall_seconds;
+  }
+
+  inline double realtime_ratio() const {
+    return sequence_seconds / wall_seconds;
+  }
+
+  inline double realtime_ratio_per_core() const {
+    return sequence_seconds / busy_seconds;
+  }
+};
+
+class BatchEngine {
+ public:
+  BatchEngine() { }
+  ~BatchEngine() { }
+
+  void Init(size_t num_threads, float sample_rate);
+  void Render(BatchJob* jobs, size_t num_jobs);
+
+  inline const BatchStatistics& statistics() const { return statistics_; }
+
+ private:
+  struct Voice;
+
+  void Worker(double* busy_seconds);
+  void RenderJob(Voice* voice, BatchJob* job);
+
+  size_t num_threads_;
+  float sample_rate_;
+
+  BatchJob* jobs_;
+  size_t num_jobs_;
+  std::atomic<size_t> next_job_;
+
+  BatchStatistics statistics_;
+
+  DISALLOW_COPY_AND_ASSIGN(BatchEngine);
+};
+
+}  // namespace marbles
+
+#endif  // MARBLES_TEST_BATCH_ENGINE_H_
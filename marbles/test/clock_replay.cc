@@ -0,0 +1,177 @@
+// Copyright 2015 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Replays a recorded clock through a RampExtractor.
+
+#include "marbles/test/clock_replay.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include "stmlib/utils/gate_flags.h"
+
+namespace marbles {
+
+using namespace std;
+using namespace stmlib;
+
+const size_t kReplayBlockSize = 256;
+
+void ClockReplay::Init(float sample_rate, float pulse_duration) {
+  sample_rate_ = sample_rate;
+  pulse_duration_ = max(
+      static_cast<size_t>(pulse_duration * sample_rate),
+      static_cast<size_t>(1));
+  timestamps_.clear();
+}
+
+bool ClockReplay::Load(const char* file_name) {
+  FILE* fp = fopen(file_name, "r");
+  if (!fp) {
+    return false;
+  }
+  
+  timestamps_.clear();
+  char line[256];
+  while (fgets(line, sizeof(line), fp)) {
+    double t;
+    if (line[0] != '#' && sscanf(line, "%lf", &t) == 1) {
+      timestamps_.push_back(t);
+    }
+  }
+  fclose(fp);
+  sort(timestamps_.begin(), timestamps_.end());
+  return timestamps_.size() >= 2;
+}
+
+bool ClockReplay::Save(const char* file_name) const {
+  FILE* fp = fopen(file_name, "w");
+  if (!fp) {
+    return false;
+  }
+  fprintf(fp, "# Clock timestamps (s)\n");
+  for (size_t i = 0; i < timestamps_.size(); ++i) {
+    fprintf(fp, "%.6f\n", timestamps_[i]);
+  }
+  fclose(fp);
+  return true;
+}
+
+void ClockReplay::Run(
+    RampExtractor* extractor,
+    float lock_threshold,
+    ClockReplayResult* result) const {
+  Ratio ratio;
+  ratio.p = 1;
+  ratio.q = 1;
+  
+  // Edges, in samples, relative to the first one.
+  vector<size_t> edge(timestamps_.size());
+  for (size_t i = 0; i < timestamps_.size(); ++i) {
+    edge[i] = static_cast<size_t>(
+        (timestamps_[i] - timestamps_[0]) * sample_rate_ + 0.5);
+  }
+  
+  size_t num_periods = edge.empty() ? 0 : edge.size() - 1;
+  vector<float> phase_error(num_periods);
+  vector<float> period_error(num_periods);
+  
+  GateFlags flags[kReplayBlockSize];
+  float ramp[kReplayBlockSize];
+  GateFlags previous_flag = GATE_FLAG_LOW;
+  
+  extractor->Reset();
+  for (size_t k = 0; k < num_periods; ++k) {
+    const size_t start = edge[k];
+    const size_t end = edge[k + 1];
+    const float period = static_cast<float>(end - start);
+    double sum = 0.0;
+    
+    for (size_t n = start; n < end; n += kReplayBlockSize) {
+      size_t size = min(kReplayBlockSize, end - n);
+      for (size_t i = 0; i < size; ++i) {
+        bool high = (n + i - start) < pulse_duration_;
+        previous_flag = ExtractGateFlags(previous_flag, high);
+        flags[i] = previous_flag;
+      }
+      extractor->Process(ratio, false, flags, ramp, size);
+      if (n == start) {
+        // The rising edge has been processed: the extractor has just
+        // evaluated its prediction for the period which ended on it.
+        period_error[k] = k == 0 ? 0.0f : extractor->statistics().error;
+      }
+      for (size_t i = 0; i < size; ++i) {
+        float ideal = static_cast<float>(n + i - start + 1) / period;
+        float error = ramp[i] - ideal;
+        sum += error * error;
+      }
+    }
+    phase_error[k] = sqrt(sum / period);
+  }
+  
+  // The error on the period which ended at edge k is only known at edge k.
+  // Shift it so that period_error[k] is the error on period k.
+  for (size_t k = 0; k + 1 < num_periods; ++k) {
+    period_error[k] = period_error[k + 1];
+  }
+  
+  result->num_periods = num_periods;
+  result->lock_time = -1.0f;
+  result->lock_period = num_periods;
+  size_t run = 0;
+  for (size_t k = 0; k < num_periods; ++k) {
+    run = phase_error[k] < lock_threshold ? run + 1 : 0;
+    if (run == kLockNumPeriods) {
+      result->lock_period = k + 1 - kLockNumPeriods;
+      result->lock_time = static_cast<float>(
+          timestamps_[result->lock_period] - timestamps_[0]);
+      break;
+    }
+  }
+  
+  double phase_sum = 0.0;
+  double period_sum = 0.0;
+  size_t num_period_errors = 0;
+  result->max_phase_error = 0.0f;
+  for (size_t k = result->lock_period; k < num_periods; ++k) {
+    phase_sum += phase_error[k] * phase_error[k];
+    result->max_phase_error = max(result->max_phase_error, phase_error[k]);
+    if (k + 1 < num_periods) {
+      period_sum += period_error[k] * period_error[k];
+      ++num_period_errors;
+    }
+  }
+  size_t num_locked = num_periods - result->lock_period;
+  result->phase_jitter = num_locked ? sqrt(phase_sum / num_locked) : 0.0f;
+  result->period_jitter = num_period_errors
+      ? sqrt(period_sum / num_period_errors)
+      : 0.0f;
+  result->best_predictor = extractor->best_predictor();
+  result->statistics = extractor->statistics();
+}
+
+}  // namespace marbles
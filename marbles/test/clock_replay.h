@@ -0,0 +1,103 @@
+// Copyright 2015 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Replays a recorded clock through a RampExtractor, and measures how fast and
+// how tightly its ramp locks to the clock.
+//
+// Clock files are text files with the time (in seconds) of each rising edge,
+// one per line. Lines starting with # are ignored.
+//
+// The phase error is the difference between the ramp and the ideal ramp
+// going from 0 to 1 between two consecutive edges. The clock is locked once
+// the RMS phase error stays below a threshold for kLockNumPeriods periods.
+
+#ifndef MARBLES_TEST_CLOCK_REPLAY_H_
+#define MARBLES_TEST_CLOCK_REPLAY_H_
+
+#include <vector>
+
+#include "stmlib/stmlib.h"
+
+#include "marbles/ramp/ramp_extractor.h"
+
+namespace marbles {
+
+const size_t kLockNumPeriods = 8;
+
+struct ClockReplayResult {
+  size_t num_periods;
+  
+  // Time of the first edge of the first run of kLockNumPeriods locked
+  // periods, relative to the first edge, or -1 if the clock never locked.
+  float lock_time;
+  size_t lock_period;
+  
+  // RMS phase error after lock, as a fraction of the period.
+  float phase_jitter;
+  // Largest RMS phase error of a period after lock.
+  float max_phase_error;
+  // RMS error of the period used by the extractor after lock, relative to
+  // the actual period.
+  float period_jitter;
+  
+  int best_predictor;  // At the end of the replay.
+  PredictionStatistics statistics;
+};
+
+class ClockReplay {
+ public:
+  ClockReplay() { }
+  ~ClockReplay() { }
+  
+  // pulse_duration is the time the clock stays high after each edge - short
+  // triggers by default, which disables the pulse width based prediction.
+  void Init(float sample_rate, float pulse_duration);
+  
+  bool Load(const char* file_name);
+  bool Save(const char* file_name) const;
+  
+  inline void Clear() { timestamps_.clear(); }
+  inline void AddTimestamp(double t) { timestamps_.push_back(t); }
+  inline size_t num_timestamps() const { return timestamps_.size(); }
+  
+  // The extractor is reset before the replay, and its registered predictors
+  // and set of enabled predictors are preserved.
+  void Run(
+      RampExtractor* extractor,
+      float lock_threshold,
+      ClockReplayResult* result) const;
+  
+ private:
+  float sample_rate_;
+  size_t pulse_duration_;
+  std::vector<double> timestamps_;
+  
+  DISALLOW_COPY_AND_ASSIGN(ClockReplay);
+};
+
+}  // namespace marbles
+
+#endif  // MARBLES_TEST_CLOCK_REPLAY_H_
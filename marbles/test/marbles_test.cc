@@ -13,8 +13,17 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <vector>
+
 #include "marbles/cv_reader_channel.h"
 #include "marbles/note_filter.h"
+#include "marbles/random/counter_random_generator.h"
+#include "marbles/ramp/period_predictor.h"
 #include "marbles/ramp/ramp_divider.h"
 #include "marbles/ramp/ramp_extractor.h"
 #include "marbles/random/distributions.h"
@@ -25,6 +34,8 @@
 #include "marbles/random/t_generator.h"
 #include "marbles/random/x_y_generator.h"
 #include "marbles/scale_recorder.h"
+#include "marbles/test/batch_engine.h"
+#include "marbles/test/clock_replay.h"
 #include "marbles/test/fixtures.h"
 #include "marbles/test/ramp_checker.h"
 #include "stmlib/test/wav_writer.h"
@@ -696,6 +707,430 @@ void TestScaleRecorder() {
   }
 }
 
+void TestCounterRandomGenerator() {
+  const size_t kNumWords = 4096;
+  vector<uint32_t> reference(kNumWords);
+  vector<uint32_t> words(kNumWords);
+
+  CounterRandomGenerator generator;
+  generator.Init(0x1234);
+  for (size_t i = 0; i < kNumWords; ++i) {
+    reference[i] = generator.GetWord();
+  }
+
+  // Filling vectors of any size gives the same sequence.
+  const size_t vector_sizes[] = { 1, 3, 4, 5, 16, 17, 127, 1000 };
+  for (size_t i = 0; i < sizeof(vector_sizes) / sizeof(size_t); ++i) {
+    generator.Init(0x1234);
+    for (size_t n = 0; n < kNumWords; n += vector_sizes[i]) {
+      generator.Fill(&words[n], min(vector_sizes[i], kNumWords - n));
+    }
+    assert(words == reference);
+  }
+
+  // So does starting in the middle of the sequence.
+  generator.Init(0x1234);
+  generator.Seek(1001);
+  assert(generator.GetWord() == reference[1001]);
+
+  // Child sequences are distinct from their parent and from each other.
+  CounterRandomGenerator child[2];
+  generator.Init(0x1234);
+  generator.Split(0, &child[0]);
+  generator.Split(1, &child[1]);
+  size_t num_identical = 0;
+  for (size_t i = 0; i < kNumWords; ++i) {
+    uint32_t a = child[0].GetWord();
+    uint32_t b = child[1].GetWord();
+    num_identical += (a == b) + (a == reference[i]);
+  }
+  assert(num_identical < 2);
+
+  // Sanity check of the distribution of the words.
+  size_t histogram[16] = { 0 };
+  generator.Init(0);
+  for (size_t i = 0; i < 1600000; ++i) {
+    ++histogram[generator.GetWord() >> 28];
+  }
+  for (size_t i = 0; i < 16; ++i) {
+    assert(histogram[i] > 99000 && histogram[i] < 101000);
+  }
+
+  const size_t kNumBenchmarkWords = 1 << 26;
+  generator.Init(1);
+  clock_t start = clock();
+  uint32_t sum = 0;
+  for (size_t n = 0; n < kNumBenchmarkWords; n += kNumWords) {
+    generator.Fill(&words[0], kNumWords);
+    sum += words[n % kNumWords];
+  }
+  float elapsed = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+  printf("Counter RNG: %.1f Mwords/s (%08x)\n",
+         kNumBenchmarkWords / elapsed * 1e-6f, sum);
+}
+
+void TestBatchEngine() {
+  const size_t kNumJobs = 32;
+  const size_t kNumFrames = ::kSampleRate * 60;
+
+  GroupSettings x;
+  x.control_mode = CONTROL_MODE_BUMP;
+  x.voltage_range = VOLTAGE_RANGE_FULL;
+  x.register_mode = false;
+  x.register_value = 0.0f;
+  x.spread = 0.6f;
+  x.bias = 0.5f;
+  x.steps = 0.7f;
+  x.deja_vu = 0.3f;
+  x.scale_index = 0;
+  x.length = 8;
+  x.ratio.p = 1;
+  x.ratio.q = 1;
+
+  GroupSettings y = x;
+  y.control_mode = CONTROL_MODE_IDENTICAL;
+  y.deja_vu = 0.0f;
+  y.length = 1;
+  y.ratio.q = 4;
+
+  vector<BatchJob> jobs(kNumJobs);
+  for (size_t i = 0; i < kNumJobs; ++i) {
+    BatchJob* j = &jobs[i];
+    j->seed = i;
+    j->t_model = TGeneratorModel(i % (T_GENERATOR_MODEL_MARKOV + 1));
+    j->t_range = T_GENERATOR_RANGE_4X;
+    j->t_rate = 0.5f;
+    j->t_bias = 0.5f;
+    j->t_jitter = 0.2f;
+    j->t_deja_vu = 0.0f;
+    j->t_length = 8;
+    j->t_pulse_width_mean = 0.5f;
+    j->t_pulse_width_std = 0.2f;
+    j->x = x;
+    j->y = y;
+    j->num_frames = kNumFrames;
+    j->voltages = NULL;
+    j->gates = NULL;
+  }
+
+  vector<uint64_t> hashes;
+  const size_t num_threads[] = { 1, 2, 4, 8 };
+  for (size_t i = 0; i < sizeof(num_threads) / sizeof(size_t); ++i) {
+    BatchEngine engine;
+    engine.Init(num_threads[i], ::kSampleRate);
+    engine.Render(&jobs[0], kNumJobs);
+    const BatchStatistics& s = engine.statistics();
+    printf("Batch engine, %lu threads: %.2f sequences/s, "
+           "%.0fx realtime (%.0fx per core)\n",
+           s.num_threads, s.sequences_per_second(),
+           s.realtime_ratio(), s.realtime_ratio_per_core());
+    for (size_t j = 0; j < kNumJobs; ++j) {
+      if (i == 0) {
+        hashes.push_back(jobs[j].hash);
+      } else {
+        assert(hashes[j] == jobs[j].hash);
+      }
+    }
+  }
+
+  // Different seeds, different sequences.
+  sort(hashes.begin(), hashes.end());
+  assert(unique(hashes.begin(), hashes.end()) == hashes.end());
+}
+
+void TestBetaDistributionSampler() {
+  const size_t kNumSamples = 65536;
+  vector<float> uniform(kNumSamples);
+  vector<float> samples(kNumSamples);
+  vector<uint32_t> words(kNumSamples);
+  
+  CounterRandomGenerator generator;
+  generator.Init(0x5eed);
+  generator.Fill(&words[0], kNumSamples);
+  // Strictly between 0 and 1: the scalar version reads past the end of its
+  // tables for 1.0 (or 0.0 when the result is flipped).
+  for (size_t i = 0; i < kNumSamples; ++i) {
+    uniform[i] = (static_cast<float>(words[i] >> 8) + 0.5f) / 16777216.0f;
+  }
+  // The boundaries between the main table and the tails.
+  uniform[0] = 0.05f;
+  uniform[1] = 0.95f;
+  
+  float max_error = 0.0f;
+  float max_cdf_error = 0.0f;
+  for (int i = 0; i <= 8; ++i) {
+    for (int j = 0; j <= 12; ++j) {
+      float bias = float(i) / 8.0f;
+      float spread = float(j) / 12.0f;
+      BetaDistributionSampler sampler;
+      sampler.Init(spread, bias);
+      sampler.Sample(&uniform[0], &samples[0], kNumSamples);
+      
+      // Same samples as the scalar version, up to rounding errors.
+      for (size_t n = 0; n < kNumSamples; ++n) {
+        float error = fabs(
+            samples[n] - BetaDistributionSample(uniform[n], spread, bias));
+        max_error = max(max_error, error);
+      }
+      
+      // The distribution of the samples follows the target distribution:
+      // a fraction q of the samples is below the q-th quantile. Inverse
+      // cdfs can be flat, so ties are counted on both sides.
+      vector<float> sorted(samples);
+      sort(sorted.begin(), sorted.end());
+      for (int k = 1; k < 32; ++k) {
+        float q = float(k) / 32.0f;
+        float quantile = BetaDistributionSample(q, spread, bias);
+        float below = float(lower_bound(sorted.begin(), sorted.end(), quantile)
+            - sorted.begin()) / kNumSamples;
+        float below_or_equal = float(upper_bound(
+            sorted.begin(), sorted.end(), quantile) - sorted.begin()) / \
+                kNumSamples;
+        float error = max(max(below - q, q - below_or_equal), 0.0f);
+        max_cdf_error = max(max_cdf_error, error);
+      }
+    }
+  }
+  printf("Beta sampler: max error %g, max CDF error %g\n",
+         max_error, max_cdf_error);
+  assert(max_error < 1e-5f);
+  assert(max_cdf_error < 0.01f);
+
+  // Throughput, with new parameters every 1024 samples.
+  const size_t kBlockSize = 1024;
+  const size_t kNumBenchmarkSamples = 1 << 24;
+  float spread = 0.3f;
+  float bias = 0.6f;
+  float sum = 0.0f;
+  
+  clock_t start = clock();
+  for (size_t n = 0; n < kNumBenchmarkSamples; n += kBlockSize) {
+    spread = spread >= 0.9f ? 0.1f : spread + 0.01f;
+    for (size_t i = 0; i < kBlockSize; ++i) {
+      samples[i] = BetaDistributionSample(uniform[(n + i) % kNumSamples],
+          spread, bias);
+    }
+    sum += samples[n % kBlockSize];
+  }
+  float scalar = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+  
+  start = clock();
+  for (size_t n = 0; n < kNumBenchmarkSamples; n += kBlockSize) {
+    spread = spread >= 0.9f ? 0.1f : spread + 0.01f;
+    BetaDistributionSampler sampler;
+    sampler.Init(spread, bias);
+    sampler.Sample(&uniform[n % kNumSamples], &samples[0], kBlockSize);
+    sum += samples[n % kBlockSize];
+  }
+  float batched = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+  printf("Beta sampler: scalar %.1f Msamples/s, batched %.1f Msamples/s "
+         "(%f)\n",
+         kNumBenchmarkSamples / scalar * 1e-6f,
+         kNumBenchmarkSamples / batched * 1e-6f,
+         sum);
+}
+
+// The search in Quantizer::Process().
+float ReferenceQuantize(const Scale& scale, uint8_t threshold, float value) {
+  uint16_t bitmask = 0;
+  int first = -1;
+  int last = 0;
+  for (int i = 0; i < scale.num_degrees; ++i) {
+    if (scale.degree[i].weight >= threshold) {
+      bitmask |= 1 << i;
+      if (first == -1) first = i;
+      last = i;
+    }
+  }
+
+  const float note = value * (1.0f / scale.base_interval);
+  MAKE_INTEGRAL_FRACTIONAL(note);
+  if (value < 0.0f) {
+    note_integral -= 1;
+    note_fractional += 1.0f;
+  }
+  note_fractional *= scale.base_interval;
+
+  float a = scale.degree[last].voltage - scale.base_interval;
+  float b = scale.degree[first].voltage + scale.base_interval;
+  for (int i = 0; i < scale.num_degrees; ++i) {
+    if (bitmask & 1) {
+      float v = scale.degree[i].voltage;
+      if (note_fractional > v) {
+        a = v;
+      } else {
+        b = v;
+        break;
+      }
+    }
+    bitmask >>= 1;
+  }
+  float quantized_voltage = note_fractional < (a + b) * 0.5f ? a : b;
+  return quantized_voltage + \
+      static_cast<float>(note_integral) * scale.base_interval;
+}
+
+void TestQuantizerLookup() {
+  Scale scales[3];
+  scales[0].InitMajor();
+  scales[1].InitTenth();
+  
+  // Irregular scale with a different base interval.
+  scales[2].base_interval = 1.5f;
+  scales[2].num_degrees = 16;
+  for (int i = 0; i < 16; ++i) {
+    scales[2].degree[i].voltage = 1.5f * float(i * i) / 256.0f;
+    scales[2].degree[i].weight = i == 3 ? 255 : (i * 97) % 251;
+  }
+  
+  const size_t kNumValues = 10 * 4096 + 1;
+  vector<float> values(kNumValues);
+  vector<float> quantized(kNumValues);
+  for (size_t i = 0; i < kNumValues; ++i) {
+    values[i] = float(i) / 4096.0f - 5.0f;
+  }
+  
+  // Exhaustive comparison with the search in Process(), on a fine grid covering
+  // the full voltage range, and for all levels.
+  for (int s = 0; s < 3; ++s) {
+    const Scale& scale = scales[s];
+    uint8_t thresholds[kNumThresholds] = { 0, 16, 32, 64, 128, 192, 255 };
+    uint8_t second_largest_threshold = 0;
+    for (int i = 0; i < scale.num_degrees; ++i) {
+      uint8_t w = scale.degree[i].weight;
+      if (w != 255 && w >= second_largest_threshold) {
+        second_largest_threshold = w;
+      }
+    }
+    if (second_largest_threshold > 192) {
+      thresholds[kNumThresholds - 2] = second_largest_threshold;
+    }
+    
+    for (int level = 0; level <= kNumThresholds; ++level) {
+      float amount = float(level) / float(kNumThresholds);
+      Quantizer q;
+      q.Init(scale);
+      for (size_t i = 0; i < kNumValues; ++i) {
+        float expected = level == 0
+            ? values[i]
+            : ReferenceQuantize(scale, thresholds[level - 1], values[i]);
+        assert(q.Process(values[i], amount, false) == expected);
+      }
+      q.Process(&values[0], &quantized[0], kNumValues, amount);
+      for (size_t i = 0; i < kNumValues; ++i) {
+        assert(quantized[i] == q.Process(values[i], amount, false));
+      }
+    }
+  }
+  
+  // Throughput.
+  const size_t kNumIterations = 200;
+  Quantizer q;
+  q.Init(scales[0]);
+  float sum = 0.0f;
+  
+  clock_t start = clock();
+  for (size_t n = 0; n < kNumIterations; ++n) {
+    for (size_t i = 0; i < kNumValues; ++i) {
+      quantized[i] = ReferenceQuantize(scales[0], 64, values[i]);
+    }
+    sum += quantized[n];
+  }
+  float reference = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+  
+  start = clock();
+  for (size_t n = 0; n < kNumIterations; ++n) {
+    for (size_t i = 0; i < kNumValues; ++i) {
+      quantized[i] = q.Process(values[i], 0.6f, false);
+    }
+    sum += quantized[n];
+  }
+  float scalar = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+  
+  start = clock();
+  for (size_t n = 0; n < kNumIterations; ++n) {
+    q.Process(&values[0], &quantized[0], kNumValues, 0.6f);
+    sum += quantized[n];
+  }
+  float batched = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+  
+  const float num_values = kNumIterations * kNumValues * 1e-6f;
+  printf("Quantizer: reference %.1f Mvalues/s, scalar %.1f Mvalues/s, "
+         "batched %.1f Mvalues/s (%f)\n",
+         num_values / reference, num_values / scalar, num_values / batched,
+         sum);
+}
+
+void MakeNetworkClock(
+    float bpm,
+    float new_bpm,
+    float jitter,
+    float duration,
+    ClockReplay* replay) {
+  // 24 PPQN clock, with a tempo change halfway, and with a gaussian jitter on
+  // each edge.
+  CounterRandomGenerator generator;
+  generator.Init(0x24);
+  replay->Clear();
+  double t = 0.0;
+  while (t < duration) {
+    float u = 1.0f - generator.GetFloat();
+    float v = generator.GetFloat();
+    float gaussian = sqrtf(-2.0f * logf(u)) * cosf(2.0f * M_PI * v);
+    replay->AddTimestamp(max(t + 0.1 + jitter * gaussian, 0.0));
+    t += 60.0 / ((t < duration * 0.5f ? bpm : new_bpm) * 24.0);
+  }
+}
+
+void TestClockReplay() {
+  const char* predictor_names[] = {
+    "Built-in", "Kalman", "Built-in + Kalman"
+  };
+  const float jitters[] = { 0.0f, 0.0005f, 0.001f };
+
+  ClockReplay replay;
+  replay.Init(::kSampleRate, 0.001f);
+  
+  for (size_t j = 0; j < sizeof(jitters) / sizeof(float); ++j) {
+    MakeNetworkClock(120.0f, 132.0f, jitters[j], 60.0f, &replay);
+    assert(replay.Save("marbles_clock.txt"));
+    assert(replay.Load("marbles_clock.txt"));
+    
+    for (int i = 0; i < 3; ++i) {
+      KalmanPeriodPredictor kalman;
+      kalman.Init(0.002f, 0.01f);
+      
+      RampExtractor extractor;
+      extractor.Init(1000.0f / ::kSampleRate);
+      int index = extractor.AddPredictor(&kalman);
+      assert(index == RampExtractor::PREDICTOR_LAST);
+      if (i == 0) {
+        extractor.set_enabled_predictors((1 << index) - 1);
+      } else if (i == 1) {
+        extractor.set_enabled_predictors(1 << index);
+      }
+      
+      ClockReplayResult r;
+      replay.Run(&extractor, 0.05f, &r);
+      printf("%.1f ms jitter, %s: lock %.3f s (period %lu), "
+             "phase jitter %.2f%%, period jitter %.2f%%, "
+             "predictor %d (selected %u times)\n",
+             jitters[j] * 1000.0f, predictor_names[i], r.lock_time,
+             r.lock_period, r.phase_jitter * 100.0f,
+             r.period_jitter * 100.0f, r.best_predictor,
+             extractor.predictor_statistics(r.best_predictor).num_selected);
+      assert(r.statistics.num_predictions == r.num_periods);
+      assert(r.lock_time >= 0.0f);
+      
+      // Replays are deterministic.
+      ClockReplayResult r2;
+      replay.Run(&extractor, 0.05f, &r2);
+      assert(r2.lock_period == r.lock_period);
+      assert(r2.phase_jitter == r.phase_jitter);
+    }
+  }
+}
+
 int main(void) {
   // Test distributions and value processors.
   // TestBetaDistribution();
@@ -716,6 +1151,11 @@ int main(void) {
   // TestXYGeneratorASR();
   // TestTGeneratorRampIntegrity();
   TestTGenerator();
+  TestCounterRandomGenerator();
+  TestBatchEngine();
+  TestBetaDistributionSampler();
+  TestQuantizerLookup();
+  TestClockReplay();
   
   // TestScaleRecorder();
 }
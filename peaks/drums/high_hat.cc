@@ -28,6 +28,7 @@
 
 #include "peaks/drums/high_hat.h"
 
+#include <algorithm>
 #include <cstdio>
 
 #include "stmlib/utils/dsp.h"
@@ -40,6 +41,8 @@ namespace peaks {
 using namespace stmlib;
 
 void HighHat::Init() {
+  std::fill(&phase_[0], &phase_[6], 0);
+
   noise_.Init();
   noise_.set_frequency(105 << 7);  // 8kHz
   noise_.set_resonance(24000);
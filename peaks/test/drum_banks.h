@@ -0,0 +1,416 @@
+// Copyright 2013 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Banks of hi-hat and snare drum voices, rendered together on the host.
+//
+// The state of the voices is stored in arrays indexed by lane, and the inner
+// loops run over the lanes, without branches, so that the compiler turns them
+// into SIMD code: the six square oscillators of the hi-hat, the noise
+// generators of the snare drum, and all the SVF and excitation chains are
+// processed for a whole vector of voices at once. The output is identical to
+// the one of HighHat and SnareDrum - except that each snare drum voice has its
+// own noise generator, with the recurrence of stmlib::Random.
+//
+// Gate flags and output samples are interleaved: gate_flags[i * num_voices +
+// j] and out[i * num_voices + j] are those of sample i of voice j.
+//
+// The kernels always process kDrumBankMaxVoices lanes. With a trip count
+// known at compile time, GCC vectorizes them at -O2 - its cheap cost model
+// rejects loops over a variable number of lanes. The unused lanes are never
+// triggered, and their output is not written back, so a bank of a few voices
+// costs as much as a full one.
+
+#ifndef PEAKS_TEST_DRUM_BANKS_H_
+#define PEAKS_TEST_DRUM_BANKS_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+
+#include "stmlib/utils/dsp.h"
+
+#include "peaks/drums/svf.h"
+#include "peaks/gate_processor.h"
+#include "peaks/resources.h"
+
+namespace peaks {
+
+const size_t kDrumBankMaxVoices = 16;
+const size_t kDrumBankBlockSize = 32;
+
+// Same as CLIP, written with min/max, which the compiler vectorizes.
+inline int32_t ClipLane(int32_t x) {
+  return std::max(std::min(x, 32767), -32767);
+}
+
+// Svf, without punch, for all the lanes of a bank.
+class SvfLanes {
+ public:
+  SvfLanes() { }
+  ~SvfLanes() { }
+
+  void Init() {
+    std::fill(&lp_[0], &lp_[kDrumBankMaxVoices], 0);
+    std::fill(&bp_[0], &bp_[kDrumBankMaxVoices], 0);
+    for (size_t i = 0; i < kDrumBankMaxVoices; ++i) {
+      set_frequency(i, 33 << 7);
+      set_resonance(i, 16384);
+    }
+  }
+
+  inline void set_frequency(size_t lane, int16_t frequency) {
+    f_[lane] = stmlib::Interpolate824(lut_svf_cutoff, frequency << 17);
+  }
+
+  inline void set_resonance(size_t lane, int16_t resonance) {
+    damp_[lane] = stmlib::Interpolate824(lut_svf_damp, resonance << 17);
+  }
+
+  template<SvfMode mode>
+  inline int32_t Process(size_t lane, int32_t in) {
+    int32_t f = f_[lane];
+    int32_t lp = lp_[lane];
+    int32_t bp = bp_[lane];
+    int32_t notch = in - (bp * damp_[lane] >> 15);
+    lp = ClipLane(lp + (f * bp >> 15));
+    int32_t hp = notch - lp;
+    bp = ClipLane(bp + (f * hp >> 15));
+    lp_[lane] = lp;
+    bp_[lane] = bp;
+    return mode == SVF_MODE_BP ? bp : (mode == SVF_MODE_HP ? hp : lp);
+  }
+
+ private:
+  int32_t f_[kDrumBankMaxVoices];
+  int32_t damp_[kDrumBankMaxVoices];
+  int32_t lp_[kDrumBankMaxVoices];
+  int32_t bp_[kDrumBankMaxVoices];
+
+  DISALLOW_COPY_AND_ASSIGN(SvfLanes);
+};
+
+// Excitation, for all the lanes of a bank.
+class ExcitationLanes {
+ public:
+  ExcitationLanes() { }
+  ~ExcitationLanes() { }
+
+  void Init(uint16_t delay, uint16_t decay) {
+    for (size_t i = 0; i < kDrumBankMaxVoices; ++i) {
+      delay_[i] = delay;
+      decay_[i] = decay;
+      counter_[i] = 0;
+      state_[i] = 0;
+      level_[i] = 0;
+    }
+  }
+
+  inline void set_decay(size_t lane, uint16_t decay) {
+    decay_[lane] = decay;
+  }
+
+  // Triggers the lane if all the bits of mask are set. The selection is done
+  // with the mask, since the compiler turns a conditional expression into a
+  // branch here.
+  inline void Trigger(size_t lane, int32_t mask, int32_t level) {
+    level_[lane] += (level - level_[lane]) & mask;
+    counter_[lane] += (delay_[lane] + 1 - counter_[lane]) & mask;
+  }
+
+  inline bool done(size_t lane) const {
+    return counter_[lane] == 0;
+  }
+
+  inline int32_t Process(size_t lane) {
+    int32_t state = state_[lane] * decay_[lane] >> 12;
+    int32_t counter = counter_[lane];
+    int32_t level = level_[lane];
+    int32_t magnitude = level < 0 ? -level : level;
+    state += counter == 1 ? magnitude : 0;
+    counter_[lane] = counter > 0 ? counter - 1 : counter;
+    state_[lane] = state;
+    return level < 0 ? -state : state;
+  }
+
+ private:
+  int32_t delay_[kDrumBankMaxVoices];
+  uint32_t decay_[kDrumBankMaxVoices];
+  int32_t counter_[kDrumBankMaxVoices];
+  int32_t state_[kDrumBankMaxVoices];
+  int32_t level_[kDrumBankMaxVoices];
+
+  DISALLOW_COPY_AND_ASSIGN(ExcitationLanes);
+};
+
+// Gate flags and output of the voices of a bank, for a block of at most
+// kDrumBankBlockSize samples, copied in and out of the interleaved buffers.
+// The kernels use this copy, on the stack, instead of the caller's buffers,
+// which the compiler cannot prove to be distinct from the state of the
+// voices.
+struct DrumBankBlock {
+  int32_t trigger[kDrumBankBlockSize][kDrumBankMaxVoices];
+  int32_t out[kDrumBankBlockSize][kDrumBankMaxVoices];
+
+  void ReadTriggers(const GateFlags* gate_flags, size_t n, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+      for (size_t j = 0; j < n; ++j) {
+        trigger[i][j] = -static_cast<int32_t>(
+            (gate_flags[i * n + j] & GATE_FLAG_RISING) != 0);
+      }
+      std::fill(&trigger[i][n], &trigger[i][kDrumBankMaxVoices], 0);
+    }
+  }
+
+  void Write(int16_t* destination, size_t n, size_t size) const {
+    for (size_t i = 0; i < size; ++i) {
+      for (size_t j = 0; j < n; ++j) {
+        destination[i * n + j] = out[i][j];
+      }
+    }
+  }
+};
+
+class HighHatBank {
+ public:
+  HighHatBank() { }
+  ~HighHatBank() { }
+
+  void Init(size_t num_voices) {
+    num_voices_ = num_voices;
+    for (size_t i = 0; i < 6; ++i) {
+      std::fill(&phase_[i][0], &phase_[i][kDrumBankMaxVoices], 0);
+    }
+    noise_.Init();
+    vca_coloration_.Init();
+    for (size_t i = 0; i < kDrumBankMaxVoices; ++i) {
+      noise_.set_frequency(i, 105 << 7);  // 8kHz
+      noise_.set_resonance(i, 24000);
+      vca_coloration_.set_frequency(i, 110 << 7);  // 13kHz
+      vca_coloration_.set_resonance(i, 0);
+    }
+    vca_envelope_.Init(0, 4093);
+  }
+
+  void Configure(size_t voice, uint16_t* parameter, ControlMode control_mode) {
+  }
+
+  void Process(const GateFlags* gate_flags, int16_t* out, size_t size) {
+    const size_t n = num_voices_;
+    DrumBankBlock block;
+    while (size) {
+      size_t block_size = std::min(size, kDrumBankBlockSize);
+      block.ReadTriggers(gate_flags, n, block_size);
+      for (size_t i = 0; i < block_size; ++i) {
+        for (size_t j = 0; j < kDrumBankMaxVoices; ++j) {
+          vca_envelope_.Trigger(j, block.trigger[i][j], 32768 * 15);
+
+          phase_[0][j] += 48318382;
+          phase_[1][j] += 71582788;
+          phase_[2][j] += 37044092;
+          phase_[3][j] += 54313440;
+          phase_[4][j] += 66214079;
+          phase_[5][j] += 93952409;
+
+          int32_t noise = 0;
+          noise += phase_[0][j] >> 31;
+          noise += phase_[1][j] >> 31;
+          noise += phase_[2][j] >> 31;
+          noise += phase_[3][j] >> 31;
+          noise += phase_[4][j] >> 31;
+          noise += phase_[5][j] >> 31;
+          noise <<= 12;
+
+          int32_t filtered_noise = 0;
+          filtered_noise += noise_.Process<SVF_MODE_BP>(j, noise);
+          filtered_noise += noise_.Process<SVF_MODE_BP>(j, noise);
+          filtered_noise = std::max(std::min(filtered_noise, 32767), 0);
+
+          int32_t envelope = vca_envelope_.Process(j) >> 4;
+          int32_t vca_noise = ClipLane(envelope * filtered_noise >> 14);
+          int32_t hh = 0;
+          hh += vca_coloration_.Process<SVF_MODE_HP>(j, vca_noise);
+          hh += vca_coloration_.Process<SVF_MODE_HP>(j, vca_noise);
+          block.out[i][j] = ClipLane(hh << 1);
+        }
+      }
+      block.Write(out, n, block_size);
+      gate_flags += block_size * n;
+      out += block_size * n;
+      size -= block_size;
+    }
+  }
+
+  inline size_t num_voices() const { return num_voices_; }
+
+ private:
+  size_t num_voices_;
+  uint32_t phase_[6][kDrumBankMaxVoices];
+  SvfLanes noise_;
+  SvfLanes vca_coloration_;
+  ExcitationLanes vca_envelope_;
+
+  DISALLOW_COPY_AND_ASSIGN(HighHatBank);
+};
+
+class SnareDrumBank {
+ public:
+  SnareDrumBank() { }
+  ~SnareDrumBank() { }
+
+  // The noise generator of voice i is seeded with seed + i.
+  void Init(size_t num_voices, uint32_t seed) {
+    num_voices_ = num_voices;
+    excitation_1_up_.Init(0, 1536);
+    excitation_1_down_.Init(1e-3 * 48000, 3072);
+    excitation_2_.Init(1e-3 * 48000, 1200);
+    excitation_noise_.Init(0, 4093);
+    body_1_.Init();
+    body_2_.Init();
+    noise_.Init();
+    for (size_t i = 0; i < kDrumBankMaxVoices; ++i) {
+      noise_.set_resonance(i, 2000);
+      set_tone(i, 0);
+      set_snappy(i, 32768);
+      set_decay(i, 32768);
+      set_frequency(i, 0);
+      rng_state_[i] = seed + i;
+    }
+  }
+
+  void Configure(size_t voice, uint16_t* parameter, ControlMode control_mode) {
+    if (control_mode == CONTROL_MODE_HALF) {
+      set_frequency(voice, 0);
+      set_decay(voice, 32768);
+      set_tone(voice, parameter[0]);
+      set_snappy(voice, parameter[1]);
+    } else {
+      set_frequency(voice, parameter[0] - 32768);
+      set_tone(voice, parameter[1]);
+      set_snappy(voice, parameter[2]);
+      set_decay(voice, parameter[3]);
+    }
+  }
+
+  void set_tone(size_t voice, uint16_t tone) {
+    gain_1_[voice] = 22000 - (tone >> 2);
+    gain_2_[voice] = 22000 + (tone >> 2);
+  }
+
+  void set_snappy(size_t voice, uint16_t snappy) {
+    snappy >>= 1;
+    if (snappy >= 28672) {
+      snappy = 28672;
+    }
+    snappy_[voice] = 512 + snappy;
+  }
+
+  void set_decay(size_t voice, uint16_t decay) {
+    body_1_.set_resonance(voice, 29000 + (decay >> 5));
+    body_2_.set_resonance(voice, 26500 + (decay >> 5));
+    excitation_noise_.set_decay(voice, 4092 + (decay >> 14));
+  }
+
+  void set_frequency(size_t voice, int16_t frequency) {
+    int16_t base_note = 52 << 7;
+    int32_t transposition = frequency;
+    base_note += transposition * 896 >> 15;
+    body_1_.set_frequency(voice, base_note);
+    body_2_.set_frequency(voice, base_note + (12 << 7));
+    noise_.set_frequency(voice, base_note + (48 << 7));
+  }
+
+  void Process(const GateFlags* gate_flags, int16_t* out, size_t size) {
+    const size_t n = num_voices_;
+    DrumBankBlock block;
+    while (size) {
+      size_t block_size = std::min(size, kDrumBankBlockSize);
+      block.ReadTriggers(gate_flags, n, block_size);
+      for (size_t i = 0; i < block_size; ++i) {
+        for (size_t j = 0; j < kDrumBankMaxVoices; ++j) {
+          int32_t trigger = block.trigger[i][j];
+          excitation_1_up_.Trigger(j, trigger, 15 * 32768);
+          excitation_1_down_.Trigger(j, trigger, -1 * 32768);
+          excitation_2_.Trigger(j, trigger, 13107);
+          excitation_noise_.Trigger(j, trigger, snappy_[j]);
+
+          int32_t excitation_1 = 0;
+          excitation_1 += excitation_1_up_.Process(j);
+          excitation_1 += excitation_1_down_.Process(j);
+          excitation_1 += !excitation_1_down_.done(j) ? 2621 : 0;
+
+          int32_t body_1 = body_1_.Process<SVF_MODE_BP>(j, excitation_1) + \
+              (excitation_1 >> 4);
+
+          int32_t excitation_2 = 0;
+          excitation_2 += excitation_2_.Process(j);
+          excitation_2 += !excitation_2_.done(j) ? 13107 : 0;
+
+          int32_t body_2 = body_2_.Process<SVF_MODE_BP>(j, excitation_2) + \
+              (excitation_2 >> 4);
+
+          // Same recurrence as stmlib::Random::GetSample().
+          rng_state_[j] = rng_state_[j] * 1664525L + 1013904223L;
+          int32_t noise_sample = static_cast<int16_t>(rng_state_[j] >> 16);
+          int32_t noise = noise_.Process<SVF_MODE_BP>(j, noise_sample);
+          int32_t noise_envelope = excitation_noise_.Process(j);
+          int32_t sd = 0;
+          sd += body_1 * gain_1_[j] >> 15;
+          sd += body_2 * gain_2_[j] >> 15;
+          sd += noise_envelope * noise >> 15;
+          block.out[i][j] = ClipLane(sd);
+        }
+      }
+      block.Write(out, n, block_size);
+      gate_flags += block_size * n;
+      out += block_size * n;
+      size -= block_size;
+    }
+  }
+
+  inline size_t num_voices() const { return num_voices_; }
+
+ private:
+  size_t num_voices_;
+
+  ExcitationLanes excitation_1_up_;
+  ExcitationLanes excitation_1_down_;
+  ExcitationLanes excitation_2_;
+  ExcitationLanes excitation_noise_;
+  SvfLanes body_1_;
+  SvfLanes body_2_;
+  SvfLanes noise_;
+
+  int32_t gain_1_[kDrumBankMaxVoices];
+  int32_t gain_2_[kDrumBankMaxVoices];
+  int32_t snappy_[kDrumBankMaxVoices];
+  uint32_t rng_state_[kDrumBankMaxVoices];
+
+  DISALLOW_COPY_AND_ASSIGN(SnareDrumBank);
+};
+
+}  // namespace peaks
+
+#endif  // PEAKS_TEST_DRUM_BANKS_H_
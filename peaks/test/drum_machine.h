@@ -0,0 +1,289 @@
+// Copyright 2013 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Host drum machine: many drum voices, each one playing a 16-step pattern,
+// rendered block by block and mixed together. Bass drum and FM drum voices are
+// rendered one by one; hi-hat and snare drum voices are grouped in banks of
+// kDrumBankMaxVoices voices. The time spent rendering each instrument is
+// measured, in cycles of the time stamp counter on x86 - in nanoseconds
+// elsewhere.
+
+#ifndef PEAKS_TEST_DRUM_MACHINE_H_
+#define PEAKS_TEST_DRUM_MACHINE_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+#include <ctime>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif  // __x86_64__ || __i386__
+
+#include "stmlib/utils/dsp.h"
+
+#include "peaks/drums/bass_drum.h"
+#include "peaks/drums/fm_drum.h"
+#include "peaks/gate_processor.h"
+#include "peaks/test/drum_banks.h"
+
+namespace peaks {
+
+const size_t kDrumMachineMaxVoices = 64;
+const size_t kDrumMachineNumSteps = 16;
+const size_t kDrumMachineNumBanks = kDrumMachineMaxVoices / kDrumBankMaxVoices;
+
+enum DrumMachineInstrument {
+  DRUM_MACHINE_INSTRUMENT_BASS_DRUM,
+  DRUM_MACHINE_INSTRUMENT_SNARE_DRUM,
+  DRUM_MACHINE_INSTRUMENT_HIGH_HAT,
+  DRUM_MACHINE_INSTRUMENT_FM_DRUM,
+  DRUM_MACHINE_INSTRUMENT_LAST
+};
+
+inline uint64_t ReadCycleCounter() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return static_cast<uint64_t>(t.tv_sec) * 1000000000 + t.tv_nsec;
+#endif  // __x86_64__ || __i386__
+}
+
+class DrumMachine {
+ public:
+  DrumMachine() { }
+  ~DrumMachine() { }
+
+  // The duration of a step is given in samples.
+  void Init(uint32_t step_duration) {
+    step_duration_ = step_duration;
+    clock_ = 0;
+    num_voices_ = 0;
+    std::fill(
+        &num_instruments_[0],
+        &num_instruments_[DRUM_MACHINE_INSTRUMENT_LAST],
+        0);
+    ResetMeasurements();
+  }
+
+  // Adds a voice playing a pattern - bit i set for a hit on step i. Returns
+  // false when all the voices are in use. The voices should all be added
+  // before the first call to Render(), since adding a hi-hat or snare drum
+  // voice resets its bank.
+  bool AddVoice(
+      DrumMachineInstrument instrument,
+      uint16_t pattern,
+      const uint16_t* parameter) {
+    if (num_voices_ == kDrumMachineMaxVoices) {
+      return false;
+    }
+    Voice* v = &voice_[num_voices_++];
+    v->instrument = instrument;
+    v->pattern = pattern;
+    v->previous_gate_flag = GATE_FLAG_LOW;
+    v->index = num_instruments_[instrument]++;
+    std::copy(&parameter[0], &parameter[4], &v->parameter[0]);
+
+    size_t bank = v->index / kDrumBankMaxVoices;
+    size_t lane = v->index % kDrumBankMaxVoices;
+    switch (instrument) {
+      case DRUM_MACHINE_INSTRUMENT_BASS_DRUM:
+        bass_drum_[v->index].Init();
+        bass_drum_[v->index].Configure(v->parameter, CONTROL_MODE_FULL);
+        break;
+
+      case DRUM_MACHINE_INSTRUMENT_FM_DRUM:
+        fm_drum_[v->index].Init();
+        fm_drum_[v->index].Configure(v->parameter, CONTROL_MODE_FULL);
+        break;
+
+      case DRUM_MACHINE_INSTRUMENT_HIGH_HAT:
+        high_hat_bank_[bank].Init(lane + 1);
+        break;
+
+      case DRUM_MACHINE_INSTRUMENT_SNARE_DRUM:
+        snare_drum_bank_[bank].Init(lane + 1, bank * kDrumBankMaxVoices);
+        for (size_t i = 0; i < num_voices_; ++i) {
+          const Voice& other = voice_[i];
+          if (other.instrument == instrument &&
+              other.index / kDrumBankMaxVoices == bank) {
+            snare_drum_bank_[bank].Configure(
+                other.index % kDrumBankMaxVoices,
+                voice_[i].parameter,
+                CONTROL_MODE_FULL);
+          }
+        }
+        break;
+
+      default:
+        break;
+    }
+    return true;
+  }
+
+  void Render(int16_t* out, size_t size) {
+    while (size) {
+      size_t block_size = std::min(size, kDrumBankBlockSize);
+      RenderBlock(out, block_size);
+      out += block_size;
+      size -= block_size;
+    }
+  }
+
+  void ResetMeasurements() {
+    std::fill(&cycles_[0], &cycles_[DRUM_MACHINE_INSTRUMENT_LAST], 0);
+    num_samples_ = 0;
+  }
+
+  inline size_t num_voices() const { return num_voices_; }
+  inline size_t num_voices(DrumMachineInstrument instrument) const {
+    return num_instruments_[instrument];
+  }
+  inline uint64_t cycles(DrumMachineInstrument instrument) const {
+    return cycles_[instrument];
+  }
+
+  // Average time spent rendering one sample of one voice.
+  inline double cycles_per_voice_sample(
+      DrumMachineInstrument instrument) const {
+    uint64_t n = num_samples_ * num_instruments_[instrument];
+    return n ? static_cast<double>(cycles_[instrument]) / n : 0.0;
+  }
+
+ private:
+  struct Voice {
+    DrumMachineInstrument instrument;
+    uint16_t pattern;
+    uint16_t parameter[4];
+    GateFlags previous_gate_flag;
+    size_t index;  // Among the voices playing the same instrument.
+  };
+
+  void RenderBlock(int16_t* out, size_t size) {
+    // The gate is high during the first half of the steps on which the
+    // pattern has a hit.
+    for (size_t i = 0; i < num_voices_; ++i) {
+      Voice* v = &voice_[i];
+      for (size_t j = 0; j < size; ++j) {
+        uint32_t t = clock_ + j;
+        uint32_t step = (t / step_duration_) % kDrumMachineNumSteps;
+        bool gate = (v->pattern & (1 << step)) && \
+            (t % step_duration_) < (step_duration_ >> 1);
+        v->previous_gate_flag = ExtractGateFlags(v->previous_gate_flag, gate);
+        gate_flags_[i][j] = v->previous_gate_flag;
+      }
+    }
+    clock_ += size;
+    num_samples_ += size;
+
+    std::fill(&mix_[0], &mix_[size], 0);
+    for (size_t i = 0; i < num_voices_; ++i) {
+      const Voice& v = voice_[i];
+      uint64_t start = ReadCycleCounter();
+      if (v.instrument == DRUM_MACHINE_INSTRUMENT_BASS_DRUM) {
+        bass_drum_[v.index].Process(gate_flags_[i], voice_out_, size);
+      } else if (v.instrument == DRUM_MACHINE_INSTRUMENT_FM_DRUM) {
+        fm_drum_[v.index].Process(gate_flags_[i], voice_out_, size);
+      } else {
+        continue;
+      }
+      cycles_[v.instrument] += ReadCycleCounter() - start;
+      for (size_t j = 0; j < size; ++j) {
+        mix_[j] += voice_out_[j];
+      }
+    }
+
+    RenderBanks(DRUM_MACHINE_INSTRUMENT_HIGH_HAT, size);
+    RenderBanks(DRUM_MACHINE_INSTRUMENT_SNARE_DRUM, size);
+
+    for (size_t j = 0; j < size; ++j) {
+      int32_t sample = mix_[j] >> 2;
+      CLIP(sample);
+      out[j] = sample;
+    }
+  }
+
+  void RenderBanks(DrumMachineInstrument instrument, size_t size) {
+    size_t num_banks = (num_instruments_[instrument] + \
+        kDrumBankMaxVoices - 1) / kDrumBankMaxVoices;
+    for (size_t bank = 0; bank < num_banks; ++bank) {
+      size_t n = std::min(
+          num_instruments_[instrument] - bank * kDrumBankMaxVoices,
+          kDrumBankMaxVoices);
+      for (size_t i = 0; i < num_voices_; ++i) {
+        const Voice& v = voice_[i];
+        if (v.instrument == instrument &&
+            v.index / kDrumBankMaxVoices == bank) {
+          size_t lane = v.index % kDrumBankMaxVoices;
+          for (size_t j = 0; j < size; ++j) {
+            bank_gate_flags_[j * n + lane] = gate_flags_[i][j];
+          }
+        }
+      }
+      uint64_t start = ReadCycleCounter();
+      if (instrument == DRUM_MACHINE_INSTRUMENT_HIGH_HAT) {
+        high_hat_bank_[bank].Process(bank_gate_flags_, bank_out_, size);
+      } else {
+        snare_drum_bank_[bank].Process(bank_gate_flags_, bank_out_, size);
+      }
+      cycles_[instrument] += ReadCycleCounter() - start;
+      for (size_t j = 0; j < size; ++j) {
+        for (size_t lane = 0; lane < n; ++lane) {
+          mix_[j] += bank_out_[j * n + lane];
+        }
+      }
+    }
+  }
+
+  uint32_t step_duration_;
+  uint32_t clock_;
+
+  Voice voice_[kDrumMachineMaxVoices];
+  size_t num_voices_;
+  size_t num_instruments_[DRUM_MACHINE_INSTRUMENT_LAST];
+
+  BassDrum bass_drum_[kDrumMachineMaxVoices];
+  FmDrum fm_drum_[kDrumMachineMaxVoices];
+  HighHatBank high_hat_bank_[kDrumMachineNumBanks];
+  SnareDrumBank snare_drum_bank_[kDrumMachineNumBanks];
+
+  GateFlags gate_flags_[kDrumMachineMaxVoices][kDrumBankBlockSize];
+  GateFlags bank_gate_flags_[kDrumBankBlockSize * kDrumBankMaxVoices];
+  int16_t bank_out_[kDrumBankBlockSize * kDrumBankMaxVoices];
+  int16_t voice_out_[kDrumBankBlockSize];
+  int32_t mix_[kDrumBankBlockSize];
+
+  uint64_t cycles_[DRUM_MACHINE_INSTRUMENT_LAST];
+  uint64_t num_samples_;
+
+  DISALLOW_COPY_AND_ASSIGN(DrumMachine);
+};
+
+}  // namespace peaks
+
+#endif  // PEAKS_TEST_DRUM_MACHINE_H_
@@ -13,14 +13,20 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <cassert>
 #include <cmath>
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
 
+#include "peaks/drums/high_hat.h"
+#include "peaks/drums/snare_drum.h"
 #include "peaks/processors.h"
+#include "peaks/test/drum_banks.h"
+#include "peaks/test/drum_machine.h"
 
 #include "stmlib/test/wav_writer.h"
+#include "stmlib/utils/random.h"
 
 using namespace peaks;
 using namespace stmlib;
@@ -109,7 +115,130 @@ void TestPatternPredictor() {
   }
 }
 
+HighHat high_hat[kDrumBankMaxVoices];
+SnareDrum snare_drum[kDrumBankMaxVoices];
+HighHatBank high_hat_bank;
+SnareDrumBank snare_drum_bank;
+
+// The kernels always run all kDrumBankMaxVoices lanes; with a partial bank,
+// the idle lanes must not leak into the interleaved output.
+void TestDrumBanks(size_t n) {
+  const size_t kBlockSize = kDrumBankBlockSize;
+  GateFlags gate_flags[kDrumBankMaxVoices][kBlockSize];
+  GateFlags bank_gate_flags[kBlockSize * kDrumBankMaxVoices];
+  int16_t out[kDrumBankMaxVoices][kBlockSize];
+  int16_t bank_out[kBlockSize * kDrumBankMaxVoices];
+  uint32_t rng_state[kDrumBankMaxVoices];
+  uint16_t parameter[4];
+
+  high_hat_bank.Init(n);
+  snare_drum_bank.Init(n, 0);
+  for (size_t j = 0; j < n; ++j) {
+    high_hat[j].Init();
+    snare_drum[j].Init();
+    parameter[0] = 10000 + j * 3000;
+    parameter[1] = j * 4000;
+    parameter[2] = 60000 - j * 2000;
+    parameter[3] = j * 4096;
+    snare_drum[j].Configure(parameter, CONTROL_MODE_FULL);
+    snare_drum_bank.Configure(j, parameter, CONTROL_MODE_FULL);
+    rng_state[j] = j;
+  }
+
+  int32_t error_high_hat = 0;
+  int32_t error_snare_drum = 0;
+  for (uint32_t t = 0; t < kSampleRate * 10; t += kBlockSize) {
+    for (size_t j = 0; j < n; ++j) {
+      uint32_t period = 3000 + 517 * j;
+      for (size_t i = 0; i < kBlockSize; ++i) {
+        bool previous = t + i > 0 && (t + i - 1) % period < 200;
+        bool current = (t + i) % period < 200;
+        gate_flags[j][i] = ExtractGateFlags(previous, current);
+        bank_gate_flags[i * n + j] = gate_flags[j][i];
+      }
+    }
+
+    high_hat_bank.Process(bank_gate_flags, bank_out, kBlockSize);
+    for (size_t j = 0; j < n; ++j) {
+      high_hat[j].Process(gate_flags[j], out[j], kBlockSize);
+      for (size_t i = 0; i < kBlockSize; ++i) {
+        int32_t error = abs(out[j][i] - bank_out[i * n + j]);
+        error_high_hat = std::max(error_high_hat, error);
+      }
+    }
+
+    // Each voice of the bank has its own noise generator.
+    snare_drum_bank.Process(bank_gate_flags, bank_out, kBlockSize);
+    for (size_t j = 0; j < n; ++j) {
+      Random::Seed(rng_state[j]);
+      snare_drum[j].Process(gate_flags[j], out[j], kBlockSize);
+      rng_state[j] = Random::state();
+      for (size_t i = 0; i < kBlockSize; ++i) {
+        int32_t error = abs(out[j][i] - bank_out[i * n + j]);
+        error_snare_drum = std::max(error_snare_drum, error);
+      }
+    }
+  }
+  printf("Drum banks x %zu: max error hh %d sd %d\n",
+         n, error_high_hat, error_snare_drum);
+  assert(error_high_hat == 0);
+  assert(error_snare_drum == 0);
+}
+
+DrumMachine drum_machine;
+
+void TestDrumMachine() {
+  WavWriter wav_writer(1, kSampleRate, 10);
+  wav_writer.Open("drum_machine.wav");
+
+  // 125 BPM, 16th notes.
+  drum_machine.Init(kSampleRate * 60 / 125 / 4);
+  uint16_t parameter[4];
+  for (size_t i = 0; i < 8; ++i) {
+    parameter[0] = 30000 + i * 1000;
+    parameter[1] = 20000 + i * 4000;
+    parameter[2] = 32768;
+    parameter[3] = 32768;
+    drum_machine.AddVoice(
+        DRUM_MACHINE_INSTRUMENT_BASS_DRUM, 0x1111, parameter);
+    drum_machine.AddVoice(
+        DRUM_MACHINE_INSTRUMENT_FM_DRUM, 0x8282, parameter);
+  }
+  for (size_t i = 0; i < 16; ++i) {
+    parameter[0] = 20000 + i * 2000;
+    parameter[1] = i * 4000;
+    parameter[2] = 40000;
+    parameter[3] = 20000 + i * 2000;
+    drum_machine.AddVoice(
+        DRUM_MACHINE_INSTRUMENT_SNARE_DRUM, 0x1010, parameter);
+  }
+  for (size_t i = 0; i < 32; ++i) {
+    drum_machine.AddVoice(
+        DRUM_MACHINE_INSTRUMENT_HIGH_HAT,
+        0xffff >> (i & 3),
+        parameter);
+  }
+
+  int16_t out[kDrumBankBlockSize];
+  for (uint32_t i = 0; i < kSampleRate * 10; i += kDrumBankBlockSize) {
+    drum_machine.Render(out, kDrumBankBlockSize);
+    wav_writer.WriteFrames(out, kDrumBankBlockSize);
+  }
+
+  const char* name[] = { "bd", "sd", "hh", "fm" };
+  for (size_t i = 0; i < DRUM_MACHINE_INSTRUMENT_LAST; ++i) {
+    DrumMachineInstrument instrument = static_cast<DrumMachineInstrument>(i);
+    printf("Drum machine: %s x %zu, %.1f cycles per voice and sample\n",
+           name[i],
+           drum_machine.num_voices(instrument),
+           drum_machine.cycles_per_voice_sample(instrument));
+  }
+}
+
 int main(void) {
   TestFMDrum();
   TestPatternPredictor();
+  TestDrumBanks(kDrumBankMaxVoices);
+  TestDrumBanks(5);
+  TestDrumMachine();
 }
@@ -34,7 +34,6 @@
 #include "stages/drivers/serial_link.h"
 #include "stages/segment_generator.h"
 #include "stages/settings.h"
-#include "stages/ui.h"
 
 namespace stages {
 
@@ -49,6 +48,22 @@ const uint32_t kAdvancedRightKey = stmlib::FourCC<'s', 'g', 'a', 'r'>::value;
 const uint32_t kUnpatchedInputDelay = 2000;
 const int32_t kLongPressDuration = 500;
 
+// Ping the neighbors every 50ms, between t = 500ms and t = 1500ms when the
+// chain has at most 6 modules. Each ping moves the index one module to the
+// right, and the size one module to the left - so the window is longer when
+// the chain can have more modules.
+const uint32_t kDiscoveryPingStart = 2000;
+const uint32_t kDiscoveryPingInterval = 200;
+const uint32_t kDiscoveryPingEnd = kDiscoveryPingStart + \
+    kDiscoveryPingInterval * (2 * kMaxChainSize + 8);
+
+// The discovery phase ends 500ms after the last ping.
+const uint32_t kDiscoveryDuration = kDiscoveryPingEnd + 2000;
+
+// Index sent in the flags of the channel states (3 bits, 7 is reserved for
+// requests).
+const size_t kMaxFlagsIndex = 6;
+
 void ChainState::Init(SerialLink* left, SerialLink* right, const Settings& settings) {
 
   left_ = left;
@@ -109,10 +124,9 @@ void ChainState::Reinit(const Settings& settings) {
 }
 
 void ChainState::DiscoverNeighbors() {
-  // Between t = 500ms and t = 1500ms, ping the neighbors every 50ms
-  if (counter_ >= 2000 &&
-      counter_ <= 6000 &&
-      (counter_ % 200) == 0) {
+  if (counter_ >= kDiscoveryPingStart &&
+      counter_ <= kDiscoveryPingEnd &&
+      (counter_ % kDiscoveryPingInterval) == 0) {
     left_tx_packet_.discovery.key = leftKey;
     left_tx_packet_.discovery.counter = size_;
     left_->Transmit(left_tx_packet_);
@@ -135,8 +149,9 @@ void ChainState::DiscoverNeighbors() {
 
   bool ouroboros_ = index_ >= kMaxChainSize || size_ > kMaxChainSize;
 
-  // The discovery phase lasts 2000ms.
-  status_ = counter_ < 8000 && !ouroboros_ ? CHAIN_DISCOVERING_NEIGHBORS : CHAIN_READY;
+  status_ = counter_ < kDiscoveryDuration && !ouroboros_
+      ? CHAIN_DISCOVERING_NEIGHBORS
+      : CHAIN_READY;
   if (status_ == CHAIN_DISCOVERING_NEIGHBORS) {
     ++counter_;
   } else {
@@ -186,7 +201,7 @@ void ChainState::ReceiveRight() {
   }
 
   if (p) {
-    size_t rx_index = p->channel[0].index();
+    size_t rx_index = packet_index(*p);
     if (rx_index > index_ && rx_index < size_) {
       // This packet contains the state of a module on the right.
       // Check if some settings have been changed on the remote modules,
@@ -249,6 +264,9 @@ void ChainState::TransmitLeft() {
         remote_channel(tx_index, 0),
         remote_channel(tx_index, kNumChannels),
         &left_tx_packet_.to_left.channel[0]);
+#if STAGES_MAX_CHAIN_SIZE > 6
+    left_tx_packet_.to_left.index = tx_index;
+#endif  // STAGES_MAX_CHAIN_SIZE
   }
   left_->Transmit(left_tx_packet_);
 }
@@ -294,7 +312,8 @@ void ChainState::Configure(
     const uint16_t *local_configs = settings.state().segment_configuration;
 
     if (!local_channel(i)->input_patched()) {
-      if (channel > last_patched_channel) {
+      if (channel > last_patched_channel &&
+          channel - last_patched_channel < size_t(kMaxNumSegments)) {
         // Create a slave channel - we are just extending a chain of segments.
         size_t segment = channel - last_patched_channel;
         segment_generator[i].ConfigureSlave(segment);
@@ -351,7 +370,8 @@ void ChainState::Configure(
         ++num_segments;
 
         add_more_segments = channel < last_channel && \
-             !channel_state_[channel].input_patched();
+             !channel_state_[channel].input_patched() && \
+             num_segments < kMaxNumSegments;
       }
       if (dirty || num_segments != segment_generator[i].num_segments()) {
         segment_generator[i].Configure(true, configuration, num_segments);
@@ -382,7 +402,7 @@ inline void ChainState::UpdateLocalState(
     uint16_t config = settings.state().segment_configuration[i];
     size_t channel = local_channel_index(i);
     dirty_[channel] = local_channel(i)->UpdateFlags(
-        index_,
+        min(index_, kMaxFlagsIndex),
         config,
         input_patched)
       || (config != last_local_config_[i]); // Check props that are not transmitted
@@ -38,9 +38,28 @@
 
 namespace stages {
 
-const size_t kMaxChainSize = 6;
+// Host builds can simulate chains of more than 6 modules. Their packets are
+// larger, so they can't talk to real modules.
+#ifndef STAGES_MAX_CHAIN_SIZE
+#define STAGES_MAX_CHAIN_SIZE 6
+#endif  // STAGES_MAX_CHAIN_SIZE
+
+#if !defined(TEST) && STAGES_MAX_CHAIN_SIZE != 6
+#error "The size of the chain can only be changed in host builds"
+#endif  // TEST
+
+const size_t kMaxChainSize = STAGES_MAX_CHAIN_SIZE;
 const size_t kMaxNumChannels = kMaxChainSize * kNumChannels;
+
+#if STAGES_MAX_CHAIN_SIZE > 6
+const size_t kPacketSize = ((2 * kMaxChainSize + 13) & ~3) > 28
+    ? ((2 * kMaxChainSize + 13) & ~3)
+    : 28;
+#else
 const size_t kPacketSize = 24;
+#endif  // STAGES_MAX_CHAIN_SIZE
+
+const int32_t kLongPressDurationForMultiModeToggle = 5000;
 
 const uint32_t kReinitKey = 0xffffffff;
 const uint32_t kReinitCount = 0xff;
@@ -82,6 +101,15 @@ class ChainState {
 
   inline ChainStateStatus status() const { return status_; }
 
+  // What this module knows about the rest of the chain.
+  inline ChannelBitmask input_patched(size_t module) const {
+    return input_patched_[module];
+  }
+
+  inline segment::Configuration channel_configuration(size_t channel) const {
+    return channel_state_[channel].configuration();
+  }
+
   // Internally, we only store a loop bit for each channel - but the UI needs
   // to know more than that. It needs to know whether a channel with a loop bit
   // set to 1 is a loop start, a loop end, or self-looping channel. This
@@ -158,6 +186,8 @@ class ChainState {
       return c;
     }
 
+    // With more than 6 modules, the index saturates to 6 - 7 being reserved
+    // for requests. The actual index is sent in RightToLeftPacket::index.
     inline size_t index() const {
       return (size_t(flags) >> 5) & 0b111;
     }
@@ -208,8 +238,14 @@ class ChainState {
     }
   }
 
+#if STAGES_MAX_CHAIN_SIZE > 6
+  typedef uint16_t ChannelIndex;
+#else
+  typedef uint8_t ChannelIndex;
+#endif  // STAGES_MAX_CHAIN_SIZE
+
   struct LeftToRightPacket {
-    uint8_t last_patched_channel;
+    ChannelIndex last_patched_channel;
     int8_t segment;
     float phase;
     Loop last_loop;
@@ -219,6 +255,9 @@ class ChainState {
 
   struct RightToLeftPacket {
     ChannelState channel[kNumChannels];
+#if STAGES_MAX_CHAIN_SIZE > 6
+    uint8_t index;
+#endif  // STAGES_MAX_CHAIN_SIZE
   };
 
   enum Request {
@@ -229,7 +268,7 @@ class ChainState {
 
   struct RequestPacket {
     uint8_t request;
-    uint8_t argument[4];
+    ChannelIndex argument[4];
   };
 
   struct DiscoveryPacket {
@@ -280,6 +319,14 @@ class ChainState {
     return (d->key == kReinitKey) && (d->counter == kReinitCount);
   }
 
+  inline size_t packet_index(const RightToLeftPacket& p) const {
+#if STAGES_MAX_CHAIN_SIZE > 6
+    return p.channel[0].index() == 0x7 ? 0x7 : p.index;
+#else
+    return p.channel[0].index();
+#endif  // STAGES_MAX_CHAIN_SIZE
+  }
+
   RequestPacket MakeLoopChangeRequest(size_t loop_start, size_t loop_end);
 
   Quantizer quantizers_[kNumChannels];
@@ -31,7 +31,11 @@
 
 #include "stmlib/stmlib.h"
 
+#ifndef TEST
 #include <stm32f37x_conf.h>
+#else
+#include <algorithm>
+#endif  // TEST
 
 namespace stages {
 
@@ -40,11 +44,117 @@ enum SerialLinkDirection {
   SERIAL_LINK_DIRECTION_RIGHT
 };
 
+#ifdef TEST
+
+// In host builds, a link is an in-process stand-in for the UART. Transmit()
+// queues the bytes on the sender's side, and Deliver() moves them into a ring
+// buffer owned by the peer. Deliver() must be called while the peer is not
+// reading, so that a simulator running modules on several threads decides when
+// packets arrive, and gets the same results whatever the order in which the
+// modules are processed. As with the circular DMA of the firmware, a sender is
+// never blocked: when the receiver does not read, the oldest blocks are
+// overwritten.
+
+const size_t kSerialLinkRingSize = 4096;
+
+#endif  // TEST
+
 class SerialLink {
  public:
   SerialLink() { }
   ~SerialLink() { }
-  
+
+#ifdef TEST
+
+  void Init(
+      SerialLinkDirection direction,
+      uint32_t baud_rate,
+      uint8_t* rx_buffer,
+      size_t rx_block_size) {
+    direction_ = direction;
+    rx_buffer_ = rx_buffer;
+    rx_block_size_ = rx_block_size;
+    rx_half_ = 0;
+    polled_rx_buffer_ = NULL;
+    polled_rx_size_ = 0;
+
+    peer_ = NULL;
+    tx_size_ = 0;
+    write_ptr_ = 0;
+    read_ptr_ = 0;
+    num_overruns_ = 0;
+  }
+
+  // Must be called after Init() on both ends.
+  void Connect(SerialLink* peer) {
+    peer_ = peer;
+    peer->peer_ = this;
+  }
+
+  void Transmit(const void* buffer, size_t size) {
+    if (!peer_ || tx_size_ + size > kSerialLinkRingSize) {
+      return;
+    }
+    const uint8_t* bytes = static_cast<const uint8_t*>(buffer);
+    std::copy(&bytes[0], &bytes[size], &tx_buffer_[tx_size_]);
+    tx_size_ += size;
+  }
+
+  // Makes everything transmitted so far visible to the peer.
+  void Deliver() {
+    if (!peer_) {
+      return;
+    }
+    for (size_t i = 0; i < tx_size_; ++i) {
+      peer_->ring_[(peer_->write_ptr_ + i) % kSerialLinkRingSize] = \
+          tx_buffer_[i];
+    }
+    peer_->write_ptr_ += tx_size_;
+    tx_size_ = 0;
+    
+    // Drop what has been overwritten.
+    size_t block_size = peer_->rx_block_size_ ? peer_->rx_block_size_ : 1;
+    while (peer_->write_ptr_ - peer_->read_ptr_ > kSerialLinkRingSize) {
+      peer_->read_ptr_ += block_size;
+    }
+  }
+
+  bool tx_complete() { return true; }
+
+  void Receive(void* buffer, size_t size) {
+    polled_rx_buffer_ = static_cast<uint8_t*>(buffer);
+    polled_rx_size_ = size;
+  }
+
+  bool rx_complete() {
+    return polled_rx_buffer_ && Pop(polled_rx_buffer_, polled_rx_size_);
+  }
+
+  // Like the circular DMA, alternates between the two halves of rx_buffer,
+  // and only keeps the last block received.
+  const uint8_t* available_rx_buffer() {
+    if (!rx_block_size_) {
+      return NULL;
+    }
+    size_t num_blocks = (write_ptr_ - read_ptr_) / rx_block_size_;
+    if (num_blocks > 1) {
+      num_overruns_ += num_blocks - 1;
+      read_ptr_ += (num_blocks - 1) * rx_block_size_;
+    }
+    uint8_t* destination = &rx_buffer_[rx_half_ * rx_block_size_];
+    if (!Pop(destination, rx_block_size_)) {
+      return NULL;
+    }
+    rx_half_ ^= 1;
+    return destination;
+  }
+
+  // Number of blocks received but never read, because a more recent block
+  // had arrived by the time available_rx_buffer() was called.
+  inline uint32_t num_overruns() const { return num_overruns_; }
+
+#else
+
   void Init(
       SerialLinkDirection direction,
       uint32_t baud_rate,
@@ -53,11 +163,6 @@ class SerialLink {
   
   void Transmit(const void* buffer, size_t size);
   
-  template<typename T>
-  void Transmit(const T& t) {
-    Transmit(&t, sizeof(T));
-  }
-  
   bool tx_complete();
   
   // For polled RX: call Receive(destination, size);
@@ -69,6 +174,13 @@ class SerialLink {
   // For continuous RX: returns NULL if no data is ready, or a pointer if
   // a buffer has been received.
   const uint8_t* available_rx_buffer();
+
+#endif  // TEST
+  
+  template<typename T>
+  void Transmit(const T& t) {
+    Transmit(&t, sizeof(T));
+  }
   
   template<typename T>
   inline const T* available_rx_buffer() {
@@ -80,6 +192,32 @@ class SerialLink {
   SerialLinkDirection direction_;
   size_t rx_block_size_;
   uint8_t* rx_buffer_;
+
+#ifdef TEST
+  bool Pop(uint8_t* destination, size_t size) {
+    if (write_ptr_ - read_ptr_ < size) {
+      return false;
+    }
+    for (size_t i = 0; i < size; ++i) {
+      destination[i] = ring_[(read_ptr_ + i) % kSerialLinkRingSize];
+    }
+    read_ptr_ += size;
+    return true;
+  }
+
+  int rx_half_;
+  uint8_t* polled_rx_buffer_;
+  size_t polled_rx_size_;
+
+  SerialLink* peer_;
+  uint8_t tx_buffer_[kSerialLinkRingSize];
+  size_t tx_size_;
+  
+  uint8_t ring_[kSerialLinkRingSize];
+  size_t write_ptr_;  // Only modified by the peer, in Deliver().
+  size_t read_ptr_;
+  uint32_t num_overruns_;
+#endif  // TEST
   
   DISALLOW_COPY_AND_ASSIGN(SerialLink);
 };
@@ -77,6 +77,7 @@ void SegmentGenerator::Init(Settings* settings) {
   lp_ = 0.0f;
 
   monitored_segment_ = 0;
+  previous_segment_ = 0;
   active_segment_ = 0;
   retrig_delay_ = 0;
   primary_ = 0;
@@ -93,6 +94,7 @@ void SegmentGenerator::Init(Settings* settings) {
   s.if_complete = 0;
   s.bipolar = false;
   s.retrig = true;
+  s.advance_tm = false;
   s.shift_register = Random::GetSample();
   s.register_value = Random::GetFloat();
   fill(&segments_[0], &segments_[kMaxNumSegments + 1], s);
@@ -142,17 +144,6 @@ inline float SegmentGenerator::WarpPhase(float t, float curve) const {
   return t;
 }
 
-inline float SegmentGenerator::RateToFrequency(float rate) const {
-  int32_t i = static_cast<int32_t>(rate * 2048.0f);
-  CONSTRAIN(i, 0, LUT_ENV_FREQUENCY_SIZE);
-  return lut_env_frequency[i];
-}
-
-inline float SegmentGenerator::PortamentoRateToLPCoefficient(float rate) const {
-  int32_t i = static_cast<int32_t>(rate * 512.0f);
-  return lut_portamento_coefficient[i];
-}
-
 static void advance_tm(
     const float steps_param,
     const float prob_param,
@@ -488,7 +479,7 @@ Ratio divider_ratios_fast[] = {
   calc_ratio(16, 1),
 };
 
-void SegmentGenerator::ProcessTapLFO(
+void SegmentGenerator::ExtractTapLFOPhase(
     const GateFlags* gate_flags, SegmentGenerator::Output* out, size_t size) {
   float ramp[12];
   Ratio r;
@@ -515,19 +506,22 @@ void SegmentGenerator::ProcessTapLFO(
   for (size_t i = 0; i < size; ++i) {
     out[i].phase = ramp[i];
   }
+}
+
+void SegmentGenerator::ProcessTapLFO(
+    const GateFlags* gate_flags, SegmentGenerator::Output* out, size_t size) {
+  ExtractTapLFOPhase(gate_flags, out, size);
   ShapeLFO(parameters_[0].secondary, out, size, segments_[0].bipolar);
   active_segment_ = out[size - 1].segment;
 }
 
-void SegmentGenerator::ProcessFreeRunningLFO(
-    const GateFlags* gate_flags, SegmentGenerator::Output* out, size_t size) {
+float SegmentGenerator::FreeRunningLFOFrequency() const {
   float f = 96.0f * (parameters_[0].primary - 0.5f);
   CONSTRAIN(f, -128.0f, 127.0f);
 
   float frequency = SemitonesToRatio(f) * 2.0439497f / kSampleRate;
 
-  active_segment_ = 0;
-  switch (segments_[active_segment_].range) {
+  switch (segments_[0].range) {
     case segment::RANGE_SLOW:
       frequency /= 16.0f;
       break;
@@ -543,6 +537,12 @@ void SegmentGenerator::ProcessFreeRunningLFO(
     frequency /= 8.0f;
   }
   CONSTRAIN(frequency, 0.0f, kMaxFrequency);
+  return frequency;
+}
+
+void SegmentGenerator::ProcessFreeRunningLFO(
+    const GateFlags* gate_flags, SegmentGenerator::Output* out, size_t size) {
+  const float frequency = FreeRunningLFOFrequency();
 
   for (size_t i = 0; i < size; ++i) {
     phase_ += frequency;
@@ -885,11 +885,10 @@ void SegmentGenerator::ProcessSlave(
 }
 
 /* static */
-void SegmentGenerator::ShapeLFO(
+void SegmentGenerator::ComputeLFOShape(
     float shape,
-    SegmentGenerator::Output* in_out,
-    size_t size,
-    bool bipolar) {
+    bool bipolar,
+    SegmentGenerator::LFOShape* lfo_shape) {
   shape -= 0.5f;
   shape = 2.0f + 9.999999f * shape / (1.0f + 3.0f * fabs(shape));
 
@@ -898,27 +897,39 @@ void SegmentGenerator::ShapeLFO(
   const float sine_amount = max(
       shape < 2.0f ? shape - 1.0f : 3.0f - shape, 0.0f);
 
-  const float slope_up = 1.0f / slope;
-  const float slope_down = 1.0f / (1.0f - slope);
-  const float plateau = 0.5f * (1.0f - plateau_width);
-  const float normalization = 1.0f / plateau;
-  const float phase_shift = plateau_width * 0.25f;
+  lfo_shape->slope = slope;
+  lfo_shape->slope_up = 1.0f / slope;
+  lfo_shape->slope_down = 1.0f / (1.0f - slope);
+  lfo_shape->plateau = 0.5f * (1.0f - plateau_width);
+  lfo_shape->normalization = 1.0f / lfo_shape->plateau;
+  lfo_shape->phase_shift = plateau_width * 0.25f;
+  lfo_shape->sine_amount = sine_amount;
 
-  const float amplitude = bipolar ? (10.0f / 16.0f) : 0.5f;
-  const float offset = bipolar ? 0.0f : 0.5f;
+  lfo_shape->amplitude = bipolar ? (10.0f / 16.0f) : 0.5f;
+  lfo_shape->offset = bipolar ? 0.0f : 0.5f;
+}
+
+void SegmentGenerator::ShapeLFO(
+    float shape,
+    SegmentGenerator::Output* in_out,
+    size_t size,
+    bool bipolar) {
+  LFOShape s;
+  ComputeLFOShape(shape, bipolar, &s);
   while (size--) {
-    float phase = in_out->phase + phase_shift;
+    float phase = in_out->phase + s.phase_shift;
     if (phase > 1.0f) {
       phase -= 1.0f;
     }
-    float triangle = phase < slope
-        ? slope_up * phase
-        : 1.0f - (phase - slope) * slope_down;
+    float triangle = phase < s.slope
+        ? s.slope_up * phase
+        : 1.0f - (phase - s.slope) * s.slope_down;
     triangle -= 0.5f;
-    CONSTRAIN(triangle, -plateau, plateau);
-    triangle = triangle * normalization;
+    CONSTRAIN(triangle, -s.plateau, s.plateau);
+    triangle = triangle * s.normalization;
     float sine = InterpolateWrap(lut_sine, phase + 0.75f, 1024.0f);
-    in_out->value = amplitude * Crossfade(triangle, sine, sine_amount) + offset;
+    in_out->value = s.amplitude * Crossfade(triangle, sine, s.sine_amount) + \
+        s.offset;
     in_out->segment = phase < 0.5f ? 0 : 1;
     ++in_out;
   }
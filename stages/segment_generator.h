@@ -36,6 +36,7 @@
 #include "stages/delay_line_16_bits.h"
 
 #include "stages/ramp_extractor.h"
+#include "stages/resources.h"
 #include "stages/settings.h"
 #include "stmlib/utils/random.h"
 
@@ -47,7 +48,21 @@ const float kSampleRate = 31250.0f;
 // of RAM because the 6 generators running on a module will never have to deal
 // with 36 segments each. But it was a bit too much to have a shared pool of
 // pre-allocated Segments shared by all SegmentGenerators!
-const int kMaxNumSegments = 36;
+//
+// Host builds simulating longer chains can raise this limit.
+#ifndef STAGES_MAX_NUM_SEGMENTS
+#define STAGES_MAX_NUM_SEGMENTS 36
+#endif  // STAGES_MAX_NUM_SEGMENTS
+
+#if !defined(TEST) && STAGES_MAX_NUM_SEGMENTS != 36
+#error "The number of segments can only be changed in host builds"
+#endif  // TEST
+
+#if STAGES_MAX_NUM_SEGMENTS > 127
+#error "Segment indices are stored on 8 bits"
+#endif  // STAGES_MAX_NUM_SEGMENTS
+
+const int kMaxNumSegments = STAGES_MAX_NUM_SEGMENTS;
 
 const size_t kMaxDelay = 768;
 
@@ -190,6 +205,10 @@ class SegmentGenerator {
     return num_segments_;
   }
 
+  inline ProcessFn process_fn() const {
+    return process_fn_;
+  }
+
   inline bool needs_attenuation() const {
     return process_fn_ == &SegmentGenerator::ProcessAttOff || process_fn_ == &SegmentGenerator::ProcessAttSampleAndHold;
   }
@@ -219,10 +238,35 @@ class SegmentGenerator {
   DECLARE_PROCESS_FN(ClockedSampleAndHold);
   DECLARE_PROCESS_FN(Slave);
 
+  struct LFOShape {
+    float slope;
+    float slope_up;
+    float slope_down;
+    float plateau;
+    float normalization;
+    float phase_shift;
+    float sine_amount;
+    float amplitude;
+    float offset;
+  };
+
+  static void ComputeLFOShape(float shape, bool bipolar, LFOShape* lfo_shape);
   void ShapeLFO(float shape, Output* in_out, size_t size, bool bipolar);
+  void ExtractTapLFOPhase(
+      const stmlib::GateFlags* gate_flags, Output* out, size_t size);
+  float FreeRunningLFOFrequency() const;
   float WarpPhase(float t, float curve) const;
-  float RateToFrequency(float rate) const;
-  float PortamentoRateToLPCoefficient(float rate) const;
+
+  inline float RateToFrequency(float rate) const {
+    int32_t i = static_cast<int32_t>(rate * 2048.0f);
+    CONSTRAIN(i, 0, LUT_ENV_FREQUENCY_SIZE);
+    return lut_env_frequency[i];
+  }
+
+  inline float PortamentoRateToLPCoefficient(float rate) const {
+    int32_t i = static_cast<int32_t>(rate * 512.0f);
+    return lut_portamento_coefficient[i];
+  }
 
   float phase_;
   float aux_;
@@ -287,6 +331,8 @@ class SegmentGenerator {
   float y_;
   float z_;
 
+  friend class SegmentGeneratorBatch;
+
   DISALLOW_COPY_AND_ASSIGN(SegmentGenerator);
 };
 
@@ -0,0 +1,297 @@
+// Copyright 2017 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Processes a block of samples for many segment generators at once.
+
+#include "stages/segment_generator_batch.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "stmlib/dsp/dsp.h"
+
+namespace stages {
+
+using namespace std;
+using namespace stmlib;
+
+// Number of channels classified at once.
+const size_t kBatchWindowSize = 64;
+
+typedef SegmentGenerator SG;
+
+// Same as SegmentGenerator::WarpPhase, with the curve-dependent terms
+// computed once per block.
+static inline float WarpPhase(float t, float amount, bool flip) {
+  t = flip ? 1.0f - t : t;
+  t = (1.0f + amount) * t / (1.0f + amount * t);
+  return flip ? 1.0f - t : t;
+}
+
+static inline void ComputeWarp(float curve, float* amount, bool* flip) {
+  curve -= 0.5f;
+  *flip = curve < 0.0f;
+  *amount = 128.0f * curve * curve;
+}
+
+void SegmentGeneratorBatch::Init() {
+  fill(&num_blocks_[0], &num_blocks_[BATCH_KERNEL_LAST], 0);
+  table_.current_stamp = 0;
+  fill(&table_.stamp[0], &table_.stamp[kMaxNumSegments + 1], 0);
+}
+
+/* static */
+BatchKernel SegmentGeneratorBatch::kernel(const SegmentGenerator& generator) {
+  // The other modes (zero, attenuverter, decay, free-running and tap LFO)
+  // are so cheap that gathering and scattering the lanes costs more than it
+  // saves: they run faster through SegmentGenerator::Process.
+  const SG::ProcessFn fn = generator.process_fn_;
+  if (fn == &SG::ProcessPortamento) {
+    return BATCH_KERNEL_PORTAMENTO;
+  } else if (fn == &SG::ProcessMultiSegment) {
+    // Turing segments modify their level in the middle of a block, so the
+    // segment table can't be built in advance.
+    for (int i = 0; i <= generator.num_segments_; ++i) {
+      if (generator.segments_[i].advance_tm) {
+        return BATCH_KERNEL_SCALAR;
+      }
+    }
+    return BATCH_KERNEL_MULTI_SEGMENT;
+  }
+  return BATCH_KERNEL_SCALAR;
+}
+
+void SegmentGeneratorBatch::Process(
+    SegmentGenerator* generators,
+    const GateFlags* const* gate_flags,
+    SegmentGenerator::Output* const* out,
+    bool* active,
+    size_t num_channels,
+    size_t size) {
+  uint8_t channels[BATCH_KERNEL_LAST][kBatchWindowSize];
+  size_t num_channels_per_kernel[BATCH_KERNEL_LAST];
+  Lanes lanes;
+
+  for (size_t first = 0; first < num_channels; first += kBatchWindowSize) {
+    const size_t window_size = min(num_channels - first, kBatchWindowSize);
+    fill(
+        &num_channels_per_kernel[0],
+        &num_channels_per_kernel[BATCH_KERNEL_LAST],
+        0);
+    for (size_t i = 0; i < window_size; ++i) {
+      BatchKernel k = kernel(generators[first + i]);
+      channels[k][num_channels_per_kernel[k]++] = i;
+    }
+
+    size_t n = num_channels_per_kernel[BATCH_KERNEL_PORTAMENTO];
+    for (size_t i = 0; i < n; i += kNumBatchLanes) {
+      lanes.num_lanes = min(n - i, kNumBatchLanes);
+      for (size_t l = 0; l < lanes.num_lanes; ++l) {
+        const size_t channel = first + channels[BATCH_KERNEL_PORTAMENTO][i + l];
+        lanes.generator[l] = &generators[channel];
+        lanes.out[l] = out[channel];
+        lanes.channel[l] = channel;
+      }
+      ProcessPortamento(&lanes, size);
+      if (active) {
+        for (size_t l = 0; l < lanes.num_lanes; ++l) {
+          active[lanes.channel[l]] = lanes.generator[l]->active_segment_ == 0;
+        }
+      }
+    }
+    num_blocks_[BATCH_KERNEL_PORTAMENTO] += n;
+
+    n = num_channels_per_kernel[BATCH_KERNEL_MULTI_SEGMENT];
+    for (size_t i = 0; i < n; ++i) {
+      const size_t channel = first + channels[BATCH_KERNEL_MULTI_SEGMENT][i];
+      SegmentGenerator* g = &generators[channel];
+      ProcessMultiSegment(g, gate_flags[channel], out[channel], size);
+      if (active) {
+        active[channel] = g->active_segment_ == 0;
+      }
+    }
+    num_blocks_[BATCH_KERNEL_MULTI_SEGMENT] += n;
+
+    // The remaining channels are processed in order, since a slave reads the
+    // output of the channel before it.
+    n = num_channels_per_kernel[BATCH_KERNEL_SCALAR];
+    for (size_t i = 0; i < n; ++i) {
+      const size_t channel = first + channels[BATCH_KERNEL_SCALAR][i];
+      SegmentGenerator* g = &generators[channel];
+      if (g->process_fn_ == &SG::ProcessSlave && channel > 0) {
+        copy(&out[channel - 1][0], &out[channel - 1][size], &out[channel][0]);
+      }
+      bool a = g->Process(gate_flags[channel], out[channel], size);
+      if (active) {
+        active[channel] = a;
+      }
+    }
+    num_blocks_[BATCH_KERNEL_SCALAR] += n;
+  }
+}
+
+void SegmentGeneratorBatch::ProcessPortamento(Lanes* lanes, size_t size) {
+  // Unused lanes duplicate the first one. They are computed, so that the
+  // loops below have a fixed number of iterations, but their state and their
+  // output are never written back.
+  for (size_t l = lanes->num_lanes; l < kNumBatchLanes; ++l) {
+    lanes->generator[l] = lanes->generator[0];
+    lanes->out[l] = lanes->out[0];
+  }
+
+  float coefficient[kNumBatchLanes];
+  float primary[kNumBatchLanes];
+  float increment[kNumBatchLanes];
+  float lp[kNumBatchLanes];
+  for (size_t l = 0; l < kNumBatchLanes; ++l) {
+    const SegmentGenerator* g = lanes->generator[l];
+    coefficient[l] = g->PortamentoRateToLPCoefficient(
+        g->parameters_[0].secondary);
+    primary[l] = g->primary_;
+    increment[l] = (g->parameters_[0].primary - g->primary_) / \
+        static_cast<float>(size);
+    lp[l] = g->lp_;
+  }
+
+  for (size_t i = 0; i < size; ++i) {
+    for (size_t l = 0; l < kNumBatchLanes; ++l) {
+      primary[l] += increment[l];
+      ONE_POLE(lp[l], primary[l], coefficient[l]);
+    }
+    for (size_t l = 0; l < lanes->num_lanes; ++l) {
+      SegmentGenerator::Output* out = &lanes->out[l][i];
+      out->value = lp[l];
+      out->phase = 0.5f;
+      out->segment = 0;
+    }
+  }
+
+  for (size_t l = 0; l < lanes->num_lanes; ++l) {
+    SegmentGenerator* g = lanes->generator[l];
+    g->primary_ = g->value_ = primary[l];
+    g->lp_ = lp[l];
+    g->active_segment_ = 0;
+  }
+}
+
+void SegmentGeneratorBatch::FillSegmentTable(
+    const SegmentGenerator& generator,
+    int i) {
+  const SG::Segment& s = generator.segments_[i];
+  SegmentTable* t = &table_;
+  t->has_start[i] = s.start != NULL;
+  t->start[i] = s.start ? *s.start : 0.0f;
+  t->end[i] = *s.end;
+  t->end_source[i] = s.end;
+  t->frequency[i] = s.time ? generator.RateToFrequency(*s.time) : 0.0f;
+  ComputeWarp(*s.curve, &t->warp_amount[i], &t->warp_flip[i]);
+  t->has_phase[i] = s.phase != NULL;
+  t->phase[i] = s.phase ? *s.phase : 0.0f;
+  t->portamento[i] = generator.PortamentoRateToLPCoefficient(*s.portamento);
+  t->if_rising[i] = s.if_rising;
+  t->if_falling[i] = s.if_falling;
+  t->if_complete[i] = s.if_complete;
+  t->retrig[i] = s.retrig;
+  t->stamp[i] = t->current_stamp;
+}
+
+void SegmentGeneratorBatch::ProcessMultiSegment(
+    SegmentGenerator* g,
+    const GateFlags* gate_flags,
+    SegmentGenerator::Output* out,
+    size_t size) {
+  // Only the segments visited during the block are copied to the table.
+  const SegmentTable& t = table_;
+
+  float phase = g->phase_;
+  float start = g->start_;
+  float lp = g->lp_;
+  float value = g->value_;
+  int active = g->active_segment_;
+  int previous = g->previous_segment_;
+
+  ++table_.current_stamp;
+  FillSegmentTable(*g, active);
+  FillSegmentTable(*g, previous);
+
+  for (size_t i = 0; i < size; ++i) {
+    if (!t.has_start[active] && t.has_phase[previous] && \
+        t.end_source[active] != t.end_source[previous]) {
+      ONE_POLE(start, t.end[previous], t.portamento[previous]);
+    }
+
+    phase += t.frequency[active];
+    bool complete = phase >= 1.0f;
+    if (complete) {
+      phase = 1.0f;
+    }
+    value = Crossfade(
+        start,
+        t.end[active],
+        WarpPhase(
+            t.has_phase[active] ? t.phase[active] : phase,
+            t.warp_amount[active],
+            t.warp_flip[active]));
+
+    ONE_POLE(lp, value, t.portamento[active]);
+
+    int go_to_segment = -1;
+    if ((gate_flags[i] & GATE_FLAG_RISING) && t.retrig[active]) {
+      go_to_segment = t.if_rising[active];
+    } else if (gate_flags[i] & GATE_FLAG_FALLING) {
+      go_to_segment = t.if_falling[active];
+    } else if (complete) {
+      go_to_segment = t.if_complete[active];
+    }
+
+    if (go_to_segment != -1) {
+      if (t.stamp[go_to_segment] != t.current_stamp) {
+        FillSegmentTable(*g, go_to_segment);
+      }
+      phase = 0.0f;
+      start = t.has_start[go_to_segment]
+          ? t.start[go_to_segment]
+          : (go_to_segment == active ? start : lp);
+      if (go_to_segment != active) {
+        previous = active;
+      }
+      active = go_to_segment;
+    }
+
+    out[i].value = lp;
+    out[i].phase = phase;
+    out[i].segment = active;
+  }
+
+  g->phase_ = phase;
+  g->start_ = start;
+  g->lp_ = lp;
+  g->value_ = value;
+  g->active_segment_ = active;
+  g->previous_segment_ = previous;
+}
+
+}  // namespace stages
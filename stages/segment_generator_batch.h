@@ -0,0 +1,138 @@
+// Copyright 2017 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Processes a block of samples for many segment generators at once (for
+// example, all the channels of several emulated modules).
+//
+// Portamento generators are grouped by kNumBatchLanes and rendered together,
+// with their parameters gathered into small arrays so that the inner loop
+// runs over lanes rather than through the pointers of the Segment structures.
+// Multi-segment generators take different transitions in each channel, so
+// they are rendered one channel at a time, but the parameters of the segments
+// visited during the block are resolved once into a table instead of being
+// read through the pointers at each sample. The cheaper modes, for which
+// gathering the parameters costs more than it saves, and the other modes use
+// SegmentGenerator::Process. The output is identical to calling
+// SegmentGenerator::Process on each channel, in order (as long as the
+// compiler is not allowed to fuse multiplies and adds, see -ffp-contract).
+
+#ifndef STAGES_SEGMENT_GENERATOR_BATCH_H_
+#define STAGES_SEGMENT_GENERATOR_BATCH_H_
+
+#include "stmlib/stmlib.h"
+#include "stmlib/utils/gate_flags.h"
+
+#include "stages/segment_generator.h"
+
+namespace stages {
+
+const size_t kNumBatchLanes = 4;
+
+enum BatchKernel {
+  BATCH_KERNEL_PORTAMENTO,
+  BATCH_KERNEL_MULTI_SEGMENT,
+  BATCH_KERNEL_SCALAR,
+  BATCH_KERNEL_LAST
+};
+
+class SegmentGeneratorBatch {
+ public:
+  SegmentGeneratorBatch() { }
+  ~SegmentGeneratorBatch() { }
+
+  void Init();
+
+  // Channel i reads gate_flags[i] and writes out[i]. When active is not NULL,
+  // active[i] receives the value returned by SegmentGenerator::Process.
+  //
+  // A channel configured as a slave reads the output of the channel before
+  // it, as it does with the single output buffer used by the firmware. For
+  // the first channel, out[0] must already contain the data received from
+  // the previous module.
+  void Process(
+      SegmentGenerator* generators,
+      const stmlib::GateFlags* const* gate_flags,
+      SegmentGenerator::Output* const* out,
+      bool* active,
+      size_t num_channels,
+      size_t size);
+
+  static BatchKernel kernel(const SegmentGenerator& generator);
+
+  // Number of channel blocks rendered by each kernel since Init().
+  inline uint32_t num_blocks(BatchKernel kernel) const {
+    return num_blocks_[kernel];
+  }
+
+ private:
+  // Parameters of the segments of a multi-segment generator, with the
+  // pointers resolved for the duration of a block.
+  struct SegmentTable {
+    // The entries for which stamp[i] is equal to current_stamp have been
+    // filled for the block being rendered.
+    uint32_t current_stamp;
+    uint32_t stamp[kMaxNumSegments + 1];
+    float start[kMaxNumSegments + 1];
+    float end[kMaxNumSegments + 1];
+    const float* end_source[kMaxNumSegments + 1];
+    float frequency[kMaxNumSegments + 1];
+    float warp_amount[kMaxNumSegments + 1];
+    float phase[kMaxNumSegments + 1];
+    float portamento[kMaxNumSegments + 1];
+    int8_t if_rising[kMaxNumSegments + 1];
+    int8_t if_falling[kMaxNumSegments + 1];
+    int8_t if_complete[kMaxNumSegments + 1];
+    bool has_start[kMaxNumSegments + 1];
+    bool has_phase[kMaxNumSegments + 1];
+    bool warp_flip[kMaxNumSegments + 1];
+    bool retrig[kMaxNumSegments + 1];
+  };
+
+  struct Lanes {
+    SegmentGenerator* generator[kNumBatchLanes];
+    SegmentGenerator::Output* out[kNumBatchLanes];
+    size_t channel[kNumBatchLanes];
+    size_t num_lanes;
+  };
+
+  void ProcessPortamento(Lanes* lanes, size_t size);
+  void ProcessMultiSegment(
+      SegmentGenerator* generator,
+      const stmlib::GateFlags* gate_flags,
+      SegmentGenerator::Output* out,
+      size_t size);
+
+  void FillSegmentTable(const SegmentGenerator& generator, int segment);
+
+  SegmentTable table_;
+  uint32_t num_blocks_[BATCH_KERNEL_LAST];
+
+  DISALLOW_COPY_AND_ASSIGN(SegmentGeneratorBatch);
+};
+
+}  // namespace stages
+
+#endif  // STAGES_SEGMENT_GENERATOR_BATCH_H_
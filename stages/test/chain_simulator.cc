@@ -0,0 +1,199 @@
+// Copyright 2017 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Chain simulator.
+
+#include "stages/test/chain_simulator.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace stages {
+
+using namespace std;
+using namespace stmlib;
+
+ChainSimulator::~ChainSimulator() {
+  for (size_t i = 0; i < modules_.size(); ++i) {
+    delete modules_[i];
+  }
+}
+
+void ChainSimulator::Init(size_t num_modules, size_t num_threads) {
+  for (size_t i = 0; i < modules_.size(); ++i) {
+    delete modules_[i];
+  }
+  modules_.clear();
+
+  num_threads_ = max(min(num_threads, num_modules), size_t(1));
+  tick_ = 0;
+  fill(&no_gate_[0], &no_gate_[kBlockSize], GATE_FLAG_LOW);
+
+  SegmentGenerator::Output zero = { 0.0f, 0.0f, 0 };
+
+  for (size_t i = 0; i < num_modules; ++i) {
+    VirtualModule* m = new VirtualModule;
+
+    // Default settings, without going through the flash storage.
+    State* s = m->settings.mutable_state();
+    fill(&s->segment_configuration[0], &s->segment_configuration[kNumChannels],
+         0);
+    s->color_blind = 0;
+    s->multimode = MULTI_MODE_STAGES;
+
+    IOBuffer::Block* b = &m->block;
+    for (size_t j = 0; j < kNumChannels; ++j) {
+      b->cv[j] = 0.0f;
+      b->slider[j] = 0.5f;
+      b->cv_slider[j] = 0.5f;
+      b->pot[j] = 0.5f;
+      b->input_patched[j] = false;
+      fill(&b->input[j][0], &b->input[j][kBlockSize], GATE_FLAG_LOW);
+      fill(&b->output[j][0], &b->output[j][kBlockSize], 0);
+    }
+    fill(&m->out[0], &m->out[kBlockSize], zero);
+    m->num_overruns = 0;
+
+    for (size_t j = 0; j < kNumChannels; ++j) {
+      m->segment_generator[j].Init(&m->settings);
+    }
+    m->chain_state.Init(&m->left, &m->right, m->settings);
+    modules_.push_back(m);
+  }
+
+  for (size_t i = 0; i + 1 < num_modules; ++i) {
+    modules_[i]->right.Connect(&modules_[i + 1]->left);
+  }
+}
+
+bool ChainSimulator::converged() const {
+  for (size_t i = 0; i < modules_.size(); ++i) {
+    const ChainState& c = modules_[i]->chain_state;
+    if (c.status() != ChainState::CHAIN_READY ||
+        c.index() != i ||
+        c.size() != modules_.size()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint32_t ChainSimulator::num_overruns() const {
+  uint32_t n = 0;
+  for (size_t i = 0; i < modules_.size(); ++i) {
+    n += modules_[i]->num_overruns;
+  }
+  return n;
+}
+
+void ChainSimulator::Tick(VirtualModule* m) {
+  bool ready = m->chain_state.status() == ChainState::CHAIN_READY;
+  uint32_t num_overruns = m->left.num_overruns() + m->right.num_overruns();
+  
+  // Same sequence of operations as the Process() function of the firmware.
+  m->chain_state.Update(
+      m->block,
+      &m->settings,
+      &m->segment_generator[0],
+      m->out);
+  for (size_t channel = 0; channel < kNumChannels; ++channel) {
+    m->segment_generator[channel].Process(
+        m->block.input_patched[channel] ? m->block.input[channel] : no_gate_,
+        m->out,
+        kBlockSize);
+  }
+  
+  if (ready) {
+    m->num_overruns += m->left.num_overruns() + m->right.num_overruns() - \
+        num_overruns;
+  }
+}
+
+void ChainSimulator::Synchronize() {
+  unique_lock<mutex> lock(mutex_);
+  uint32_t generation = barrier_generation_;
+  if (++num_waiting_ == num_threads_) {
+    num_waiting_ = 0;
+    ++barrier_generation_;
+    barrier_.notify_all();
+  } else {
+    while (generation == barrier_generation_) {
+      barrier_.wait(lock);
+    }
+  }
+}
+
+void ChainSimulator::RunThread(size_t thread_index, uint32_t num_ticks) {
+  size_t n = modules_.size();
+  size_t first = thread_index * n / num_threads_;
+  size_t last = (thread_index + 1) * n / num_threads_;
+
+  for (uint32_t t = 0; t < num_ticks; ++t) {
+    for (size_t i = first; i < last; ++i) {
+      Tick(modules_[i]);
+    }
+    Synchronize();
+
+    // All modules are stopped: the condition can inspect them.
+    if (thread_index == 0) {
+      ++tick_;
+      ++num_ticks_run_;
+      done_ = condition_ && condition_->Done(*this, tick_);
+    }
+
+    // What has been transmitted during this tick will be received during the
+    // next one.
+    for (size_t i = first; i < last; ++i) {
+      modules_[i]->left.Deliver();
+      modules_[i]->right.Deliver();
+    }
+    Synchronize();
+
+    if (done_) {
+      break;
+    }
+  }
+}
+
+uint32_t ChainSimulator::Run(uint32_t num_ticks, ChainCondition* condition) {
+  condition_ = condition;
+  num_ticks_run_ = 0;
+  done_ = false;
+  num_waiting_ = 0;
+  barrier_generation_ = 0;
+
+  vector<thread> threads;
+  for (size_t i = 1; i < num_threads_; ++i) {
+    threads.push_back(thread(&ChainSimulator::RunThread, this, i, num_ticks));
+  }
+  RunThread(0, num_ticks);
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+  }
+  return num_ticks_run_;
+}
+
+}  // namespace stages
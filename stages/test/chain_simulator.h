@@ -0,0 +1,132 @@
+// Copyright 2017 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Runs a chain of virtual modules connected by host serial links. Each module
+// runs the same code as the firmware (ChainState::Update, then the segment
+// generators) once per tick - a tick is a block of kBlockSize samples.
+//
+// Modules are spread across threads. Within a tick, every module first runs
+// its Update, then the packets it has transmitted are delivered. The results
+// are thus identical whatever the number of threads.
+
+#ifndef STAGES_TEST_CHAIN_SIMULATOR_H_
+#define STAGES_TEST_CHAIN_SIMULATOR_H_
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "stmlib/stmlib.h"
+#include "stmlib/utils/gate_flags.h"
+
+#include "stages/chain_state.h"
+#include "stages/drivers/serial_link.h"
+#include "stages/io_buffer.h"
+#include "stages/segment_generator.h"
+#include "stages/settings.h"
+
+namespace stages {
+
+class ChainSimulator;
+
+// Evaluated once per tick, while all modules are stopped. Running the chain
+// stops as soon as Done() returns true.
+class ChainCondition {
+ public:
+  ChainCondition() { }
+  virtual ~ChainCondition() { }
+
+  virtual bool Done(const ChainSimulator& simulator, uint32_t tick) = 0;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ChainCondition);
+};
+
+struct VirtualModule {
+  Settings settings;
+  ChainState chain_state;
+  SerialLink left;
+  SerialLink right;
+  SegmentGenerator segment_generator[kNumChannels];
+  IOBuffer::Block block;
+  SegmentGenerator::Output out[kBlockSize];
+  uint32_t num_overruns;
+};
+
+class ChainSimulator {
+ public:
+  ChainSimulator() { }
+  ~ChainSimulator();
+
+  void Init(size_t num_modules, size_t num_threads);
+
+  // Runs the chain for at most num_ticks ticks, returns the number of ticks
+  // actually run.
+  uint32_t Run(uint32_t num_ticks, ChainCondition* condition);
+
+  // All modules know their position in the chain and are done discovering
+  // their neighbors.
+  bool converged() const;
+
+  inline size_t num_modules() const { return modules_.size(); }
+  inline uint32_t tick() const { return tick_; }
+
+  inline const VirtualModule& module(size_t i) const { return *modules_[i]; }
+  inline VirtualModule* mutable_module(size_t i) { return modules_[i]; }
+
+  // Number of packets missed by the modules while they were running the chain
+  // protocol. While a module reinitializes, it stops reading its links, and
+  // what it receives in the meantime is discarded by its next read, as on the
+  // hardware - this is not counted.
+  uint32_t num_overruns() const;
+
+ private:
+  void Tick(VirtualModule* module);
+  void RunThread(size_t thread_index, uint32_t num_ticks);
+  void Synchronize();
+
+  std::vector<VirtualModule*> modules_;
+  size_t num_threads_;
+  uint32_t tick_;
+
+  stmlib::GateFlags no_gate_[kBlockSize];
+
+  // State shared by the threads during Run().
+  ChainCondition* condition_;
+  uint32_t num_ticks_run_;
+  bool done_;
+
+  std::mutex mutex_;
+  std::condition_variable barrier_;
+  size_t num_waiting_;
+  uint32_t barrier_generation_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChainSimulator);
+};
+
+}  // namespace stages
+
+#endif  // STAGES_TEST_CHAIN_SIMULATOR_H_
@@ -0,0 +1,225 @@
+// Copyright 2017 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Chain simulator test. Built separately from stages_test, with a larger
+// STAGES_MAX_CHAIN_SIZE.
+
+#include <cassert>
+#include <cstdio>
+
+#include <chrono>
+
+#include "stages/test/chain_simulator.h"
+
+using namespace stages;
+using namespace std;
+using namespace stmlib;
+
+const uint32_t kSampleRate = 32000;
+
+class ChainReadyCondition : public ChainCondition {
+ public:
+  ChainReadyCondition() : discovered_tick_(0), reinitialized_(0) { }
+
+  // Wait for all modules to restart the discovery of their neighbors before
+  // checking that the chain is ready.
+  void set_wait_for_reinit(size_t num_modules) {
+    reinitialized_.assign(num_modules, false);
+  }
+
+  virtual bool Done(const ChainSimulator& simulator, uint32_t tick) {
+    bool discovered = true;
+    bool reinitialized = true;
+    for (size_t i = 0; i < simulator.num_modules(); ++i) {
+      const ChainState& c = simulator.module(i).chain_state;
+      if (i < reinitialized_.size()) {
+        if (c.status() == ChainState::CHAIN_DISCOVERING_NEIGHBORS) {
+          reinitialized_[i] = true;
+        }
+        reinitialized = reinitialized && reinitialized_[i];
+      }
+      discovered = discovered && \
+          c.index() == i && c.size() == simulator.num_modules();
+    }
+    if (!reinitialized) {
+      return false;
+    }
+    if (discovered && !discovered_tick_) {
+      discovered_tick_ = tick;
+    }
+    return simulator.converged();
+  }
+
+  inline uint32_t discovered_tick() const { return discovered_tick_; }
+
+ private:
+  uint32_t discovered_tick_;
+  vector<bool> reinitialized_;
+};
+
+// Records when a change made on one module becomes visible on the others.
+class ChainPropagationCondition : public ChainCondition {
+ public:
+  ChainPropagationCondition(bool to_right, uint32_t start_tick)
+      : to_right_(to_right),
+        start_tick_(start_tick) { }
+
+  virtual bool Done(const ChainSimulator& simulator, uint32_t tick) {
+    size_t n = simulator.num_modules();
+    if (arrival_.empty()) {
+      arrival_.assign(n, 0);
+    }
+    bool done = true;
+    for (size_t i = 0; i < n; ++i) {
+      const ChainState& c = simulator.module(i).chain_state;
+      bool received = to_right_
+          ? i == 0 || (c.input_patched(0) & 1)
+          : i == n - 1 || c.channel_configuration(
+                (n - 1) * kNumChannels).type == segment::TYPE_STEP;
+      if (received && !arrival_[i]) {
+        arrival_[i] = tick - start_tick_;
+      }
+      done = done && received;
+    }
+    return done;
+  }
+
+  // Number of ticks before the change was seen by the module at the other end
+  // of the chain.
+  inline uint32_t latency() const {
+    return arrival_.size() ? arrival_[to_right_ ? arrival_.size() - 1 : 0] : 0;
+  }
+
+ private:
+  bool to_right_;
+  uint32_t start_tick_;
+  vector<uint32_t> arrival_;
+};
+
+struct ChainSimulatorResult {
+  uint32_t discovered;
+  uint32_t ready;
+  uint32_t reinit_discovered;
+  uint32_t reinit_ready;
+  uint32_t right_latency;
+  uint32_t left_latency;
+  uint32_t num_overruns;
+  float ticks_per_second;
+};
+
+ChainSimulatorResult SimulateChain(size_t num_modules, size_t num_threads) {
+  const uint32_t kTimeout = 100000;
+  ChainSimulatorResult result;
+  ChainSimulator* simulator = new ChainSimulator();
+  simulator->Init(num_modules, num_threads);
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+  // Power up.
+  ChainReadyCondition power_up;
+  result.ready = simulator->Run(kTimeout, &power_up);
+  result.discovered = power_up.discovered_tick();
+
+  // Settle, then reinitialize the chain from its first module (as if its
+  // mode had been changed).
+  simulator->Run(1000, NULL);
+  uint32_t reinit_tick = simulator->tick();
+  simulator->mutable_module(0)->chain_state.start_reinit();
+  ChainReadyCondition reinit;
+  reinit.set_wait_for_reinit(num_modules);
+  result.reinit_ready = simulator->Run(kTimeout, &reinit);
+  result.reinit_discovered = reinit.discovered_tick() - reinit_tick;
+
+  // After a reinitialization, all inputs are considered as patched for a
+  // while. Wait for this to time out, then patch the gate input of the first
+  // channel of the first module. The information is transmitted from left to
+  // right.
+  simulator->Run(10000, NULL);
+  simulator->mutable_module(0)->block.input_patched[0] = true;
+  ChainPropagationCondition to_right(true, simulator->tick());
+  simulator->Run(kTimeout, &to_right);
+  result.right_latency = to_right.latency();
+
+  // Change the type of the first segment of the last module. The information
+  // is transmitted from right to left.
+  simulator->Run(1000, NULL);
+  simulator->mutable_module(num_modules - 1)->settings.mutable_state()->\
+      segment_configuration[0] = segment::TYPE_STEP;
+  ChainPropagationCondition to_left(false, simulator->tick());
+  simulator->Run(kTimeout, &to_left);
+  result.left_latency = to_left.latency();
+
+  chrono::duration<float> elapsed = chrono::steady_clock::now() - start;
+  result.ticks_per_second = simulator->tick() / elapsed.count();
+  result.num_overruns = simulator->num_overruns();
+  delete simulator;
+  return result;
+}
+
+void TestChainSimulator() {
+  // One tick of the chain state is one block.
+  const float tick_duration = 1000.0f * kBlockSize / ::kSampleRate;
+  const size_t chain_sizes[] = { 6, 16, 64 };
+
+  for (size_t i = 0; i < sizeof(chain_sizes) / sizeof(size_t); ++i) {
+    size_t n = chain_sizes[i];
+    if (n > kMaxChainSize) {
+      continue;
+    }
+    ChainSimulatorResult r = SimulateChain(n, 1);
+    ChainSimulatorResult r_threaded = SimulateChain(n, n);
+
+    printf("Chain of %lu modules\n", n);
+    printf("  discovery: %.0fms (ready after %.0fms)\n",
+           r.discovered * tick_duration, r.ready * tick_duration);
+    printf("  reinit:    %.0fms (ready after %.0fms)\n",
+           r.reinit_discovered * tick_duration,
+           r.reinit_ready * tick_duration);
+    printf("  latency:   left to right %.1fms (%.2fms/hop), "
+           "right to left %.1fms (%.2fms/hop)\n",
+           r.right_latency * tick_duration,
+           r.right_latency * tick_duration / (n - 1),
+           r.left_latency * tick_duration,
+           r.left_latency * tick_duration / (n - 1));
+    // Realtime is 1 / tick_duration ticks per second.
+    printf("  speed:     %.1fx realtime (1 thread), %.1fx realtime "
+           "(%lu threads)\n",
+           r.ticks_per_second * tick_duration / 1000.0f,
+           r_threaded.ticks_per_second * tick_duration / 1000.0f, n);
+    printf("  overruns:  %u packets\n", r.num_overruns);
+
+    assert(r.ready < 100000 && r.reinit_ready < 100000);
+    assert(r.num_overruns == 0 && r_threaded.num_overruns == 0);
+    assert(r.discovered == r_threaded.discovered);
+    assert(r.reinit_discovered == r_threaded.reinit_discovered);
+    assert(r.right_latency == r_threaded.right_latency);
+    assert(r.left_latency == r_threaded.left_latency);
+  }
+}
+
+int main(void) {
+  TestChainSimulator();
+}
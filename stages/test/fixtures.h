@@ -90,7 +90,8 @@ class PulseGenerator {
 class SegmentGeneratorTest {
  public:
    SegmentGeneratorTest() {
-    segment_generator_.Init();
+    settings_.mutable_state()->multimode = MULTI_MODE_STAGES;
+    segment_generator_.Init(&settings_);
   }
   ~SegmentGeneratorTest() { }
 
@@ -143,6 +144,7 @@ class SegmentGeneratorTest {
   }
   
  private:
+  Settings settings_;
   SegmentGenerator segment_generator_;
   PulseGenerator pulse_generator_;
   vector<SegmentParameters> segment_parameters_;
@@ -13,11 +13,14 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <cassert>
 #include <cmath>
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
+#include <ctime>
 
+#include "stages/segment_generator_batch.h"
 #include "stages/test/fixtures.h"
 
 using namespace stages;
@@ -183,6 +186,202 @@ void TestDelayLine() {
   }
 }
 
+struct BatchTestMode {
+  const char* name;
+  bool advanced;
+  bool has_trigger;
+  segment::Configuration configuration[5];
+  int num_segments;
+};
+
+const BatchTestMode batch_test_modes[] = {
+  { "zero", false, false, { { segment::TYPE_RAMP, false } }, 1 },
+  { "att_off", true, false, { { segment::TYPE_STEP, true } }, 1 },
+  { "portamento", false, false, { { segment::TYPE_STEP, false } }, 1 },
+  { "decay", false, true, { { segment::TYPE_RAMP, false } }, 1 },
+  { "free_running_lfo", false, false, { { segment::TYPE_RAMP, true } }, 1 },
+  { "tap_lfo", false, true, { { segment::TYPE_RAMP, true } }, 1 },
+  { "adsr", false, true, {
+      { segment::TYPE_RAMP, false },
+      { segment::TYPE_RAMP, false },
+      { segment::TYPE_HOLD, true },
+      { segment::TYPE_RAMP, false } }, 4 },
+  { "looping_ad", false, true, {
+      { segment::TYPE_RAMP, true },
+      { segment::TYPE_RAMP, true } }, 2 },
+  { "sample_and_hold", false, true, { { segment::TYPE_STEP, false } }, 1 },
+};
+
+const size_t kNumBatchTestModes = sizeof(batch_test_modes) / \
+    sizeof(BatchTestMode);
+const size_t kNumBatchTestChannels = kNumChannels * 16;
+
+class BatchTestRig {
+ public:
+  BatchTestRig() {
+    settings_[0].mutable_state()->multimode = MULTI_MODE_STAGES;
+    settings_[1].mutable_state()->multimode = MULTI_MODE_STAGES_ADVANCED;
+    for (size_t i = 0; i < kNumBatchTestChannels; ++i) {
+      generator_[i].Init(&settings_[0]);
+      gate_state_[i] = false;
+      gate_pointers_[i] = gate_flags_[i];
+      out_pointers_[i] = out_[i];
+    }
+    has_slaves_ = false;
+    batch_.Init();
+  }
+
+  void Configure(size_t channel, size_t mode) {
+    const BatchTestMode& m = batch_test_modes[mode];
+    generator_[channel].Init(&settings_[m.advanced ? 1 : 0]);
+    generator_[channel].Configure(
+        m.has_trigger, m.configuration, m.num_segments);
+  }
+
+  void ConfigureSlave(size_t channel, int segment) {
+    generator_[channel].ConfigureSlave(segment);
+    has_slaves_ = true;
+  }
+
+  void set_parameters(size_t channel, float primary, float secondary) {
+    SegmentGenerator* g = &generator_[channel];
+    for (int i = 0; i < g->num_segments(); ++i) {
+      g->set_segment_parameters(i, primary, secondary, primary);
+    }
+  }
+
+  void RenderGates(size_t size) {
+    for (size_t i = 0; i < kNumBatchTestChannels; ++i) {
+      for (size_t j = 0; j < size; ++j) {
+        GateFlags previous = j ? gate_flags_[i][j - 1] : gate_state_[i];
+        bool high = previous & GATE_FLAG_HIGH;
+        if ((rand() % 600) == 0) {
+          high = !high;
+        }
+        gate_flags_[i][j] = ExtractGateFlags(previous, high);
+      }
+      gate_state_[i] = gate_flags_[i][size - 1];
+    }
+  }
+
+  void Process(bool batched, size_t size) {
+    if (batched) {
+      batch_.Process(
+          generator_, gate_pointers_, out_pointers_, NULL,
+          kNumBatchTestChannels, size);
+    } else {
+      // Like the firmware, with a single output buffer per module.
+      for (size_t i = 0; i < kNumBatchTestChannels; ++i) {
+        if (i && has_slaves_) {
+          copy(&out_[i - 1][0], &out_[i - 1][size], &out_[i][0]);
+        }
+        generator_[i].Process(gate_flags_[i], out_[i], size);
+      }
+    }
+  }
+
+  const SegmentGenerator::Output* out(size_t channel) const {
+    return out_[channel];
+  }
+
+  const SegmentGeneratorBatch& batch() const { return batch_; }
+
+ private:
+  Settings settings_[2];
+  SegmentGenerator generator_[kNumBatchTestChannels];
+  SegmentGeneratorBatch batch_;
+  bool has_slaves_;
+  GateFlags gate_state_[kNumBatchTestChannels];
+  GateFlags gate_flags_[kNumBatchTestChannels][kBlockSize];
+  SegmentGenerator::Output out_[kNumBatchTestChannels][kBlockSize];
+  const GateFlags* gate_pointers_[kNumBatchTestChannels];
+  SegmentGenerator::Output* out_pointers_[kNumBatchTestChannels];
+};
+
+void TestSegmentGeneratorBatch() {
+  // Mix all modes. Every other cycle through the list of modes, the channel
+  // following a multi-segment generator is configured as its slave.
+  BatchTestRig* rig[2] = { new BatchTestRig(), new BatchTestRig() };
+  for (size_t r = 0; r < 2; ++r) {
+    for (size_t i = 0; i < kNumBatchTestChannels; ++i) {
+      size_t cycle = i / kNumBatchTestModes;
+      size_t mode = (i + cycle) % kNumBatchTestModes;
+      size_t previous_mode = (i + cycle - 1) % kNumBatchTestModes;
+      if ((cycle & 1) && (i % kNumBatchTestModes) && \
+          batch_test_modes[previous_mode].num_segments > 1) {
+        rig[r]->ConfigureSlave(i, i % 3);
+      } else {
+        rig[r]->Configure(i, mode);
+      }
+    }
+  }
+
+  size_t num_blocks = ::kSampleRate * 10 / kBlockSize;
+  size_t num_errors = 0;
+  for (size_t block = 0; block < num_blocks; ++block) {
+    for (size_t i = 0; i < kNumBatchTestChannels; ++i) {
+      if (block % 64 == 0) {
+        float primary = (rand() % 1000) / 1000.0f;
+        float secondary = (rand() % 1000) / 1000.0f;
+        rig[0]->set_parameters(i, primary, secondary);
+        rig[1]->set_parameters(i, primary, secondary);
+      }
+    }
+    srand(block);
+    rig[0]->RenderGates(kBlockSize);
+    srand(block);
+    rig[1]->RenderGates(kBlockSize);
+    rig[0]->Process(false, kBlockSize);
+    rig[1]->Process(true, kBlockSize);
+    for (size_t i = 0; i < kNumBatchTestChannels; ++i) {
+      if (memcmp(
+              rig[0]->out(i),
+              rig[1]->out(i),
+              sizeof(SegmentGenerator::Output) * kBlockSize)) {
+        ++num_errors;
+      }
+    }
+  }
+  printf("Batched segment generators: %lu mismatched blocks\n", num_errors);
+  assert(num_errors == 0);
+
+  for (int k = 0; k < BATCH_KERNEL_LAST; ++k) {
+    printf("  kernel %d: %u blocks\n", k,
+           rig[1]->batch().num_blocks(static_cast<BatchKernel>(k)));
+  }
+  delete rig[0];
+  delete rig[1];
+}
+
+void BenchmarkSegmentGeneratorBatch() {
+  const size_t num_blocks = ::kSampleRate * 2 / kBlockSize;
+  const float duration = static_cast<float>(num_blocks * kBlockSize) / \
+      ::kSampleRate;
+
+  for (size_t mode = 0; mode < kNumBatchTestModes; ++mode) {
+    BatchTestRig* rig = new BatchTestRig();
+    for (size_t i = 0; i < kNumBatchTestChannels; ++i) {
+      rig->Configure(i, mode);
+      rig->set_parameters(i, 0.3f, 0.6f);
+    }
+    rig->RenderGates(kBlockSize);
+
+    float channels[2];
+    for (int batched = 0; batched < 2; ++batched) {
+      clock_t start = clock();
+      for (size_t block = 0; block < num_blocks; ++block) {
+        rig->Process(batched, kBlockSize);
+      }
+      float elapsed = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+      channels[batched] = kNumBatchTestChannels * duration / elapsed;
+    }
+    // Number of channels that could be rendered in realtime.
+    printf("%-18s scalar: %6.0f channels, batched: %6.0f channels\n",
+           batch_test_modes[mode].name, channels[0], channels[1]);
+    delete rig;
+  }
+}
+
 int main(void) {
   TestADSR();
   TestTwoStepSequence();
@@ -196,4 +395,6 @@ int main(void) {
   TestDelay();
   TestZero();
   TestClockedSampleAndHold();
+  TestSegmentGeneratorBatch();
+  BenchmarkSegmentGeneratorBatch();
 }
@@ -0,0 +1,368 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Compressor, block-based floating point version.
+//
+// Process() is a drop-in replacement for the Compressor of the firmware, and
+// reproduces its curve: it outputs the control signal of the VCA. Compress()
+// processes the audio signal itself, delayed by a configurable look-ahead
+// time, with the level detected on the audio signal or on an external
+// sidechain signal, by a RMS or a peak detector.
+//
+// Only the attack/decay smoothing of the level runs sample by sample. The
+// other stages - energy, maximum over the look-ahead window, gain computation
+// from a table of the transfer curve precomputed by Configure() - process
+// whole blocks.
+
+#ifndef STREAMS_DSP_BLOCK_COMPRESSOR_H_
+#define STREAMS_DSP_BLOCK_COMPRESSOR_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+
+#include "streams/dsp/dsp.h"
+#include "streams/dsp/window_maximum.h"
+#include "streams/gain.h"
+#include "streams/resources.h"
+
+namespace streams {
+
+// DAC codes for a gain change of 1.0 on the log2 scale (6dB), with 256 DAC
+// codes <=> 1.55dB.
+const float kBlockCompressorGainConstant = 256.0f * 6.0f / 1.55f;
+
+// Energy below which the excite input is considered unpatched (-30dB).
+const float kBlockCompressorSidechainThreshold = 1.0f / 1024.0f;
+
+// The firmware clamps the squared level at 1 LSB.
+const float kBlockCompressorMinEnergy = 1.0f / 1073741824.0f;
+
+// The transfer curve is tabulated for levels from 0 to 16 (96dB) above the
+// threshold, with 16 points per unit on the log2 scale.
+const size_t kBlockCompressorKneeTableSize = 256;
+const float kBlockCompressorKneeTableRange = 16.0f;
+
+const size_t kBlockCompressorMaxLookAhead = kWindowMaximumMaxSize - 1;
+const size_t kBlockCompressorDelayLineSize = kWindowMaximumMaxSize;
+
+enum BlockCompressorDetection {
+  BLOCK_COMPRESSOR_DETECTION_RMS,
+  BLOCK_COMPRESSOR_DETECTION_PEAK
+};
+
+class BlockCompressor {
+ public:
+  BlockCompressor() { }
+  ~BlockCompressor() { }
+
+  void Init(float sample_rate) {
+    sample_rate_ = sample_rate;
+    rate_ratio_ = kReferenceSampleRate / sample_rate;
+    detector_ = 0.0f;
+    sidechain_signal_detector_ = 0.0f;
+    gain_reduction_ = 0.0f;
+    // Decay time: 5s.
+    sidechain_decay_coefficient_ = OnePoleCoefficient(14174, rate_ratio_);
+
+    detection_ = BLOCK_COMPRESSOR_DETECTION_RMS;
+    set_look_ahead(0.0f);
+
+    // Unity gain until the first call to Configure().
+    threshold_ = 0.0f;
+    slope_ = 0.0f;
+    makeup_gain_ = 0.0f;
+    soft_knee_ = false;
+    attack_coefficient_ = 1.0f;
+    decay_coefficient_ = 1.0f;
+    ComputeKneeTables();
+  }
+
+  void Configure(bool alternate, int32_t* parameters, int32_t* globals) {
+    uint16_t attack_time;
+    uint16_t decay_time;
+    uint16_t amount;
+    uint16_t threshold;
+
+    if (globals) {
+      attack_time = globals[0] * (128 + 128 + 99) >> 16;  // 1ms to 500ms
+      decay_time = 128 + 99 + (globals[2] >> 8);  // 50ms to 5000ms
+      threshold = globals[1];
+      amount = globals[3];
+    } else {
+      attack_time = !alternate ? 1 : 40;  // 0.2ms or 2ms;
+      decay_time = !alternate ? 279 : 236;  // 150ms or 70ms;
+      threshold = parameters[0];
+      amount = parameters[1];
+    }
+
+    attack_coefficient_ = OnePoleCoefficient(
+        lut_lp_coefficients[attack_time], rate_ratio_);
+    decay_coefficient_ = OnePoleCoefficient(
+        lut_lp_coefficients[decay_time], rate_ratio_);
+
+    // Same computations as in Compressor, on the 16.16 log2 scale.
+    int32_t threshold_log2 = (-1280 + 5 * (threshold >> 8)) << 8;
+    int32_t ratio;
+    int32_t makeup_gain;
+    if (amount < 32768) {
+      // Compression with no makeup gain.
+      ratio = lut_compressor_ratio[(32767 - amount) >> 7];
+      makeup_gain = 0;
+    } else {
+      // Adaptive compression with makeup gain.
+      amount -= 32768;
+      makeup_gain = amount * (kMaxExponentialGain >> 8) >> 7;
+      int32_t knee_gain = threshold_log2 + makeup_gain;
+      if (knee_gain >= 0) {
+        makeup_gain = -threshold_log2;
+        knee_gain = 0;
+      }
+      if (knee_gain > -4096) {
+        // Brickwall limiter mode, with an instant attack.
+        ratio = 0;
+        attack_coefficient_ = 1.0f;
+      } else {
+        ratio = knee_gain / (threshold_log2 >> 8);
+      }
+    }
+    threshold_ = static_cast<float>(threshold_log2) / 65536.0f;
+
+    // The tables are relative to the threshold, and only depend on the shape
+    // of the curve.
+    float slope = 1.0f - static_cast<float>(ratio) / 256.0f;
+    float makeup = static_cast<float>(makeup_gain) / 65536.0f;
+    if (slope != slope_ || makeup != makeup_gain_ || alternate != soft_knee_) {
+      slope_ = slope;
+      makeup_gain_ = makeup;
+      soft_knee_ = alternate;
+      ComputeKneeTables();
+    }
+  }
+
+  // Compatibility mode: same outputs as Compressor.
+  void Process(
+      const float* audio,
+      const float* excite,
+      float* gain,
+      float* frequency,
+      size_t size) {
+    float level[kMaxBlockSize];
+    while (size) {
+      size_t block_size = std::min(size, kMaxBlockSize);
+      Detect(audio, excite, level, block_size);
+      ComputeGain(level, gain_table_, gain, block_size);
+      std::fill(&frequency[0], &frequency[block_size], 65535.0f / 65536.0f);
+      audio += block_size;
+      excite += block_size;
+      gain += block_size;
+      frequency += block_size;
+      size -= block_size;
+    }
+  }
+
+  // Compresses audio into out, which can be the same buffer. The level is
+  // detected on sidechain, or on audio when sidechain is NULL. The output is
+  // delayed by the look-ahead time.
+  void Compress(
+      const float* audio,
+      const float* sidechain,
+      float* out,
+      size_t size) {
+    float level[kMaxBlockSize];
+    float gain[kMaxBlockSize];
+    while (size) {
+      size_t block_size = std::min(size, kMaxBlockSize);
+      const float* detected = sidechain ? sidechain : audio;
+      for (size_t i = 0; i < block_size; ++i) {
+        level[i] = detected[i] * detected[i];
+      }
+      if (detection_ == BLOCK_COMPRESSOR_DETECTION_PEAK) {
+        peak_window_.Process(level, level, block_size);
+      }
+      Smooth(level, block_size);
+      ComputeGain(level, amplitude_table_, gain, block_size);
+
+      size_t write_ptr = delay_line_write_ptr_;
+      for (size_t i = 0; i < block_size; ++i) {
+        delay_line_[write_ptr & kDelayLineMask] = audio[i];
+        float delayed = delay_line_[(write_ptr - look_ahead_) & kDelayLineMask];
+        out[i] = delayed * gain[i];
+        ++write_ptr;
+      }
+      delay_line_write_ptr_ = write_ptr & kDelayLineMask;
+
+      audio += block_size;
+      if (sidechain) {
+        sidechain += block_size;
+      }
+      out += block_size;
+      size -= block_size;
+    }
+  }
+
+  // Look-ahead time of Compress(), in seconds. Changing it clears the delay
+  // line.
+  void set_look_ahead(float look_ahead) {
+    size_t samples = static_cast<size_t>(
+        std::max(look_ahead, 0.0f) * sample_rate_ + 0.5f);
+    look_ahead_ = std::min(samples, kBlockCompressorMaxLookAhead);
+    peak_window_.Init(look_ahead_ + 1);
+    std::fill(
+        &delay_line_[0],
+        &delay_line_[kBlockCompressorDelayLineSize],
+        0.0f);
+    delay_line_write_ptr_ = 0;
+  }
+
+  inline void set_detection(BlockCompressorDetection detection) {
+    detection_ = detection;
+  }
+
+  // Latency of Compress(), in samples.
+  inline size_t look_ahead() const { return look_ahead_; }
+
+  // Gain reduction on the log2 scale, for the last sample.
+  inline float gain_reduction() const { return gain_reduction_; }
+
+ private:
+  static const size_t kDelayLineMask = kBlockCompressorDelayLineSize - 1;
+
+  // Detects the RMS level on the EXCITE input, or on the AUDIO input when
+  // there is no signal on the EXCITE input.
+  void Detect(
+      const float* audio,
+      const float* excite,
+      float* level,
+      size_t size) {
+    float detector = detector_;
+    float sidechain_signal_detector = sidechain_signal_detector_;
+    for (size_t i = 0; i < size; ++i) {
+      float energy = excite[i] * excite[i];
+      float error = energy - sidechain_signal_detector;
+      sidechain_signal_detector += error > 0.0f
+          ? error
+          : error * sidechain_decay_coefficient_;
+      if (sidechain_signal_detector < kBlockCompressorSidechainThreshold) {
+        energy = audio[i] * audio[i];
+      }
+      error = energy - detector;
+      detector += error * (error > 0.0f
+          ? attack_coefficient_
+          : decay_coefficient_);
+      level[i] = detector;
+    }
+    detector_ = detector;
+    sidechain_signal_detector_ = sidechain_signal_detector;
+  }
+
+  // Attack/decay smoothing of the energy, in place.
+  void Smooth(float* level, size_t size) {
+    float detector = detector_;
+    for (size_t i = 0; i < size; ++i) {
+      float error = level[i] - detector;
+      detector += error * (error > 0.0f
+          ? attack_coefficient_
+          : decay_coefficient_);
+      level[i] = detector;
+    }
+    detector_ = detector;
+  }
+
+  // Position of the level above the threshold, on the log2 scale.
+  inline float Position(float energy) const {
+    energy = std::max(energy, kBlockCompressorMinEnergy);
+    return std::max(0.5f * FastLog2(energy) - threshold_, 0.0f);
+  }
+
+  // Attenuation on the log2 scale, with a soft knee over the first unit of
+  // attenuation.
+  inline float Attenuation(float position) const {
+    float attenuation = position * slope_;
+    float knee_amount = soft_knee_ ? std::max(1.0f - attenuation, 0.0f) : 0.0f;
+    float cube = attenuation * attenuation * attenuation;
+    return attenuation + (cube - attenuation) * knee_amount;
+  }
+
+  void ComputeKneeTables() {
+    const float step = kBlockCompressorKneeTableRange / \
+        static_cast<float>(kBlockCompressorKneeTableSize);
+    for (size_t i = 0; i < kBlockCompressorKneeTableSize + 2; ++i) {
+      float g = makeup_gain_ - Attenuation(static_cast<float>(i) * step);
+      float code = static_cast<float>(kUnityGain) + \
+          g * kBlockCompressorGainConstant;
+      gain_table_[i] = std::min(std::max(code, 0.0f), 65535.0f) / 65536.0f;
+      amplitude_table_[i] = exp2f(g);
+    }
+  }
+
+  void ComputeGain(
+      const float* level,
+      const float* table,
+      float* gain,
+      size_t size) {
+    const float scale = static_cast<float>(kBlockCompressorKneeTableSize) / \
+        kBlockCompressorKneeTableRange;
+    const float max_index = static_cast<float>(kBlockCompressorKneeTableSize);
+    for (size_t i = 0; i < size; ++i) {
+      float index = std::min(Position(level[i]) * scale, max_index);
+      gain[i] = Interpolate(table, index);
+    }
+    gain_reduction_ = -Attenuation(Position(level[size - 1]));
+  }
+
+  float sample_rate_;
+  float rate_ratio_;
+
+  float slope_;  // 1 - 1 / ratio.
+  float threshold_;
+  float makeup_gain_;
+
+  bool soft_knee_;
+
+  float attack_coefficient_;
+  float decay_coefficient_;
+  float sidechain_decay_coefficient_;
+  float detector_;
+  float sidechain_signal_detector_;
+  float gain_reduction_;
+
+  // The last point is only read by the interpolation at the end of the range.
+  float gain_table_[kBlockCompressorKneeTableSize + 2];
+  float amplitude_table_[kBlockCompressorKneeTableSize + 2];
+
+  BlockCompressorDetection detection_;
+  size_t look_ahead_;
+  WindowMaximum peak_window_;
+  float delay_line_[kBlockCompressorDelayLineSize];
+  size_t delay_line_write_ptr_;
+
+  DISALLOW_COPY_AND_ASSIGN(BlockCompressor);
+};
+
+}  // namespace streams
+
+#endif  // STREAMS_DSP_BLOCK_COMPRESSOR_H_
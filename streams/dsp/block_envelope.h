@@ -0,0 +1,274 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Simple AD envelope, block-based floating point version.
+
+#ifndef STREAMS_DSP_BLOCK_ENVELOPE_H_
+#define STREAMS_DSP_BLOCK_ENVELOPE_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+
+#include "streams/dsp/dsp.h"
+#include "streams/envelope.h"
+#include "streams/gain.h"
+#include "streams/meta_parameters.h"
+#include "streams/resources.h"
+
+namespace streams {
+
+class BlockEnvelope {
+ public:
+  BlockEnvelope() { }
+  ~BlockEnvelope() { }
+
+  void Init(float sample_rate) {
+    rate_ratio_ = kReferenceSampleRate / sample_rate;
+    std::fill(&shape_[0], &shape_[kMaxNumSegments], ENV_SHAPE_LINEAR);
+    set_ad(0, 8192);
+    segment_ = num_segments_;
+    phase_ = 0.0f;
+    start_value_ = 0.0f;
+    value_ = 0.0f;
+    rate_modulation_ = 0.0f;
+    gate_level_ = 0.0f;
+    gate_ = false;
+    hard_reset_ = false;
+    alternate_ = false;
+    attack_ = 0;
+    decay_ = 0;
+    frequency_amount_ = 0.0f;
+    frequency_offset_ = 0.0f;
+    smoothing_coefficient_ = ShiftCoefficient(8, rate_ratio_);
+    gate_level_coefficient_ = ShiftCoefficient(8, rate_ratio_);
+    rate_modulation_coefficient_ = ShiftCoefficient(12, rate_ratio_);
+  }
+
+  void Configure(bool alternate, int32_t* parameters, int32_t* globals) {
+    uint16_t a, d;
+    if (globals) {
+      a = globals[0];
+      d = globals[2];
+    } else {
+      ComputeAttackDecay(parameters[0], &a, &d);
+    }
+    int32_t amount;
+    int32_t offset;
+    ComputeAmountOffset(parameters[1], &amount, &offset);
+    target_frequency_amount_ = static_cast<float>(amount) / 65536.0f;
+    target_frequency_offset_ = static_cast<float>(offset) / 65536.0f;
+
+    if (a != attack_ || d != decay_ || alternate != alternate_) {
+      attack_ = a;
+      decay_ = d;
+      alternate_ = alternate;
+      if (alternate_) {
+        set_ar(a, d);
+      } else {
+        set_ad(a, d);
+      }
+      hard_reset_ = true;
+    }
+  }
+
+  inline void set_ad(uint16_t attack, uint16_t decay) {
+    num_segments_ = 2;
+    sustain_point_ = 0;
+    set_levels_and_times(attack, decay);
+    shape_[0] = ENV_SHAPE_LINEAR;
+    shape_[1] = ENV_SHAPE_EXPONENTIAL;
+    UpdateSegments();
+  }
+
+  inline void set_ar(uint16_t attack, uint16_t decay) {
+    num_segments_ = 2;
+    sustain_point_ = 1;
+    set_levels_and_times(attack, decay);
+    shape_[0] = ENV_SHAPE_LINEAR;
+    shape_[1] = ENV_SHAPE_LINEAR;
+    UpdateSegments();
+  }
+
+  void Process(
+      const float* audio,
+      const float* excite,
+      float* gain,
+      float* frequency,
+      size_t size) {
+    const float threshold = static_cast<float>(kSchmittTriggerThreshold) / \
+        32768.0f;
+    const float full_scale = 32767.0f / 32768.0f;
+    const float gain_scale = static_cast<float>(kAboveUnityGain) / 65536.0f;
+
+    // The state is kept in local variables: the compiler cannot prove that
+    // the output buffers do not overlap the members, and would otherwise
+    // reload and store all of them at each sample.
+    int16_t segment = segment_;
+    float start_value = start_value_;
+    float value = value_;
+    float phase = phase_;
+    float rate_modulation = rate_modulation_;
+    float gate_level = gate_level_;
+    float frequency_amount = frequency_amount_;
+    float frequency_offset = frequency_offset_;
+    bool gate = gate_;
+    bool hard_reset = hard_reset_;
+
+    for (size_t i = 0; i < size; ++i) {
+      // Smooth frequency amount parameters.
+      frequency_amount += smoothing_coefficient_ * \
+          (target_frequency_amount_ - frequency_amount);
+      frequency_offset += smoothing_coefficient_ * \
+          (target_frequency_offset_ - frequency_offset);
+
+      float e = excite[i];
+      bool trigger = false;
+      if (!gate) {
+        if (e > threshold) {
+          trigger = true;
+          gate = true;
+          hard_reset = false;
+        }
+      } else {
+        if (e < 0.5f * threshold) {
+          gate = false;
+        } else {
+          // Track the level of the signal while the GATE is held.
+          gate_level += gate_level_coefficient_ * (e - gate_level);
+        }
+      }
+      if (trigger) {
+        start_value = (segment == num_segments_ || hard_reset)
+            ? level_[0]
+            : value;
+        segment = 0;
+        phase = 0.0f;
+      } else if (phase >= 1.0f) {
+        start_value = level_[segment + 1];
+        ++segment;
+        phase = 0.0f;
+      }
+
+      bool sustained = sustain_point_ && segment == sustain_point_ && gate;
+      float increment = sustained ? 0.0f : increment_[segment];
+
+      // Modulates the envelope rate by the actual excitation pulse.
+      rate_modulation += rate_modulation_coefficient_ * \
+          ((e > threshold ? e : 0.0f) - rate_modulation);
+      increment *= 1.0f + 2.0f * rate_modulation;
+
+      float a = start_value;
+      float b = level_[segment + 1];
+      float t = Interpolate(shape_table_[segment], phase * 256.0f) / 65536.0f;
+      value = a + (b - a) * t;
+      phase += increment;
+
+      // Applies a variable amount of distortion, depending on the level.
+      float compressed = full_scale - (full_scale - value) * \
+          (full_scale - value);
+      compressed = full_scale - (full_scale - compressed) * \
+          (full_scale - compressed);
+      float scaled = value + (compressed - value) * gate_level;
+      scaled *= 0.875f + 0.125f * gate_level;
+      gain[i] = scaled * gain_scale;
+      frequency[i] = frequency_offset + scaled * frequency_amount;
+    }
+
+    segment_ = segment;
+    start_value_ = start_value;
+    value_ = value;
+    phase_ = phase;
+    rate_modulation_ = rate_modulation;
+    gate_level_ = gate_level;
+    frequency_amount_ = frequency_amount;
+    frequency_offset_ = frequency_offset;
+    gate_ = gate;
+    hard_reset_ = hard_reset;
+  }
+
+ private:
+  inline void set_levels_and_times(uint16_t attack, uint16_t decay) {
+    level_[0] = 0.0f;
+    level_[1] = 32767.0f / 32768.0f;
+    level_[2] = 0.0f;
+    time_[0] = attack;
+    time_[1] = decay;
+  }
+
+  // Phase increment and shape table of each segment, and of the end of the
+  // envelope, where the phase stops.
+  inline void UpdateSegments() {
+    for (uint16_t i = 0; i <= num_segments_; ++i) {
+      increment_[i] = i == num_segments_
+          ? 0.0f
+          : static_cast<float>(lut_env_increments[time_[i] >> 8]) * \
+              rate_ratio_ / 4294967296.0f;
+      shape_table_[i] = lookup_table_table[LUT_ENV_LINEAR + shape_[i]];
+    }
+  }
+
+  float rate_ratio_;
+  bool gate_;
+
+  float level_[kMaxNumSegments];
+  uint16_t time_[kMaxNumSegments];
+  EnvelopeShape shape_[kMaxNumSegments];
+  float increment_[kMaxNumSegments];
+  const uint16_t* shape_table_[kMaxNumSegments];
+
+  int16_t segment_;
+  float start_value_;
+  float value_;
+
+  float phase_;
+
+  uint16_t num_segments_;
+  uint16_t sustain_point_;
+
+  float target_frequency_amount_;
+  float target_frequency_offset_;
+  float frequency_amount_;
+  float frequency_offset_;
+  float smoothing_coefficient_;
+
+  uint16_t attack_;
+  uint16_t decay_;
+
+  bool alternate_;
+  bool hard_reset_;
+
+  float rate_modulation_;
+  float rate_modulation_coefficient_;
+  float gate_level_;
+  float gate_level_coefficient_;
+
+  DISALLOW_COPY_AND_ASSIGN(BlockEnvelope);
+};
+
+}  // namespace streams
+
+#endif  // STREAMS_DSP_BLOCK_ENVELOPE_H_
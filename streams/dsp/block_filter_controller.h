@@ -0,0 +1,93 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Plain filter, block-based floating point version.
+
+#ifndef STREAMS_DSP_BLOCK_FILTER_CONTROLLER_H_
+#define STREAMS_DSP_BLOCK_FILTER_CONTROLLER_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+
+#include "streams/dsp/dsp.h"
+
+namespace streams {
+
+class BlockFilterController {
+ public:
+  BlockFilterController() { }
+  ~BlockFilterController() { }
+
+  void Init(float sample_rate) {
+    frequency_offset_ = 0.0f;
+    frequency_amount_ = 0.0f;
+    smoothing_coefficient_ = ShiftCoefficient(
+        8, kReferenceSampleRate / sample_rate);
+  }
+
+  void Process(
+      const float* audio,
+      const float* excite,
+      float* gain,
+      float* frequency,
+      size_t size) {
+    float amount = frequency_amount_;
+    float offset = frequency_offset_;
+    for (size_t i = 0; i < size; ++i) {
+      // Smooth frequency amount parameters.
+      amount += smoothing_coefficient_ * (target_frequency_amount_ - amount);
+      offset += smoothing_coefficient_ * (target_frequency_offset_ - offset);
+      float f = offset + 2.0f * excite[i] * amount;
+      frequency[i] = std::max(std::min(f, 65535.0f / 65536.0f), 0.0f);
+    }
+    std::fill(&gain[0], &gain[size], 0.0f);
+    frequency_amount_ = amount;
+    frequency_offset_ = offset;
+  }
+
+  void Configure(bool alternate, int32_t* parameters, int32_t* globals) {
+    int32_t amount = parameters[1];
+    amount -= 32768;
+    amount = amount * amount >> 15;
+    amount = parameters[1] < 32768 ? -amount : amount;
+    target_frequency_amount_ = static_cast<float>(amount) / 65536.0f;
+    target_frequency_offset_ = static_cast<float>(parameters[0]) / 65536.0f;
+  }
+
+ private:
+  float target_frequency_amount_;
+  float target_frequency_offset_;
+  float frequency_amount_;
+  float frequency_offset_;
+  float smoothing_coefficient_;
+
+  DISALLOW_COPY_AND_ASSIGN(BlockFilterController);
+};
+
+}  // namespace streams
+
+#endif  // STREAMS_DSP_BLOCK_FILTER_CONTROLLER_H_
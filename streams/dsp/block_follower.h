@@ -0,0 +1,229 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Follower, block-based floating point version.
+
+#ifndef STREAMS_DSP_BLOCK_FOLLOWER_H_
+#define STREAMS_DSP_BLOCK_FOLLOWER_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "streams/dsp/dsp.h"
+#include "streams/dsp/float_svf.h"
+#include "streams/follower.h"
+#include "streams/gain.h"
+#include "streams/meta_parameters.h"
+#include "streams/resources.h"
+
+namespace streams {
+
+class BlockFollower {
+ public:
+  BlockFollower() { }
+  ~BlockFollower() { }
+
+  void Init(float sample_rate) {
+    rate_ratio_ = kReferenceSampleRate / sample_rate;
+    analysis_low_.Init(sample_rate);
+    analysis_low_.set_frequency_and_resonance(45 << 7, 0);
+    analysis_medium_.Init(sample_rate);
+    analysis_medium_.set_frequency_and_resonance(86 << 7, 0);
+
+    for (uint16_t i = 0; i < kNumBands; ++i) {
+      energy_[i][0] = energy_[i][1] = 0.0f;
+      follower_[i] = 0.0f;
+      follower_lp_[i] = 0.0f;
+      spectrum_[i] = 0.0f;
+    }
+    centroid_ = 0.0f;
+    frequency_amount_ = 0.0f;
+    frequency_offset_ = 0.0f;
+    smoothing_coefficient_ = ShiftCoefficient(8, rate_ratio_);
+    centroid_coefficient_ = ShiftCoefficient(8, rate_ratio_);
+  }
+
+  void Configure(bool alternate, int32_t* parameters, int32_t* globals) {
+    uint16_t attack_time;
+    uint16_t decay_time;
+    int32_t amount;
+    int32_t offset;
+
+    if (globals) {
+      // Attack: 1ms to 100ms
+      attack_time = globals[0] >> 8;
+      // Decay: 10ms to 1000ms
+      decay_time = 128 + (globals[2] >> 8);
+    } else {
+      uint16_t shape = parameters[0];
+      if (shape < 32768) {
+        // attack: 1ms to 2ms.
+        attack_time = (shape * 39 >> 15);
+        // decay: 10ms to 100ms.
+        decay_time = 128 + (shape * 128 >> 15);
+      } else {
+        shape -= 32768;
+        // attack: 2ms to 20ms.
+        attack_time = 39 + (shape * 128 >> 15);
+        // decay: 100ms to 200ms.
+        decay_time = 128 + 128 + (shape * 39 >> 15);
+      }
+    }
+    ComputeAmountOffset(parameters[1], &amount, &offset);
+    target_frequency_amount_ = static_cast<float>(amount) / 65536.0f;
+    target_frequency_offset_ = static_cast<float>(offset) / 65536.0f;
+
+    // Slow down the attack detection on low frequencies.
+    static const uint16_t attack_offset[kNumBands] = { 39, 19, 0 };
+    // Slow down the decay detection on high frequencies as there is more noise.
+    static const uint16_t decay_offset[kNumBands] = { 39, 19, 99 };
+    for (uint16_t i = 0; i < kNumBands; ++i) {
+      attack_coefficient_[i] = OnePoleCoefficient(
+          lut_lp_coefficients[attack_time + attack_offset[i]], rate_ratio_);
+      decay_coefficient_[i] = OnePoleCoefficient(
+          lut_lp_coefficients[decay_time + decay_offset[i]], rate_ratio_);
+    }
+
+    only_filter_ = alternate;
+    // Integrate more slowly for spectrum estimation.
+    spectrum_coefficient_ = ShiftCoefficient(
+        only_filter_ ? 6 : 10,
+        rate_ratio_);
+  }
+
+  void Process(
+      const float* audio,
+      const float* excite,
+      float* gain,
+      float* frequency,
+      size_t size) {
+    while (size--) {
+      // Smooth frequency amount parameters.
+      frequency_amount_ += smoothing_coefficient_ * \
+          (target_frequency_amount_ - frequency_amount_);
+      frequency_offset_ += smoothing_coefficient_ * \
+          (target_frequency_offset_ - frequency_offset_);
+
+      analysis_low_.Process(*excite++);
+      analysis_medium_.Process(analysis_low_.hp());
+
+      float channel[kNumBands];
+      channel[0] = analysis_low_.lp();
+      channel[1] = analysis_medium_.lp();
+      channel[2] = analysis_medium_.hp();
+
+      // Same scale as the fixed-point version: 1.0 is a full-scale squared
+      // sample for the energies, and 1.0 is 65536 for the envelope.
+      float envelope = 0.0f;
+      float centroid_numerator = 0.0f;
+      float centroid_denominator = 0.0f;
+      for (uint16_t i = 0; i < kNumBands; ++i) {
+        // The follower snaps back when the energy stops decreasing, which
+        // requires it to reach a plateau. As in the firmware, this happens
+        // when the level of the band decays below 1 LSB.
+        float level = static_cast<float>(
+            static_cast<int32_t>(channel[i] * 32768.0f)) / 32768.0f;
+        float energy = level * level;
+        float e0 = energy_[i][0];
+        float e1 = energy_[i][1];
+        float follower = follower_[i];
+
+        // Ride an ascending peak. Otherwise, hold and snap on local maxima.
+        bool ascending = e0 < e1 && e1 < energy && energy > follower;
+        bool maximum = e0 <= e1 && e1 >= energy;
+        follower = ascending ? energy : follower;
+        follower = maximum ? e1 : follower;
+        follower_[i] = follower;
+        energy_[i][0] = e1;
+        energy_[i][1] = energy;
+
+        // Then let a low-pass filter smooth things out.
+        float error = follower - follower_lp_[i];
+        follower_lp_[i] += error * (error > 0.0f
+            ? attack_coefficient_[i]
+            : decay_coefficient_[i]);
+        envelope += 2.0f * follower_lp_[i];
+
+        float spectrum_target = only_filter_ ? follower_lp_[i] : follower;
+        spectrum_[i] += spectrum_coefficient_ * \
+            (spectrum_target - spectrum_[i]);
+        centroid_numerator += static_cast<float>(i) * spectrum_[i];
+        centroid_denominator += spectrum_[i];
+      }
+
+      envelope = std::max(std::min(envelope, 65535.0f / 65536.0f), 0.0f);
+      float gain_mod = sqrtf(envelope);
+      // The firmware adds 1 LSB to the denominator, on a scale where 1.0 is
+      // 2^14.
+      float centroid = 0.5f * centroid_numerator / \
+          (centroid_denominator + 1.0f / 16384.0f);
+      if (gain_mod > 0.125f) {
+        centroid_ = centroid;
+      } else if (gain_mod > 0.0625f) {
+        centroid_ += centroid_coefficient_ * (centroid - centroid_);
+      }
+
+      float g = gain_mod * static_cast<float>(kUnityGain) / 65536.0f;
+      float f = frequency_offset_ + centroid_ * frequency_amount_;
+      *gain++ = only_filter_ ? f : g;
+      *frequency++ = only_filter_ ? 65535.0f / 65536.0f : f;
+    }
+  }
+
+ private:
+  float rate_ratio_;
+
+  FloatSvf analysis_low_;
+  FloatSvf analysis_medium_;
+  float energy_[kNumBands][2];
+  float follower_[kNumBands];
+
+  float attack_coefficient_[kNumBands];
+  float decay_coefficient_[kNumBands];
+  float follower_lp_[kNumBands];
+
+  float spectrum_[kNumBands];
+  float spectrum_coefficient_;
+
+  float centroid_;
+  float centroid_coefficient_;
+
+  float frequency_offset_;
+  float frequency_amount_;
+  float target_frequency_offset_;
+  float target_frequency_amount_;
+  float smoothing_coefficient_;
+
+  bool only_filter_;
+
+  DISALLOW_COPY_AND_ASSIGN(BlockFollower);
+};
+
+}  // namespace streams
+
+#endif  // STREAMS_DSP_BLOCK_FOLLOWER_H_
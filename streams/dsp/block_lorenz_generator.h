@@ -0,0 +1,131 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Lorenz system, block-based floating point version.
+
+#ifndef STREAMS_DSP_BLOCK_LORENZ_GENERATOR_H_
+#define STREAMS_DSP_BLOCK_LORENZ_GENERATOR_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+
+#include "streams/dsp/dsp.h"
+#include "streams/resources.h"
+
+namespace streams {
+
+class BlockLorenzGenerator {
+ public:
+  BlockLorenzGenerator() { }
+  ~BlockLorenzGenerator() { }
+
+  void Init(float sample_rate) {
+    rate_ratio_ = kReferenceSampleRate / sample_rate;
+    x_ = 0.1f;
+    y_ = 0.0f;
+    z_ = 0.0f;
+    vcf_amount_ = 0.0f;
+    vca_amount_ = 0.0f;
+    smoothing_coefficient_ = ShiftCoefficient(8, rate_ratio_);
+  }
+
+  void set_index(uint8_t index) {
+    index_ = index;
+  }
+
+  void Configure(bool alternate, int32_t* parameters, int32_t* globals) {
+    rate_ = parameters[0] >> 8;
+    int32_t vcf_amount = 65535 - parameters[1];
+    int32_t vca_amount = parameters[1];
+    if (vcf_amount >= 32767) vcf_amount = 32767;
+    if (vca_amount >= 32767) vca_amount = 32767;
+    target_vcf_amount_ = static_cast<float>(vcf_amount) / 32768.0f;
+    target_vca_amount_ = static_cast<float>(vca_amount) / 32768.0f;
+  }
+
+  void Process(
+      const float* audio,
+      const float* excite,
+      float* gain,
+      float* frequency,
+      size_t size) {
+    const float sigma = 10.0f;
+    const float rho = 28.0f;
+    const float beta = 8.0f / 3.0f;
+    const float full_scale = 65535.0f / 65536.0f;
+    while (size--) {
+      vcf_amount_ += smoothing_coefficient_ * \
+          (target_vcf_amount_ - vcf_amount_);
+      vca_amount_ += smoothing_coefficient_ * \
+          (target_vca_amount_ - vca_amount_);
+
+      // The rate is quantized as in the firmware, and the time step is
+      // scaled to the actual sample rate.
+      int32_t rate = rate_ + (static_cast<int32_t>(*excite++ * 32768.0f) >> 8);
+      CONSTRAIN(rate, 0, 256);
+      float dt = static_cast<float>(lut_lorenz_rate[rate]) * rate_ratio_ / \
+          16777216.0f;
+
+      float x = x_ + dt * (sigma * (y_ - x_));
+      float y = y_ + dt * (x_ * (rho - z_) - y_);
+      float z = z_ + dt * (x_ * y_ - beta * z_);
+      x_ = x;
+      y_ = y;
+      z_ = z;
+
+      float z_scaled = z * (1.0f / 64.0f);
+      float x_scaled = x * (1.0f / 64.0f) + 0.5f;
+      if (index_) {
+        // On channel 2, z and y are inverted to get more variety!
+        std::swap(x_scaled, z_scaled);
+      }
+
+      float g = z_scaled * vca_amount_;
+      float f = full_scale + (x_scaled - full_scale) * vcf_amount_;
+      *gain++ = std::max(std::min(g, full_scale), 0.0f);
+      *frequency++ = std::max(std::min(f, full_scale), 0.0f);
+    }
+  }
+
+ private:
+  float rate_ratio_;
+  float x_, y_, z_;
+  int32_t rate_;
+  float vcf_amount_;
+  float vca_amount_;
+  float target_vcf_amount_;
+  float target_vca_amount_;
+  float smoothing_coefficient_;
+
+  uint8_t index_;
+
+  DISALLOW_COPY_AND_ASSIGN(BlockLorenzGenerator);
+};
+
+}  // namespace streams
+
+#endif  // STREAMS_DSP_BLOCK_LORENZ_GENERATOR_H_
@@ -0,0 +1,70 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Block-based, floating point dynamics processor.
+
+#include "streams/dsp/block_processor.h"
+
+#include <algorithm>
+
+namespace streams {
+
+using namespace std;
+
+#define REGISTER_BLOCK_PROCESSOR(ClassName) \
+  { &BlockProcessor::ClassName ## Init, \
+    &BlockProcessor::ClassName ## Process, \
+    &BlockProcessor::ClassName ## Configure },
+
+/* static */
+const BlockProcessor::ProcessorCallbacks
+BlockProcessor::callbacks_table_[PROCESSOR_FUNCTION_LAST] = {
+  REGISTER_BLOCK_PROCESSOR(Envelope)
+  REGISTER_BLOCK_PROCESSOR(Vactrol)
+  REGISTER_BLOCK_PROCESSOR(Follower)
+  REGISTER_BLOCK_PROCESSOR(Compressor)
+  REGISTER_BLOCK_PROCESSOR(FilterController)
+  REGISTER_BLOCK_PROCESSOR(LorenzGenerator)
+};
+
+void BlockProcessor::Init(uint8_t index, float sample_rate) {
+  sample_rate_ = sample_rate;
+  for (uint8_t i = 0; i < PROCESSOR_FUNCTION_LAST; ++i) {
+    (this->*callbacks_table_[i].init)();
+  }
+  dirty_ = true;
+  alternate_ = false;
+  linked_ = false;
+
+  fill(&parameters_[0], &parameters_[2], 32768);
+  fill(&globals_[0], &globals_[4], 32768);
+
+  set_function(PROCESSOR_FUNCTION_ENVELOPE);
+
+  lorenz_generator_.set_index(index);
+}
+
+}  // namespace streams
@@ -0,0 +1,160 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Generic class interfacing all block-based, floating point dynamics
+// processors.
+
+#ifndef STREAMS_DSP_BLOCK_PROCESSOR_H_
+#define STREAMS_DSP_BLOCK_PROCESSOR_H_
+
+#include "stmlib/stmlib.h"
+
+#include "streams/dsp/block_compressor.h"
+#include "streams/dsp/block_envelope.h"
+#include "streams/dsp/block_filter_controller.h"
+#include "streams/dsp/block_follower.h"
+#include "streams/dsp/block_lorenz_generator.h"
+#include "streams/dsp/block_vactrol.h"
+#include "streams/processor.h"
+
+namespace streams {
+
+#define DECLARE_BLOCK_PROCESSOR(ClassName, variable) \
+  void ClassName ## Init() { \
+    variable.Init(sample_rate_); \
+  } \
+  void ClassName ## Process( \
+      const float* a, const float* e, float* g, float* f, size_t n) { \
+    variable.Process(a, e, g, f, n); \
+  } \
+  void ClassName ## Configure(bool a, int32_t* p, int32_t* g) { \
+    variable.Configure(a, p, g); \
+  } \
+  Block ## ClassName variable;
+
+class BlockProcessor {
+ public:
+  BlockProcessor() { }
+  ~BlockProcessor() { }
+
+  void Init(uint8_t index, float sample_rate);
+
+  typedef void (BlockProcessor::*InitFn)();
+  typedef void (BlockProcessor::*ProcessFn)(
+      const float*,
+      const float*,
+      float*,
+      float*,
+      size_t);
+  typedef void (BlockProcessor::*ConfigureFn)(
+      bool,
+      int32_t*,
+      int32_t*);
+
+  struct ProcessorCallbacks {
+    InitFn init;
+    ProcessFn process;
+    ConfigureFn configure;
+  };
+
+  inline void set_function(ProcessorFunction function) {
+    function_ = function;
+    callbacks_ = callbacks_table_[function];
+    (this->*callbacks_.init)();
+    dirty_ = true;
+  }
+
+  inline void set_alternate(bool alternate) {
+    alternate_ = alternate;
+    dirty_ = true;
+  }
+
+  inline void set_linked(bool linked) {
+    linked_ = linked;
+    dirty_ = true;
+  }
+
+  inline void set_parameter(uint16_t index, uint16_t value) {
+    parameters_[index] = value;
+    dirty_ = true;
+  }
+  inline void set_global(uint16_t index, uint16_t value) {
+    globals_[index] = value;
+    dirty_ = linked_;
+  }
+
+  inline ProcessorFunction function() const { return function_; }
+  inline bool alternate() const { return alternate_; }
+  inline bool linked() const { return linked_; }
+  inline float gain_reduction() const { return compressor_.gain_reduction(); }
+
+  // audio and excite are the inputs, with 1.0f for 32768; gain and frequency
+  // the outputs, with 1.0f for 65536.
+  inline void Process(
+      const float* audio,
+      const float* excite,
+      float* gain,
+      float* frequency,
+      size_t size) {
+    (this->*callbacks_.process)(audio, excite, gain, frequency, size);
+  }
+
+  void Configure() {
+    if (!dirty_) {
+      return;
+    }
+    (this->*callbacks_.configure)(
+        alternate_,
+        parameters_,
+        linked_ ? globals_ : NULL);
+    dirty_ = false;
+  }
+
+ private:
+  float sample_rate_;
+  ProcessorFunction function_;
+  bool linked_;
+  bool alternate_;
+  bool dirty_;
+  int32_t parameters_[2];
+  int32_t globals_[4];
+
+  ProcessorCallbacks callbacks_;
+  static const ProcessorCallbacks callbacks_table_[PROCESSOR_FUNCTION_LAST];
+
+  DECLARE_BLOCK_PROCESSOR(Envelope, envelope_);
+  DECLARE_BLOCK_PROCESSOR(Vactrol, vactrol_);
+  DECLARE_BLOCK_PROCESSOR(Follower, follower_);
+  DECLARE_BLOCK_PROCESSOR(Compressor, compressor_);
+  DECLARE_BLOCK_PROCESSOR(FilterController, filter_controller_);
+  DECLARE_BLOCK_PROCESSOR(LorenzGenerator, lorenz_generator_);
+
+  DISALLOW_COPY_AND_ASSIGN(BlockProcessor);
+};
+
+}  // namespace streams
+
+#endif  // STREAMS_DSP_BLOCK_PROCESSOR_H_
@@ -0,0 +1,336 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Vactrol, block-based floating point version.
+//
+// Unlike the other block-based processors, this one is slower than its
+// fixed-point counterpart on a host CPU, by about 1.5x with a noisy excitation.
+// Each sample goes through a chain of dependent one-pole filters, whose
+// coefficients depend on the sign of the error. Noise makes these signs
+// unpredictable. The fixed-point version selects the coefficients with
+// conditional moves, while the float version branches, and mispredicts.
+// Branch-free selections (min/max, masks) lengthen the dependency chain by
+// more than they save, so the branches are kept.
+
+#ifndef STREAMS_DSP_BLOCK_VACTROL_H_
+#define STREAMS_DSP_BLOCK_VACTROL_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+
+#include "streams/dsp/dsp.h"
+#include "streams/gain.h"
+#include "streams/meta_parameters.h"
+#include "streams/resources.h"
+
+namespace streams {
+
+class BlockVactrol {
+ public:
+  BlockVactrol() { }
+  ~BlockVactrol() { }
+
+  void Init(float sample_rate) {
+    rate_ratio_ = kReferenceSampleRate / sample_rate;
+    std::fill(&state_[0], &state_[4], 0.0f);
+    excite_ = 0.0f;
+    gate_ = false;
+    onset_ = 0;
+    onset_duration_ = std::max(
+        static_cast<int32_t>(1.0f / rate_ratio_ + 0.5f), 1);
+    frequency_amount_ = 0.0f;
+    frequency_offset_ = 0.0f;
+    smoothing_coefficient_ = ShiftCoefficient(8, rate_ratio_);
+    excite_attack_coefficient_ = OnePoleCoefficient(1 << 30, rate_ratio_);
+    excite_decay_step_ = rate_ratio_ / 32768.0f;
+    overshoot_coefficient_ = OnePoleCoefficient(67976239, rate_ratio_);
+    // Get into the "sensitized" state in 1s, out of it in 60s.
+    sensitize_coefficient_ = OnePoleCoefficient(138132, rate_ratio_);
+    desensitize_coefficient_ = OnePoleCoefficient(1151, rate_ratio_);
+  }
+
+  void Configure(bool alternate, int32_t* parameters, int32_t* globals) {
+    uint16_t attack_time;
+    uint16_t decay_time;
+    int32_t amount;
+    int32_t offset;
+
+    ComputeAmountOffset(parameters[1], &amount, &offset);
+    if (globals) {
+      // Attack: 10ms to 1000ms
+      attack_time = 128 + (globals[0] >> 8);
+      // Decay: 10ms to 5000ms
+      decay_time = 128 + (globals[2] * 355 >> 16);
+    } else {
+      uint16_t shape = parameters[0];
+      if (shape < 32768) {
+        // attack: 10ms
+        attack_time = 128;
+        // decay: 50ms to 2000ms
+        decay_time = 227 + (shape * 196 >> 15);
+      } else if (shape < 49512) {
+        shape -= 32768;
+        // attack: 10ms to 500ms.
+        attack_time = 128 + (shape * 227 >> 15);
+        // decay: 2000ms to 1000ms.
+        decay_time = 423 - (89 * shape >> 15);
+      } else {
+        shape -= 49512;
+        // attack: 500ms to 50ms.
+        attack_time = 355 - (shape >> 7);
+        // decay: 1000ms to 100ms.
+        decay_time = 384 - (128 * shape >> 15);
+      }
+    }
+
+    // Same computations as in Vactrol, including the wrap-around of the fast
+    // attack coefficient in plucked mode.
+    int32_t attack = lut_lp_coefficients[attack_time];
+    int32_t fast_attack = lut_lp_coefficients[attack_time - 128];
+    int32_t decay = lut_lp_coefficients[decay_time];
+    int32_t fast_decay = lut_lp_coefficients[decay_time - 128];
+    plucked_ = alternate;
+    if (alternate) {
+      fast_attack = static_cast<int32_t>(
+          static_cast<uint32_t>(fast_attack) << 4);
+    } else {
+      decay >>= 1;
+    }
+    attack_coefficient_ = OnePoleCoefficient(attack, rate_ratio_);
+    fast_attack_coefficient_ = OnePoleCoefficient(fast_attack, rate_ratio_);
+    decay_coefficient_ = OnePoleCoefficient(decay, rate_ratio_);
+    fast_decay_coefficient_ = OnePoleCoefficient(fast_decay, rate_ratio_);
+    excite_decay_coefficient_ = OnePoleCoefficient(
+        static_cast<int64_t>(decay) << 1, rate_ratio_);
+
+    int32_t ringing_tail = 8192;
+    int32_t headroom = 65535 - offset;
+    if (ringing_tail > headroom) {
+      ringing_tail = headroom;
+    }
+    if (ringing_tail > amount) {
+      ringing_tail = amount;
+    }
+    target_frequency_offset_ = static_cast<float>(offset + ringing_tail) / \
+        65536.0f;
+    target_frequency_amount_ = static_cast<float>(amount - ringing_tail) / \
+        65536.0f;
+  }
+
+  void Process(
+      const float* audio,
+      const float* excite,
+      float* gain,
+      float* frequency,
+      size_t size) {
+    if (plucked_) {
+      ProcessPlucked(excite, gain, frequency, size);
+    } else {
+      ProcessFollowing(excite, gain, frequency, size);
+    }
+  }
+
+ private:
+  static inline float Gompertz(float x) {
+    return Interpolate(wav_gompertz, x * 1024.0f) / 32768.0f;
+  }
+
+  inline void SmoothFrequencyParameters(float* amount, float* offset) const {
+    *amount += smoothing_coefficient_ * (target_frequency_amount_ - *amount);
+    *offset += smoothing_coefficient_ * (target_frequency_offset_ - *offset);
+  }
+
+  // The states have the scale of the fixed-point version divided by 2^31.
+  // They are kept in local variables during the loops: the compiler cannot
+  // prove that the output buffers do not overlap the members, and would
+  // otherwise reload and store all of them at each sample.
+  void ProcessPlucked(
+      const float* excite,
+      float* gain,
+      float* frequency,
+      size_t size) {
+    const float threshold = static_cast<float>(kSchmittTriggerThreshold) / \
+        32768.0f;
+    const float gain_scale = static_cast<float>(kAboveUnityGain) / 65536.0f;
+    float state[4] = { state_[0], state_[1], state_[2], state_[3] };
+    float frequency_amount = frequency_amount_;
+    float frequency_offset = frequency_offset_;
+    bool gate = gate_;
+    for (size_t i = 0; i < size; ++i) {
+      SmoothFrequencyParameters(&frequency_amount, &frequency_offset);
+      float e = excite[i];
+      if (!gate) {
+        if (e > threshold) {
+          gate = true;
+          state[0] = state[1] = 32767.0f / 32768.0f;
+        }
+      } else {
+        if (e < 0.5f * threshold) {
+          gate = false;
+        }
+      }
+
+      // Filter the excitation pulses.
+      state[0] -= state[0] * fast_decay_coefficient_;
+      state[1] -= state[1] * decay_coefficient_;
+
+      // VCF envelope.
+      float error = state[0] - state[2];
+      state[2] += error * (error > 0.0f
+          ? fast_attack_coefficient_
+          : fast_decay_coefficient_);
+
+      // VCA envelope. Increase the duration of the tail.
+      error = state[1] - state[3];
+      float coefficient = error > 0.0f
+          ? fast_attack_coefficient_
+          : decay_coefficient_;
+      float strength = error > 0.0f ? error : -error;
+      state[3] += error * coefficient * (0.5f + strength);
+
+      gain[i] = gain_scale * Gompertz(state[3] * 0.375f);
+      frequency[i] = frequency_offset + frequency_amount * state[2];
+    }
+    std::copy(&state[0], &state[4], &state_[0]);
+    frequency_amount_ = frequency_amount;
+    frequency_offset_ = frequency_offset;
+    gate_ = gate;
+  }
+
+  void ProcessFollowing(
+      const float* excite,
+      float* gain,
+      float* frequency,
+      size_t size) {
+    const float gain_scale = static_cast<float>(kAboveUnityGain) / 65536.0f;
+    float state[4] = { state_[0], state_[1], state_[2], state_[3] };
+    float excite_state = excite_;
+    float frequency_amount = frequency_amount_;
+    float frequency_offset = frequency_offset_;
+    int32_t onset = onset_;
+    for (size_t i = 0; i < size; ++i) {
+      SmoothFrequencyParameters(&frequency_amount, &frequency_offset);
+
+      // Low-pass filter the negative edges to prevent fast pulse to
+      // immediately decay before the vactrol has started reacting. The
+      // firmware rounds the decay towards -inf: it is faster by half a LSB per
+      // sample on average, and of at least 1 LSB per sample.
+      float error = std::max(excite[i], 0.0f) - excite_state;
+      excite_state += error > 0.0f
+          ? error * excite_attack_coefficient_
+          : std::max(error, std::min(
+                error * excite_decay_coefficient_ - 0.5f * excite_decay_step_,
+                -excite_decay_step_));
+
+      float input = 0.5f * (65535.0f / 65536.0f + frequency_offset + \
+          0.5f * frequency_amount) * excite_state;
+      state[3] += (input - state[3]) * overshoot_coefficient_;
+
+      error = input - state[0];
+      float coefficient;
+      if (state[1] <= 0.0f) {
+        onset = onset_duration_;
+      }
+      if (error > 0.0f) {
+        if (onset) {
+          // In the firmware, the fast attack only lasts for the first sample
+          // of the onset. Make it last as long at other sample rates.
+          coefficient = fast_attack_coefficient_;
+          --onset;
+        } else {
+          // Increase attack time when the photocell has been desensitized.
+          coefficient = attack_coefficient_ * \
+              (1.0f + (255.0f - state[2] * 256.0f) / 64.0f);
+        }
+      } else {
+        coefficient = state[1] < 0.0f
+            ? decay_coefficient_
+            : fast_decay_coefficient_;
+      }
+      // First order.
+      state[0] += error * coefficient;
+      // Second order.
+      state[1] += (error - state[1]) * coefficient;
+
+      // Memory effect. As in the firmware, where 1 << 31 wraps around, the
+      // memory is pulled down when the level goes above 1/8.
+      float sensitivity = state[0] > 0.125f ? -1.0f : state[0] * 8.0f;
+      error = sensitivity - state[2];
+      state[2] += error * (error > 0.0f
+          ? sensitize_coefficient_
+          : desensitize_coefficient_);
+
+      // Apply non-linearity, with a little hack to add overshoot...
+      float index = 0.5f * state[0] + state[3] * state[1];
+      index = std::max(std::min(index, 0.5f), 0.0f);
+      float amplitude = index < 0.25f ? Gompertz(index * 4.0f) : 1.0f;
+      float cutoff = std::min(index * 4.0f, 1.0f);
+      cutoff *= cutoff;
+      gain[i] = gain_scale * amplitude;
+      frequency[i] = frequency_offset + frequency_amount * cutoff;
+    }
+    std::copy(&state[0], &state[4], &state_[0]);
+    excite_ = excite_state;
+    frequency_amount_ = frequency_amount;
+    frequency_offset_ = frequency_offset;
+    onset_ = onset;
+  }
+
+  float rate_ratio_;
+
+  float target_frequency_amount_;
+  float target_frequency_offset_;
+  float frequency_amount_;
+  float frequency_offset_;
+  float smoothing_coefficient_;
+
+  float attack_coefficient_;
+  float decay_coefficient_;
+  float fast_attack_coefficient_;
+  float fast_decay_coefficient_;
+  float excite_attack_coefficient_;
+  float excite_decay_coefficient_;
+  float excite_decay_step_;
+  float overshoot_coefficient_;
+  float sensitize_coefficient_;
+  float desensitize_coefficient_;
+
+  float state_[4];
+  float excite_;
+
+  int32_t onset_;
+  int32_t onset_duration_;
+
+  bool gate_;
+  bool plucked_;
+
+  DISALLOW_COPY_AND_ASSIGN(BlockVactrol);
+};
+
+}  // namespace streams
+
+#endif  // STREAMS_DSP_BLOCK_VACTROL_H_
@@ -0,0 +1,104 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Utility routines for the block-based, floating point versions of the
+// dynamics processors.
+//
+// These processors run on the host, at any sample rate. Their inputs and
+// outputs have the same scale as the ones of the fixed-point processors:
+// 1.0f for the audio and excite inputs is 32768, 1.0f for the gain and
+// frequency outputs is 65536. The knobs are read from the same uint16 values.
+//
+// The one-pole coefficients are computed from the ones of the firmware, which
+// have been designed for a sample rate of kReferenceSampleRate, and rescaled to
+// give the same time constants at the actual sample rate.
+
+#ifndef STREAMS_DSP_DSP_H_
+#define STREAMS_DSP_DSP_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace streams {
+
+const float kReferenceSampleRate = 31089.0f;
+
+// The processors render their output in chunks of this size, into buffers
+// allocated on the stack.
+const size_t kMaxBlockSize = 32;
+
+// Converts a one-pole coefficient in the 1.31 format of the firmware - the
+// fraction of the error added to the state at each sample - to the coefficient
+// giving the same time constant at another sample rate. rate_ratio is
+// kReferenceSampleRate / sample_rate.
+inline float OnePoleCoefficient(int64_t coefficient, float rate_ratio) {
+  float c = static_cast<float>(coefficient) / 2147483648.0f;
+  c = std::max(std::min(c, 1.0f), 0.0f);
+  return 1.0f - powf(1.0f - c, rate_ratio);
+}
+
+// Coefficient of the x += (target - x) >> shift smoothers of the firmware.
+inline float ShiftCoefficient(int32_t shift, float rate_ratio) {
+  int64_t coefficient = static_cast<int64_t>(1) << (31 - shift);
+  return OnePoleCoefficient(coefficient, rate_ratio);
+}
+
+// Linear interpolation in a lookup table, index being in [0, size - 1].
+template<typename T>
+inline float Interpolate(const T* table, float index) {
+  int32_t integral = static_cast<int32_t>(index);
+  float fractional = index - static_cast<float>(integral);
+  float a = static_cast<float>(table[integral]);
+  float b = static_cast<float>(table[integral + 1]);
+  return a + (b - a) * fractional;
+}
+
+// log2(x), for x > 0, from the exponent and a series expansion of the log of
+// the mantissa, with an error below 2e-5 - the log table of the firmware has
+// an error of 3e-3. There are no branches or library calls, so that the loops
+// calling it are vectorized.
+inline float FastLog2(float x) {
+  int32_t bits;
+  memcpy(&bits, &x, sizeof(float));
+  float exponent = static_cast<float>((bits >> 23) - 127);
+  bits = (bits & 0x007fffff) | 0x3f800000;
+  float m;
+  memcpy(&m, &bits, sizeof(float));
+  float t = (m - 1.0f) / (m + 1.0f);
+  float t2 = t * t;
+  float p = 0.4121986f;
+  p = p * t2 + 0.5770780f;
+  p = p * t2 + 0.9617967f;
+  p = p * t2 + 2.8853901f;
+  return exponent + p * t;
+}
+
+}  // namespace streams
+
+#endif  // STREAMS_DSP_DSP_H_
@@ -0,0 +1,97 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// SVF used for the envelope follower filter bank, floating point version.
+
+#ifndef STREAMS_DSP_FLOAT_SVF_H_
+#define STREAMS_DSP_FLOAT_SVF_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace streams {
+
+class FloatSvf {
+ public:
+  FloatSvf() { }
+  ~FloatSvf() { }
+
+  void Init(float sample_rate) {
+    sample_rate_ = sample_rate;
+    lp_ = 0.0f;
+    bp_ = 0.0f;
+    hp_ = 0.0f;
+    set_frequency_and_resonance(33 << 7, 16384);
+  }
+
+  // Same parameters as Svf: the frequency is a MIDI note in 9.7 format. The
+  // coefficients are those of the lookup tables, computed for the actual
+  // sample rate.
+  void set_frequency_and_resonance(int16_t frequency, int16_t resonance) {
+    float cutoff = 440.0f * powf(
+        2.0f, (static_cast<float>(frequency) / 128.0f - 69.0f) / 12.0f);
+    float f = std::min(cutoff / sample_rate_, 0.125f);
+    f_ = 2.0f * sinf(3.14159265f * f);
+    float r = static_cast<float>(resonance >> 7) / 257.0f;
+    damp_ = std::min(
+        2.0f * (1.0f - sqrtf(sqrtf(r))),
+        std::min(2.0f, 2.0f / f_ - f_ * 0.5f));
+  }
+
+  inline void Process(float in) {
+    float notch = in - bp_ * damp_;
+    lp_ = Clip(lp_ + f_ * bp_);
+    hp_ = notch - lp_;
+    bp_ = Clip(bp_ + f_ * hp_);
+    hp_ = Clip(hp_);
+  }
+
+  inline float lp() const { return lp_; }
+  inline float bp() const { return bp_; }
+  inline float hp() const { return hp_; }
+
+ private:
+  static inline float Clip(float x) {
+    return std::max(std::min(x, 32767.0f / 32768.0f), -32767.0f / 32768.0f);
+  }
+
+  float sample_rate_;
+
+  float f_;
+  float damp_;
+
+  float lp_;
+  float bp_;
+  float hp_;
+
+  DISALLOW_COPY_AND_ASSIGN(FloatSvf);
+};
+
+}  // namespace streams
+
+#endif  // STREAMS_DSP_FLOAT_SVF_H_
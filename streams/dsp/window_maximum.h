@@ -0,0 +1,117 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Maximum of a signal over a sliding window, in constant time per sample
+// whatever the length of the window (van Herk / Gil-Werman algorithm).
+//
+// The signal is split in segments as long as the window. Any window overlaps
+// two consecutive segments, and its maximum is the maximum of a suffix of the
+// first one - computed when this segment is complete - and of a prefix of the
+// second one - the running maximum of the current segment.
+
+#ifndef STREAMS_DSP_WINDOW_MAXIMUM_H_
+#define STREAMS_DSP_WINDOW_MAXIMUM_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+
+namespace streams {
+
+const size_t kWindowMaximumMaxSize = 2048;
+
+class WindowMaximum {
+ public:
+  WindowMaximum() { }
+  ~WindowMaximum() { }
+
+  // The input signal is assumed to be positive.
+  void Init(size_t size) {
+    size_ = std::max(std::min(size, kWindowMaximumMaxSize), size_t(1));
+    std::fill(&history_[0], &history_[kBufferSize], 0.0f);
+    std::fill(&suffix_maximum_[0], &suffix_maximum_[kBufferSize], 0.0f);
+    prefix_maximum_ = 0.0f;
+    position_ = 0;
+    segment_position_ = 0;
+  }
+
+  // Writes in out[i] the maximum of in[i] and of the size - 1 samples before.
+  void Process(const float* in, float* out, size_t size) {
+    size_t position = position_;
+    size_t segment_position = segment_position_;
+    float prefix_maximum = prefix_maximum_;
+    for (size_t i = 0; i < size; ++i) {
+      if (segment_position == size_) {
+        ComputeSuffixMaximum(position);
+        segment_position = 0;
+        prefix_maximum = 0.0f;
+      }
+      history_[position & kBufferMask] = in[i];
+      prefix_maximum = std::max(prefix_maximum, in[i]);
+      // When the window is aligned with the current segment, the suffix is
+      // the whole previous segment - and not part of the window.
+      float suffix_maximum = segment_position == size_ - 1
+          ? 0.0f
+          : suffix_maximum_[(position - size_ + 1) & kBufferMask];
+      out[i] = std::max(prefix_maximum, suffix_maximum);
+      ++position;
+      ++segment_position;
+    }
+    position_ = position;
+    segment_position_ = segment_position;
+    prefix_maximum_ = prefix_maximum;
+  }
+
+  inline size_t size() const { return size_; }
+
+ private:
+  static const size_t kBufferSize = kWindowMaximumMaxSize * 2;
+  static const size_t kBufferMask = kBufferSize - 1;
+
+  // Computes the suffix maxima of the segment ending before end.
+  void ComputeSuffixMaximum(size_t end) {
+    float maximum = 0.0f;
+    for (size_t i = 1; i <= size_; ++i) {
+      size_t index = (end - i) & kBufferMask;
+      maximum = std::max(maximum, history_[index]);
+      suffix_maximum_[index] = maximum;
+    }
+  }
+
+  size_t size_;
+  size_t position_;
+  size_t segment_position_;
+  float prefix_maximum_;
+
+  float history_[kBufferSize];
+  float suffix_maximum_[kBufferSize];
+
+  DISALLOW_COPY_AND_ASSIGN(WindowMaximum);
+};
+
+}  // namespace streams
+
+#endif  // STREAMS_DSP_WINDOW_MAXIMUM_H_
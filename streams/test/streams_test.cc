@@ -0,0 +1,693 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+#include <algorithm>
+
+#include "streams/dsp/block_compressor.h"
+#include "streams/dsp/block_processor.h"
+#include "streams/dsp/window_maximum.h"
+#include "streams/compressor.h"
+#include "streams/processor.h"
+
+using namespace streams;
+using namespace std;
+
+const size_t kBlockSize = 32;
+
+// 2s at the sample rate of the firmware.
+const size_t kNumSamples = 62178;
+
+enum ExciteType {
+  EXCITE_GATE,
+  EXCITE_NOISE_BURST,
+  EXCITE_UNPATCHED,
+  EXCITE_LAST
+};
+
+// Audio: a 220Hz sine, with an amplitude swelling from -34dB to full scale.
+// Excite: gates of various lengths and levels, decaying noise bursts, or
+// nothing.
+void RenderTestSignals(
+    ExciteType type,
+    float sample_rate,
+    int16_t* audio,
+    int16_t* excite,
+    size_t size) {
+  const float kPi = 3.14159265358979f;
+  srand(0);
+  float burst = 0.0f;
+  float burst_decay = expf(-1.0f / (0.05f * sample_rate));
+  for (size_t i = 0; i < size; ++i) {
+    float t = static_cast<float>(i) / sample_rate;
+    float swell = 0.5f + 0.5f * sinf(2.0f * kPi * 0.7f * t);
+    float amplitude = 0.02f + 0.97f * swell * swell;
+    audio[i] = 32767.0f * amplitude * sinf(2.0f * kPi * 220.0f * t);
+
+    size_t period = static_cast<size_t>(0.23f * sample_rate);
+    size_t pulse = i / period;
+    size_t pulse_position = i % period;
+    switch (type) {
+      case EXCITE_GATE:
+        {
+          size_t width = period * (1 + pulse % 5) / 8;
+          excite[i] = pulse_position < width ? 12000 + (pulse % 4) * 6000 : 0;
+        }
+        break;
+
+      case EXCITE_NOISE_BURST:
+        if (pulse_position == 0) {
+          burst = 0.3f + 0.7f * static_cast<float>(pulse % 3) / 2.0f;
+        }
+        burst *= burst_decay;
+        excite[i] = 32767.0f * burst * \
+            (static_cast<float>(rand()) / RAND_MAX * 2.0f - 1.0f);
+        break;
+
+      default:
+        excite[i] = 0;
+        break;
+    }
+  }
+}
+
+struct ErrorStatistics {
+  float max;
+  double sum_of_squares;
+  size_t count;
+
+  void Init() {
+    max = 0.0f;
+    sum_of_squares = 0.0;
+    count = 0;
+  }
+
+  void Add(float error) {
+    error = fabsf(error);
+    max = std::max(max, error);
+    sum_of_squares += error * error;
+    ++count;
+  }
+
+  float rms() const {
+    return count ? sqrt(sum_of_squares / count) : 0.0f;
+  }
+};
+
+struct SignalStatistics {
+  double sum;
+  double sum_of_squares;
+  size_t count;
+
+  void Init() {
+    sum = sum_of_squares = 0.0;
+    count = 0;
+  }
+
+  void Add(float x) {
+    sum += x;
+    sum_of_squares += x * x;
+    ++count;
+  }
+
+  float mean() const { return sum / count; }
+  float std() const {
+    return sqrt(std::max(sum_of_squares / count - mean() * mean(), 0.0));
+  }
+};
+
+// Errors, in units of the full 16-bit output range, of the block-based
+// processors against the fixed-point ones, across all the test cases.
+//
+// - The x += (t - x) >> n smoothers of the firmware have dead zones and round
+//   towards -inf, which the float versions do not reproduce: the envelope's
+//   gate level settles 1% low, and the frequency offsets 255 LSB low.
+// - The memory effect of the fixed-point vactrol relies on a signed overflow,
+//   whose result depends on the compiler, and drifts away from the float
+//   version.
+// - The follower switches its centroid on a threshold of its gain, which can
+//   be crossed one sample apart, and the fixed-point centroid is truncated to
+//   0 on low levels.
+// - The Lorenz attractor is chaotic, and the float and fixed-point trajectories
+//   diverge within a few hundred samples: the means and standard deviations of
+//   the outputs are compared instead, with the gain_max tolerance.
+struct Tolerance {
+  const char* name;
+  float gain_max;
+  float gain_rms;
+  float frequency_max;
+  float frequency_rms;
+};
+
+const Tolerance kTolerance[PROCESSOR_FUNCTION_LAST] = {
+  { "envelope", 0.15f, 0.013f, 0.22f, 0.018f },
+  { "vactrol", 0.005f, 0.0005f, 0.044f, 0.006f },
+  { "follower", 0.08f, 0.004f, 0.06f, 0.004f },
+  { "compressor", 0.0001f, 0.0001f, 0.0001f, 0.0001f },
+  { "filter", 0.0001f, 0.0001f, 0.012f, 0.004f },
+  { "lorenz", 0.03f, 0.0f, 0.0f, 0.0f },
+};
+
+const uint16_t kKnobSettings[][2] = {
+  { 0, 65535 },
+  { 16384, 49152 },
+  { 32768, 32768 },
+  { 58000, 12000 },
+};
+
+const size_t kNumKnobSettings =
+    sizeof(kKnobSettings) / sizeof(kKnobSettings[0]);
+
+// The fixed-point processors do not reset all their state in Init(): each test
+// case gets its own, zero-initialized, instance.
+Processor processor[2 * kNumKnobSettings * EXCITE_LAST];
+BlockProcessor block_processor;
+
+void TestBlockProcessor() {
+  int16_t* audio = new int16_t[kNumSamples];
+  int16_t* excite = new int16_t[kNumSamples];
+  float* audio_float = new float[kNumSamples];
+  float* excite_float = new float[kNumSamples];
+  float* gain = new float[kNumSamples];
+  float* frequency = new float[kNumSamples];
+
+  for (int f = 0; f < PROCESSOR_FUNCTION_LAST; ++f) {
+    ProcessorFunction function = static_cast<ProcessorFunction>(f);
+    const Tolerance& tolerance = kTolerance[f];
+    ErrorStatistics gain_error;
+    ErrorStatistics frequency_error;
+    gain_error.Init();
+    frequency_error.Init();
+    float lorenz_difference = 0.0f;
+
+    size_t test_case = 0;
+    for (int e = 0; e < EXCITE_LAST; ++e) {
+      RenderTestSignals(
+          static_cast<ExciteType>(e),
+          kReferenceSampleRate,
+          audio,
+          excite,
+          kNumSamples);
+      for (size_t i = 0; i < kNumSamples; ++i) {
+        audio_float[i] = static_cast<float>(audio[i]) / 32768.0f;
+        excite_float[i] = static_cast<float>(excite[i]) / 32768.0f;
+      }
+
+      for (int alternate = 0; alternate < 2; ++alternate) {
+        for (size_t k = 0; k < kNumKnobSettings; ++k) {
+          Processor* p = &processor[test_case++];
+          p->Init(0);
+          p->set_function(function);
+          p->set_alternate(alternate);
+          p->set_parameter(0, kKnobSettings[k][0]);
+          p->set_parameter(1, kKnobSettings[k][1]);
+          p->Configure();
+
+          block_processor.Init(0, kReferenceSampleRate);
+          block_processor.set_function(function);
+          block_processor.set_alternate(alternate);
+          block_processor.set_parameter(0, kKnobSettings[k][0]);
+          block_processor.set_parameter(1, kKnobSettings[k][1]);
+          block_processor.Configure();
+          for (size_t i = 0; i < kNumSamples; i += kBlockSize) {
+            block_processor.Process(
+                &audio_float[i],
+                &excite_float[i],
+                &gain[i],
+                &frequency[i],
+                std::min(kBlockSize, kNumSamples - i));
+          }
+
+          SignalStatistics statistics[4];
+          for (size_t i = 0; i < 4; ++i) {
+            statistics[i].Init();
+          }
+          for (size_t i = 0; i < kNumSamples; ++i) {
+            uint16_t fixed_gain = 0;
+            uint16_t fixed_frequency = 65535;
+            p->Process(audio[i], excite[i], &fixed_gain, &fixed_frequency);
+            float g = static_cast<float>(fixed_gain) / 65536.0f;
+            float f = static_cast<float>(fixed_frequency) / 65536.0f;
+            if (function == PROCESSOR_FUNCTION_LORENZ_GENERATOR) {
+              statistics[0].Add(g);
+              statistics[1].Add(gain[i]);
+              statistics[2].Add(f);
+              statistics[3].Add(frequency[i]);
+            } else {
+              gain_error.Add(g - gain[i]);
+              frequency_error.Add(f - frequency[i]);
+            }
+          }
+
+          if (function == PROCESSOR_FUNCTION_LORENZ_GENERATOR) {
+            float difference = 0.0f;
+            for (size_t i = 0; i < 4; i += 2) {
+              difference = std::max(difference, fabsf(
+                  statistics[i].mean() - statistics[i + 1].mean()));
+              difference = std::max(difference, fabsf(
+                  statistics[i].std() - statistics[i + 1].std()));
+            }
+            lorenz_difference = std::max(lorenz_difference, difference);
+          }
+        }
+      }
+    }
+
+    if (function == PROCESSOR_FUNCTION_LORENZ_GENERATOR) {
+      printf("%-10s statistics within %.4f\n",
+             tolerance.name,
+             lorenz_difference);
+      assert(lorenz_difference <= tolerance.gain_max);
+    } else {
+      printf("%-10s gain max %.4f (rms %.4f), frequency max %.4f (rms %.4f)\n",
+             tolerance.name,
+             gain_error.max,
+             gain_error.rms(),
+             frequency_error.max,
+             frequency_error.rms());
+      assert(gain_error.max <= tolerance.gain_max);
+      assert(gain_error.rms() <= tolerance.gain_rms);
+      assert(frequency_error.max <= tolerance.frequency_max);
+      assert(frequency_error.rms() <= tolerance.frequency_rms);
+    }
+  }
+
+  delete[] frequency;
+  delete[] gain;
+  delete[] excite_float;
+  delete[] audio_float;
+  delete[] excite;
+  delete[] audio;
+}
+
+void BenchmarkBlockProcessor() {
+  const float kSampleRate = 48000.0f;
+  const size_t kBenchmarkSamples = 480000;
+  const int kNumPasses = 4;
+
+  int16_t* audio = new int16_t[kBenchmarkSamples];
+  int16_t* excite = new int16_t[kBenchmarkSamples];
+  float* audio_float = new float[kBenchmarkSamples];
+  float* excite_float = new float[kBenchmarkSamples];
+  float gain[kBlockSize];
+  float frequency[kBlockSize];
+
+  RenderTestSignals(
+      EXCITE_NOISE_BURST,
+      kSampleRate,
+      audio,
+      excite,
+      kBenchmarkSamples);
+  for (size_t i = 0; i < kBenchmarkSamples; ++i) {
+    audio_float[i] = static_cast<float>(audio[i]) / 32768.0f;
+    excite_float[i] = static_cast<float>(excite[i]) / 32768.0f;
+  }
+
+  const float num_samples = static_cast<float>(kBenchmarkSamples * kNumPasses);
+  for (int f = 0; f < PROCESSOR_FUNCTION_LAST; ++f) {
+    ProcessorFunction function = static_cast<ProcessorFunction>(f);
+    Processor* p = &processor[0];
+    p->Init(0);
+    p->set_function(function);
+    p->Configure();
+    uint32_t sum = 0;
+    clock_t start = clock();
+    for (int pass = 0; pass < kNumPasses; ++pass) {
+      for (size_t i = 0; i < kBenchmarkSamples; ++i) {
+        uint16_t fixed_gain = 0;
+        uint16_t fixed_frequency = 65535;
+        p->Process(audio[i], excite[i], &fixed_gain, &fixed_frequency);
+        sum += fixed_gain + fixed_frequency;
+      }
+    }
+    float fixed_time = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+
+    block_processor.Init(0, kSampleRate);
+    block_processor.set_function(function);
+    block_processor.Configure();
+    float block_sum = 0.0f;
+    start = clock();
+    for (int pass = 0; pass < kNumPasses; ++pass) {
+      for (size_t i = 0; i < kBenchmarkSamples; i += kBlockSize) {
+        block_processor.Process(
+            &audio_float[i],
+            &excite_float[i],
+            gain,
+            frequency,
+            kBlockSize);
+        block_sum += gain[0] + frequency[0];
+      }
+    }
+    float block_time = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+
+    float fixed_ns = fixed_time / num_samples * 1e9f;
+    float block_ns = block_time / num_samples * 1e9f;
+    printf("%-10s float %.1f ns/sample, fixed %.1f ns/sample, "
+           "%.0f float processors per core at 48kHz (%u %.0f)\n",
+           kTolerance[f].name,
+           block_ns,
+           fixed_ns,
+           1e9f / (block_ns * kSampleRate),
+           sum & 0xff,
+           block_sum);
+  }
+
+  delete[] excite_float;
+  delete[] audio_float;
+  delete[] excite;
+  delete[] audio;
+}
+
+WindowMaximum window_maximum;
+
+void TestWindowMaximum() {
+  const size_t kNumTestSamples = 3 * kWindowMaximumMaxSize + 1000;
+  float* in = new float[kNumTestSamples];
+  float* out = new float[kNumTestSamples];
+
+  srand(0);
+  for (size_t i = 0; i < kNumTestSamples; ++i) {
+    // Random values, with decreasing ramps - where the maximum is at the start
+    // of the window.
+    in[i] = (i / 700) % 2
+        ? static_cast<float>(rand()) / RAND_MAX
+        : static_cast<float>(700 - i % 700);
+  }
+
+  size_t sizes[64];
+  size_t num_sizes = 0;
+  for (size_t size = 1; size <= 17; ++size) {
+    sizes[num_sizes++] = size;
+  }
+  for (size_t size = 32; size <= kWindowMaximumMaxSize; size *= 2) {
+    sizes[num_sizes++] = size - 1;
+    sizes[num_sizes++] = size;
+    if (size < kWindowMaximumMaxSize) {
+      sizes[num_sizes++] = size + 1;
+    }
+  }
+  sizes[num_sizes++] = 1000;
+
+  for (size_t s = 0; s < num_sizes; ++s) {
+    size_t size = sizes[s];
+    window_maximum.Init(size);
+    assert(window_maximum.size() == size);
+    size_t i = 0;
+    while (i < kNumTestSamples) {
+      size_t block_size = std::min(
+          static_cast<size_t>(1 + rand() % 300),
+          kNumTestSamples - i);
+      window_maximum.Process(&in[i], &out[i], block_size);
+      i += block_size;
+    }
+    for (size_t i = 0; i < kNumTestSamples; ++i) {
+      size_t start = i + 1 >= size ? i + 1 - size : 0;
+      float maximum = *std::max_element(&in[start], &in[i + 1]);
+      assert(out[i] == maximum);
+    }
+  }
+  window_maximum.Init(kWindowMaximumMaxSize + 100);
+  assert(window_maximum.size() == kWindowMaximumMaxSize);
+  window_maximum.Init(0);
+  assert(window_maximum.size() == 1);
+  printf("window maximum: %d window sizes match\n",
+         static_cast<int>(num_sizes));
+
+  delete[] out;
+  delete[] in;
+}
+
+// Attack, threshold, decay and amount, as set by a linked module.
+const int32_t kCompressorGlobals[][4] = {
+  { 0, 32768, 0, 65535 },
+  { 32768, 16384, 32768, 20000 },
+  { 65535, 49152, 65535, 50000 },
+};
+
+const size_t kNumCompressorGlobals =
+    sizeof(kCompressorGlobals) / sizeof(kCompressorGlobals[0]);
+
+// Compressor::Init() does not reset the sidechain detector.
+Compressor compressor[kNumCompressorGlobals * EXCITE_LAST];
+BlockCompressor block_compressor;
+BlockCompressor delayed_block_compressor;
+
+void TestBlockCompressor() {
+  int16_t* audio = new int16_t[kNumSamples];
+  int16_t* excite = new int16_t[kNumSamples];
+  float* audio_float = new float[kNumSamples];
+  float* excite_float = new float[kNumSamples];
+  float* delayed_audio = new float[kNumSamples];
+  float* gain = new float[kNumSamples];
+  float* frequency = new float[kNumSamples];
+  float* out = new float[kNumSamples];
+  float* reference = new float[kNumSamples];
+
+  // Process() against the fixed-point Compressor, configured by a linked
+  // module - the unlinked settings are covered by TestBlockProcessor().
+  ErrorStatistics gain_error;
+  gain_error.Init();
+  size_t test_case = 0;
+  for (int e = 0; e < EXCITE_LAST; ++e) {
+    RenderTestSignals(
+        static_cast<ExciteType>(e),
+        kReferenceSampleRate,
+        audio,
+        excite,
+        kNumSamples);
+    for (size_t i = 0; i < kNumSamples; ++i) {
+      audio_float[i] = static_cast<float>(audio[i]) / 32768.0f;
+      excite_float[i] = static_cast<float>(excite[i]) / 32768.0f;
+    }
+    for (size_t k = 0; k < kNumCompressorGlobals; ++k) {
+      int32_t globals[4];
+      std::copy(&kCompressorGlobals[k][0], &kCompressorGlobals[k][4], globals);
+      Compressor* c = &compressor[test_case++];
+      c->Init();
+      c->Configure(false, NULL, globals);
+      block_compressor.Init(kReferenceSampleRate);
+      block_compressor.Configure(false, NULL, globals);
+      for (size_t i = 0; i < kNumSamples; i += kBlockSize) {
+        block_compressor.Process(
+            &audio_float[i],
+            &excite_float[i],
+            &gain[i],
+            &frequency[i],
+            std::min(kBlockSize, kNumSamples - i));
+      }
+      for (size_t i = 0; i < kNumSamples; ++i) {
+        uint16_t fixed_gain = 0;
+        uint16_t fixed_frequency = 65535;
+        c->Process(audio[i], excite[i], &fixed_gain, &fixed_frequency);
+        gain_error.Add(static_cast<float>(fixed_gain) / 65536.0f - gain[i]);
+      }
+    }
+  }
+  printf("compressor globals: gain max %.5f (rms %.5f)\n",
+         gain_error.max,
+         gain_error.rms());
+  assert(gain_error.max <= 0.0001f);
+
+  // Compress() without look-ahead applies the gain computed by Process() -
+  // converted from a VCA code to an amplitude - to the audio signal. The
+  // tables are interpolated linearly over steps of 1/16 on the log2 scale, and
+  // exp2 of the interpolated VCA code differs from the interpolated amplitude
+  // by about (ln(2) / 16)^2 / 8 = 2.35e-4, relatively - a bit more where the
+  // soft knee is steeper.
+  RenderTestSignals(
+      EXCITE_UNPATCHED,
+      kReferenceSampleRate,
+      audio,
+      excite,
+      kNumSamples);
+  for (size_t i = 0; i < kNumSamples; ++i) {
+    audio_float[i] = static_cast<float>(audio[i]) / 32768.0f;
+    excite_float[i] = 0.0f;
+  }
+  ErrorStatistics compress_error;
+  compress_error.Init();
+  for (int alternate = 0; alternate < 2; ++alternate) {
+    for (size_t k = 0; k < kNumKnobSettings; ++k) {
+      int32_t parameters[2] = { kKnobSettings[k][0], kKnobSettings[k][1] };
+      block_compressor.Init(kReferenceSampleRate);
+      block_compressor.Configure(alternate, parameters, NULL);
+      block_compressor.Process(
+          audio_float, excite_float, gain, frequency, kNumSamples);
+      block_compressor.Init(kReferenceSampleRate);
+      block_compressor.Configure(alternate, parameters, NULL);
+      assert(block_compressor.look_ahead() == 0);
+      block_compressor.Compress(audio_float, NULL, out, kNumSamples);
+      for (size_t i = 0; i < kNumSamples; ++i) {
+        float g = (gain[i] * 65536.0f - kUnityGain) / \
+            kBlockCompressorGainConstant;
+        float expected = audio_float[i] * exp2f(g);
+        compress_error.Add((out[i] - expected) / std::max(
+            fabsf(expected), 1e-3f));
+      }
+    }
+  }
+  printf("compress: relative error max %.6f (rms %.6f)\n",
+         compress_error.max,
+         compress_error.rms());
+  assert(compress_error.max <= 3e-4f);
+
+  // With a look-ahead, the gain is still computed on the current sidechain
+  // samples, and applied to the delayed audio. Peak detection never gives
+  // more gain than RMS detection.
+  const size_t kLookAheads[] = { 1, 31, 256, kBlockCompressorMaxLookAhead };
+  int32_t parameters[2] = { 40000, 65535 };
+  for (size_t l = 0; l < sizeof(kLookAheads) / sizeof(size_t); ++l) {
+    size_t look_ahead = kLookAheads[l];
+    for (size_t i = 0; i < kNumSamples; ++i) {
+      delayed_audio[i] = i >= look_ahead ? audio_float[i - look_ahead] : 0.0f;
+    }
+
+    block_compressor.Init(kReferenceSampleRate);
+    block_compressor.Configure(false, parameters, NULL);
+    block_compressor.set_look_ahead(
+        static_cast<float>(look_ahead) / kReferenceSampleRate);
+    assert(block_compressor.look_ahead() == look_ahead);
+    delayed_block_compressor.Init(kReferenceSampleRate);
+    delayed_block_compressor.Configure(false, parameters, NULL);
+    for (size_t i = 0; i < kNumSamples; i += kBlockSize) {
+      size_t size = std::min(kBlockSize, kNumSamples - i);
+      block_compressor.Compress(
+          &audio_float[i], &audio_float[i], &out[i], size);
+      delayed_block_compressor.Compress(
+          &delayed_audio[i], &audio_float[i], &reference[i], size);
+    }
+    for (size_t i = 0; i < kNumSamples; ++i) {
+      assert(out[i] == reference[i]);
+    }
+
+    block_compressor.Init(kReferenceSampleRate);
+    block_compressor.Configure(false, parameters, NULL);
+    block_compressor.set_look_ahead(
+        static_cast<float>(look_ahead) / kReferenceSampleRate);
+    block_compressor.set_detection(BLOCK_COMPRESSOR_DETECTION_PEAK);
+    block_compressor.Compress(audio_float, NULL, out, kNumSamples);
+    for (size_t i = 0; i < kNumSamples; ++i) {
+      assert(fabsf(out[i]) <= fabsf(reference[i]) + 1e-6f);
+    }
+  }
+
+  delete[] reference;
+  delete[] out;
+  delete[] frequency;
+  delete[] gain;
+  delete[] delayed_audio;
+  delete[] excite_float;
+  delete[] audio_float;
+  delete[] excite;
+  delete[] audio;
+}
+
+void BenchmarkBlockCompressor() {
+  const float kSampleRate = 48000.0f;
+  const size_t kBenchmarkSamples = 480000;
+  const size_t kCallSize = 256;
+  const int kNumPasses = 4;
+  const size_t kLookAheads[] = { 0, 32, 256, 1024, 2047 };
+  const size_t kNumLookAheads = sizeof(kLookAheads) / sizeof(size_t);
+  const char* kModes[] = { "rms", "peak", "peak + sidechain" };
+
+  int16_t* audio = new int16_t[kBenchmarkSamples];
+  int16_t* excite = new int16_t[kBenchmarkSamples];
+  float* audio_float = new float[kBenchmarkSamples];
+  float* excite_float = new float[kBenchmarkSamples];
+  float out[kCallSize];
+
+  RenderTestSignals(
+      EXCITE_NOISE_BURST,
+      kSampleRate,
+      audio,
+      excite,
+      kBenchmarkSamples);
+  for (size_t i = 0; i < kBenchmarkSamples; ++i) {
+    audio_float[i] = static_cast<float>(audio[i]) / 32768.0f;
+    excite_float[i] = static_cast<float>(excite[i]) / 32768.0f;
+  }
+
+  int32_t parameters[2] = { 40000, 65535 };
+  const float num_samples = static_cast<float>(kBenchmarkSamples * kNumPasses);
+  printf("compress, ns/sample for a look-ahead of");
+  for (size_t l = 0; l < kNumLookAheads; ++l) {
+    printf(" %d", static_cast<int>(kLookAheads[l]));
+  }
+  printf(" samples\n");
+  for (int mode = 0; mode < 3; ++mode) {
+    float ns[kNumLookAheads];
+    float sum = 0.0f;
+    for (size_t l = 0; l < kNumLookAheads; ++l) {
+      block_compressor.Init(kSampleRate);
+      block_compressor.Configure(false, parameters, NULL);
+      block_compressor.set_look_ahead(
+          static_cast<float>(kLookAheads[l]) / kSampleRate);
+      assert(block_compressor.look_ahead() == kLookAheads[l]);
+      block_compressor.set_detection(mode == 0
+          ? BLOCK_COMPRESSOR_DETECTION_RMS
+          : BLOCK_COMPRESSOR_DETECTION_PEAK);
+      const float* sidechain = mode == 2 ? excite_float : NULL;
+      clock_t start = clock();
+      for (int pass = 0; pass < kNumPasses; ++pass) {
+        for (size_t i = 0; i < kBenchmarkSamples; i += kCallSize) {
+          size_t size = std::min(kCallSize, kBenchmarkSamples - i);
+          block_compressor.Compress(
+              &audio_float[i],
+              sidechain ? &sidechain[i] : NULL,
+              out,
+              size);
+          sum += out[0];
+        }
+      }
+      float time = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+      ns[l] = time / num_samples * 1e9f;
+    }
+    printf("%-16s", kModes[mode]);
+    for (size_t l = 0; l < kNumLookAheads; ++l) {
+      printf(" %5.1f", ns[l]);
+    }
+    printf(" (%.0f)\n", sum);
+  }
+
+  delete[] excite_float;
+  delete[] audio_float;
+  delete[] excite;
+  delete[] audio;
+}
+
+int main(void) {
+  TestBlockProcessor();
+  TestWindowMaximum();
+  TestBlockCompressor();
+  BenchmarkBlockProcessor();
+  BenchmarkBlockCompressor();
+}
@@ -0,0 +1,498 @@
+// Copyright 2017 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Arbitrary number of related slope generators, for host-side modulation.
+//
+// Generalization of PolySlopeGenerator, in the control range, to num_channels
+// outputs. With 4 channels, and the ratios of PolySlopeGenerator passed to
+// set_ratios(), the outputs are identical. The ramps are stepped by the same
+// RampGenerator; the state of the shapers is stored as one array per
+// variable, so that the loops across channels can be mapped onto SIMD lanes
+// by the compiler.
+//
+// Output modes:
+// - OUTPUT_MODE_GATES: slope, shifted slope, EOA and EOR on the first 4
+//   channels, as in PolySlopeGenerator. The other channels are silent.
+// - OUTPUT_MODE_AMPLITUDE: one slope, panned across the outputs by shift.
+// - OUTPUT_MODE_SLOPE_PHASE: one slope per channel, with a phase (looping
+//   mode) or pulse width (AD and AR modes) spread set by shift.
+// - OUTPUT_MODE_FREQUENCY: one slope per channel, at the ratios set with
+//   set_ratios().
+//
+// The audio range is not supported: band-limited slopes need the BLEP state
+// machines of RampShaper, which do not vectorize.
+
+#ifndef TIDES_POLY_SLOPE_BANK_H_
+#define TIDES_POLY_SLOPE_BANK_H_
+
+#include <algorithm>
+
+#include "stmlib/dsp/dsp.h"
+#include "stmlib/dsp/parameter_interpolator.h"
+#include "stmlib/utils/gate_flags.h"
+
+#include "tides2/poly_slope_generator.h"
+#include "tides2/ramp_generator.h"
+#include "tides2/ramp_shaper.h"
+#include "tides2/ratio.h"
+#include "tides2/resources.h"
+
+namespace tides {
+
+template<size_t num_channels>
+class PolySlopeBank {
+ public:
+  PolySlopeBank() { }
+  ~PolySlopeBank() { }
+
+  void Init() {
+    frequency_ = 0.01f;
+    pw_ = 0.0f;
+    shift_ = 0.0f;
+    shape_ = 0.0f;
+    fold_ = 0.0f;
+
+    Ratio r;
+    r.ratio = 1.0f;
+    r.q = 1;
+    std::fill(&ratio_[0], &ratio_[num_channels], r);
+    std::fill(&unit_ratio_[0], &unit_ratio_[num_channels], r);
+
+    ramp_generator_.Init();
+    std::fill(
+        &previous_phase_shift_[0],
+        &previous_phase_shift_[num_channels],
+        0.0f);
+    std::fill(&previous_input_[0], &previous_input_[num_channels], 0.0f);
+    std::fill(&previous_output_[0], &previous_output_[num_channels], 0.0f);
+    std::fill(&breakpoint_[0], &breakpoint_[num_channels], 0.0f);
+    for (size_t i = 0; i < 2; ++i) {
+      gate_shaper_[i].Init();
+    }
+    filter_.Init();
+  }
+
+  void Reset() {
+    filter_.Init();
+  }
+
+  // Frequency ratios of the FREQUENCY output mode. In looping mode, a new
+  // ratio is applied to a channel only when its phase wraps, as in
+  // RampGenerator.
+  void set_ratios(const Ratio* ratios) {
+    std::copy(&ratios[0], &ratios[num_channels], &ratio_[0]);
+  }
+
+  // out is interleaved, with num_channels values per sample - the same layout
+  // as PolySlopeGenerator::OutputSample.
+  void Render(
+      RampMode ramp_mode,
+      OutputMode output_mode,
+      float frequency,
+      float pw,
+      float shape,
+      float smoothness,
+      float shift,
+      const stmlib::GateFlags* gate_flags,
+      const float* ramp,
+      float* out,
+      size_t size) {
+    frequency = std::min(frequency, 0.25f);
+
+    // Skew the response of the pulse width parameter, as in the control range
+    // of PolySlopeGenerator.
+    if (pw < 0.5f) {
+      pw = 0.5f + 0.6f * (pw - 0.5f) / (fabsf(pw - 0.5f) + 0.1f);
+    }
+
+    if (ramp && ramp_mode == RAMP_MODE_AR) {
+      frequency *= 1.0f + 2.0f * fabsf(pw - 0.5f);
+    }
+
+    const float slope = 3.0f + fabsf(pw - 0.5f) * 5.0f;
+    const float shape_amount = fabsf(shape - 0.5f) * 2.0f;
+    const float shape_amount_attenuation = Tame(frequency, slope, 16.0f);
+    shape = 0.5f + (shape - 0.5f) * shape_amount_attenuation;
+
+    if (smoothness > 0.5f) {
+      smoothness = 0.5f + (smoothness - 0.5f) * Tame(
+          frequency,
+          slope * (3.0f + shape_amount * shape_amount_attenuation * 5.0f),
+          12.0f);
+    }
+
+    switch (ramp_mode) {
+      case RAMP_MODE_AD:
+        Render<RAMP_MODE_AD>(
+            output_mode, frequency, pw, shape, smoothness, shift,
+            gate_flags, ramp, out, size);
+        break;
+
+      case RAMP_MODE_LOOPING:
+        Render<RAMP_MODE_LOOPING>(
+            output_mode, frequency, pw, shape, smoothness, shift,
+            gate_flags, ramp, out, size);
+        break;
+
+      default:
+        Render<RAMP_MODE_AR>(
+            output_mode, frequency, pw, shape, smoothness, shift,
+            gate_flags, ramp, out, size);
+        break;
+    }
+
+    if (smoothness < 0.5f) {
+      float ratio = smoothness * 2.0f;
+      ratio *= ratio;
+      ratio *= ratio;
+
+      float f[num_channels];
+      for (size_t i = 0; i < num_channels; ++i) {
+        size_t source = output_mode == OUTPUT_MODE_FREQUENCY ? i : 0;
+        f[i] = ramp_generator_.frequency(source) * 0.5f;
+        f[i] += (1.0f - f[i]) * ratio;
+      }
+      if (output_mode == OUTPUT_MODE_GATES) {
+        filter_.template Process<1>(f, out, size);
+      } else {
+        filter_.template Process<num_channels>(f, out, size);
+      }
+    }
+  }
+
+ private:
+  template<RampMode ramp_mode>
+  inline void Render(
+      OutputMode output_mode,
+      float frequency,
+      float pw,
+      float shape,
+      float smoothness,
+      float shift,
+      const stmlib::GateFlags* gate_flags,
+      const float* ramp,
+      float* out,
+      size_t size) {
+    switch (output_mode) {
+      case OUTPUT_MODE_GATES:
+        RenderInternal<ramp_mode, OUTPUT_MODE_GATES>(
+            frequency, pw, shape, smoothness, shift, gate_flags, ramp,
+            out, size);
+        break;
+
+      case OUTPUT_MODE_AMPLITUDE:
+        RenderInternal<ramp_mode, OUTPUT_MODE_AMPLITUDE>(
+            frequency, pw, shape, smoothness, shift, gate_flags, ramp,
+            out, size);
+        break;
+
+      case OUTPUT_MODE_SLOPE_PHASE:
+        RenderInternal<ramp_mode, OUTPUT_MODE_SLOPE_PHASE>(
+            frequency, pw, shape, smoothness, shift, gate_flags, ramp,
+            out, size);
+        break;
+
+      default:
+        RenderInternal<ramp_mode, OUTPUT_MODE_FREQUENCY>(
+            frequency, pw, shape, smoothness, shift, gate_flags, ramp,
+            out, size);
+        break;
+    }
+  }
+
+  template<RampMode ramp_mode, OutputMode output_mode>
+  void RenderInternal(
+      float frequency,
+      float pw,
+      float shape,
+      float smoothness,
+      float shift,
+      const stmlib::GateFlags* gate_flags,
+      const float* ramp,
+      float* out,
+      size_t size) {
+    stmlib::ParameterInterpolator fm(&frequency_, frequency, size);
+    stmlib::ParameterInterpolator pwm(&pw_, pw, size);
+    stmlib::ParameterInterpolator shift_modulation(
+        &shift_, 2.0f * shift - 1.0f, size);
+    stmlib::ParameterInterpolator shape_modulation(
+        &shape_, shape * 5.9999f + 5.0f, size);
+    stmlib::ParameterInterpolator fold_modulation(
+        &fold_, std::max(2.0f * (smoothness - 0.5f), 0.0f), size);
+
+    // Only the first ratio is used by the other modes, and it is 1 in all the
+    // ratio tables of PolySlopeGenerator.
+    ramp_generator_.set_next_ratio(
+        output_mode == OUTPUT_MODE_FREQUENCY ? ratio_ : unit_ratio_);
+
+    // Number of slopes to shape.
+    const size_t n = output_mode == OUTPUT_MODE_SLOPE_PHASE || \
+        output_mode == OUTPUT_MODE_FREQUENCY ? num_channels : 1;
+
+    float per_channel_pw[num_channels];
+    float phase[num_channels];
+    float phase_shift[num_channels];
+    float channel_frequency[num_channels];
+    float channel_pw[num_channels];
+    float slope[num_channels];
+
+    for (size_t i = 0; i < size; ++i) {
+      const float f0 = fm.Next();
+      const float pw = pwm.Next();
+      const float shift = shift_modulation.Next();
+      // A single channel has no spread of pulse widths.
+      const float step = num_channels > 1
+          ? shift * (1.0f / (num_channels - 1))
+          : 0.0f;
+      const float partial_step = shift * (1.0f / num_channels);
+      const float fold = fold_modulation.Next();
+
+      const float pw_increment = (shift > 0.0f ? (1.0f - pw) : pw) * step;
+      for (size_t j = 0; j < num_channels; ++j) {
+        per_channel_pw[j] = pw + pw_increment * float(j);
+      }
+
+      // Increment ramps.
+      const float* step_pw = output_mode == OUTPUT_MODE_SLOPE_PHASE && \
+          ramp_mode == RAMP_MODE_AR ? per_channel_pw : &pw;
+      if (ramp) {
+        ramp_generator_.template Step<
+            ramp_mode, output_mode, RANGE_CONTROL, true>(
+                f0, step_pw, stmlib::GATE_FLAG_LOW, ramp[i]);
+      } else {
+        ramp_generator_.template Step<
+            ramp_mode, output_mode, RANGE_CONTROL, false>(
+                f0, step_pw, gate_flags[i], 0.0f);
+      }
+
+      // Compute shape.
+      const float shape = shape_modulation.Next();
+      MAKE_INTEGRAL_FRACTIONAL(shape);
+      const int16_t* shape_table = &lut_wavetable[shape_integral * 1025];
+
+      // Gather the phase, frequency, phase shift and pulse width of each
+      // slope.
+      for (size_t j = 0; j < n; ++j) {
+        size_t source = output_mode == OUTPUT_MODE_FREQUENCY || \
+            (output_mode == OUTPUT_MODE_SLOPE_PHASE && \
+             ramp_mode == RAMP_MODE_AR) ? j : 0;
+        phase[j] = ramp_generator_.phase(source);
+        channel_frequency[j] = ramp_generator_.frequency(source);
+        phase_shift[j] = 0.0f;
+        channel_pw[j] = output_mode == OUTPUT_MODE_SLOPE_PHASE && \
+            ramp_mode == RAMP_MODE_AD ? per_channel_pw[j] : pw;
+      }
+      if (output_mode == OUTPUT_MODE_SLOPE_PHASE) {
+        // Accumulated as in PolySlopeGenerator, for identical rounding.
+        float s = 0.0f;
+        for (size_t j = 0; j < n; ++j) {
+          phase_shift[j] = s;
+          s -= partial_step;
+        }
+      }
+
+      Slope<ramp_mode>(
+          phase, phase_shift, channel_frequency, channel_pw, slope, n);
+      const float raw = slope[0];
+      for (size_t j = 0; j < n; ++j) {
+        slope[j] = Shape<ramp_mode>(slope[j], shape_table, shape_fractional, j);
+      }
+      Fold<ramp_mode>(slope, fold, n);
+
+      if (output_mode == OUTPUT_MODE_GATES) {
+        std::fill(&out[0], &out[num_channels], 0.0f);
+        out[0] = slope[0] * shift;
+        if (num_channels > 1) {
+          // Uses the state of the second waveshaper, as in
+          // PolySlopeGenerator.
+          out[1] = Scale<ramp_mode>(Shape<ramp_mode>(
+              raw, &lut_wavetable[8200], 0.0f, 1));
+        }
+        if (num_channels > 2) {
+          out[2] = gate_shaper_[0].template EOA<ramp_mode>(
+              phase[0], channel_frequency[0], pw) * 8.0f;
+        }
+        if (num_channels > 3) {
+          out[3] = gate_shaper_[1].template EOR<ramp_mode>(
+              phase[0], channel_frequency[0], pw) * 8.0f;
+        }
+      } else if (output_mode == OUTPUT_MODE_AMPLITUDE) {
+        const float s = slope[0] * (shift < 0.0f ? -1.0f : + 1.0f);
+        const float channel_index = fabsf(shift * (num_channels + 1.1f));
+        for (size_t j = 0; j < num_channels; ++j) {
+          const float channel = static_cast<float>(j + 1);
+          const float gain = std::max(
+              1.0f - fabsf(channel - channel_index), 0.0f);
+          out[j] = s * gain;
+        }
+      } else {
+        std::copy(&slope[0], &slope[num_channels], &out[0]);
+      }
+      out += num_channels;
+    }
+  }
+
+  // RampShaper::Slope, in the control range.
+  template<RampMode ramp_mode>
+  inline void Slope(
+      const float* phase,
+      const float* phase_shift,
+      const float* frequency,
+      const float* pw,
+      float* out,
+      size_t n) {
+    if (ramp_mode == RAMP_MODE_AR) {
+      std::copy(&phase[0], &phase[n], &out[0]);
+      return;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      float p = phase[i];
+      float f = frequency[i];
+      // The phase shift is ignored in AD mode.
+      const float s = ramp_mode == RAMP_MODE_AD ? 0.0f : phase_shift[i];
+      if (s) {
+        p += s;
+        f += s - previous_phase_shift_[i];
+        previous_phase_shift_[i] = s;
+        p = p >= 1.0f ? p - 1.0f : (p < 0.0f ? p + 1.0f : p);
+      }
+      float this_pw = pw[i];
+      CONSTRAIN(this_pw, fabsf(f) * 2.0f, 1.0f - 2.0f * fabsf(f));
+      const float slope_up = 0.5f / this_pw;
+      const float slope_down = 0.5f / (1.0f - this_pw);
+      out[i] = p < this_pw
+          ? p * slope_up
+          : (p - this_pw) * slope_down + 0.5f;
+    }
+  }
+
+  // RampWaveshaper::Shape, with the state of the waveshaper of channel i.
+  // The table lookup is a gather, and stays scalar.
+  template<RampMode ramp_mode>
+  inline float Shape(
+      float input,
+      const int16_t* shape,
+      float shape_fractional,
+      size_t i) {
+    float ws_index = 1024.0f * input;
+    MAKE_INTEGRAL_FRACTIONAL(ws_index)
+    ws_index_integral &= 1023;
+    const int16_t* s = &shape[ws_index_integral];
+    float x0 = static_cast<float>(s[0]) / 32768.0f;
+    float x1 = static_cast<float>(s[1]) / 32768.0f;
+    float y0 = static_cast<float>(s[1025]) / 32768.0f;
+    float y1 = static_cast<float>(s[1026]) / 32768.0f;
+    float x = x0 + (x1 - x0) * ws_index_fractional;
+    float y = y0 + (y1 - y0) * ws_index_fractional;
+    float output = x + (y - x) * shape_fractional;
+
+    if (ramp_mode != RAMP_MODE_AR) {
+      return output;
+    }
+    // The breakpoint tracking, rewritten with selects.
+    const float previous = previous_input_[i];
+    const bool crossing = (previous <= 0.5f && input > 0.5f) || \
+        (previous > 0.5f && input < 0.5f);
+    float breakpoint = breakpoint_[i];
+    breakpoint = input == 0.5f ? 0.0f : breakpoint;
+    breakpoint = input == 1.0f ? 1.0f : breakpoint;
+    breakpoint = crossing ? previous_output_[i] : breakpoint;
+    output = input <= 0.5f
+        ? breakpoint + (1.0f - breakpoint) * output
+        : breakpoint * output;
+    breakpoint_[i] = breakpoint;
+    previous_input_[i] = input;
+    previous_output_[i] = output;
+    return output;
+  }
+
+  template<RampMode ramp_mode>
+  inline void Fold(float* in_out, float fold_amount, size_t n) {
+    if (ramp_mode == RAMP_MODE_LOOPING) {
+      for (size_t i = 0; i < n; ++i) {
+        const float bipolar = 2.0f * in_out[i] - 1.0f;
+        const float folded = fold_amount > 0.0f ? stmlib::Interpolate(
+            lut_bipolar_fold,
+            0.5f + bipolar * (0.03f + 0.46f * fold_amount),
+            1024.0f) : 0.0f;
+        in_out[i] = 5.0f * (bipolar + (folded - bipolar) * fold_amount);
+      }
+    } else {
+      for (size_t i = 0; i < n; ++i) {
+        const float unipolar = in_out[i];
+        const float folded = fold_amount > 0.0f ? stmlib::Interpolate(
+            lut_unipolar_fold,
+            unipolar * fold_amount,
+            1024.0f) : 0.0f;
+        in_out[i] = 8.0f * (unipolar + (folded - unipolar) * fold_amount);
+      }
+    }
+  }
+
+  template<RampMode ramp_mode>
+  inline float Scale(float unipolar) {
+    if (ramp_mode == RAMP_MODE_LOOPING) {
+      return 10.0f * unipolar - 5.0f;
+    } else {
+      return 8.0f * unipolar;
+    }
+  }
+
+  inline float Tame(float f0, float harmonics, float order) {
+    f0 *= harmonics;
+    float max_f = 0.5f * (1.0f / order);
+    float max_amount = 1.0f - (f0 - max_f) / (0.5f - max_f);
+    CONSTRAIN(max_amount, 0.0f, 1.0f);
+    return max_amount * max_amount * max_amount;
+  }
+
+  float frequency_;
+  float pw_;
+  float shift_;
+  float shape_;
+  float fold_;
+
+  Ratio ratio_[num_channels];
+  Ratio unit_ratio_[num_channels];
+
+  RampGenerator<num_channels> ramp_generator_;
+
+  float previous_phase_shift_[num_channels];
+  float previous_input_[num_channels];
+  float previous_output_[num_channels];
+  float breakpoint_[num_channels];
+
+  // EOA and EOR outputs of the GATES mode.
+  RampShaper gate_shaper_[2];
+
+  Filter<num_channels> filter_;
+
+  DISALLOW_COPY_AND_ASSIGN(PolySlopeBank);
+};
+
+}  // namespace tides
+
+#endif  // TIDES_POLY_SLOPE_BANK_H_
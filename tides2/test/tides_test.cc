@@ -14,12 +14,15 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <algorithm>
+#include <cassert>
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <xmmintrin.h>
 
+#include "tides2/poly_slope_bank.h"
 #include "tides2/poly_slope_generator.h"
 #include "tides2/resources.h"
 #include "tides2/ramp_generator.h"
@@ -179,8 +182,167 @@ void TestPolySlopeGenerator() {
   }
 }
 
+void TestPolySlopeBank() {
+  // Row of the control ratio table of PolySlopeGenerator selected by a shift
+  // of 0.8 in the FREQUENCY mode.
+  const Ratio ratios[4] = { { 1.0f, 1 }, { 1.5f, 2 }, { 2.0f, 1 }, { 3.0f, 1 } };
+  const size_t num_samples = kSampleRate * 4;
+
+  for (int ramp_source = 0; ramp_source < 2; ++ramp_source) {
+    for (int ramp_mode = 0; ramp_mode < RAMP_MODE_LAST; ++ramp_mode) {
+      for (int output_mode = 0; output_mode < OUTPUT_MODE_LAST; ++output_mode) {
+        PulseGenerator pulses;
+        if (ramp_mode != RAMP_MODE_LOOPING) {
+          pulses.CreateTestPattern();
+        } else {
+          pulses.AddPulses(kSampleRate, 100, 10);
+        }
+
+        PolySlopeGenerator poly_slope;
+        poly_slope.Init();
+        PolySlopeBank<4> bank;
+        bank.Init();
+        bank.set_ratios(ratios);
+
+        float phase = 0.0f;
+        size_t num_mismatches = 0;
+        for (size_t i = 0; i < num_samples; i += kBlockSize) {
+          GateFlags gate_flags[kBlockSize];
+          float ramp[kBlockSize];
+          pulses.Render(gate_flags, kBlockSize);
+          const float f0 = (ramp_mode == RAMP_MODE_LOOPING ? 20.0f : 4.0f) / \
+              kSampleRate;
+          for (size_t j = 0; j < kBlockSize; ++j) {
+            ramp[j] = phase;
+            phase += f0;
+            if (phase >= 1.0f) {
+              phase -= 1.0f;
+            }
+          }
+          if (ramp_source == 1) {
+            fill(&gate_flags[0], &gate_flags[kBlockSize], GATE_FLAG_LOW);
+          }
+
+          // Sweep all the parameters, with the smoothness crossing 0.5 to
+          // exercise both the filter and the wavefolder.
+          const float t = static_cast<float>(i) / num_samples;
+          const float pw = t;
+          const float shape = 1.0f - t;
+          const float smoothness = 0.5f + 0.45f * sinf(t * 12.0f);
+          const float shift = output_mode == OUTPUT_MODE_FREQUENCY
+              ? 0.8f
+              : 0.5f + 0.5f * sinf(t * 7.0f);
+
+          PolySlopeGenerator::OutputSample out[kBlockSize];
+          float bank_out[kBlockSize * 4];
+          poly_slope.Render(
+              RampMode(ramp_mode), OutputMode(output_mode), RANGE_CONTROL,
+              f0, pw, shape, smoothness, shift,
+              gate_flags, ramp_source == 1 ? ramp : NULL, out, kBlockSize);
+          bank.Render(
+              RampMode(ramp_mode), OutputMode(output_mode),
+              f0, pw, shape, smoothness, shift,
+              gate_flags, ramp_source == 1 ? ramp : NULL, bank_out, kBlockSize);
+          for (size_t j = 0; j < kBlockSize; ++j) {
+            for (size_t k = 0; k < 4; ++k) {
+              if (out[j].channel[k] != bank_out[j * 4 + k]) {
+                ++num_mismatches;
+              }
+            }
+          }
+        }
+        printf(
+            "PolySlopeBank<4> %s %-4s %-11s: %zu mismatches\n",
+            ramp_source_name[ramp_source],
+            ramp_mode_name[ramp_mode],
+            output_mode_name[output_mode],
+            num_mismatches);
+        assert(num_mismatches == 0);
+      }
+    }
+  }
+}
+
+void TestPolySlopeBankSingleChannel() {
+  PolySlopeBank<1> bank;
+  bank.Init();
+  PulseGenerator pulses;
+  pulses.CreateTestPattern();
+
+  for (int ramp_mode = 0; ramp_mode < RAMP_MODE_LAST; ++ramp_mode) {
+    for (int output_mode = 0; output_mode < OUTPUT_MODE_LAST; ++output_mode) {
+      for (size_t i = 0; i < kSampleRate; i += kBlockSize) {
+        GateFlags gate_flags[kBlockSize];
+        float out[kBlockSize];
+        pulses.Render(gate_flags, kBlockSize);
+        const float t = static_cast<float>(i) / kSampleRate;
+        bank.Render(
+            RampMode(ramp_mode), OutputMode(output_mode),
+            20.0f / kSampleRate, t, 0.5f, 0.7f, t,
+            gate_flags, NULL, out, kBlockSize);
+        for (size_t j = 0; j < kBlockSize; ++j) {
+          assert(isfinite(out[j]));
+        }
+      }
+    }
+  }
+}
+
+template<size_t num_channels>
+void BenchmarkPolySlopeBank() {
+  static PolySlopeBank<num_channels> bank;
+  static float out[kBlockSize * num_channels];
+  bank.Init();
+
+  Ratio r[num_channels];
+  for (size_t i = 0; i < num_channels; ++i) {
+    r[i].ratio = 1.0f / static_cast<float>(i % 16 + 1);
+    r[i].q = i % 16 + 1;
+  }
+  bank.set_ratios(r);
+
+  PulseGenerator pulses;
+  pulses.AddPulses(kSampleRate, 100, 10);
+
+  const size_t num_samples = kSampleRate * 10;
+  for (int output_mode = 0; output_mode < OUTPUT_MODE_LAST; ++output_mode) {
+    clock_t start = clock();
+    float checksum = 0.0f;
+    for (size_t i = 0; i < num_samples; i += kBlockSize) {
+      GateFlags gate_flags[kBlockSize];
+      pulses.Render(gate_flags, kBlockSize);
+      bank.Render(
+          RAMP_MODE_LOOPING,
+          OutputMode(output_mode),
+          2.0f / kSampleRate,
+          0.5f,  // pw
+          0.3f,  // shape
+          0.7f,  // smoothness
+          0.8f,  // shift
+          gate_flags,
+          NULL,
+          out,
+          kBlockSize);
+      checksum += out[num_channels - 1];
+    }
+    double seconds = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+    double channel_seconds = num_channels * num_samples / kSampleRate;
+    printf(
+        "PolySlopeBank<%3zu> %-11s: %8.0fx realtime per channel (%.3f)\n",
+        num_channels,
+        output_mode_name[output_mode],
+        channel_seconds / seconds,
+        checksum);
+  }
+}
+
 int main(void) {
   _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
   TestRampGenerator();
   TestPolySlopeGenerator();
+  TestPolySlopeBank();
+  TestPolySlopeBankSingleChannel();
+  BenchmarkPolySlopeBank<4>();
+  BenchmarkPolySlopeBank<64>();
+  BenchmarkPolySlopeBank<512>();
 }
@@ -0,0 +1,88 @@
+// Copyright 2013 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Maps notes to DAC codes, for outputs calibrated by measuring the DAC code
+// of each octave.
+//
+// The interval between two calibration points is interpolated linearly. The
+// table stores, for each octave, its DAC code and the difference with the
+// next one, so that a lookup only has to find the octave - which a division
+// by a constant does without searching - and read a single entry. The result
+// is the same, to the LSB, as Voice::NoteToDacCode() used to be.
+
+#ifndef YARNS_CALIBRATION_TABLE_H_
+#define YARNS_CALIBRATION_TABLE_H_
+
+#include "stmlib/stmlib.h"
+
+namespace yarns {
+
+// num_octaves is the number of calibration points. Notes are in units of
+// 1/octave_size octave, starting at the first calibration point, and are
+// clipped to the range covered by the table.
+template<uint8_t num_octaves, int32_t octave_size>
+class CalibrationTable {
+ public:
+  CalibrationTable() { }
+  ~CalibrationTable() { }
+
+  // To be called again whenever one of the calibration points changes.
+  void Init(const uint16_t* dac_code) {
+    for (uint8_t i = 0; i < num_octaves - 1; ++i) {
+      entry_[i].dac_code = dac_code[i];
+      entry_[i].delta = static_cast<int32_t>(dac_code[i + 1]) - dac_code[i];
+    }
+  }
+
+  inline uint16_t Lookup(int32_t note) const {
+    if (note <= 0) {
+      note = 0;
+    }
+    if (note >= kMaxNote) {
+      note = kMaxNote - 1;
+    }
+    uint32_t octave = static_cast<uint32_t>(note) / octave_size;
+    int32_t fraction = note - static_cast<int32_t>(octave) * octave_size;
+    const Entry& e = entry_[octave];
+    return e.dac_code + (e.delta * fraction / octave_size);
+  }
+
+ private:
+  static const int32_t kMaxNote = (num_octaves - 1) * octave_size;
+
+  struct Entry {
+    int32_t dac_code;
+    int32_t delta;
+  };
+
+  Entry entry_[num_octaves - 1];
+
+  DISALLOW_COPY_AND_ASSIGN(CalibrationTable);
+};
+
+}  // namespace yarns
+
+#endif // YARNS_CALIBRATION_TABLE_H_
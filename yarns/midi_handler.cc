@@ -31,16 +31,14 @@
 #include <algorithm>
 
 #include "yarns/multi.h"
-#ifndef TEST
 #include "yarns/storage_manager.h"
-#endif // TEST
 
 namespace yarns {
 
 using namespace std;
 
 /* static */
-MidiHandler::MidiBuffer MidiHandler::input_buffer_; 
+MidiHandler::MidiInputBuffer MidiHandler::input_buffer_; 
 
 /* static */
 MidiHandler::MidiBuffer MidiHandler::output_buffer_;
@@ -51,6 +49,21 @@ MidiHandler::SmallMidiBuffer MidiHandler::high_priority_output_buffer_;
 /* static */
 stmlib_midi::MidiStreamParser<MidiHandler> MidiHandler::parser_;
 
+/* static */
+MidiEvent MidiHandler::events_[kMidiEventBatchSize];
+
+/* static */
+uint8_t MidiHandler::num_events_;
+
+/* static */
+uint32_t MidiHandler::dropped_input_bytes_;
+
+/* static */
+uint32_t MidiHandler::output_overflows_;
+
+/* static */
+uint32_t MidiHandler::coalesced_events_;
+
 /* static */
 const MidiHandler::SysExDescription MidiHandler::accepted_sysex_[] = {
   { { 0xf0, 0x00, 0x21, 0x02, 0x00, 0x0b }, 6, 0xff,
@@ -68,6 +81,12 @@ const MidiHandler::SysExDescription MidiHandler::accepted_sysex_[] = {
 /* static */
 uint8_t MidiHandler::sysex_rx_write_ptr_;
 
+/* static */
+bool MidiHandler::sysex_streaming_;
+
+/* static */
+SysExStreamReceiver MidiHandler::sysex_stream_;
+
 /* static */
 uint8_t MidiHandler::previous_packet_index_;
 
@@ -83,18 +102,139 @@ uint8_t MidiHandler::calibration_note_;
 /* static */
 bool MidiHandler::factory_testing_requested_;
 
+#ifdef TEST
+/* static */
+MidiHandler::DispatchObserverFn MidiHandler::dispatch_observer_;
+#endif  // TEST
+
 /* static */
 void MidiHandler::Init() {
   input_buffer_.Init();
   output_buffer_.Init();
   high_priority_output_buffer_.Init();
+  num_events_ = 0;
+  ResetCounters();
   sysex_rx_write_ptr_ = 0;
+  sysex_streaming_ = false;
+  sysex_stream_.Init();
   previous_packet_index_ = 0;
   calibration_voice_ = 0xff;
   calibration_note_ = 0xff;
   factory_testing_requested_ = false;
 }
 
+/* static */
+void MidiHandler::QueueContinuous(
+    uint8_t status,
+    uint8_t data_1,
+    uint8_t data_2) {
+  // Look for a message in the batch setting the same CC, pitch bend or
+  // pressure of the same channel. The search stops at the realtime messages,
+  // so that the values received during different clock ticks are kept, and
+  // at the notes, program changes and ordered CCs of the same channel. The
+  // older message is removed, and the new one is queued at the end.
+  uint8_t channel = status & 0x0f;
+  bool control_change = (status & 0xf0) == 0xb0;
+  for (int16_t i = num_events_ - 1; i >= 0; --i) {
+    const MidiEvent& e = events_[i];
+    if (e.status >= 0xf0) {
+      break;
+    } else if ((e.status & 0x0f) != channel) {
+      continue;
+    } else if (e.status == status &&
+               (!control_change || e.data[0] == data_1)) {
+      copy(&events_[i + 1], &events_[num_events_], &events_[i]);
+      --num_events_;
+      ++coalesced_events_;
+      break;
+    }
+    uint8_t type = e.status & 0xf0;
+    if (type != 0xd0 && type != 0xe0 &&
+        !(type == 0xb0 && coalescable(e.data[0]))) {
+      break;
+    }
+  }
+  Queue(status, data_1, data_2);
+}
+
+/* static */
+void MidiHandler::DispatchEvents() {
+  for (uint8_t i = 0; i < num_events_; ++i) {
+    Dispatch(events_[i]);
+  }
+  num_events_ = 0;
+}
+
+/* static */
+void MidiHandler::Dispatch(const MidiEvent& e) {
+#ifdef TEST
+  if (dispatch_observer_) {
+    (*dispatch_observer_)(e);
+  }
+#endif  // TEST
+  uint8_t channel = e.status & 0x0f;
+  bool thru = !multi.direct_thru();
+  switch (e.status & 0xf0) {
+    case 0x80:
+      if (multi.NoteOff(channel, e.data[0], e.data[1]) && thru) {
+        Send3(0x80 | channel, e.data[0], 0);
+      }
+      break;
+
+    case 0x90:
+      if (multi.NoteOn(channel, e.data[0], e.data[1]) && thru) {
+        Send3(0x90 | channel, e.data[0], e.data[1]);
+      }
+      break;
+
+    case 0xa0:
+      if (multi.Aftertouch(channel, e.data[0], e.data[1]) && thru) {
+        Send3(0xa0 | channel, e.data[0], e.data[1]);
+      }
+      break;
+
+    case 0xb0:
+      if (multi.ControlChange(channel, e.data[0], e.data[1]) && thru) {
+        Send3(0xb0 | channel, e.data[0], e.data[1]);
+      }
+      break;
+
+    case 0xc0:
+      if (thru) {
+        Send2(0xc0 | channel, e.data[0]);
+      }
+      break;
+
+    case 0xd0:
+      if (multi.Aftertouch(channel, e.data[0]) && thru) {
+        Send2(0xd0 | channel, e.data[0]);
+      }
+      break;
+
+    case 0xe0:
+      if (multi.PitchBend(channel, e.data[0] | (e.data[1] << 7)) && thru) {
+        Send3(0xe0 | channel, e.data[0], e.data[1]);
+      }
+      break;
+
+    case 0xf0:
+      if (e.status == 0xff) {
+        multi.Reset();
+      } else if (!multi.internal_clock()) {
+        if (e.status == 0xf8) {
+          multi.Clock();
+        } else if (e.status == 0xfa) {
+          multi.Start(false);
+        } else if (e.status == 0xfb) {
+          multi.Continue();
+        } else if (e.status == 0xfc) {
+          multi.Stop();
+        }
+      }
+      break;
+  }
+}
+
 /* static */
 void MidiHandler::DecodeSysExMessage() {
   uint8_t length = sysex_rx_write_ptr_;
@@ -157,7 +297,6 @@ enum SysExCommand {
 
 /* static */
 void MidiHandler::HandleYarnsSpecificMessage() {
-#ifndef TEST
   uint8_t command = sysex_rx_buffer_[6];
   if (command == SYSEX_COMMAND_DUMP_PACKET) {
     uint8_t packet_index = sysex_rx_buffer_[7];
@@ -193,6 +332,31 @@ void MidiHandler::HandleYarnsSpecificMessage() {
     } else if (packet_index) {
       storage_manager.DeserializeMulti();
     }
+  } else if (command == SYSEX_COMMAND_STREAM_BEGIN) {
+    if (sysex_rx_write_ptr_ == kSysExStreamBeginSize) {
+      uint32_t size = Read21Bits(&sysex_rx_buffer_[8]);
+      uint8_t* destination = storage_manager.BeginReception(
+          sysex_rx_buffer_[7],
+          size);
+      if (destination) {
+        sysex_stream_.Start(destination, size);
+        SysExSendStreamAck(SYSEX_STREAM_STARTED);
+      } else {
+        sysex_stream_.Abort();
+        SysExSendStreamAck(SYSEX_STREAM_REJECTED);
+      }
+    }
+  } else if (command == SYSEX_COMMAND_STREAM_DATA) {
+    if (sysex_rx_write_ptr_ == kSysExStreamDataHeaderSize + 1) {
+      bool complete = sysex_stream_.complete();
+      SysExStreamStatus status = sysex_stream_.EndChunk();
+      if (status == SYSEX_STREAM_DONE && !complete) {
+        storage_manager.CommitReception();
+      }
+      if (status != SYSEX_STREAM_IGNORED) {
+        SysExSendStreamAck(status);
+      }
+    }
   } else if (command == SYSEX_COMMAND_REQUEST_PACKETS) {
     if (sysex_rx_buffer_[7] == 0 &&
         sysex_rx_buffer_[8] == 0 && 
@@ -219,7 +383,6 @@ void MidiHandler::HandleYarnsSpecificMessage() {
       storage_manager.SaveCalibration();
     }
   }
-#endif  // TEST
 }
 
 /* static */
@@ -251,6 +414,30 @@ void MidiHandler::SysExSendPacket(
   Flush();
 }
 
+/* static */
+void MidiHandler::StartSysExStreamChunk() {
+  if (sysex_rx_buffer_[6] != SYSEX_COMMAND_STREAM_DATA ||
+      !equal(
+          &kSysExStreamPrefix[0],
+          &kSysExStreamPrefix[kSysExStreamPrefixSize],
+          &sysex_rx_buffer_[0])) {
+    return;
+  }
+  sysex_stream_.StartChunk(
+      sysex_rx_buffer_[7],
+      Read21Bits(&sysex_rx_buffer_[8]));
+  sysex_streaming_ = true;
+}
+
+/* static */
+void MidiHandler::SysExSendStreamAck(SysExStreamStatus status) {
+  uint8_t ack[kSysExStreamAckSize];
+  size_t size = sysex_stream_.WriteAck(status, ack);
+  for (size_t i = 0; i < size; ++i) {
+    SendBlocking(ack[i]);
+  }
+}
+
 /* static */
 void MidiHandler::SysExSendPackets(const uint8_t* data, size_t size) {
   uint8_t block_index = 0;
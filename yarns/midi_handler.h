@@ -35,15 +35,26 @@
 #include "stmlib/midi/midi.h"
 
 #include "yarns/multi.h"
+#include "yarns/sysex_stream.h"
 
 namespace yarns {
 
 const size_t kSysexMaxChunkSize = 64;
 const size_t kSysexRxBufferSize = kSysexMaxChunkSize * 2 + 16;
+const size_t kMidiEventBatchSize = 32;
+
+// A channel or realtime message decoded by the parser. The messages are
+// queued while the input buffer is parsed, and dispatched to the multi by
+// batches, in ProcessInput().
+struct MidiEvent {
+  uint8_t status;
+  uint8_t data[2];
+};
 
 class MidiHandler {
  public:
   typedef stmlib::RingBuffer<uint8_t, 128> MidiBuffer;
+  typedef stmlib::RingBuffer<uint8_t, 256> MidiInputBuffer;
   typedef stmlib::RingBuffer<uint8_t, 32> SmallMidiBuffer;
    
   MidiHandler() { }
@@ -52,52 +63,46 @@ class MidiHandler {
   static void Init();
   
   static void NoteOn(uint8_t channel, uint8_t note, uint8_t velocity) {
-    if (multi.NoteOn(channel, note, velocity) && !multi.direct_thru()) {
-      Send3(0x90 | channel, note, velocity);
-    }
+    Queue(0x90 | channel, note, velocity);
   }
   
   static void NoteOff(uint8_t channel, uint8_t note, uint8_t velocity) {
-    if (multi.NoteOff(channel, note, velocity) && !multi.direct_thru()) {
-      Send3(0x80 | channel, note, 0);
-    }
+    Queue(0x80 | channel, note, velocity);
   }
   
   static void Aftertouch(uint8_t channel, uint8_t note, uint8_t velocity) {
-    if (multi.Aftertouch(channel, note, velocity) && !multi.direct_thru()) {
-      Send3(0xa0 | channel, note, velocity);
-    }
+    Queue(0xa0 | channel, note, velocity);
   }
   
   static void Aftertouch(uint8_t channel, uint8_t velocity) {
-    if (multi.Aftertouch(channel, velocity) && !multi.direct_thru()) {
-      Send2(0xd0 | channel, velocity);
-    }
+    QueueContinuous(0xd0 | channel, velocity, 0);
   }
   
   static void ControlChange(
       uint8_t channel,
       uint8_t controller,
       uint8_t value) {
-    if (multi.ControlChange(channel, controller, value) && !multi.direct_thru()) {
-      Send3(0xb0 | channel, controller, value);
+    if (coalescable(controller)) {
+      QueueContinuous(0xb0 | channel, controller, value);
+    } else {
+      Queue(0xb0 | channel, controller, value);
     }
   }
   
   static void ProgramChange(uint8_t channel, uint8_t program) {
-    if (!multi.direct_thru()) {
-      Send2(0xc0 | channel, program);
-    }
+    Queue(0xc0 | channel, program, 0);
   }
   
   static void PitchBend(uint8_t channel, uint16_t pitch_bend) {
-    if (multi.PitchBend(channel, pitch_bend) && !multi.direct_thru()) {
-      Send3(0xe0 | channel, pitch_bend & 0x7f, pitch_bend >> 7);
-    }
+    QueueContinuous(0xe0 | channel, pitch_bend & 0x7f, pitch_bend >> 7);
   }
 
   static void SysExStart() {
+    // Preserve the order of the MIDI thru and of the messages received
+    // before the SysEx.
+    DispatchEvents();
     sysex_rx_write_ptr_ = 0;
+    sysex_streaming_ = false;
     ProcessSysExByte(0xf0);
   }
 
@@ -106,6 +111,7 @@ class MidiHandler {
   }
   
   static void SysExEnd() {
+    sysex_streaming_ = false;
     ProcessSysExByte(0xf7);
     DecodeSysExMessage();
   }
@@ -113,31 +119,23 @@ class MidiHandler {
   static void BozoByte(uint8_t bozo_byte) { }
 
   static void Clock() {
-    if (!multi.internal_clock()) {
-      multi.Clock();
-    }
+    Queue(0xf8, 0, 0);
   }
   
   static void Start() {
-    if (!multi.internal_clock()) {
-      multi.Start(false);
-    }
+    Queue(0xfa, 0, 0);
   }
   
   static void Continue() {
-    if (!multi.internal_clock()) {
-      multi.Continue();
-    }
+    Queue(0xfb, 0, 0);
   }
   
   static void Stop() {
-    if (!multi.internal_clock()) {
-      multi.Stop();
-    }
+    Queue(0xfc, 0, 0);
   }
   
   static void Reset() {
-    multi.Reset();
+    Queue(0xff, 0, 0);
   }
   
   static bool CheckChannel(uint8_t channel) { return true; }
@@ -182,13 +180,24 @@ class MidiHandler {
   }
   
   static void PushByte(uint8_t byte) {
-    input_buffer_.Overwrite(byte);
+    // Drop the byte rather than overwriting the unread data when the main
+    // loop is late.
+    if (input_buffer_.writable()) {
+      input_buffer_.Overwrite(byte);
+    } else {
+      ++dropped_input_bytes_;
+    }
   }
   
   static void ProcessInput() {
     while (input_buffer_.readable()) {
       parser_.PushByte(input_buffer_.ImmediateRead());
+      // A byte completes at most one message.
+      if (num_events_ == kMidiEventBatchSize) {
+        DispatchEvents();
+      }
     }
+    DispatchEvents();
   }
   
   static inline MidiBuffer* mutable_output_buffer() { return &output_buffer_; }
@@ -197,17 +206,26 @@ class MidiHandler {
   }
 
   static inline void Send3(uint8_t byte_1, uint8_t byte_2, uint8_t byte_3) {
+    if (output_buffer_.writable() < 3) {
+      ++output_overflows_;
+    }
     output_buffer_.Overwrite(byte_1);
     output_buffer_.Overwrite(byte_2);
     output_buffer_.Overwrite(byte_3);
   }
 
   static inline void Send2(uint8_t byte_1, uint8_t byte_2) {
+    if (output_buffer_.writable() < 2) {
+      ++output_overflows_;
+    }
     output_buffer_.Overwrite(byte_1);
     output_buffer_.Overwrite(byte_2);
   }
 
   static inline void Send1(uint8_t byte) {
+    if (!output_buffer_.writable()) {
+      ++output_overflows_;
+    }
     output_buffer_.Overwrite(byte);
   }
   
@@ -233,6 +251,12 @@ class MidiHandler {
   
   static void SysExSendPackets(const uint8_t* data, size_t size);
   
+  // Called when the destination of a streamed transfer is used for something
+  // else.
+  static void AbortSysExStream() {
+    sysex_stream_.Abort();
+  }
+  
   static inline bool calibrating() {
     return calibration_voice_ < kNumVoices && calibration_note_ < kNumOctaves;
   }
@@ -245,18 +269,67 @@ class MidiHandler {
     factory_testing_requested_ = false;
   }
   
+  // Input bytes lost because the input buffer was full.
+  static inline uint32_t dropped_input_bytes() { return dropped_input_bytes_; }
+  // Messages written to the output buffer while it was full.
+  static inline uint32_t output_overflows() { return output_overflows_; }
+  // CC, pitch bend and channel pressure messages superseded by a more recent
+  // value before being dispatched.
+  static inline uint32_t coalesced_events() { return coalesced_events_; }
+  
+  static void ResetCounters() {
+    dropped_input_bytes_ = 0;
+    output_overflows_ = 0;
+    coalesced_events_ = 0;
+  }
+  
+#ifdef TEST
+  // Called with each message dispatched to the multi, to check the batching
+  // and coalescing of the input.
+  typedef void (*DispatchObserverFn)(const MidiEvent& e);
+  static inline void set_dispatch_observer(DispatchObserverFn fn) {
+    dispatch_observer_ = fn;
+  }
+#endif  // TEST
+  
  private:
   static void SysExSendPacket(
       uint8_t packet_index,
       const uint8_t* data,
       size_t size);
   static void DecodeSysExMessage();
+  static void StartSysExStreamChunk();
+  static void SysExSendStreamAck(SysExStreamStatus status);
+  
+  static inline void Queue(uint8_t status, uint8_t data_1, uint8_t data_2) {
+    MidiEvent* e = &events_[num_events_++];
+    e->status = status;
+    e->data[0] = data_1;
+    e->data[1] = data_2;
+  }
+  static void QueueContinuous(uint8_t status, uint8_t data_1, uint8_t data_2);
+  static void DispatchEvents();
+  static void Dispatch(const MidiEvent& e);
+  
+  // Data entry, NRPN/RPN selection and channel mode messages depend on the
+  // order of the other CCs, and are never coalesced.
+  static inline bool coalescable(uint8_t controller) {
+    return controller != 0x06 && controller != 0x26 &&
+        (controller < 0x60 || controller > 0x65) &&
+        controller < 0x78;
+  }
   inline static void ProcessSysExByte(uint8_t sysex_byte) {
     if (!multi.direct_thru()) {
       Send1(sysex_byte);
     }
-    if (sysex_rx_write_ptr_ < sizeof(sysex_rx_buffer_)) {
+    if (sysex_streaming_) {
+      // The payload of streamed data is decoded as it is received.
+      sysex_stream_.Write(sysex_byte);
+    } else if (sysex_rx_write_ptr_ < sizeof(sysex_rx_buffer_)) {
       sysex_rx_buffer_[sysex_rx_write_ptr_++] = sysex_byte;
+      if (sysex_rx_write_ptr_ == kSysExStreamDataHeaderSize) {
+        StartSysExStreamChunk();
+      }
     }
   }
   
@@ -264,13 +337,22 @@ class MidiHandler {
   static void HandleScaleOctaveTuning2ByteForm();
   static void HandleYarnsSpecificMessage();
   
-  static MidiBuffer input_buffer_; 
+  static MidiInputBuffer input_buffer_; 
   static MidiBuffer output_buffer_; 
   static SmallMidiBuffer high_priority_output_buffer_;
   static stmlib_midi::MidiStreamParser<MidiHandler> parser_;
   
+  static MidiEvent events_[kMidiEventBatchSize];
+  static uint8_t num_events_;
+  
+  static uint32_t dropped_input_bytes_;
+  static uint32_t output_overflows_;
+  static uint32_t coalesced_events_;
+  
   static uint8_t sysex_rx_buffer_[kSysexRxBufferSize];
   static uint8_t sysex_rx_write_ptr_;
+  static bool sysex_streaming_;
+  static SysExStreamReceiver sysex_stream_;
   
   static uint8_t previous_packet_index_;
   
@@ -280,6 +362,10 @@ class MidiHandler {
   static bool factory_testing_requested_;
   
   static const SysExDescription accepted_sysex_[];
+  
+#ifdef TEST
+  static DispatchObserverFn dispatch_observer_;
+#endif  // TEST
    
   DISALLOW_COPY_AND_ASSIGN(MidiHandler);
 };
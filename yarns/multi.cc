@@ -30,8 +30,6 @@
 
 #include <algorithm>
 
-#include "stmlib/algorithms/voice_allocator.h"
-
 #include "yarns/just_intonation_processor.h"
 #include "yarns/midi_handler.h"
 #include "yarns/settings.h"
@@ -60,6 +58,8 @@ void Multi::Init(bool reset_calibration) {
   for (uint8_t i = 0; i < kNumVoices; ++i) {
     voice_[i].Init(reset_calibration);
   }
+  num_used_voices_ = kNumOutputVoices;
+  output_snapshot_.Init();
   running_ = false;
   latched_ = false;
   recording_ = false;
@@ -292,9 +292,24 @@ void Multi::Refresh() {
     }
   }
 
-  for (uint8_t i = 0; i < kNumVoices; ++i) {
+  for (uint8_t i = 0; i < num_used_voices_; ++i) {
     voice_[i].Refresh();
   }
+  PublishOutputs();
+}
+
+void Multi::PublishOutputs() {
+  OutputFrame* frame = output_snapshot_.BeginWrite();
+  GetCvGate(frame->cv, frame->gate);
+  GetLedsBrightness(frame->leds_brightness);
+  frame->num_voices = num_used_voices_;
+  for (uint8_t i = 0; i < num_used_voices_; ++i) {
+    const Voice& voice = voice_[i];
+    frame->voice[i].note_dac_code = voice.note_dac_code();
+    frame->voice[i].velocity = voice.velocity();
+    frame->voice[i].gate = voice.gate();
+  }
+  output_snapshot_.Publish();
 }
 
 void Multi::Set(uint8_t address, uint8_t value) {
@@ -507,6 +522,7 @@ void Multi::UpdateLayout() {
   for (uint8_t i = 0; i < kNumVoices; ++i) {
     voice_[i].NoteOff();
   }
+  num_used_voices_ = kNumOutputVoices;
   
   switch (settings_.layout) {
     case LAYOUT_MONO:
@@ -562,6 +578,31 @@ void Multi::UpdateLayout() {
   }
 }
 
+#ifdef TEST
+void Multi::AllocateParts(
+    uint8_t num_parts,
+    uint8_t num_voices_per_part,
+    bool polychain) {
+  for (uint8_t i = 0; i < kNumParts; ++i) {
+    part_[i].Reset();
+  }
+  for (uint8_t i = 0; i < kNumVoices; ++i) {
+    voice_[i].NoteOff();
+  }
+  for (uint8_t i = 0; i < num_parts; ++i) {
+    part_[i].AllocateVoices(
+        &voice_[i * num_voices_per_part],
+        num_voices_per_part,
+        polychain);
+    part_[i].set_siblings(num_parts > 1);
+  }
+  num_active_parts_ = num_parts;
+  num_used_voices_ = max(
+      static_cast<uint8_t>(num_parts * num_voices_per_part),
+      kNumOutputVoices);
+}
+#endif  // TEST
+
 void Multi::ChangeLayout(Layout old_layout, Layout new_layout) {
   // Reset and close all parts and voices.
   for (uint8_t i = 0; i < kNumParts; ++i) {
@@ -570,6 +611,7 @@ void Multi::ChangeLayout(Layout old_layout, Layout new_layout) {
   for (uint8_t i = 0; i < kNumVoices; ++i) {
     voice_[i].NoteOff();
   }
+  num_used_voices_ = kNumOutputVoices;
   
   switch (new_layout) {
     case LAYOUT_MONO:
@@ -34,13 +34,41 @@
 #include "yarns/internal_clock.h"
 #include "yarns/layout_configurator.h"
 #include "yarns/part.h"
+#include "yarns/snapshot.h"
 #include "yarns/voice.h"
 
 namespace yarns {
 
+// Voices driving the outputs of the module. The layouts only use these.
+const uint8_t kNumOutputVoices = 4;
+
+#ifdef TEST
+const uint8_t kNumParts = 16;
+const uint8_t kNumVoices = 64;
+#else
 const uint8_t kNumParts = 4;
-const uint8_t kNumVoices = 4;
+const uint8_t kNumVoices = kNumOutputVoices;
+#endif  // TEST
 const uint8_t kMaxBarDuration = 32;
+const uint8_t kNumOutputSnapshotSlots = 4;
+
+struct VoiceOutput {
+  uint16_t note_dac_code;
+  uint8_t velocity;
+  bool gate;
+};
+
+// State of the outputs, published by Multi::Refresh().
+struct OutputFrame {
+  uint16_t cv[kNumOutputVoices];
+  bool gate[kNumOutputVoices];
+  uint8_t leds_brightness[kNumVoices];
+  uint8_t num_voices;  // Voices refreshed by the multi, and copied below.
+  VoiceOutput voice[kNumVoices];
+};
+
+typedef Snapshot<OutputFrame, kNumOutputSnapshotSlots> OutputSnapshot;
+typedef SnapshotReader<OutputFrame, kNumOutputSnapshotSlots> OutputReader;
 
 struct MultiSettings {
   uint8_t layout;
@@ -300,7 +328,7 @@ class Multi {
   }
 
   inline void RenderAudio() {
-    for (uint8_t i = 0; i < kNumVoices; ++i) {
+    for (uint8_t i = 0; i < num_used_voices_; ++i) {
       voice_[i].RenderAudio();
     }
   }
@@ -334,6 +362,9 @@ class Multi {
   inline const Part& part(uint8_t index) const { return part_[index]; }
   inline const Voice& voice(uint8_t index) const { return voice_[index]; }
   inline const MultiSettings& settings() const { return settings_; }
+  inline const OutputSnapshot& output_snapshot() const {
+    return output_snapshot_;
+  }
   inline uint8_t num_active_parts() const { return num_active_parts_; }
   
   inline Voice* mutable_voice(uint8_t index) { return &voice_[index]; }
@@ -417,10 +448,20 @@ class Multi {
   }
   
   void StartSong();
+  
+#ifdef TEST
+  // Splits the voices between num_parts parts, instead of using one of the
+  // layouts of the module. The settings of the parts are left unchanged.
+  void AllocateParts(
+      uint8_t num_parts,
+      uint8_t num_voices_per_part,
+      bool polychain);
+#endif  // TEST
 
  private:
   void ChangeLayout(Layout old_layout, Layout new_layout);
   void UpdateLayout();
+  void PublishOutputs();
   void ClockSong();
   void HandleRemoteControlCC(uint8_t controller, uint8_t value);
   
@@ -454,9 +495,12 @@ class Multi {
   bool dirty_;
   
   uint8_t num_active_parts_;
+  uint8_t num_used_voices_;
   
   Part part_[kNumParts];
   Voice voice_[kNumVoices];
+  
+  OutputSnapshot output_snapshot_;
 
   LayoutConfigurator layout_configurator_;
   
@@ -467,6 +511,15 @@ class Multi {
   DISALLOW_COPY_AND_ASSIGN(Multi);
 };
 
+// Size of the data written by Multi::Serialize() and
+// Multi::SerializeCalibration(), and of a buffer large enough for both.
+const size_t kMultiDataSize = sizeof(MultiSettings) + kNumParts * (
+    sizeof(MidiSettings) + sizeof(VoicingSettings) + sizeof(SequencerSettings));
+const size_t kCalibrationDataSize = kNumVoices * kNumOctaves * sizeof(uint16_t);
+const size_t kSerializationBufferSize = kMultiDataSize > kCalibrationDataSize
+    ? kMultiDataSize
+    : kCalibrationDataSize;
+
 extern Multi multi;
 
 }  // namespace yarns
@@ -53,10 +53,7 @@ void Part::Init() {
   mono_allocator_.Init();
   poly_allocator_.Init();
   generated_notes_.Init();
-  std::fill(
-      &active_note_[0],
-      &active_note_[kMaxNumVoices],
-      VOICE_ALLOCATION_NOT_FOUND);
+  ClearActiveNotes();
   num_voices_ = 0;
   polychained_ = false;
   ignore_note_off_messages_ = false;
@@ -458,10 +455,7 @@ void Part::AllNotesOff() {
   for (uint8_t i = 0; i < num_voices_; ++i) {
     voice_[i]->NoteOff();
   }
-  std::fill(
-      &active_note_[0],
-      &active_note_[kMaxNumVoices],
-      VOICE_ALLOCATION_NOT_FOUND);
+  ClearActiveNotes();
   release_latched_keys_on_next_note_on_ = false;
   ignore_note_off_messages_ = false;
 }
@@ -490,10 +484,10 @@ void Part::DispatchSortedNotes(bool unison) {
           mono_allocator_.sorted_note(index).velocity,
           voicing_.portamento,
           !voice_[i]->gate_on());
-      active_note_[i] = mono_allocator_.sorted_note(index).note;
+      set_active_note(i, mono_allocator_.sorted_note(index).note);
     } else {
       voice_[i]->NoteOff();
-      active_note_[i] = VOICE_ALLOCATION_NOT_FOUND;
+      set_active_note(i, VOICE_ALLOCATION_NOT_FOUND);
     }
   }
 }
@@ -566,7 +560,7 @@ void Part::InternalNoteOn(uint8_t note, uint8_t velocity) {
           velocity,
           voicing_.portamento,
           true);
-      active_note_[voice_index] = note;
+      set_active_note(voice_index, note);
     } else {
       // Polychaining forwarding.
       midi_handler.OnInternalNoteOn(tx_channel(), note, velocity);
@@ -579,13 +573,55 @@ void Part::KillAllInstancesOfNote(uint8_t note) {
     uint8_t index = FindVoiceForNote(note);
     if (index != VOICE_ALLOCATION_NOT_FOUND) {
       voice_[index]->NoteOff();
-      active_note_[index] = VOICE_ALLOCATION_NOT_FOUND;
+      set_active_note(index, VOICE_ALLOCATION_NOT_FOUND);
     } else {
       break;
     }
   }
 }
 
+void Part::set_active_note(uint8_t voice, uint8_t note) {
+#ifdef TEST
+  uint8_t previous_note = active_note_[voice];
+  if (previous_note == note) {
+    return;
+  }
+  
+  // Unlink the voice from the voices playing its previous note...
+  if (previous_note != VOICE_ALLOCATION_NOT_FOUND) {
+    uint8_t* link = &first_voice_for_note_[previous_note];
+    while (*link != voice) {
+      link = &next_voice_for_note_[*link];
+    }
+    *link = next_voice_for_note_[voice];
+  }
+  
+  // ...and insert it, in order, in the voices playing the new note.
+  if (note != VOICE_ALLOCATION_NOT_FOUND) {
+    uint8_t* link = &first_voice_for_note_[note];
+    while (*link < voice) {
+      link = &next_voice_for_note_[*link];
+    }
+    next_voice_for_note_[voice] = *link;
+    *link = voice;
+  }
+#endif  // TEST
+  active_note_[voice] = note;
+}
+
+void Part::ClearActiveNotes() {
+  std::fill(
+      &active_note_[0],
+      &active_note_[kMaxNumVoices],
+      VOICE_ALLOCATION_NOT_FOUND);
+#ifdef TEST
+  std::fill(
+      &first_voice_for_note_[0],
+      &first_voice_for_note_[128],
+      VOICE_ALLOCATION_NOT_FOUND);
+#endif  // TEST
+}
+
 void Part::InternalNoteOff(uint8_t note) {
   if (midi_.out_mode == MIDI_OUT_MODE_GENERATED_EVENTS && !polychained_) {
     midi_handler.OnInternalNoteOff(tx_channel(), note);
@@ -632,7 +668,7 @@ void Part::InternalNoteOff(uint8_t note) {
         FindVoiceForNote(note);
     if (voice_index < num_voices_) {
       voice_[voice_index]->NoteOff();
-      active_note_[voice_index] = VOICE_ALLOCATION_NOT_FOUND;
+      set_active_note(voice_index, VOICE_ALLOCATION_NOT_FOUND);
     } else {
        midi_handler.OnInternalNoteOff(tx_channel(), note);
     }
@@ -32,15 +32,28 @@
 #include <algorithm>
 
 #include "stmlib/stmlib.h"
-#include "stmlib/algorithms/voice_allocator.h"
 #include "stmlib/algorithms/note_stack.h"
 
+#ifdef TEST
+#include "yarns/voice_allocator.h"
+#else
+#include "stmlib/algorithms/voice_allocator.h"
+#endif  // TEST
+
 namespace yarns {
 
 class Voice;
 
 const uint8_t kNumSteps = 64;
+
+#ifdef TEST
+// Host builds can drive many more voices than the module has outputs.
+const uint8_t kMaxNumVoices = 64;
+const uint8_t kNoteStackSize = 64;
+#else
 const uint8_t kMaxNumVoices = 4;
+const uint8_t kNoteStackSize = 12;
+#endif  // TEST
 
 enum ArpeggiatorDirection {
   ARPEGGIATOR_DIRECTION_UP,
@@ -306,13 +319,20 @@ class Part {
     return midi_.out_mode == MIDI_OUT_MODE_THRU && !polychained_;
   }
   
+  // When several voices play the note, returns the one with the lowest
+  // index.
   inline uint8_t FindVoiceForNote(uint8_t note) const {
+#ifdef TEST
+    return note < 128 ? first_voice_for_note_[note] : \
+        VOICE_ALLOCATION_NOT_FOUND;
+#else
     for (uint8_t i = 0; i < num_voices_; ++i) {
       if (active_note_[i] == note) {
         return i;
       }
     }
     return VOICE_ALLOCATION_NOT_FOUND;
+#endif  // TEST
   }
   
   void Set(uint8_t address, uint8_t value);
@@ -370,6 +390,8 @@ class Part {
   void ReleaseLatchedNotes();
   void DispatchSortedNotes(bool unison);
   void KillAllInstancesOfNote(uint8_t note);
+  void set_active_note(uint8_t voice, uint8_t note);
+  void ClearActiveNotes();
   
   void ClockSequencer();
   void ClockArpeggiator();
@@ -387,11 +409,25 @@ class Part {
   bool ignore_note_off_messages_;
   bool release_latched_keys_on_next_note_on_;
   
-  stmlib::NoteStack<12> pressed_keys_;
-  stmlib::NoteStack<12> generated_notes_;  // by sequencer or arpeggiator.
-  stmlib::NoteStack<12> mono_allocator_;
+  stmlib::NoteStack<kNoteStackSize> pressed_keys_;
+  // by sequencer or arpeggiator.
+  stmlib::NoteStack<kNoteStackSize> generated_notes_;
+  stmlib::NoteStack<kNoteStackSize> mono_allocator_;
+#ifdef TEST
+  // With up to 64 voices, the host builds look up the voices playing a note
+  // in tables rather than by scanning them. The module keeps the stmlib
+  // allocator and the scan, which are smaller and fast enough for 4 voices.
+  VoiceAllocator<kMaxNumVoices * 2> poly_allocator_;
+#else
   stmlib::VoiceAllocator<kMaxNumVoices * 2> poly_allocator_;
+#endif  // TEST
   uint8_t active_note_[kMaxNumVoices];
+  
+#ifdef TEST
+  // The voices playing each note, linked by increasing index.
+  uint8_t first_voice_for_note_[128];
+  uint8_t next_voice_for_note_[kMaxNumVoices];
+#endif  // TEST
   uint8_t cyclic_allocation_note_counter_;
   
   uint8_t arp_seq_prescaler_;
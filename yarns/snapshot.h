@@ -0,0 +1,179 @@
+// Copyright 2013 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Versioned snapshot of a frame of data, published by one writer (an
+// interrupt, or a thread on the host) and read by any number of readers
+// without locks.
+//
+// The writer fills the frames of a ring of slots in turn, and each slot has a
+// sequence number which is odd while the slot is being written. A reader
+// copies the slot of the latest version, and checks that its sequence number
+// has not changed during the copy. This only fails if the writer has gone
+// around the whole ring while the reader was copying - the reader does not
+// wait or retry, it keeps its previous frame and counts it as late. Each
+// reader also counts the versions it has skipped.
+//
+// The GCC __atomic builtins are used instead of std::atomic, so that this
+// also builds for the firmware.
+
+#ifndef YARNS_SNAPSHOT_H_
+#define YARNS_SNAPSHOT_H_
+
+#include "stmlib/stmlib.h"
+
+#include <cstring>
+
+namespace yarns {
+
+template<typename Frame, uint8_t num_slots>
+class SnapshotReader;
+
+// num_slots must be a power of 2. Frame must be copyable with memcpy.
+template<typename Frame, uint8_t num_slots>
+class Snapshot {
+ public:
+  Snapshot() { }
+  ~Snapshot() { }
+
+  void Init() {
+    version_ = 0;
+    published_version_ = 0;
+    for (uint8_t i = 0; i < num_slots; ++i) {
+      slot_[i].sequence = 0;
+      memset(&slot_[i].frame, 0, sizeof(Frame));
+    }
+  }
+
+  // The frame to fill for the next version. It is not visible to the readers
+  // until Publish() is called.
+  Frame* BeginWrite() {
+    Slot* slot = &slot_[(version_ + 1) & (num_slots - 1)];
+    __atomic_store_n(
+        &slot->sequence,
+        2 * (version_ + 1) - 1,
+        __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return &slot->frame;
+  }
+
+  void Publish() {
+    ++version_;
+    Slot* slot = &slot_[version_ & (num_slots - 1)];
+    __atomic_store_n(&slot->sequence, 2 * version_, __ATOMIC_RELEASE);
+    __atomic_store_n(&published_version_, version_, __ATOMIC_RELEASE);
+  }
+
+  // Version of the latest frame published, 0 if none has been.
+  inline uint32_t version() const {
+    return __atomic_load_n(&published_version_, __ATOMIC_ACQUIRE);
+  }
+
+ private:
+  friend class SnapshotReader<Frame, num_slots>;
+
+  struct Slot {
+    uint32_t sequence;
+    Frame frame;
+  };
+
+  // Only touched by the writer.
+  uint32_t version_;
+
+  uint32_t published_version_;
+  Slot slot_[num_slots];
+
+  DISALLOW_COPY_AND_ASSIGN(Snapshot);
+};
+
+template<typename Frame, uint8_t num_slots>
+class SnapshotReader {
+ public:
+  SnapshotReader() { }
+  ~SnapshotReader() { }
+
+  void Init(const Snapshot<Frame, num_slots>* snapshot) {
+    snapshot_ = snapshot;
+    version_ = 0;
+    num_dropped_frames_ = 0;
+    num_late_frames_ = 0;
+    memset(&frame_[0], 0, sizeof(Frame));
+    current_frame_ = 0;
+  }
+
+  // Copies the latest frame, if it is newer than the one already read.
+  // Returns true if frame() has changed. Never waits.
+  bool Read() {
+    uint32_t version = snapshot_->version();
+    if (version == version_) {
+      return false;
+    }
+    const typename Snapshot<Frame, num_slots>::Slot& slot = \
+        snapshot_->slot_[version & (num_slots - 1)];
+    uint32_t sequence = __atomic_load_n(&slot.sequence, __ATOMIC_ACQUIRE);
+    
+    // Copy to the other frame, so that the current one is kept if the copy
+    // fails.
+    Frame* frame = &frame_[current_frame_ ^ 1];
+    memcpy(frame, &slot.frame, sizeof(Frame));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (sequence != 2 * version ||
+        __atomic_load_n(&slot.sequence, __ATOMIC_RELAXED) != sequence) {
+      ++num_late_frames_;
+      return false;
+    }
+    if (version_ && version - version_ > 1) {
+      num_dropped_frames_ += version - version_ - 1;
+    }
+    version_ = version;
+    current_frame_ ^= 1;
+    return true;
+  }
+
+  inline const Frame& frame() const { return frame_[current_frame_]; }
+  inline uint32_t version() const { return version_; }
+
+  // Versions published and never read, because a newer one had already been
+  // published when Read() was called.
+  inline uint32_t num_dropped_frames() const { return num_dropped_frames_; }
+
+  // Reads which have failed because the writer has overwritten the frame
+  // while it was being copied.
+  inline uint32_t num_late_frames() const { return num_late_frames_; }
+
+ private:
+  const Snapshot<Frame, num_slots>* snapshot_;
+  uint32_t version_;
+  uint32_t num_dropped_frames_;
+  uint32_t num_late_frames_;
+  Frame frame_[2];
+  uint8_t current_frame_;
+
+  DISALLOW_COPY_AND_ASSIGN(SnapshotReader);
+};
+
+}  // namespace yarns
+
+#endif  // YARNS_SNAPSHOT_H_
@@ -34,12 +34,14 @@
 namespace yarns {
 
 void StorageManager::SaveMulti(uint8_t slot) {
+  AbortReception();
   stream_buffer_.Rewind();
   multi.Serialize(&stream_buffer_);
   storage_.Save(stream_buffer_.bytes(), stream_buffer_.position(), 1 + slot);
 }
 
 bool StorageManager::LoadMulti(uint8_t slot) {
+  AbortReception();
   // Dummy serialization of the multi to know its size.
   stream_buffer_.Rewind();
   multi.Serialize(&stream_buffer_);
@@ -54,12 +56,14 @@ bool StorageManager::LoadMulti(uint8_t slot) {
 }
 
 void StorageManager::SaveCalibration() {
+  AbortReception();
   stream_buffer_.Rewind();
   multi.SerializeCalibration(&stream_buffer_);
   storage_.Save(stream_buffer_.bytes(), stream_buffer_.position(), 0);
 }
 
 bool StorageManager::LoadCalibration() {
+  AbortReception();
   stream_buffer_.Rewind();
   multi.SerializeCalibration(&stream_buffer_);
   uint32_t expected_size = stream_buffer_.position();
@@ -74,6 +78,7 @@ bool StorageManager::LoadCalibration() {
 }
 
 void StorageManager::SysExSendMulti() {
+  AbortReception();
   stream_buffer_.Rewind();
   multi.Serialize(&stream_buffer_);
   midi_handler.SysExSendPackets(
@@ -82,10 +87,46 @@ void StorageManager::SysExSendMulti() {
 }
 
 void StorageManager::DeserializeMulti() {
+  AbortReception();
   stream_buffer_.Rewind();
   multi.Deserialize(&stream_buffer_);
 }
 
+uint8_t* StorageManager::BeginReception(uint8_t destination, size_t size) {
+  AbortReception();
+  if (destination >= RECEPTION_DESTINATION_SLOT + kNumMultiSlots) {
+    return NULL;
+  }
+  
+  // Dummy serialization of the multi to know its size.
+  stream_buffer_.Rewind();
+  multi.Serialize(&stream_buffer_);
+  if (size != stream_buffer_.position()) {
+    return NULL;
+  }
+  receiving_ = true;
+  reception_destination_ = destination;
+  reception_size_ = size;
+  return stream_buffer_.mutable_bytes();
+}
+
+void StorageManager::AbortReception() {
+  if (receiving_) {
+    receiving_ = false;
+    midi_handler.AbortSysExStream();
+  }
+}
+
+void StorageManager::CommitReception() {
+  receiving_ = false;
+  if (reception_destination_ == RECEPTION_DESTINATION_MULTI) {
+    DeserializeMulti();
+  } else {
+    uint8_t slot = reception_destination_ - RECEPTION_DESTINATION_SLOT;
+    storage_.Save(stream_buffer_.bytes(), reception_size_, 1 + slot);
+  }
+}
+
 /* extern */
 StorageManager storage_manager;
 
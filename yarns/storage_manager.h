@@ -34,10 +34,64 @@
 #include "stmlib/stmlib.h"
 
 #include "stmlib/utils/stream_buffer.h"
+#ifndef TEST
 #include "stmlib/system/storage.h"
+#endif  // TEST
+
+#include "yarns/multi.h"
 
 namespace yarns {
 
+const uint8_t kNumMultiSlots = 8;
+
+// Destinations of streamed SysEx transfers.
+enum ReceptionDestination {
+  RECEPTION_DESTINATION_MULTI,
+  RECEPTION_DESTINATION_SLOT,  // + slot index.
+};
+
+#ifdef TEST
+
+// Flash storage, in RAM, for the host builds.
+template<uint16_t num_pages>
+class RamStorage {
+ public:
+  RamStorage() { }
+  ~RamStorage() { }
+  
+  void Init() {
+    std::fill(&size_[0], &size_[num_pages], 0);
+    num_saves_ = 0;
+  }
+  
+  void Save(const uint8_t* data, size_t size, uint16_t page) {
+    std::copy(&data[0], &data[size], &data_[page][0]);
+    size_[page] = size;
+    ++num_saves_;
+  }
+  
+  bool Load(uint8_t* data, size_t size, uint16_t page) {
+    if (size != size_[page]) {
+      return false;
+    }
+    std::copy(&data_[page][0], &data_[page][size], &data[0]);
+    return true;
+  }
+  
+  inline const uint8_t* data(uint16_t page) const { return data_[page]; }
+  inline size_t size(uint16_t page) const { return size_[page]; }
+  inline uint32_t num_saves() const { return num_saves_; }
+  
+ private:
+  uint8_t data_[num_pages][kSerializationBufferSize];
+  size_t size_[num_pages];
+  uint32_t num_saves_;
+  
+  DISALLOW_COPY_AND_ASSIGN(RamStorage);
+};
+
+#endif  // TEST
+
 class StorageManager {
  public:
   StorageManager() { }
@@ -50,17 +104,47 @@ class StorageManager {
   void SysExSendMulti();
   
   void AppendData(const uint8_t* data, size_t size, bool rewind) {
+    AbortReception();
     if (rewind) {
       stream_buffer_.Rewind();
     }
-    stream_buffer_.Write(data, size);
+    // Ignore the packets of dumps larger than a multi.
+    if (stream_buffer_.position() + size <= kSerializationBufferSize) {
+      stream_buffer_.Write(data, size);
+    }
   }
   
   void DeserializeMulti();
+  
+  // Streamed SysEx transfers are decoded directly into the buffer used for
+  // serialization. Returns NULL if the destination does not exist, or if
+  // size does not match the size of its data. Any other use of the buffer
+  // before CommitReception() aborts the transfer, which the sender then
+  // has to start again.
+  uint8_t* BeginReception(uint8_t destination, size_t size);
+  void CommitReception();
+  
+  inline bool receiving() const { return receiving_; }
+
+#ifdef TEST
+  inline RamStorage<1 + kNumMultiSlots>* mutable_storage() {
+    return &storage_;
+  }
+#endif  // TEST
 
  private:
-  stmlib::StreamBuffer<1024> stream_buffer_;
-  stmlib::Storage<0x8020000, 9> storage_;
+  void AbortReception();
+  
+  stmlib::StreamBuffer<kSerializationBufferSize> stream_buffer_;
+#ifdef TEST
+  RamStorage<1 + kNumMultiSlots> storage_;
+#else
+  stmlib::Storage<0x8020000, 1 + kNumMultiSlots> storage_;
+#endif  // TEST
+  
+  bool receiving_;
+  uint8_t reception_destination_;
+  size_t reception_size_;
   
   DISALLOW_COPY_AND_ASSIGN(StorageManager);
 };
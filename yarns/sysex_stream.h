@@ -0,0 +1,417 @@
+// Copyright 2013 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Streamed SysEx transfers.
+//
+// A transfer starts with a BEGIN message giving the destination and the size
+// of the data, followed by DATA messages carrying chunks of up to
+// kSysExStreamChunkSize bytes, packed 7 bytes in 8 (the first byte of each
+// group of 8 holds the MSBs of the 7 following bytes). Each chunk has a 7-bit
+// sequence number and a Fletcher-16 checksum, sent in the header of the
+// message so that the payload can be decoded into the destination as it is
+// received, without buffering the message.
+//
+// The receiver acknowledges the BEGIN message and each chunk. The sender
+// waits for the acknowledgement of the BEGIN message, then keeps up to
+// kSysExStreamWindowSize chunks in flight, and goes back to the
+// chunk expected by the receiver when it receives an error. The receiver only
+// reports the first of a series of chunks received out of sequence, so that
+// the sender does not rewind once for each chunk which was in flight.
+//
+// The module echoes the SysEx messages it receives on its MIDI output, where
+// the acknowledgements are sent too. The sender must leave the time of
+// kSysExStreamGapSize bytes after each message, otherwise the output of the
+// module falls behind its input, and its output buffer overflows.
+//
+// Message layouts, after the 6 bytes of the yarns SysEx prefix:
+//
+// BEGIN  [command][destination][size (3 x 7 bits)] f7
+// DATA   [command][sequence][checksum (3 x 7 bits)][packed payload] f7
+// ACK    [command][next expected sequence][status] f7
+
+#ifndef YARNS_SYSEX_STREAM_H_
+#define YARNS_SYSEX_STREAM_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+
+namespace yarns {
+
+const size_t kSysExStreamChunkSize = 256;
+const size_t kSysExStreamWindowSize = 8;
+const size_t kSysExStreamPrefixSize = 6;
+const size_t kSysExStreamBeginSize = kSysExStreamPrefixSize + 1 + 1 + 3 + 1;
+const size_t kSysExStreamDataHeaderSize = kSysExStreamPrefixSize + 1 + 1 + 3;
+const size_t kSysExStreamAckSize = kSysExStreamPrefixSize + 1 + 1 + 1 + 1;
+const size_t kSysExStreamGapSize = kSysExStreamAckSize;
+const size_t kSysExStreamMaxMessageSize = kSysExStreamDataHeaderSize + \
+    (kSysExStreamChunkSize + 6) / 7 * 8 + 1;
+
+const uint8_t kSysExStreamPrefix[kSysExStreamPrefixSize] = {
+  0xf0, 0x00, 0x21, 0x02, 0x00, 0x0b
+};
+
+enum SysExStreamCommand {
+  SYSEX_COMMAND_STREAM_BEGIN = 2,
+  SYSEX_COMMAND_STREAM_DATA = 3,
+  SYSEX_COMMAND_STREAM_ACK = 4
+};
+
+enum SysExStreamStatus {
+  SYSEX_STREAM_OK,
+  SYSEX_STREAM_STARTED,
+  SYSEX_STREAM_DONE,
+  SYSEX_STREAM_REJECTED,
+  SYSEX_STREAM_NOT_STARTED,
+  SYSEX_STREAM_OUT_OF_SEQUENCE,
+  SYSEX_STREAM_CHECKSUM_ERROR,
+  SYSEX_STREAM_SIZE_ERROR,
+  SYSEX_STREAM_IGNORED  // Not acknowledged.
+};
+
+class Fletcher16 {
+ public:
+  inline void Init() {
+    a_ = b_ = 0;
+  }
+
+  inline void Update(uint8_t byte) {
+    a_ += byte;
+    b_ += a_;
+  }
+
+  inline uint16_t value() const { return (b_ << 8) | a_; }
+
+ private:
+  uint8_t a_;
+  uint8_t b_;
+};
+
+// Sizes and checksums are sent as 3 bytes of 7 bits, MSB first.
+inline uint8_t* Write21Bits(uint32_t value, uint8_t* destination) {
+  *destination++ = (value >> 14) & 0x7f;
+  *destination++ = (value >> 7) & 0x7f;
+  *destination++ = value & 0x7f;
+  return destination;
+}
+
+inline uint32_t Read21Bits(const uint8_t* source) {
+  return (static_cast<uint32_t>(source[0]) << 14) | \
+      (source[1] << 7) | source[2];
+}
+
+class SysExStreamReceiver {
+ public:
+  SysExStreamReceiver() { }
+  ~SysExStreamReceiver() { }
+
+  void Init() {
+    destination_ = NULL;
+    accepted_ = false;
+    nak_sent_ = false;
+  }
+
+  void Start(uint8_t* destination, size_t size) {
+    destination_ = destination;
+    expected_size_ = size;
+    size_ = 0;
+    next_chunk_ = 0;
+    accepted_ = false;
+    nak_sent_ = false;
+  }
+
+  // Also drops the rest of the chunk being received, if any.
+  void Abort() {
+    destination_ = NULL;
+    accepted_ = false;
+  }
+
+  // Called once the header of a DATA message has been received.
+  void StartChunk(uint8_t sequence, uint16_t checksum) {
+    accepted_ = destination_ && sequence == next_sequence();
+    expected_checksum_ = checksum;
+    checksum_.Init();
+    chunk_size_ = 0;
+    group_position_ = 0;
+    overflow_ = false;
+  }
+
+  // Unpacks and stores a byte of the payload.
+  inline void Write(uint8_t byte) {
+    if (!accepted_) {
+      return;
+    }
+    if (group_position_ == 0) {
+      msbs_ = byte;
+      group_position_ = 1;
+      return;
+    }
+    byte |= (msbs_ << (8 - group_position_)) & 0x80;
+    group_position_ = group_position_ == 7 ? 0 : group_position_ + 1;
+    if (chunk_size_ < kSysExStreamChunkSize &&
+        size_ + chunk_size_ < expected_size_) {
+      destination_[size_ + chunk_size_++] = byte;
+      checksum_.Update(byte);
+    } else {
+      overflow_ = true;
+    }
+  }
+
+  // Called at the end of the DATA message. A chunk is rejected if it is not
+  // the one expected, if its checksum does not match, or if it is shorter
+  // than kSysExStreamChunkSize without being the last one. Chunks received
+  // again after the end of the transfer (because the last acknowledgement has
+  // been lost) are acknowledged with SYSEX_STREAM_DONE again, and chunks
+  // received while no transfer is open with SYSEX_STREAM_NOT_STARTED.
+  SysExStreamStatus EndChunk() {
+    bool accepted = accepted_;
+    accepted_ = false;
+    if (!accepted) {
+      if (complete()) {
+        return SYSEX_STREAM_DONE;
+      } else if (!destination_) {
+        return SYSEX_STREAM_NOT_STARTED;
+      } else if (nak_sent_) {
+        return SYSEX_STREAM_IGNORED;
+      }
+      nak_sent_ = true;
+      return SYSEX_STREAM_OUT_OF_SEQUENCE;
+    }
+    
+    // Errors on the expected chunk are always reported: this chunk was
+    // either the first one in error, or a retransmission.
+    nak_sent_ = true;
+    if (checksum_.value() != expected_checksum_) {
+      return SYSEX_STREAM_CHECKSUM_ERROR;
+    } else if (overflow_ || group_position_ == 1 ||
+               chunk_size_ != std::min(
+                   kSysExStreamChunkSize, expected_size_ - size_)) {
+      return SYSEX_STREAM_SIZE_ERROR;
+    }
+    nak_sent_ = false;
+    size_ += chunk_size_;
+    ++next_chunk_;
+    return complete() ? SYSEX_STREAM_DONE : SYSEX_STREAM_OK;
+  }
+
+  inline bool complete() const {
+    return destination_ && size_ == expected_size_;
+  }
+  inline size_t size() const { return size_; }
+  inline uint8_t next_sequence() const { return next_chunk_ & 0x7f; }
+
+  // Writes an acknowledgement message, and returns its size.
+  size_t WriteAck(SysExStreamStatus status, uint8_t* message) const {
+    std::copy(
+        &kSysExStreamPrefix[0],
+        &kSysExStreamPrefix[kSysExStreamPrefixSize],
+        message);
+    message += kSysExStreamPrefixSize;
+    *message++ = SYSEX_COMMAND_STREAM_ACK;
+    *message++ = next_sequence();
+    *message++ = status;
+    *message++ = 0xf7;
+    return kSysExStreamAckSize;
+  }
+
+ private:
+  uint8_t* destination_;
+  size_t expected_size_;
+  size_t size_;
+  uint16_t next_chunk_;
+
+  Fletcher16 checksum_;
+  uint16_t expected_checksum_;
+  size_t chunk_size_;
+  uint8_t msbs_;
+  uint8_t group_position_;
+  bool accepted_;
+  bool overflow_;
+  bool nak_sent_;
+
+  DISALLOW_COPY_AND_ASSIGN(SysExStreamReceiver);
+};
+
+// Sending side, for a librarian. Message 0 is the BEGIN message, message
+// i > 0 carries chunk i - 1.
+class SysExStreamSender {
+ public:
+  SysExStreamSender() { }
+  ~SysExStreamSender() { }
+
+  void Init(uint8_t destination, const uint8_t* data, size_t size) {
+    destination_ = destination;
+    data_ = data;
+    size_ = size;
+    num_chunks_ = (size + kSysExStreamChunkSize - 1) / kSysExStreamChunkSize;
+    base_ = 0;
+    next_ = 0;
+    done_ = false;
+    failed_ = false;
+    num_retransmissions_ = 0;
+  }
+
+  // Writes the next message to send, and returns its size - or 0 if the
+  // window is full, if the BEGIN message has not been acknowledged yet, or if
+  // all chunks have been sent. message must hold kSysExStreamMaxMessageSize
+  // bytes.
+  size_t NextMessage(uint8_t* message) {
+    if (done_ || failed_ || next_ > num_chunks_ ||
+        (next_ && !base_) ||
+        next_ >= base_ + kSysExStreamWindowSize) {
+      return 0;
+    }
+    uint8_t* start = message;
+    message = std::copy(
+        &kSysExStreamPrefix[0],
+        &kSysExStreamPrefix[kSysExStreamPrefixSize],
+        message);
+    if (next_ == 0) {
+      *message++ = SYSEX_COMMAND_STREAM_BEGIN;
+      *message++ = destination_;
+      message = Write21Bits(size_, message);
+    } else {
+      size_t offset = (next_ - 1) * kSysExStreamChunkSize;
+      size_t size = std::min(kSysExStreamChunkSize, size_ - offset);
+      const uint8_t* data = &data_[offset];
+      Fletcher16 checksum;
+      checksum.Init();
+      for (size_t i = 0; i < size; ++i) {
+        checksum.Update(data[i]);
+      }
+      *message++ = SYSEX_COMMAND_STREAM_DATA;
+      *message++ = (next_ - 1) & 0x7f;
+      message = Write21Bits(checksum.value(), message);
+      for (size_t i = 0; i < size; i += 7) {
+        size_t group_size = std::min(size - i, static_cast<size_t>(7));
+        uint8_t* msbs = message++;
+        *msbs = 0;
+        for (size_t j = 0; j < group_size; ++j) {
+          *msbs |= (data[i + j] >> 7) << j;
+          *message++ = data[i + j] & 0x7f;
+        }
+      }
+    }
+    *message++ = 0xf7;
+    ++next_;
+    return message - start;
+  }
+
+  // Processes a message received from the module. Returns false if it is not
+  // an acknowledgement.
+  bool ProcessAck(const uint8_t* message, size_t size) {
+    if (size != kSysExStreamAckSize ||
+        !std::equal(
+            &kSysExStreamPrefix[0],
+            &kSysExStreamPrefix[kSysExStreamPrefixSize],
+            message) ||
+        message[kSysExStreamPrefixSize] != SYSEX_COMMAND_STREAM_ACK) {
+      return false;
+    }
+    uint8_t sequence = message[kSysExStreamPrefixSize + 1];
+    uint8_t status = message[kSysExStreamPrefixSize + 2];
+
+    // Chunk expected by the receiver, among those which have been sent.
+    uint32_t oldest = base_ ? base_ - 1 : 0;
+    uint32_t expected = oldest + ((sequence - oldest) & 0x7f);
+    switch (status) {
+      case SYSEX_STREAM_STARTED:
+        base_ = std::max(base_, static_cast<uint32_t>(1));
+        break;
+
+      case SYSEX_STREAM_OK:
+        Acknowledge(expected);
+        break;
+
+      case SYSEX_STREAM_DONE:
+        base_ = next_;
+        done_ = true;
+        break;
+
+      case SYSEX_STREAM_REJECTED:
+        failed_ = true;
+        break;
+
+      case SYSEX_STREAM_NOT_STARTED:
+        // Start again, unless the BEGIN message is already on its way.
+        if (base_) {
+          Rewind(0);
+        }
+        break;
+
+      default:
+        Acknowledge(expected);
+        if (expected + 1 < next_) {
+          Rewind(expected + 1);
+        }
+        break;
+    }
+    return true;
+  }
+
+  // No acknowledgement received for a while: sends again all the messages
+  // which have not been acknowledged.
+  void Timeout() {
+    Rewind(base_);
+  }
+
+  inline bool done() const { return done_; }
+  inline bool failed() const { return failed_; }
+  inline uint32_t num_retransmissions() const { return num_retransmissions_; }
+
+ private:
+  // The receiver has all the chunks before expected - including when the
+  // sender has gone back to an earlier one after a timeout.
+  void Acknowledge(uint32_t expected) {
+    if (expected < num_chunks_ && expected + 1 > base_) {
+      base_ = expected + 1;
+      next_ = std::max(next_, base_);
+    }
+  }
+
+  void Rewind(uint32_t message) {
+    base_ = message;
+    num_retransmissions_ += next_ - message;
+    next_ = message;
+  }
+
+  uint8_t destination_;
+  const uint8_t* data_;
+  size_t size_;
+  uint32_t num_chunks_;
+  uint32_t base_;  // Oldest message not acknowledged.
+  uint32_t next_;  // Next message to send.
+  bool done_;
+  bool failed_;
+  uint32_t num_retransmissions_;
+
+  DISALLOW_COPY_AND_ASSIGN(SysExStreamSender);
+};
+
+}  // namespace yarns
+
+#endif  // YARNS_SYSEX_STREAM_H_
@@ -0,0 +1,205 @@
+// Copyright 2013 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Runs the multi on the host, against a virtual clock, as fast as possible.
+//
+// The interrupts of yarns.cc are replayed in a loop running at the rate of
+// the internal clock (48kHz): each sample refreshes the internal clock and
+// runs the part of the main loop processing the MIDI input and clock ticks,
+// and every 6th sample runs the 8kHz SysTick handler, which refreshes the
+// voices. The CV and gate of the voices, and the MIDI output, are compared
+// with their previous values at each SysTick, and their changes are recorded
+// as events timestamped in samples. As on the module, gates are written one
+// SysTick after the CV. The outputs are read from the snapshot published by
+// the multi, as the DAC writer does.
+//
+// Audio-rate voices (audio_mode) are not rendered.
+
+#ifndef YARNS_TEST_MULTI_SIMULATOR_H_
+#define YARNS_TEST_MULTI_SIMULATOR_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "yarns/midi_handler.h"
+#include "yarns/multi.h"
+
+namespace yarns {
+
+const uint32_t kSimulatorSampleRate = 48000;
+const uint32_t kSimulatorSamplesPerTick = 6;
+
+enum SimulatorEventType {
+  SIMULATOR_EVENT_CV,
+  SIMULATOR_EVENT_GATE,
+  SIMULATOR_EVENT_MIDI_OUT
+};
+
+struct SimulatorEvent {
+  uint32_t time;  // In samples, since Init().
+  uint8_t type;
+  uint8_t voice;  // Not used for MIDI output.
+  uint16_t value;  // DAC code, gate state, or MIDI byte.
+};
+
+class MultiSimulator {
+ public:
+  MultiSimulator() { }
+  ~MultiSimulator() { }
+
+  // Records the outputs of the first num_voices voices of the multi.
+  void Init(uint8_t num_voices) {
+    num_voices_ = num_voices;
+    output_reader_.Init(&multi.output_snapshot());
+    time_ = 0;
+    tick_phase_ = 0;
+    input_.clear();
+    input_position_ = 0;
+    // Force the recording of the initial state at the first SysTick.
+    std::fill(&cv_[0], &cv_[kNumVoices], 0xffff);
+    std::fill(&gate_[0], &gate_[kNumVoices], false);
+    std::fill(&written_gate_[0], &written_gate_[kNumVoices], true);
+  }
+
+  // Schedules MIDI input. The times must not decrease from one call to the
+  // next, and must not be in the past.
+  void PushMidi(uint32_t time, const uint8_t* data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+      TimedByte b = { time, data[i] };
+      input_.push_back(b);
+    }
+  }
+
+  inline void PushMidi(uint32_t time, uint8_t a, uint8_t b, uint8_t c) {
+    uint8_t data[3] = { a, b, c };
+    PushMidi(time, data, 3);
+  }
+
+  // Advances the virtual clock by num_samples, appending the changes of the
+  // outputs to events.
+  void Run(uint32_t num_samples, std::vector<SimulatorEvent>* events) {
+    for (uint32_t i = 0; i < num_samples; ++i) {
+      // TIM1 interrupt, for DAC channel 0.
+      multi.RefreshInternalClock();
+
+      // Main loop.
+      if (input_position_ < input_.size() &&
+          input_[input_position_].time <= time_) {
+        do {
+          midi_handler.PushByte(input_[input_position_++].data);
+        } while (input_position_ < input_.size() &&
+                 input_[input_position_].time <= time_);
+        midi_handler.ProcessInput();
+      }
+      multi.ProcessInternalClockEvents();
+
+      if (++tick_phase_ == kSimulatorSamplesPerTick) {
+        tick_phase_ = 0;
+        Tick(events);
+      }
+      ++time_;
+    }
+
+    if (input_position_ == input_.size()) {
+      input_.clear();
+      input_position_ = 0;
+    }
+  }
+
+  inline uint32_t time() const { return time_; }
+
+ private:
+  struct TimedByte {
+    uint32_t time;
+    uint8_t data;
+  };
+
+  void Tick(std::vector<SimulatorEvent>* events) {
+    for (uint8_t i = 0; i < num_voices_; ++i) {
+      if (gate_[i] != written_gate_[i]) {
+        written_gate_[i] = gate_[i];
+        Record(SIMULATOR_EVENT_GATE, i, gate_[i], events);
+      }
+    }
+
+    multi.Refresh();
+    output_reader_.Read();
+
+    const OutputFrame& outputs = output_reader_.frame();
+    uint8_t num_voices = std::min(num_voices_, outputs.num_voices);
+    for (uint8_t i = 0; i < num_voices; ++i) {
+      uint16_t cv = outputs.voice[i].note_dac_code;
+      if (cv != cv_[i]) {
+        cv_[i] = cv;
+        Record(SIMULATOR_EVENT_CV, i, cv, events);
+      }
+      gate_[i] = outputs.voice[i].gate;
+    }
+
+    MidiHandler::SmallMidiBuffer* high_priority_output = \
+        midi_handler.mutable_high_priority_output_buffer();
+    while (high_priority_output->readable()) {
+      Record(
+          SIMULATOR_EVENT_MIDI_OUT,
+          0,
+          high_priority_output->ImmediateRead(),
+          events);
+    }
+    MidiHandler::MidiBuffer* output = midi_handler.mutable_output_buffer();
+    while (output->readable()) {
+      Record(SIMULATOR_EVENT_MIDI_OUT, 0, output->ImmediateRead(), events);
+    }
+  }
+
+  inline void Record(
+      SimulatorEventType type,
+      uint8_t voice,
+      uint16_t value,
+      std::vector<SimulatorEvent>* events) {
+    SimulatorEvent e = { time_, static_cast<uint8_t>(type), voice, value };
+    events->push_back(e);
+  }
+
+  uint8_t num_voices_;
+  OutputReader output_reader_;
+  uint32_t time_;
+  uint32_t tick_phase_;
+
+  std::vector<TimedByte> input_;
+  size_t input_position_;
+
+  uint16_t cv_[kNumVoices];
+  bool gate_[kNumVoices];
+  bool written_gate_[kNumVoices];
+
+  DISALLOW_COPY_AND_ASSIGN(MultiSimulator);
+};
+
+}  // namespace yarns
+
+#endif  // YARNS_TEST_MULTI_SIMULATOR_H_
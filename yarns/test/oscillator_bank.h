@@ -0,0 +1,339 @@
+// Copyright 2013 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Renders the audio-rate oscillators of many voices together, on the host.
+//
+// The saw, square and triangle waveforms are all made of a ramp or steps,
+// band-limited with the same polyBLEP as Oscillator. They are rendered by a
+// single kernel, by groups of up to kOscillatorBankLanes voices, with the
+// state of the voices in arrays indexed by lane, in three passes over the
+// block:
+//
+// - Phase accumulation, naive waveform and detection of the edges. The inner
+//   loop runs over the lanes, and selects the edges and waveform of each lane
+//   with masks instead of branches, so that the compiler turns it into SIMD
+//   code - and voices playing different waveforms still share vectors.
+// - Band-limiting of the edges. There are only a few edges per block, so
+//   this pass is scalar, and uses the same integer division as Oscillator.
+// - Integration (for the triangle) and scaling to DAC codes, also over the
+//   lanes.
+//
+// The output is identical to the one of Oscillator. Sine and noise voices are
+// rendered one by one. Voices whose audio mode is off are skipped, and voices
+// which are silent because their gate is off only write their block once.
+
+#ifndef YARNS_TEST_OSCILLATOR_BANK_H_
+#define YARNS_TEST_OSCILLATOR_BANK_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+
+#include "stmlib/utils/dsp.h"
+#include "stmlib/utils/random.h"
+
+#include "yarns/resources.h"
+#include "yarns/voice.h"
+
+namespace yarns {
+
+const size_t kOscillatorBankLanes = 16;
+const size_t kOscillatorBankVectorSize = 4;
+const size_t kOscillatorBankMaxVoices = 64;
+
+class OscillatorBank {
+ public:
+  OscillatorBank() { }
+  ~OscillatorBank() { }
+
+  void Init() {
+    std::fill(&phase_[0], &phase_[kOscillatorBankMaxVoices], 0);
+    std::fill(&next_sample_[0], &next_sample_[kOscillatorBankMaxVoices], 0);
+    std::fill(
+        &integrator_state_[0],
+        &integrator_state_[kOscillatorBankMaxVoices],
+        0);
+    std::fill(&high_[0], &high_[kOscillatorBankMaxVoices], 0);
+    std::fill(&silent_[0], &silent_[kOscillatorBankMaxVoices], false);
+  }
+
+  // Renders a block for each voice whose audio mode is not off.
+  void Render(Voice* voices, size_t num_voices) {
+    size_t num_edge_voices = 0;
+    size_t num_sine_voices = 0;
+    size_t num_noise_voices = 0;
+    for (size_t i = 0; i < num_voices; ++i) {
+      const Voice& voice = voices[i];
+      uint8_t mode = voice.audio_mode();
+      if (mode == 0) {
+        continue;
+      }
+      scale_[i] = voice.calibration_dac_code(3) - voice.calibration_dac_code(8);
+      offset_[i] = voice.calibration_dac_code(3);
+      if ((mode & 0x80) && !voice.gate_on()) {
+        if (!silent_[i]) {
+          std::fill(&block_[i][0], &block_[i][kAudioBlockSize], offset_[i]);
+          silent_[i] = true;
+        }
+        continue;
+      }
+      silent_[i] = false;
+      phase_increment_[i] = Oscillator::ComputePhaseIncrement(voice.note());
+      
+      uint8_t shape = (mode & 0x0f) - 1;
+      square_[i] = (shape == 1 || shape == 2 || shape == 3) ? 0xffffffff : 0;
+      integrate_[i] = shape == 3 ? 0xffffffff : 0;
+      pw_[i] = shape == 1 ? 0x40000000 : 0x80000000;
+      if (shape <= 3) {
+        edge_voices_[num_edge_voices++] = i;
+      } else if (shape == 4) {
+        sine_voices_[num_sine_voices++] = i;
+      } else {
+        noise_voices_[num_noise_voices++] = i;
+      }
+    }
+
+    for (size_t i = 0; i < num_edge_voices; i += kOscillatorBankLanes) {
+      RenderEdges(
+          &edge_voices_[i],
+          std::min(kOscillatorBankLanes, num_edge_voices - i));
+    }
+    for (size_t i = 0; i < num_sine_voices; ++i) {
+      RenderSine(sine_voices_[i]);
+    }
+    for (size_t i = 0; i < num_noise_voices; ++i) {
+      RenderNoise(noise_voices_[i]);
+    }
+  }
+
+  // DAC codes, as read by Voice::ReadSample().
+  inline const uint16_t* block(size_t voice) const { return block_[voice]; }
+
+ private:
+  // Working copy of the state of the voices of a group, by lane. The masks
+  // have all their bits set when true.
+  struct Lanes {
+    uint32_t phase[kOscillatorBankLanes];
+    uint32_t phase_increment[kOscillatorBankLanes];
+    uint32_t pw[kOscillatorBankLanes];
+    int32_t next_sample[kOscillatorBankLanes];
+    int32_t integrator_state[kOscillatorBankLanes];
+    int32_t integrator_coefficient[kOscillatorBankLanes];
+    int32_t high[kOscillatorBankLanes];
+    int32_t square[kOscillatorBankLanes];
+    int32_t integrate[kOscillatorBankLanes];
+    int32_t scale[kOscillatorBankLanes];
+    int32_t offset[kOscillatorBankLanes];
+
+    int32_t out[kAudioBlockSize][kOscillatorBankLanes];
+    uint32_t edge_phase[kAudioBlockSize][kOscillatorBankLanes];
+    int32_t edges[kAudioBlockSize][kOscillatorBankLanes];
+  };
+
+  enum Edge {
+    EDGE_RISE = 1,
+    EDGE_FALL = 2
+  };
+
+  // Returns the number of lanes to render: the number of voices, rounded up
+  // to the size of a SIMD vector. Not being a constant, it also prevents the
+  // compiler from unrolling the loop over the lanes instead of vectorizing it.
+  // The extra lanes replicate the first voice, and are not written back.
+  size_t Load(const uint8_t* voices, size_t num_voices, Lanes* l) {
+    size_t num_lanes = (num_voices + kOscillatorBankVectorSize - 1) & \
+        ~(kOscillatorBankVectorSize - 1);
+    for (size_t j = 0; j < num_lanes; ++j) {
+      size_t v = voices[j < num_voices ? j : 0];
+      l->phase[j] = phase_[v];
+      l->phase_increment[j] = phase_increment_[v];
+      l->pw[j] = pw_[v];
+      l->next_sample[j] = next_sample_[v];
+      l->integrator_state[j] = integrator_state_[v];
+      l->integrator_coefficient[j] = static_cast<int16_t>(
+          phase_increment_[v] >> 18);
+      l->high[j] = high_[v];
+      l->square[j] = square_[v];
+      l->integrate[j] = integrate_[v];
+      l->scale[j] = scale_[v];
+      l->offset[j] = offset_[v];
+    }
+    return num_lanes;
+  }
+
+  void Store(const uint8_t* voices, size_t num_voices, const Lanes& l) {
+    for (size_t j = 0; j < num_voices; ++j) {
+      size_t v = voices[j];
+      phase_[v] = l.phase[j];
+      next_sample_[v] = l.next_sample[j];
+      integrator_state_[v] = l.integrator_state[j];
+      high_[v] = l.high[j];
+      for (size_t i = 0; i < kAudioBlockSize; ++i) {
+        block_[v][i] = l.out[i][j];
+      }
+    }
+  }
+
+  // Same as Oscillator::ThisBlepSample and Oscillator::NextBlepSample.
+  static inline int32_t ThisBlepSample(uint32_t t) {
+    return t * t >> 18;
+  }
+
+  static inline int32_t NextBlepSample(uint32_t t) {
+    t = 65535 - t;
+    return -static_cast<int32_t>(t * t >> 18);
+  }
+
+  // Saw: a ramp with a falling edge at the end of the cycle. Square: a rising
+  // edge at pw, and a falling edge at the end of the cycle. Triangle: an
+  // integrated square.
+  void RenderEdges(const uint8_t* voices, size_t num_voices) {
+    Lanes& l = lanes_;
+    size_t num_lanes = Load(voices, num_voices, &l);
+
+    // The output is the naive waveform, delayed by one sample.
+    for (size_t i = 0; i < kAudioBlockSize; ++i) {
+      for (size_t j = 0; j < num_lanes; ++j) {
+        int32_t square = l.square[j];
+        int32_t high = l.high[j];
+        uint32_t phase = l.phase[j] + l.phase_increment[j];
+        int32_t above_pw = -static_cast<int32_t>(phase >= l.pw[j]);
+        int32_t rise = square & ~high & above_pw;
+        high |= rise;
+        int32_t fall = (high | ~square) & -static_cast<int32_t>(
+            phase < l.phase_increment[j]);
+        high &= ~(fall & square);
+
+        l.out[i][j] = l.next_sample[j];
+        l.next_sample[j] = (32767 & above_pw & square) | \
+            (phase >> 17 & ~square);
+        l.edges[i][j] = (rise & EDGE_RISE) | (fall & EDGE_FALL);
+        l.edge_phase[i][j] = phase;
+        l.phase[j] = phase;
+        l.high[j] = high;
+      }
+    }
+
+    for (size_t j = 0; j < num_voices; ++j) {
+      // The division by zero of the lowest notes gives 0 on the Cortex-M3.
+      uint32_t divisor = l.phase_increment[j] >> 16;
+      for (size_t i = 0; i < kAudioBlockSize; ++i) {
+        int32_t edges = l.edges[i][j];
+        if (!edges) {
+          continue;
+        }
+        int32_t* next = i == kAudioBlockSize - 1
+            ? &l.next_sample[j]
+            : &l.out[i + 1][j];
+        uint32_t phase = l.edge_phase[i][j];
+        if (edges & EDGE_RISE) {
+          uint32_t t = divisor ? (phase - l.pw[j]) / divisor : 0;
+          t = t > 65535 ? 65535 : t;
+          l.out[i][j] += ThisBlepSample(t);
+          *next += NextBlepSample(t);
+        }
+        if (edges & EDGE_FALL) {
+          uint32_t t = divisor ? phase / divisor : 0;
+          t = t > 65535 ? 65535 : t;
+          l.out[i][j] -= ThisBlepSample(t);
+          *next -= NextBlepSample(t);
+        }
+      }
+    }
+
+    // The integrator costs a multiplication, so it is only run when one of
+    // the voices plays a triangle.
+    bool integrate_any = false;
+    for (size_t j = 0; j < num_voices; ++j) {
+      integrate_any |= l.integrate[j] != 0;
+    }
+    if (!integrate_any) {
+      for (size_t i = 0; i < kAudioBlockSize; ++i) {
+        for (size_t j = 0; j < num_lanes; ++j) {
+          int32_t this_sample = (l.out[i][j] - 16384) << 1;
+          l.out[i][j] = l.offset[j] - (l.scale[j] * this_sample >> 16);
+        }
+      }
+      Store(voices, num_voices, l);
+      return;
+    }
+    for (size_t i = 0; i < kAudioBlockSize; ++i) {
+      for (size_t j = 0; j < num_lanes; ++j) {
+        int32_t this_sample = (l.out[i][j] - 16384) << 1;
+        int32_t integrate = l.integrate[j];
+        int32_t s = l.integrator_state[j];
+        s += l.integrator_coefficient[j] * (this_sample - s) >> 15;
+        s = (s & integrate) | (l.integrator_state[j] & ~integrate);
+        this_sample = (s << 3 & integrate) | (this_sample & ~integrate);
+        l.integrator_state[j] = s;
+        l.out[i][j] = l.offset[j] - (l.scale[j] * this_sample >> 16);
+      }
+    }
+
+    Store(voices, num_voices, l);
+  }
+
+  void RenderSine(uint8_t v) {
+    uint32_t phase = phase_[v];
+    for (size_t i = 0; i < kAudioBlockSize; ++i) {
+      phase += phase_increment_[v];
+      int32_t sample = stmlib::Interpolate1022(wav_sine, phase);
+      block_[v][i] = offset_[v] - (scale_[v] * sample >> 16);
+    }
+    phase_[v] = phase;
+  }
+
+  void RenderNoise(uint8_t v) {
+    for (size_t i = 0; i < kAudioBlockSize; ++i) {
+      int16_t sample = stmlib::Random::GetSample();
+      block_[v][i] = offset_[v] - (scale_[v] * sample >> 16);
+    }
+  }
+
+  uint32_t phase_[kOscillatorBankMaxVoices];
+  uint32_t phase_increment_[kOscillatorBankMaxVoices];
+  uint32_t pw_[kOscillatorBankMaxVoices];
+  int32_t next_sample_[kOscillatorBankMaxVoices];
+  int32_t integrator_state_[kOscillatorBankMaxVoices];
+  int32_t high_[kOscillatorBankMaxVoices];
+  int32_t square_[kOscillatorBankMaxVoices];
+  int32_t integrate_[kOscillatorBankMaxVoices];
+  int32_t scale_[kOscillatorBankMaxVoices];
+  int32_t offset_[kOscillatorBankMaxVoices];
+  bool silent_[kOscillatorBankMaxVoices];
+
+  uint8_t edge_voices_[kOscillatorBankMaxVoices];
+  uint8_t sine_voices_[kOscillatorBankMaxVoices];
+  uint8_t noise_voices_[kOscillatorBankMaxVoices];
+  uint16_t block_[kOscillatorBankMaxVoices][kAudioBlockSize];
+
+  Lanes lanes_;
+
+  DISALLOW_COPY_AND_ASSIGN(OscillatorBank);
+};
+
+}  // namespace yarns
+
+#endif  // YARNS_TEST_OSCILLATOR_BANK_H_
@@ -0,0 +1,981 @@
+// Copyright 2013 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <pthread.h>
+#include <sched.h>
+#include <vector>
+
+#include "stmlib/algorithms/voice_allocator.h"
+#include "stmlib/utils/stream_buffer.h"
+
+#include "yarns/calibration_table.h"
+#include "yarns/midi_handler.h"
+#include "yarns/multi.h"
+#include "yarns/settings.h"
+#include "yarns/snapshot.h"
+#include "yarns/storage_manager.h"
+#include "yarns/sysex_stream.h"
+#include "yarns/test/multi_simulator.h"
+#include "yarns/test/oscillator_bank.h"
+#include "yarns/voice_allocator.h"
+
+using namespace std;
+using namespace yarns;
+
+// MIDI streams.
+
+// A stream of MIDI bytes, and the messages the handler should decode from
+// it, in order.
+struct MidiStream {
+  vector<uint8_t> bytes;
+  vector<MidiEvent> messages;
+  uint8_t running_status;
+
+  MidiStream() : running_status(0) { }
+
+  void Append(uint8_t status, uint8_t data_1, uint8_t data_2) {
+    MidiEvent e;
+    e.status = status;
+    e.data[0] = data_1;
+    e.data[1] = data_2;
+    if (status >= 0xf8) {
+      bytes.push_back(status);
+      messages.push_back(e);
+      return;
+    }
+    // Use running status half of the time, and sometimes insert a clock
+    // tick in the middle of the message, as MIDI allows.
+    bool clock_inside = !(rand() % 16);
+    if (status != running_status || rand() % 2) {
+      bytes.push_back(status);
+    }
+    running_status = status;
+    if (clock_inside) {
+      Append(0xf8, 0, 0);
+    }
+    bytes.push_back(data_1);
+    uint8_t type = status & 0xf0;
+    if (type == 0xc0 || type == 0xd0) {
+      e.data[1] = 0;
+    } else {
+      bytes.push_back(data_2);
+    }
+    messages.push_back(e);
+  }
+};
+
+// Data entry, NRPN/RPN selection and channel mode messages.
+bool IsOrderedController(uint8_t controller) {
+  return controller == 0x06 || controller == 0x26 ||
+      (controller >= 0x60 && controller <= 0x65) || controller >= 0x78;
+}
+
+bool IsContinuous(const MidiEvent& e) {
+  uint8_t type = e.status & 0xf0;
+  return type == 0xd0 || type == 0xe0 ||
+      (type == 0xb0 && !IsOrderedController(e.data[0]));
+}
+
+bool IsSameEvent(const MidiEvent& a, const MidiEvent& b) {
+  return a.status == b.status && a.data[0] == b.data[0] && \
+      a.data[1] == b.data[1];
+}
+
+// Whether b sets the same CC, pitch bend or pressure as a.
+bool IsSameControl(const MidiEvent& a, const MidiEvent& b) {
+  return a.status == b.status && \
+      ((a.status & 0xf0) != 0xb0 || a.data[0] == b.data[0]);
+}
+
+// Messages the value of a CC, pitch bend or pressure cannot be coalesced
+// across: clock and other realtime messages, and anything else than a
+// continuous message on the same channel.
+bool IsCoalescingBarrier(const MidiEvent& e, uint8_t channel) {
+  return e.status >= 0xf0 || \
+      ((e.status & 0x0f) == channel && !IsContinuous(e));
+}
+
+vector<MidiEvent> dispatched_events;
+
+void RecordDispatchedEvent(const MidiEvent& e) {
+  dispatched_events.push_back(e);
+}
+
+// Checks that the dispatched messages are the received ones, in the same
+// order, minus CC, pitch bend or pressure values superseded by a newer one
+// before the next clock tick or ordered message. Returns the number of
+// coalesced messages.
+size_t CheckCoalescing(
+    const vector<MidiEvent>& received,
+    const vector<MidiEvent>& dispatched) {
+  // The latest occurrence of a message is the one kept.
+  vector<bool> kept(received.size(), false);
+  size_t j = dispatched.size();
+  for (size_t i = received.size(); i-- > 0; ) {
+    if (j && IsSameEvent(received[i], dispatched[j - 1])) {
+      kept[i] = true;
+      --j;
+    }
+  }
+  // Nothing reordered, duplicated or invented.
+  assert(j == 0);
+
+  size_t num_coalesced = 0;
+  for (size_t i = 0; i < received.size(); ++i) {
+    if (kept[i]) {
+      continue;
+    }
+    const MidiEvent& e = received[i];
+    assert(IsContinuous(e));
+    bool superseded = false;
+    for (size_t k = i + 1; k < received.size() && !superseded; ++k) {
+      if (IsSameControl(e, received[k])) {
+        superseded = true;
+      } else if (IsCoalescingBarrier(received[k], e.status & 0x0f)) {
+        break;
+      }
+    }
+    assert(superseded);
+    ++num_coalesced;
+  }
+  return num_coalesced;
+}
+
+// A busy performance on 4 channels: CC sweeps, pitch bend and pressure,
+// notes, NRPN and data entry sequences, program changes, and clock.
+void GenerateMidiStream(size_t num_messages, MidiStream* stream) {
+  const uint8_t controllers[] = { 0x01, 0x07, 0x0b, 0x4a };
+  uint8_t value = 0;
+  while (stream->messages.size() < num_messages) {
+    uint8_t channel = rand() % 4;
+    uint8_t note = 36 + rand() % 48;
+    int r = rand() % 100;
+    ++value;
+    if (r < 30) {
+      stream->Append(0xb0 | channel, controllers[rand() % 4], value & 0x7f);
+    } else if (r < 45) {
+      stream->Append(0xe0 | channel, value & 0x7f, (value >> 1) & 0x7f);
+    } else if (r < 55) {
+      stream->Append(0xd0 | channel, value & 0x7f, 0);
+    } else if (r < 62) {
+      // NRPN selection and data entry.
+      stream->Append(0xb0 | channel, 0x63, rand() % 128);
+      stream->Append(0xb0 | channel, 0x62, rand() % 128);
+      stream->Append(0xb0 | channel, 0x06, rand() % 128);
+      stream->Append(0xb0 | channel, 0x26, rand() % 128);
+    } else if (r < 72) {
+      stream->Append(0x90 | channel, note, 1 + rand() % 127);
+      stream->Append(0x80 | channel, note, 0);
+    } else if (r < 75) {
+      stream->Append(0xa0 | channel, note, rand() % 128);
+    } else if (r < 78) {
+      stream->Append(0xc0 | channel, rand() % 128, 0);
+    } else {
+      stream->Append(0xf8, 0, 0);
+    }
+  }
+}
+
+void InitMidiHandler() {
+  multi.Init(true);
+  midi_handler.Init();
+  dispatched_events.clear();
+  midi_handler.set_dispatch_observer(&RecordDispatchedEvent);
+}
+
+void DrainMidiOutput() {
+  while (midi_handler.mutable_output_buffer()->readable()) {
+    midi_handler.mutable_output_buffer()->ImmediateRead();
+  }
+  while (midi_handler.mutable_high_priority_output_buffer()->readable()) {
+    midi_handler.mutable_high_priority_output_buffer()->ImmediateRead();
+  }
+}
+
+void TestMidiCoalescing() {
+  for (int trial = 0; trial < 200; ++trial) {
+    MidiStream stream;
+    GenerateMidiStream(2000, &stream);
+    InitMidiHandler();
+
+    // The main loop processes the input at random intervals, from every
+    // byte to a full input buffer (255 bytes).
+    size_t position = 0;
+    while (position < stream.bytes.size()) {
+      size_t size = 1 + rand() % 255;
+      size = min(size, stream.bytes.size() - position);
+      for (size_t i = 0; i < size; ++i) {
+        midi_handler.PushByte(stream.bytes[position++]);
+      }
+      midi_handler.ProcessInput();
+      DrainMidiOutput();
+    }
+    assert(midi_handler.dropped_input_bytes() == 0);
+    size_t num_coalesced = CheckCoalescing(stream.messages, dispatched_events);
+    assert(num_coalesced == midi_handler.coalesced_events());
+    assert(num_coalesced > 0);
+  }
+  midi_handler.set_dispatch_observer(NULL);
+}
+
+void BenchmarkMidiReplay() {
+  // Recorded at the maximum rate of the MIDI link (3125 bytes/s), and
+  // replayed 10 to 100 times faster, one chunk per 8kHz SysTick. The main
+  // loop processes the input once per SysTick.
+  const float kBytesPerSecond = 3125.0f;
+  const float kSysTickRate = 8000.0f;
+  const float speeds[] = { 10.0f, 30.0f, 100.0f };
+
+  MidiStream stream;
+  GenerateMidiStream(200000, &stream);
+  float duration = stream.bytes.size() / kBytesPerSecond;
+
+  for (size_t s = 0; s < sizeof(speeds) / sizeof(float); ++s) {
+    InitMidiHandler();
+    float bytes_per_tick = speeds[s] * kBytesPerSecond / kSysTickRate;
+    float budget = 0.0f;
+    size_t position = 0;
+
+    clock_t start = clock();
+    while (position < stream.bytes.size()) {
+      budget += bytes_per_tick;
+      while (budget >= 1.0f && position < stream.bytes.size()) {
+        midi_handler.PushByte(stream.bytes[position++]);
+        budget -= 1.0f;
+      }
+      midi_handler.ProcessInput();
+      DrainMidiOutput();
+    }
+    float elapsed = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+
+    assert(midi_handler.dropped_input_bytes() == 0);
+    size_t num_coalesced = CheckCoalescing(stream.messages, dispatched_events);
+    assert(num_coalesced == midi_handler.coalesced_events());
+
+    size_t num_continuous = 0;
+    for (size_t i = 0; i < stream.messages.size(); ++i) {
+      num_continuous += IsContinuous(stream.messages[i]) ? 1 : 0;
+    }
+    printf("MIDI replay at %3.0fx: %lu messages, %4.1f%% of CC/PB/pressure "
+           "coalesced, %u bytes dropped, %.0fx realtime on the host\n",
+           speeds[s],
+           stream.messages.size(),
+           100.0f * num_coalesced / num_continuous,
+           midi_handler.dropped_input_bytes(),
+           duration / elapsed);
+  }
+  midi_handler.set_dispatch_observer(NULL);
+}
+
+void TestSerializationSize() {
+  multi.Init(true);
+  stmlib::StreamBuffer<kSerializationBufferSize>* buffer = \
+      new stmlib::StreamBuffer<kSerializationBufferSize>();
+  buffer->Rewind();
+  multi.Serialize(buffer);
+  assert(buffer->position() == kMultiDataSize);
+  buffer->Rewind();
+  multi.SerializeCalibration(buffer);
+  assert(buffer->position() == kCalibrationDataSize);
+  printf("Serialized multi: %lu bytes, calibration: %lu bytes\n",
+         kMultiDataSize, kCalibrationDataSize);
+  delete buffer;
+}
+
+void TestVoiceAllocator() {
+  // The host allocator against the one from stmlib used by the module.
+  const uint8_t kCapacity = kMaxNumVoices * 2;
+  const stmlib::VoiceStealingMode stmlib_modes[] = {
+    stmlib::VOICE_STEALING_MODE_LRU,
+    stmlib::VOICE_STEALING_MODE_MRU,
+    stmlib::VOICE_STEALING_MODE_NONE
+  };
+  const VoiceStealingMode modes[] = {
+    VOICE_STEALING_MODE_LRU,
+    VOICE_STEALING_MODE_MRU,
+    VOICE_STEALING_MODE_NONE
+  };
+  stmlib::VoiceAllocator<kCapacity>* reference = \
+      new stmlib::VoiceAllocator<kCapacity>();
+  VoiceAllocator<kCapacity>* allocator = new VoiceAllocator<kCapacity>();
+  for (uint8_t size = 1; size <= kCapacity; ++size) {
+    reference->Init();
+    allocator->Init();
+    reference->set_size(size);
+    allocator->set_size(size);
+    // A few more notes than voices, so that voices get stolen. Note 127 is
+    // left out: once released, stmlib cannot tell it from an empty slot.
+    int num_notes = std::min(size + 1 + rand() % 8, 127);
+    for (int i = 0; i < 2000; ++i) {
+      uint8_t note = rand() % num_notes;
+      int r = rand() % 100;
+      if (r < 50) {
+        size_t mode = rand() % 3;
+        assert(reference->NoteOn(note, stmlib_modes[mode]) == \
+            allocator->NoteOn(note, modes[mode]));
+      } else if (r < 95) {
+        assert(reference->NoteOff(note) == allocator->NoteOff(note));
+      } else if (r < 98) {
+        reference->ClearNotes();
+        allocator->ClearNotes();
+      } else {
+        reference->Clear();
+        allocator->Clear();
+      }
+      assert(reference->Find(note) == allocator->Find(note));
+    }
+  }
+  delete allocator;
+  delete reference;
+}
+
+void BenchmarkNoteOnOff() {
+  const uint8_t sizes[] = { 4, 16, 64 };
+  const int kNumEvents = 2000000;
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(uint8_t); ++s) {
+    uint8_t num_voices = sizes[s];
+    multi.Init(true);
+    multi.AllocateParts(1, num_voices, false);
+    Part* part = multi.mutable_part(0);
+    part->mutable_voicing_settings()->allocation_mode = \
+        VOICE_ALLOCATION_MODE_POLY;
+    part->Touch();
+
+    // Chords of up to num_voices notes, taken from twice as many keys.
+    vector<uint8_t> events(kNumEvents);
+    vector<bool> held(128, false);
+    size_t num_held = 0;
+    for (int i = 0; i < kNumEvents; ++i) {
+      uint8_t note = 24 + rand() % (2 * num_voices);
+      if (!held[note] && num_held == num_voices) {
+        note = 0;
+        while (!held[note]) {
+          ++note;
+        }
+      }
+      held[note] = !held[note];
+      num_held += held[note] ? 1 : -1;
+      events[i] = note | (held[note] ? 0x80 : 0);
+    }
+
+    clock_t start = clock();
+    for (int i = 0; i < kNumEvents; ++i) {
+      uint8_t note = events[i] & 0x7f;
+      if (events[i] & 0x80) {
+        part->NoteOn(0, note, 100);
+      } else {
+        part->NoteOff(0, note);
+      }
+    }
+    float elapsed = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+    printf("Note on/off, %2d voices: %.1f M events/s\n",
+           num_voices, kNumEvents / elapsed * 1e-6);
+  }
+}
+
+void BenchmarkMultiSimulator() {
+  // 4 arpeggiated parts at 240 BPM, each on its own output.
+  settings.Init();
+  multi.Init(true);
+  midi_handler.Init();
+  multi.Set(MULTI_LAYOUT, LAYOUT_QUAD_MONO);
+  multi.Set(MULTI_CLOCK_TEMPO, 240);
+  for (uint8_t p = 0; p < 4; ++p) {
+    Part* part = multi.mutable_part(p);
+    part->Set(PART_MIDI_CHANNEL, p);
+    part->Set(PART_SEQUENCER_ARP_RANGE, 2);
+    part->Set(PART_SEQUENCER_ARP_DIRECTION, p);
+    part->Set(PART_SEQUENCER_CLOCK_DIVISION, 6 + p);
+  }
+
+  MultiSimulator simulator;
+  simulator.Init(4);
+  for (uint8_t p = 0; p < 4; ++p) {
+    for (uint8_t n = 0; n < 3; ++n) {
+      simulator.PushMidi(0, 0x90 | p, 60 + n * 4 + p, 100);
+    }
+  }
+
+  // The events are in order, and the gates of all voices alternate.
+  vector<SimulatorEvent> events;
+  simulator.Run(kSimulatorSampleRate, &events);
+  bool gate[4] = { false, false, false, false };
+  size_t num_gates[4] = { 0, 0, 0, 0 };
+  for (size_t i = 0; i < events.size(); ++i) {
+    const SimulatorEvent& e = events[i];
+    assert(i == 0 || events[i - 1].time <= e.time);
+    if (e.type == SIMULATOR_EVENT_GATE) {
+      assert(e.voice < 4);
+      assert(e.value == (num_gates[e.voice] ? !gate[e.voice] : 0));
+      gate[e.voice] = e.value;
+      ++num_gates[e.voice];
+    }
+  }
+  for (uint8_t v = 0; v < 4; ++v) {
+    assert(num_gates[v] > 4);
+  }
+
+  // One hour of sequence.
+  size_t num_events = 0;
+  clock_t start = clock();
+  for (int minute = 0; minute < 60; ++minute) {
+    events.clear();
+    simulator.Run(kSimulatorSampleRate * 60, &events);
+    num_events += events.size();
+  }
+  float elapsed = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+  printf("Multi simulator: 1 hour in %.1fs (%.0fx realtime), "
+         "%lu events, %.2f M events/s\n",
+         elapsed,
+         3600.0f / elapsed,
+         num_events,
+         num_events / elapsed * 1e-6);
+}
+
+// Streamed SysEx transfers, through a model of the MIDI link in both
+// directions. Time is counted in bytes of the link (320us).
+
+const uint32_t kMidiBytesPerSecond = 3125;
+const uint32_t kFlashWriteTime = kMidiBytesPerSecond * 25 / 1000;
+const uint32_t kSenderTimeout = kMidiBytesPerSecond * 300 / 1000;
+const int16_t kNoByte = -1;
+
+struct SysExLinkModel {
+  uint32_t drop;  // 1 / probability of dropping a byte sent to the module.
+  uint32_t duplicate;  // 1 / probability of sending a message twice.
+  uint32_t rewind;  // 1 / probability of a spurious sender timeout.
+  bool interrupt;  // Save or load a multi during each transfer.
+};
+
+inline bool OneIn(uint32_t n) {
+  return n && !(rand() % n);
+}
+
+// Sends a multi to each slot, and returns the time taken, in seconds.
+float SysExTransferBank(const SysExLinkModel& model) {
+  multi.Init(true);
+  for (uint8_t i = 0; i < kNumParts; ++i) {
+    // Hardware thru: the SysEx messages are not echoed.
+    multi.mutable_part(i)->Set(PART_MIDI_OUT_MODE, MIDI_OUT_MODE_THRU);
+  }
+  assert(multi.direct_thru());
+  midi_handler.Init();
+  storage_manager.mutable_storage()->Init();
+  DrainMidiOutput();
+
+  vector<uint8_t> bank(kNumMultiSlots * kMultiDataSize);
+  for (size_t i = 0; i < bank.size(); ++i) {
+    bank[i] = rand();
+  }
+
+  SysExStreamSender sender;
+  uint8_t message[kSysExStreamMaxMessageSize];
+  vector<int16_t> to_module;  // Or kNoByte when the link is idle.
+  vector<uint8_t> from_module;
+  vector<uint8_t> ack;
+  uint32_t time = 0;
+  uint32_t busy = 0;
+  for (uint8_t slot = 0; slot < kNumMultiSlots; ++slot) {
+    sender.Init(
+        RECEPTION_DESTINATION_SLOT + slot,
+        &bank[slot * kMultiDataSize],
+        kMultiDataSize);
+    uint32_t start = time;
+    uint32_t last_ack = time;
+    size_t to_module_position = 0;
+    size_t from_module_position = 0;
+    to_module.clear();
+    from_module.clear();
+    ack.clear();
+    bool interrupted = !model.interrupt;
+
+    while (!sender.done()) {
+      assert(!sender.failed());
+      assert(time - start < 60 * kMidiBytesPerSecond);
+
+      // Host.
+      if (to_module_position == to_module.size()) {
+        to_module.clear();
+        to_module_position = 0;
+        size_t size = sender.NextMessage(message);
+        for (int copy = OneIn(model.duplicate) ? 2 : 1; size && copy; --copy) {
+          to_module.insert(to_module.end(), &message[0], &message[size]);
+          to_module.insert(to_module.end(), kSysExStreamGapSize, kNoByte);
+        }
+      }
+      if (time - last_ack >= kSenderTimeout || OneIn(model.rewind)) {
+        sender.Timeout();
+        last_ack = time;
+      }
+
+      // Link to the module, and its main loop, which does nothing else while
+      // a page of flash is written.
+      if (to_module_position < to_module.size()) {
+        int16_t byte = to_module[to_module_position++];
+        if (byte != kNoByte && !OneIn(model.drop)) {
+          midi_handler.PushByte(byte);
+        }
+      }
+      if (busy) {
+        --busy;
+      } else {
+        uint32_t num_saves = storage_manager.mutable_storage()->num_saves();
+        midi_handler.ProcessInput();
+        if (!interrupted && time - start > kMidiBytesPerSecond / 2) {
+          // Used from the UI while a transfer is in progress.
+          assert(storage_manager.receiving());
+          if (slot & 1) {
+            storage_manager.SaveMulti(slot);
+          } else {
+            storage_manager.LoadMulti(slot);
+          }
+          assert(!storage_manager.receiving());
+          interrupted = true;
+        }
+        if (storage_manager.mutable_storage()->num_saves() != num_saves) {
+          busy = kFlashWriteTime;
+        }
+      }
+      MidiHandler::MidiBuffer* output = midi_handler.mutable_output_buffer();
+      while (output->readable()) {
+        from_module.push_back(output->ImmediateRead());
+      }
+      // What the UART has not sent yet fits in the output buffer.
+      assert(from_module.size() - from_module_position < output->capacity());
+
+      // Link to the host, with 10 times more errors.
+      if (from_module_position < from_module.size()) {
+        uint8_t byte = from_module[from_module_position++];
+        if (!OneIn(model.drop / 10)) {
+          if (byte == 0xf0) {
+            ack.clear();
+          }
+          ack.push_back(byte);
+          if (byte == 0xf7) {
+            if (sender.ProcessAck(&ack[0], ack.size())) {
+              last_ack = time;
+            }
+            ack.clear();
+          }
+        }
+      }
+      ++time;
+    }
+    assert(interrupted);
+  }
+
+  // Let the module commit the last slot.
+  time += busy;
+  RamStorage<1 + kNumMultiSlots>* storage = storage_manager.mutable_storage();
+  for (uint8_t slot = 0; slot < kNumMultiSlots; ++slot) {
+    assert(storage->size(1 + slot) == kMultiDataSize);
+    assert(equal(
+        &bank[slot * kMultiDataSize],
+        &bank[(slot + 1) * kMultiDataSize],
+        storage->data(1 + slot)));
+  }
+  return static_cast<float>(time) / kMidiBytesPerSecond;
+}
+
+void TestSysExStream() {
+  // Size of the BEGIN and DATA messages, with the chunks packed 7 bytes in 8.
+  size_t wire_size = kSysExStreamBeginSize;
+  for (size_t i = 0; i < kMultiDataSize; i += kSysExStreamChunkSize) {
+    size_t size = min(kSysExStreamChunkSize, kMultiDataSize - i);
+    wire_size += kSysExStreamDataHeaderSize + (size + 6) / 7 + size + 1;
+  }
+  float wire_time = static_cast<float>(kNumMultiSlots * wire_size) / \
+      kMidiBytesPerSecond;
+
+  const SysExLinkModel models[] = {
+    { 0, 0, 0, false },
+    { 1000, 0, 0, false },
+    { 200, 0, 0, false },
+    { 0, 4, 0, false },
+    { 0, 0, 2000, false },
+    { 1000, 8, 4000, false },
+    { 0, 0, 0, true },
+    { 1000, 8, 4000, true },
+  };
+  const char* names[] = {
+    "clean",
+    "0.1% dropped",
+    "0.5% dropped",
+    "25% duplicated",
+    "rewinds",
+    "all errors",
+    "save/load during transfer",
+    "all errors, save/load",
+  };
+  for (size_t i = 0; i < sizeof(models) / sizeof(SysExLinkModel); ++i) {
+    float time = SysExTransferBank(models[i]);
+    if (i == 0) {
+      // Gaps, acknowledgements and flash writes cost less than 10% over the
+      // time on the wire.
+      assert(time < wire_time * 1.1f);
+    }
+    printf("SysEx bank of %d x %lu bytes, %s: %.2fs (%.2fs on the wire)\n",
+           kNumMultiSlots,
+           kMultiDataSize,
+           names[i],
+           time,
+           wire_time);
+  }
+}
+
+// Audio-rate oscillators.
+
+// Gives the voices audio modes cycling through the six shapes, half of them
+// gated, and a note in the middle of the keyboard.
+void InitAudioVoices(Voice* voices, size_t num_voices) {
+  for (size_t i = 0; i < num_voices; ++i) {
+    voices[i].Init(true);
+    voices[i].set_tuning(0, 0);
+    voices[i].set_audio_mode((1 + i % 6) | (i / 6 % 2 ? 0x80 : 0));
+    voices[i].NoteOn(60 << 7, 100, 0, true);
+    voices[i].NoteOff();
+    voices[i].Refresh();
+  }
+}
+
+// Plays a random note on a voice, or releases it. Notes with a phase
+// increment below 65536 divide by zero in Oscillator on the host, so the
+// lowest octaves are not played.
+void PlayRandomNote(Voice* voice) {
+  if (rand() % 4) {
+    int16_t note;
+    do {
+      note = (12 + rand() % 116) << 7 | rand() % 128;
+    } while (!(Oscillator::ComputePhaseIncrement(note) >> 16));
+    voice->NoteOn(note, 100, 0, true);
+  } else {
+    voice->NoteOff();
+  }
+  voice->Refresh();
+}
+
+void TestOscillatorBank() {
+  const size_t sizes[] = { 4, 16, 64 };
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(size_t); ++s) {
+    size_t num_voices = sizes[s];
+    Voice* voices = new Voice[num_voices];
+    InitAudioVoices(voices, num_voices);
+    OscillatorBank* bank = new OscillatorBank();
+    bank->Init();
+    for (size_t i = 0; i < num_voices; ++i) {
+      PlayRandomNote(&voices[i]);
+    }
+
+    for (int block = 0; block < 2000; ++block) {
+      for (size_t i = 0; i < num_voices; ++i) {
+        if (!(rand() % 16)) {
+          PlayRandomNote(&voices[i]);
+        }
+      }
+      // Same noise for both.
+      uint32_t seed = stmlib::Random::state();
+      bank->Render(voices, num_voices);
+      stmlib::Random::Seed(seed);
+      for (size_t i = 0; i < num_voices; ++i) {
+        voices[i].RenderAudio();
+        const uint16_t* samples = bank->block(i);
+        for (size_t j = 0; j < kAudioBlockSize; ++j) {
+          assert(voices[i].ReadSample() == samples[j]);
+        }
+      }
+    }
+    delete bank;
+    delete[] voices;
+  }
+}
+
+void BenchmarkOscillatorBank() {
+  const size_t sizes[] = { 4, 16, 64 };
+  const int kNumBlocks = 20000;
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(size_t); ++s) {
+    size_t num_voices = sizes[s];
+    Voice* voices = new Voice[num_voices];
+    OscillatorBank* bank = new OscillatorBank();
+    uint32_t sum = 0;
+
+    // All shapes, playing; then saws only; then all voices gated off.
+    for (int test = 0; test < 3; ++test) {
+      InitAudioVoices(voices, num_voices);
+      bank->Init();
+      for (size_t i = 0; i < num_voices; ++i) {
+        if (test == 1) {
+          voices[i].set_audio_mode(1);
+        }
+        voices[i].set_audio_mode(voices[i].audio_mode() | 0x80);
+        voices[i].NoteOn((36 + i) << 7, 100, 0, true);
+        if (test == 2) {
+          voices[i].NoteOff();
+        }
+        voices[i].Refresh();
+      }
+
+      clock_t start = clock();
+      for (int block = 0; block < kNumBlocks; ++block) {
+        for (size_t i = 0; i < num_voices; ++i) {
+          voices[i].RenderAudio();
+          for (size_t j = 0; j < kAudioBlockSize; ++j) {
+            sum += voices[i].ReadSample();
+          }
+        }
+      }
+      float voice_time = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+
+      start = clock();
+      for (int block = 0; block < kNumBlocks; ++block) {
+        bank->Render(voices, num_voices);
+        for (size_t i = 0; i < num_voices; ++i) {
+          sum += bank->block(i)[block % kAudioBlockSize];
+        }
+      }
+      float bank_time = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+
+      const char* names[] = { "all shapes", "saw", "idle" };
+      float num_samples = static_cast<float>(kNumBlocks) * kAudioBlockSize * \
+          num_voices;
+      printf("Oscillators, %2lu voices, %-10s: %.2f ns/sample per voice, "
+             "%.2f ns/sample with the bank, %.1fx (%u)\n",
+             num_voices,
+             names[test],
+             voice_time / num_samples * 1e9,
+             bank_time / num_samples * 1e9,
+             voice_time / bank_time,
+             sum);
+    }
+    delete bank;
+    delete[] voices;
+  }
+}
+
+// Calibration.
+
+// Voice::NoteToDacCode() before CalibrationTable, which searched the octave.
+uint16_t NoteToDacCodeReference(
+    const uint16_t* calibrated_dac_code,
+    int32_t note) {
+  const int32_t kMaxNote = 120 << 7;
+  if (note <= 0) {
+    note = 0;
+  }
+  if (note >= kMaxNote) {
+    note = kMaxNote - 1;
+  }
+  uint8_t octave = 0;
+  while (note >= kOctave) {
+    note -= kOctave;
+    ++octave;
+  }
+  
+  // Note is now between 0 and kOctave
+  // Octave indicates the octave. Look up in the DAC code table.
+  int32_t a = calibrated_dac_code[octave];
+  int32_t b = calibrated_dac_code[octave + 1];
+  return a + ((b - a) * note / kOctave);
+}
+
+// Nominal, nominal with some error, random, and extreme calibrations.
+void RandomizeCalibration(int type, uint16_t* dac_code) {
+  for (uint8_t i = 0; i < kNumOctaves; ++i) {
+    switch (type) {
+      case 0:
+        dac_code[i] = 54586 - 5133 * i;
+        break;
+      case 1:
+        dac_code[i] = 54586 - 5133 * i + rand() % 512 - 256;
+        break;
+      case 2:
+        dac_code[i] = rand();
+        break;
+      case 3:
+        dac_code[i] = i & 1 ? 65535 : 0;
+        break;
+      default:
+        dac_code[i] = i & 1 ? 0 : 65535;
+        break;
+    }
+  }
+}
+
+void TestCalibrationTable() {
+  CalibrationTable<kNumOctaves, kOctave> table;
+  uint16_t dac_code[kNumOctaves];
+  for (int trial = 0; trial < 200; ++trial) {
+    RandomizeCalibration(trial % 5, dac_code);
+    table.Init(dac_code);
+    for (int32_t note = -70000; note <= 90000; ++note) {
+      assert(table.Lookup(note) == NoteToDacCodeReference(dac_code, note));
+    }
+    assert(table.Lookup(INT_MIN) == NoteToDacCodeReference(dac_code, INT_MIN));
+    assert(table.Lookup(INT_MAX) == NoteToDacCodeReference(dac_code, INT_MAX));
+  }
+}
+
+void BenchmarkCalibrationTable() {
+  const int kNumLookups = 10000000;
+  CalibrationTable<kNumOctaves, kOctave> table;
+  uint16_t dac_code[kNumOctaves];
+  RandomizeCalibration(1, dac_code);
+  table.Init(dac_code);
+
+  // Notes in the lowest octave, in the highest one, and everywhere.
+  const int32_t ranges[][2] = {
+    { 0, kOctave },
+    { (kNumOctaves - 2) * kOctave, (kNumOctaves - 1) * kOctave },
+    { -kOctave, kNumOctaves * kOctave }
+  };
+  const char* names[] = { "lowest octave", "highest octave", "all notes" };
+  vector<int32_t> notes(kNumLookups);
+  for (size_t r = 0; r < sizeof(ranges) / sizeof(ranges[0]); ++r) {
+    for (int i = 0; i < kNumLookups; ++i) {
+      notes[i] = ranges[r][0] + rand() % (ranges[r][1] - ranges[r][0]);
+    }
+    uint32_t sum = 0;
+    clock_t start = clock();
+    for (int i = 0; i < kNumLookups; ++i) {
+      sum += NoteToDacCodeReference(dac_code, notes[i]);
+    }
+    float search_time = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+    start = clock();
+    for (int i = 0; i < kNumLookups; ++i) {
+      sum += table.Lookup(notes[i]);
+    }
+    float table_time = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+    printf("Note to DAC code, %-14s: %.1f ns with a search, "
+           "%.1f ns with the table (%u)\n",
+           names[r],
+           search_time / kNumLookups * 1e9,
+           table_time / kNumLookups * 1e9,
+           sum);
+  }
+}
+
+// Snapshots.
+
+// Each word of a frame is derived from its version, so that a frame mixing
+// two versions can be detected.
+struct StressFrame {
+  uint32_t word[64];
+};
+
+typedef Snapshot<StressFrame, 4> StressSnapshot;
+typedef SnapshotReader<StressFrame, 4> StressSnapshotReader;
+
+struct StressReaderState {
+  const StressSnapshot* snapshot;
+  bool* done;
+  uint32_t num_reads;
+  uint32_t num_torn_frames;
+  uint32_t num_late_frames;
+  uint32_t num_dropped_frames;
+};
+
+void* StressReader(void* argument) {
+  StressReaderState* state = static_cast<StressReaderState*>(argument);
+  StressSnapshotReader reader;
+  reader.Init(state->snapshot);
+  uint32_t version = 0;
+  while (!__atomic_load_n(state->done, __ATOMIC_ACQUIRE)) {
+    if (!reader.Read()) {
+      sched_yield();
+      continue;
+    }
+    assert(reader.version() > version);
+    version = reader.version();
+    const StressFrame& frame = reader.frame();
+    for (size_t i = 0; i < 64; ++i) {
+      if (frame.word[i] != version * 2654435761U + i) {
+        ++state->num_torn_frames;
+        break;
+      }
+    }
+    ++state->num_reads;
+  }
+  state->num_late_frames = reader.num_late_frames();
+  state->num_dropped_frames = reader.num_dropped_frames();
+  return NULL;
+}
+
+void TestSnapshot() {
+  const uint32_t kNumFrames = 40000000;
+  const size_t kNumReaders = 3;
+
+  StressSnapshot* snapshot = new StressSnapshot();
+  snapshot->Init();
+  bool done = false;
+  StressReaderState state[kNumReaders];
+  pthread_t threads[kNumReaders];
+  for (size_t i = 0; i < kNumReaders; ++i) {
+    StressReaderState s = { snapshot, &done, 0, 0, 0, 0 };
+    state[i] = s;
+    pthread_create(&threads[i], NULL, &StressReader, &state[i]);
+  }
+
+  clock_t start = clock();
+  for (uint32_t version = 1; version <= kNumFrames; ++version) {
+    StressFrame* frame = snapshot->BeginWrite();
+    for (size_t i = 0; i < 64; ++i) {
+      frame->word[i] = version * 2654435761U + i;
+    }
+    snapshot->Publish();
+    // Let the readers run often, even on a single core.
+    if (!(version % 1024)) {
+      sched_yield();
+    }
+  }
+  __atomic_store_n(&done, true, __ATOMIC_RELEASE);
+  float elapsed = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+
+  for (size_t i = 0; i < kNumReaders; ++i) {
+    pthread_join(threads[i], NULL);
+    assert(state[i].num_torn_frames == 0);
+    printf("Snapshot reader %lu: %u frames read, %u late, %u dropped\n",
+           i,
+           state[i].num_reads,
+           state[i].num_late_frames,
+           state[i].num_dropped_frames);
+  }
+  printf("Snapshot: %u frames of 64 words published in %.1fs, "
+         "no torn frame\n",
+         kNumFrames,
+         elapsed);
+  delete snapshot;
+}
+
+int main(void) {
+  TestMidiCoalescing();
+  BenchmarkMidiReplay();
+  TestSerializationSize();
+  TestVoiceAllocator();
+  BenchmarkNoteOnOff();
+  BenchmarkMultiSimulator();
+  TestSysExStream();
+  TestOscillatorBank();
+  BenchmarkOscillatorBank();
+  TestCalibrationTable();
+  BenchmarkCalibrationTable();
+  TestSnapshot();
+}
@@ -32,6 +32,7 @@
 #include "yarns/ui.h"
 #include "yarns/voice.h"
 
+#include <algorithm>
 #include <cstring>
 
 namespace yarns {
@@ -154,6 +155,7 @@ void Ui::Init() {
   switches_.Init();
   queue_.Init();
   leds_.Init();
+  output_reader_.Init(&multi.output_snapshot());
   
   previous_mode_ = mode_ = UI_MODE_SPLASH;
   setting_index_ = 0;
@@ -237,8 +239,12 @@ void Ui::Poll() {
   display_.RefreshSlow();
   
   // Read LED brightness from multi and copy to LEDs driver.
+  output_reader_.Read();
   uint8_t leds_brightness[kNumVoices];
-  multi.GetLedsBrightness(leds_brightness);
+  copy(
+      &output_reader_.frame().leds_brightness[0],
+      &output_reader_.frame().leds_brightness[kNumVoices],
+      &leds_brightness[0]);
   if (mode_ == UI_MODE_FACTORY_TESTING) {
     ++factory_testing_leds_counter_;
     uint16_t x = factory_testing_leds_counter_;
@@ -38,6 +38,7 @@
 #include "yarns/drivers/encoder.h"
 #include "yarns/drivers/switches.h"
 
+#include "yarns/multi.h"
 #include "yarns/settings.h"
 #include "yarns/storage_manager.h"
 
@@ -218,6 +219,7 @@ class Ui {
   Display display_;
   Encoder encoder_;
   Switches switches_;
+  OutputReader output_reader_;
   char buffer_[32];
   
   bool long_press_event_sent_;
@@ -43,9 +43,6 @@ namespace yarns {
 using namespace stmlib;
 using namespace stmlib_midi;
 
-const int32_t kOctave = 12 << 7;
-const int32_t kMaxNote = 120 << 7;
-
 void Voice::Init(bool reset_calibration) {
   note_ = -1;
   note_source_ = note_target_ = note_portamento_ = 60 << 7;
@@ -69,6 +66,7 @@ void Voice::Init(bool reset_calibration) {
       calibrated_dac_code_[i] = 54586 - 5133 * i;
     }
   }
+  calibration_table_.Init(calibrated_dac_code_);
   dirty_ = false;
   oscillator_.Init(
     calibrated_dac_code_[3] - calibrated_dac_code_[8],
@@ -80,26 +78,12 @@ void Voice::Calibrate(uint16_t* calibrated_dac_code) {
       &calibrated_dac_code[0],
       &calibrated_dac_code[kNumOctaves],
       &calibrated_dac_code_[0]);
+  calibration_table_.Init(calibrated_dac_code_);
+  dirty_ = true;
 }
 
 inline uint16_t Voice::NoteToDacCode(int32_t note) const {
-  if (note <= 0) {
-    note = 0;
-  }
-  if (note >= kMaxNote) {
-    note = kMaxNote - 1;
-  }
-  uint8_t octave = 0;
-  while (note >= kOctave) {
-    note -= kOctave;
-    ++octave;
-  }
-  
-  // Note is now between 0 and kOctave
-  // Octave indicates the octave. Look up in the DAC code table.
-  int32_t a = calibrated_dac_code_[octave];
-  int32_t b = calibrated_dac_code_[octave + 1];
-  return a + ((b - a) * note / kOctave);
+  return calibration_table_.Lookup(note);
 }
 
 void Voice::ResetAllControllers() {
@@ -265,6 +249,7 @@ void Oscillator::Init(int32_t scale, int32_t offset) {
   integrator_state_ = 0;
 }
 
+/* static */
 uint32_t Oscillator::ComputePhaseIncrement(int16_t midi_pitch) {
   if (midi_pitch >= kHighestNote) {
     midi_pitch = kHighestNote - 1;
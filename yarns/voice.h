@@ -32,9 +32,12 @@
 #include "stmlib/stmlib.h"
 #include "stmlib/utils/ring_buffer.h"
 
+#include "yarns/calibration_table.h"
+
 namespace yarns {
 
 const uint16_t kNumOctaves = 11;
+const int32_t kOctave = 12 << 7;
 const size_t kAudioBlockSize = 64;
 
 enum TriggerShape {
@@ -63,9 +66,10 @@ class Oscillator {
   inline uint16_t ReadSample() {
     return audio_buffer_.ImmediateRead();
   }
+  
+  static uint32_t ComputePhaseIncrement(int16_t pitch);
 
  private:
-  uint32_t ComputePhaseIncrement(int16_t pitch);
   
   void RenderSilence();
   void RenderNoise();
@@ -188,6 +192,7 @@ class Voice {
   
   inline void set_calibration_dac_code(uint8_t note, uint16_t dac_code) {
     calibrated_dac_code_[note] = dac_code;
+    calibration_table_.Init(calibrated_dac_code_);
     dirty_ = true;
   }
   
@@ -199,7 +204,7 @@ class Voice {
     tuning_ = (static_cast<int32_t>(coarse) << 7) + fine;
   }
   
-  inline uint8_t audio_mode() {
+  inline uint8_t audio_mode() const {
     return audio_mode_;
   }
   inline void RenderAudio() {
@@ -236,6 +241,7 @@ class Voice {
   bool dirty_;  // Set to true when the calibration settings have changed.
   uint16_t note_dac_code_;
   uint16_t calibrated_dac_code_[kNumOctaves];
+  CalibrationTable<kNumOctaves, kOctave> calibration_table_;
   
   int16_t mod_pitch_bend_;
   uint8_t mod_wheel_;
@@ -0,0 +1,208 @@
+// Copyright 2013 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Polyphonic voice allocator.
+//
+// Same behaviour as the stmlib voice allocator, without linear scans: the
+// voices are kept in two lists ordered by the time at which they were last
+// touched (by a NoteOn or a NoteOff) - one with all the voices, and one with
+// the released voices only - and a table gives the voice which last played
+// each note. NoteOn, NoteOff and Find run in constant time.
+//
+// Used by the host builds (TEST), which drive up to 64 voices per part. The
+// module keeps the stmlib allocator.
+
+#ifndef YARNS_VOICE_ALLOCATOR_H_
+#define YARNS_VOICE_ALLOCATOR_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+
+namespace yarns {
+
+enum VoiceStealingMode {
+  VOICE_STEALING_MODE_LRU,
+  VOICE_STEALING_MODE_MRU,
+  VOICE_STEALING_MODE_NONE
+};
+
+const uint8_t kNoVoice = 0xff;
+
+// Doubly linked list of voices, stored in the arrays of the allocator.
+struct VoiceList {
+  uint8_t head;  // Least recently touched.
+  uint8_t tail;  // Most recently touched.
+
+  inline void Clear() {
+    head = tail = kNoVoice;
+  }
+
+  inline void Append(uint8_t* previous, uint8_t* next, uint8_t voice) {
+    previous[voice] = tail;
+    next[voice] = kNoVoice;
+    if (tail != kNoVoice) {
+      next[tail] = voice;
+    } else {
+      head = voice;
+    }
+    tail = voice;
+  }
+
+  inline void Remove(uint8_t* previous, uint8_t* next, uint8_t voice) {
+    if (previous[voice] != kNoVoice) {
+      next[previous[voice]] = next[voice];
+    } else {
+      head = next[voice];
+    }
+    if (next[voice] != kNoVoice) {
+      previous[next[voice]] = previous[voice];
+    } else {
+      tail = previous[voice];
+    }
+  }
+};
+
+template<uint8_t capacity>
+class VoiceAllocator {
+ public:
+  VoiceAllocator() { }
+  ~VoiceAllocator() { }
+
+  void Init() {
+    size_ = 0;
+    Clear();
+  }
+
+  uint8_t NoteOn(uint8_t note, VoiceStealingMode mode) {
+    if (size_ == 0) {
+      return kNoVoice;
+    }
+
+    // First, check if there is a voice currently playing (or releasing)
+    // this note. In this case, this voice will be responsible for
+    // retriggering this note.
+    uint8_t voice = Find(note);
+
+    // Then, try to find the least recently touched, currently inactive voice.
+    if (voice == kNoVoice) {
+      voice = released_.head;
+    }
+
+    // If all voices are active, steal the least (or most) recently touched.
+    if (voice == kNoVoice && mode != VOICE_STEALING_MODE_NONE) {
+      voice = mode == VOICE_STEALING_MODE_MRU ? touched_.tail : touched_.head;
+    }
+
+    if (voice == kNoVoice) {
+      return kNoVoice;
+    }
+
+    if (note_[voice] & kReleased) {
+      released_.Remove(released_previous_, released_next_, voice);
+    }
+    if (note_[voice] != kNoNote) {
+      voice_for_note_[note_[voice] & 0x7f] = kNoVoice;
+    }
+    note_[voice] = note;
+    voice_for_note_[note] = voice;
+    Touch(voice);
+    return voice;
+  }
+
+  uint8_t NoteOff(uint8_t note) {
+    uint8_t voice = Find(note);
+    if (voice != kNoVoice) {
+      if (note_[voice] & kReleased) {
+        released_.Remove(released_previous_, released_next_, voice);
+      }
+      note_[voice] |= kReleased;
+      released_.Append(released_previous_, released_next_, voice);
+      Touch(voice);
+    }
+    return voice;
+  }
+
+  inline uint8_t Find(uint8_t note) const {
+    return note < 128 ? voice_for_note_[note] : kNoVoice;
+  }
+
+  // Forgets the notes and the order in which the voices have been used.
+  void Clear() {
+    touched_.Clear();
+    for (uint8_t i = 0; i < size_; ++i) {
+      touched_.Append(touched_previous_, touched_next_, i);
+    }
+    ClearNotes();
+  }
+
+  // Releases all voices, keeping the order in which they have been used.
+  void ClearNotes() {
+    std::fill(&voice_for_note_[0], &voice_for_note_[128], kNoVoice);
+    std::fill(&note_[0], &note_[capacity], kNoNote);
+    released_.Clear();
+    for (uint8_t i = touched_.head; i != kNoVoice; i = touched_next_[i]) {
+      released_.Append(released_previous_, released_next_, i);
+    }
+  }
+
+  void set_size(uint8_t size) {
+    size_ = size;
+    Clear();
+  }
+
+  inline uint8_t size() const { return size_; }
+
+ private:
+  // The MSB of the note played by a voice is set when it is released. A voice
+  // which has never played a note is released.
+  static const uint8_t kReleased = 0x80;
+  static const uint8_t kNoNote = 0xff;
+
+  inline void Touch(uint8_t voice) {
+    touched_.Remove(touched_previous_, touched_next_, voice);
+    touched_.Append(touched_previous_, touched_next_, voice);
+  }
+
+  uint8_t note_[capacity];
+  uint8_t voice_for_note_[128];
+
+  VoiceList touched_;
+  uint8_t touched_previous_[capacity];
+  uint8_t touched_next_[capacity];
+
+  VoiceList released_;
+  uint8_t released_previous_[capacity];
+  uint8_t released_next_[capacity];
+
+  uint8_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(VoiceAllocator);
+};
+
+}  // namespace yarns
+
+#endif // YARNS_VOICE_ALLOCATOR_H_
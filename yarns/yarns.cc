@@ -24,6 +24,8 @@
 
 #include <stm32f10x_conf.h>
 
+#include <algorithm>
+
 #include "stmlib/utils/dsp.h"
 #include "stmlib/utils/ring_buffer.h"
 #include "stmlib/system/system_clock.h"
@@ -47,6 +49,7 @@ GateOutput gate_output;
 Ui ui;
 MidiIO midi_io;
 System sys;
+OutputReader dac_output_reader;
 
 extern "C" {
   
@@ -106,7 +109,10 @@ void SysTick_Handler() {
   // refreshed to the right value when the trigger/gate is sent.
   gate_output.Write(gate);
   multi.Refresh();
-  multi.GetCvGate(cv, gate);
+  dac_output_reader.Read();
+  const OutputFrame& outputs = dac_output_reader.frame();
+  std::copy(&outputs.cv[0], &outputs.cv[kNumOutputVoices], &cv[0]);
+  std::copy(&outputs.gate[0], &outputs.gate[kNumOutputVoices], &gate[0]);
   has_audio_sources = multi.GetAudioSource(audio_source);
   
   // In calibration mode, overrides the DAC outputs with the raw calibration
@@ -167,6 +173,7 @@ void Init() {
   
   settings.Init();
   multi.Init(true);
+  dac_output_reader.Init(&multi.output_snapshot());
   ui.Init();
 
   // Load multi 0 on boot.